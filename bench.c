@@ -0,0 +1,1112 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include "raster.h"
+
+#include <math.h> /* cosf, sinf, fminf, fmaxf */
+#include <stdio.h>
+#include <stdlib.h> /* EXIT_SUCCESS, qsort, strtol */
+#include <string.h>
+#include <time.h>
+
+typedef int bool;
+#define false 0
+#define true !false
+
+/******************************************************************************
+ * Random Numbers
+ ******************************************************************************/
+
+/* A fixed generator, so every run benchmarks the same triangles. */
+struct random_series
+{
+        uint32_t State;
+};
+typedef struct random_series random_series;
+
+uint32_t
+RandomNext(random_series *Series)
+{
+        /* xorshift32 */
+        uint32_t X = Series->State;
+        X ^= X << 13;
+        X ^= X >> 17;
+        X ^= X << 5;
+        Series->State = X;
+        return(X);
+}
+
+/* Uniform in [0, 1). */
+float
+RandomUnilateral(random_series *Series)
+{
+        float Result = (float)(RandomNext(Series) >> 8) / (float)(1 << 24);
+        return(Result);
+}
+
+float
+RandomBetween(random_series *Series, float Min, float Max)
+{
+        float Result = Min + ((Max - Min) * RandomUnilateral(Series));
+        return(Result);
+}
+
+/******************************************************************************
+ * Scene Generators
+ ******************************************************************************/
+
+struct scene
+{
+        gs_raster_triangle *Triangles;
+        gs_raster_color *Colors;
+        int NumTriangles;
+};
+typedef struct scene scene;
+
+typedef void scene_generator(scene *Scene, random_series *Series, int Width, int Height);
+
+/* Triangle with the given center, size and orientation; Aspect below 1 gives slivers. */
+gs_raster_triangle
+TriangleAround(random_series *Series, float X, float Y, float Size, float Aspect)
+{
+        float Angle = RandomBetween(Series, 0.0f, 6.2831853f);
+        float Ux = cosf(Angle) * Size * 0.5f;
+        float Uy = sinf(Angle) * Size * 0.5f;
+        float Vx = -Uy * Aspect;
+        float Vy = Ux * Aspect;
+
+        gs_raster_triangle Result;
+        Result.X1 = X - Ux - Vx;
+        Result.Y1 = Y - Uy - Vy;
+        Result.X2 = X + Ux;
+        Result.Y2 = Y + Uy;
+        Result.X3 = X - Ux + Vx;
+        Result.Y3 = Y - Uy + Vy;
+        GsRasterReorderTriangle(&Result);
+        return(Result);
+}
+
+void
+SceneAllocate(scene *Scene, int NumTriangles)
+{
+        Scene->NumTriangles = NumTriangles;
+        Scene->Triangles = (gs_raster_triangle *)malloc(sizeof(gs_raster_triangle) * NumTriangles);
+        Scene->Colors = (gs_raster_color *)malloc(sizeof(gs_raster_color) * NumTriangles);
+}
+
+void
+SceneFree(scene *Scene)
+{
+        free(Scene->Triangles);
+        free(Scene->Colors);
+}
+
+/* About one 2-4 pixel triangle per 16 pixels of screen. */
+void
+GenerateTiny(scene *Scene, random_series *Series, int Width, int Height)
+{
+        SceneAllocate(Scene, (Width * Height) / 16);
+        for(int i=0; i<Scene->NumTriangles; i++)
+        {
+                float X = RandomBetween(Series, 0.0f, (float)Width);
+                float Y = RandomBetween(Series, 0.0f, (float)Height);
+                Scene->Triangles[i] = TriangleAround(Series, X, Y, RandomBetween(Series, 2.0f, 4.0f), 1.0f);
+                Scene->Colors[i] = RandomNext(Series);
+        }
+}
+
+/* A few triangles, each larger than the screen. */
+void
+GenerateHuge(scene *Scene, random_series *Series, int Width, int Height)
+{
+        SceneAllocate(Scene, 16);
+        float Size = 2.0f * (float)(Width > Height ? Width : Height);
+        for(int i=0; i<Scene->NumTriangles; i++)
+        {
+                float X = RandomBetween(Series, 0.0f, (float)Width);
+                float Y = RandomBetween(Series, 0.0f, (float)Height);
+                Scene->Triangles[i] = TriangleAround(Series, X, Y, Size, 1.0f);
+                Scene->Colors[i] = RandomNext(Series);
+        }
+}
+
+/*
+ * Wedges from a point on screen out to two corners far past the guard band,
+ * which the engines clip into fans of pieces.
+ */
+void
+GenerateGuard(scene *Scene, random_series *Series, int Width, int Height)
+{
+        SceneAllocate(Scene, 16);
+        float Far = 1e7f;
+        for(int i=0; i<Scene->NumTriangles; i++)
+        {
+                float Angle = RandomBetween(Series, 0.0f, 6.2831853f);
+                float Spread = RandomBetween(Series, 0.3f, 1.5f);
+
+                gs_raster_triangle *Triangle = &Scene->Triangles[i];
+                Triangle->X1 = RandomBetween(Series, 0.0f, (float)Width);
+                Triangle->Y1 = RandomBetween(Series, 0.0f, (float)Height);
+                Triangle->X2 = Triangle->X1 + (cosf(Angle) * Far);
+                Triangle->Y2 = Triangle->Y1 + (sinf(Angle) * Far);
+                Triangle->X3 = Triangle->X1 + (cosf(Angle + Spread) * Far);
+                Triangle->Y3 = Triangle->Y1 + (sinf(Angle + Spread) * Far);
+                GsRasterReorderTriangle(Triangle);
+                Scene->Colors[i] = RandomNext(Series);
+        }
+}
+
+/* Long triangles around a pixel wide. */
+void
+GenerateSlivers(scene *Scene, random_series *Series, int Width, int Height)
+{
+        SceneAllocate(Scene, 2000);
+        for(int i=0; i<Scene->NumTriangles; i++)
+        {
+                float X = RandomBetween(Series, 0.0f, (float)Width);
+                float Y = RandomBetween(Series, 0.0f, (float)Height);
+                float Length = RandomBetween(Series, 0.25f, 0.75f) * (float)Width;
+                Scene->Triangles[i] = TriangleAround(Series, X, Y, Length, RandomBetween(Series, 0.5f, 2.0f) / Length);
+                Scene->Colors[i] = RandomNext(Series);
+        }
+}
+
+/* Large triangles stacked over the middle of the screen, 50 or more deep. */
+void
+GenerateOverlap(scene *Scene, random_series *Series, int Width, int Height)
+{
+        SceneAllocate(Scene, 256);
+        float Size = 0.6f * (float)(Width < Height ? Width : Height);
+        for(int i=0; i<Scene->NumTriangles; i++)
+        {
+                float X = (0.5f * (float)Width) + RandomBetween(Series, -0.1f, 0.1f) * (float)Width;
+                float Y = (0.5f * (float)Height) + RandomBetween(Series, -0.1f, 0.1f) * (float)Height;
+                Scene->Triangles[i] = TriangleAround(Series, X, Y, Size, 1.0f);
+                Scene->Colors[i] = RandomNext(Series);
+        }
+}
+
+/* Small triangles in a handful of dense clusters, leaving most tiles empty. */
+void
+GenerateClustered(scene *Scene, random_series *Series, int Width, int Height)
+{
+        int NumClusters = 8;
+        SceneAllocate(Scene, (Width * Height) / 64);
+        float Spread = 0.04f * (float)(Width < Height ? Width : Height);
+
+        float CenterX[8];
+        float CenterY[8];
+        for(int Cluster=0; Cluster<NumClusters; Cluster++)
+        {
+                CenterX[Cluster] = RandomBetween(Series, 0.1f, 0.9f) * (float)Width;
+                CenterY[Cluster] = RandomBetween(Series, 0.1f, 0.9f) * (float)Height;
+        }
+
+        for(int i=0; i<Scene->NumTriangles; i++)
+        {
+                int Cluster = RandomNext(Series) % NumClusters;
+                /* Sum of uniforms; close enough to a normal distribution. */
+                float Dx = (RandomUnilateral(Series) + RandomUnilateral(Series) + RandomUnilateral(Series) - 1.5f) * 2.0f * Spread;
+                float Dy = (RandomUnilateral(Series) + RandomUnilateral(Series) + RandomUnilateral(Series) - 1.5f) * 2.0f * Spread;
+                Scene->Triangles[i] = TriangleAround(Series, CenterX[Cluster] + Dx, CenterY[Cluster] + Dy, RandomBetween(Series, 4.0f, 12.0f), 1.0f);
+                Scene->Colors[i] = RandomNext(Series);
+        }
+}
+
+/*
+ * A jittered grid of 8-pixel cells, two triangles to a cell, sharing every
+ * vertex with their neighbors as a mesh would.  Each patch of 8x8 cells
+ * has one color, so vertices inside it are shared whole.
+ */
+void
+GenerateMesh(scene *Scene, random_series *Series, int Width, int Height)
+{
+        int Columns = Width / 8;
+        int Rows = Height / 8;
+        SceneAllocate(Scene, Columns * Rows * 2);
+
+        gs_raster_point2d *Grid = (gs_raster_point2d *)malloc(sizeof(gs_raster_point2d) * (Columns + 1) * (Rows + 1));
+        for(int Row=0; Row<=Rows; Row++)
+        {
+                for(int Column=0; Column<=Columns; Column++)
+                {
+                        bool Inside = (Row > 0 && Row < Rows && Column > 0 && Column < Columns);
+                        gs_raster_point2d *Point = &Grid[(Row * (Columns + 1)) + Column];
+                        Point->X = ((float)Column * 8.0f) + (Inside ? RandomBetween(Series, -2.0f, 2.0f) : 0.0f);
+                        Point->Y = ((float)Row * 8.0f) + (Inside ? RandomBetween(Series, -2.0f, 2.0f) : 0.0f);
+                }
+        }
+
+        gs_raster_color PatchColors[64];
+        for(int i=0; i<64; i++)
+        {
+                PatchColors[i] = RandomNext(Series);
+        }
+
+        int i = 0;
+        for(int Row=0; Row<Rows; Row++)
+        {
+                for(int Column=0; Column<Columns; Column++)
+                {
+                        gs_raster_point2d *TopLeft = &Grid[(Row * (Columns + 1)) + Column];
+                        gs_raster_point2d *BottomLeft = TopLeft + (Columns + 1);
+                        gs_raster_color Color = PatchColors[(((Row / 8) * 7) + (Column / 8)) % 64];
+
+                        gs_raster_triangle Upper;
+                        Upper.Point[0] = TopLeft[0];
+                        Upper.Point[1] = TopLeft[1];
+                        Upper.Point[2] = BottomLeft[0];
+                        gs_raster_triangle Lower;
+                        Lower.Point[0] = TopLeft[1];
+                        Lower.Point[1] = BottomLeft[1];
+                        Lower.Point[2] = BottomLeft[0];
+                        GsRasterReorderTriangle(&Upper);
+                        GsRasterReorderTriangle(&Lower);
+                        Scene->Triangles[i] = Upper;
+                        Scene->Colors[i++] = Color;
+                        Scene->Triangles[i] = Lower;
+                        Scene->Colors[i++] = Color;
+                }
+        }
+        free(Grid);
+}
+
+struct scene_type
+{
+        char *Name;
+        scene_generator *Generate;
+};
+typedef struct scene_type scene_type;
+
+scene_type SceneTypes[] =
+{
+        { "tiny", GenerateTiny },
+        { "huge", GenerateHuge },
+        { "guard", GenerateGuard },
+        { "slivers", GenerateSlivers },
+        { "overlap", GenerateOverlap },
+        { "clustered", GenerateClustered },
+        { "mesh", GenerateMesh },
+};
+#define NUM_SCENE_TYPES (int)(sizeof(SceneTypes) / sizeof(SceneTypes[0]))
+
+struct resolution
+{
+        int Width;
+        int Height;
+};
+typedef struct resolution resolution;
+
+resolution Resolutions[] =
+{
+        { 320, 240 },
+        { 1280, 720 },
+        { 1920, 1080 },
+};
+#define NUM_RESOLUTIONS (int)(sizeof(Resolutions) / sizeof(Resolutions[0]))
+
+/******************************************************************************
+ * Timing
+ ******************************************************************************/
+
+double
+Seconds()
+{
+        struct timespec Now;
+        clock_gettime(CLOCK_MONOTONIC, &Now);
+        double Result = (double)Now.tv_sec + ((double)Now.tv_nsec * 1e-9);
+        return(Result);
+}
+
+int
+CompareDoubles(const void *Left, const void *Right)
+{
+        double A = *(const double *)Left;
+        double B = *(const double *)Right;
+        return((A > B) - (A < B));
+}
+
+/* Frame times of one stage, in seconds. */
+struct stage_timings
+{
+        char *Name;
+        double *Times;
+        int NumTimes;
+#ifdef GS_RASTER_STATS
+        gs_raster_stats Stats; /* Summed over the timed frames. */
+#endif
+};
+typedef struct stage_timings stage_timings;
+
+/* Counters only cover timed frames; warmup frames run detached. */
+#ifdef GS_RASTER_STATS
+#define StatsAttach(Stage, Timed) GsRasterSetStats((Timed) ? &(Stage)->Stats : NULL)
+#else
+#define StatsAttach(Stage, Timed)
+#endif
+
+/* Nearest-rank percentile of sorted times. */
+double
+Percentile(double *Sorted, int Count, int Percent)
+{
+        int Rank = (Count * Percent + 99) / 100;
+        if(Rank < 1) Rank = 1;
+        return(Sorted[Rank - 1]);
+}
+
+void
+ReportStage(stage_timings *Stage, int NumTriangles, int Width, int Height)
+{
+        qsort(Stage->Times, Stage->NumTimes, sizeof(double), CompareDoubles);
+        double P50 = Percentile(Stage->Times, Stage->NumTimes, 50);
+        double P99 = Percentile(Stage->Times, Stage->NumTimes, 99);
+
+        printf("  %-16s p50 %9.3f ms  p99 %9.3f ms  %9.2f Mtri/s  %9.1f Mpixel/s\n",
+               Stage->Name, P50 * 1e3, P99 * 1e3,
+               ((double)NumTriangles / P50) * 1e-6,
+               ((double)Width * (double)Height / P50) * 1e-6);
+
+#ifdef GS_RASTER_STATS
+        gs_raster_stats *Stats = &Stage->Stats;
+        uint64_t TotalCycles = 0;
+        for(int i=0; i<GS_RASTER_STAGE_COUNT; i++)
+        {
+                TotalCycles += Stats->Cycles[i];
+        }
+        if(TotalCycles == 0) TotalCycles = 1;
+
+        if(Stats->Rows > 0)
+        {
+                printf("  %-16s %.1f intersections/row, peak %d of %d, %llu dropped\n", "",
+                       (double)Stats->Intersections / (double)Stats->Rows,
+                       Stats->PeakIntersections, Stats->Capacity, (unsigned long long)Stats->Overflows);
+        }
+        if(Stats->StackPushes > 0)
+        {
+                printf("  %-16s %.0f stack pushes and %.0f pops per frame, peak depth %d\n", "",
+                       (double)Stats->StackPushes / Stage->NumTimes,
+                       (double)Stats->StackPops / Stage->NumTimes,
+                       Stats->PeakStackDepth);
+        }
+        if(Stats->PixelsDrawn > 0)
+        {
+                printf("  %-16s overdraw %.2f\n", "", (double)Stats->PixelsWritten / (double)Stats->PixelsDrawn);
+        }
+        if(Stats->PixelsAntialiased > 0)
+        {
+                printf("  %-16s %.0f antialiased pixels per frame\n", "", (double)Stats->PixelsAntialiased / Stage->NumTimes);
+        }
+        if(Stats->TrianglesCulled > 0 || Stats->TrianglesClipped > 0)
+        {
+                printf("  %-16s %.0f triangles culled and %.0f clipped per frame\n", "",
+                       (double)Stats->TrianglesCulled / Stage->NumTimes,
+                       (double)Stats->TrianglesClipped / Stage->NumTimes);
+        }
+        if(Stats->VerticesTransformed > 0)
+        {
+                printf("  %-16s %.0f vertices transformed per frame\n", "", (double)Stats->VerticesTransformed / Stage->NumTimes);
+        }
+        printf("  %-16s cycles: setup %.0f%%, bin %.0f%%, generate %.0f%%, rasterize %.0f%%\n", "",
+               (100.0 * Stats->Cycles[GS_RASTER_STAGE_SETUP]) / TotalCycles,
+               (100.0 * Stats->Cycles[GS_RASTER_STAGE_BIN]) / TotalCycles,
+               (100.0 * Stats->Cycles[GS_RASTER_STAGE_GENERATE]) / TotalCycles,
+               (100.0 * Stats->Cycles[GS_RASTER_STAGE_RASTERIZE]) / TotalCycles);
+#endif
+}
+
+/******************************************************************************
+ * Benchmarks
+ ******************************************************************************/
+
+struct options
+{
+        char *SceneName; /* NULL for every scene. */
+        int Width; /* 0 for every resolution. */
+        int Height;
+        int NumFrames;
+        int NumWarmup;
+        int NumThreads;
+        gs_raster_blend Blend; /* For the GsRasterDraw stages. */
+        gs_raster_antialias Antialias;
+        gs_raster_framebuffer Framebuffer;
+        gs_raster_format Format;
+        bool Texture; /* GsRasterDrawTextured in place of GsRasterDraw. */
+        bool Vertices; /* GsRasterDrawVertices in place of either. */
+        bool Indexed; /* GsRasterDrawIndexed in place of GsRasterDrawVertices. */
+        bool Verify; /* Compare outputs in place of timing. */
+};
+typedef struct options options;
+
+/*
+ * A 256x256 texture of random texels, and texture coordinates laid over the
+ * screen as if it were a plane receding towards the top, a texel per pixel
+ * at the bottom and four per pixel at the top.
+ */
+gs_raster_texture *
+BenchTexture(random_series *Series)
+{
+        int Size = 256;
+        gs_raster_color *Texels = (gs_raster_color *)malloc(sizeof(gs_raster_color) * Size * Size);
+        for(int i=0; i<Size*Size; i++)
+        {
+                Texels[i] = RandomNext(Series) | 0xFF;
+        }
+        gs_raster_texture *Result = GsRasterTextureCreate(Texels, Size, Size);
+        free(Texels);
+        return(Result);
+}
+
+gs_raster_texcoords *
+BenchTexcoords(scene *Scene, int Height)
+{
+        gs_raster_texcoords *Result = (gs_raster_texcoords *)malloc(sizeof(gs_raster_texcoords) * Scene->NumTriangles);
+        for(int i=0; i<Scene->NumTriangles; i++)
+        {
+                for(int Vertex=0; Vertex<3; Vertex++)
+                {
+                        gs_raster_point2d *Point = &Scene->Triangles[i].Point[Vertex];
+                        float W = 4.0f - (3.0f * Point->Y / (float)Height);
+                        Result[i].U[Vertex] = Point->X * W / 256.0f;
+                        Result[i].V[Vertex] = Point->Y * W / 256.0f;
+                        Result[i].W[Vertex] = W;
+                }
+        }
+        return(Result);
+}
+
+/*
+ * The scene's triangles as vertices for GsRasterDrawVertices, in pixels
+ * with Z = 0, under the matrix that maps pixels onto clip space.  With
+ * texture coordinates, each vertex is scaled by their W, so the divide
+ * brings it back to the same pixel.
+ */
+gs_raster_vertices
+BenchVertices(scene *Scene, gs_raster_texcoords *Texcoords)
+{
+        int NumVertices = Scene->NumTriangles * 3;
+        gs_raster_vertices Result = {0};
+        Result.X = (float *)malloc(sizeof(float) * NumVertices);
+        Result.Y = (float *)malloc(sizeof(float) * NumVertices);
+        Result.Z = (float *)calloc(NumVertices, sizeof(float));
+        Result.Colors = (gs_raster_color *)malloc(sizeof(gs_raster_color) * NumVertices);
+        if(Texcoords != NULL)
+        {
+                Result.W = (float *)malloc(sizeof(float) * NumVertices);
+                Result.U = (float *)malloc(sizeof(float) * NumVertices);
+                Result.V = (float *)malloc(sizeof(float) * NumVertices);
+        }
+
+        for(int i=0; i<Scene->NumTriangles; i++)
+        {
+                for(int Vertex=0; Vertex<3; Vertex++)
+                {
+                        int Index = (i * 3) + Vertex;
+                        float W = (Texcoords != NULL) ? Texcoords[i].W[Vertex] : 1.0f;
+                        Result.X[Index] = Scene->Triangles[i].Point[Vertex].X * W;
+                        Result.Y[Index] = Scene->Triangles[i].Point[Vertex].Y * W;
+                        Result.Colors[Index] = Scene->Colors[i];
+                        if(Texcoords != NULL)
+                        {
+                                Result.W[Index] = W;
+                                Result.U[Index] = Texcoords[i].U[Vertex];
+                                Result.V[Index] = Texcoords[i].V[Vertex];
+                        }
+                }
+        }
+        return(Result);
+}
+
+/* Maps pixels onto clip space, for vertices laid out as BenchVertices lays them out. */
+gs_raster_matrix
+BenchTransform(int Width, int Height)
+{
+        gs_raster_matrix Result =
+        {{
+                { 2.0f / (float)Width, 0.0f, 0.0f, -1.0f },
+                { 0.0f, -2.0f / (float)Height, 0.0f, 1.0f },
+                { 0.0f, 0.0f, 1.0f, 0.0f },
+                { 0.0f, 0.0f, 0.0f, 1.0f },
+        }};
+        return(Result);
+}
+
+void
+BenchVerticesFree(gs_raster_vertices *Vertices)
+{
+        free(Vertices->X);
+        free(Vertices->Y);
+        free(Vertices->Z);
+        free(Vertices->W);
+        free(Vertices->Colors);
+        free(Vertices->U);
+        free(Vertices->V);
+}
+
+bool
+SameVertex(gs_raster_vertices *Vertices, int A, int B)
+{
+        bool Result = (Vertices->X[A] == Vertices->X[B] && Vertices->Y[A] == Vertices->Y[B] &&
+                       Vertices->Z[A] == Vertices->Z[B] && Vertices->Colors[A] == Vertices->Colors[B]);
+        if(Result && Vertices->W != NULL)
+        {
+                Result = (Vertices->W[A] == Vertices->W[B] && Vertices->U[A] == Vertices->U[B] && Vertices->V[A] == Vertices->V[B]);
+        }
+        return(Result);
+}
+
+/*
+ * Welds vertices laid out as BenchVertices lays them out, in place, keeping
+ * one of each distinct vertex, and returns the triangles as indices into
+ * them, reordered by GsRasterOptimizeIndices.
+ */
+uint32_t *
+BenchIndices(gs_raster_vertices *Vertices, int NumTriangles, int *NumVertices)
+{
+        int NumCorners = NumTriangles * 3;
+        uint32_t *Result = (uint32_t *)malloc(sizeof(uint32_t) * (NumCorners > 0 ? NumCorners : 1));
+
+        int NumSlots = 1;
+        while(NumSlots < NumCorners * 2) NumSlots *= 2;
+        int *Slots = (int *)malloc(sizeof(int) * NumSlots); /* Welded vertex in each slot, or -1. */
+        for(int i=0; i<NumSlots; i++)
+        {
+                Slots[i] = -1;
+        }
+
+        int Count = 0;
+        for(int Corner=0; Corner<NumCorners; Corner++)
+        {
+                uint32_t Bits[3];
+                memcpy(&Bits[0], &Vertices->X[Corner], sizeof(uint32_t));
+                memcpy(&Bits[1], &Vertices->Y[Corner], sizeof(uint32_t));
+                Bits[2] = Vertices->Colors[Corner];
+                uint32_t Hash = (Bits[0] * 2654435761u) ^ (Bits[1] * 2246822519u) ^ (Bits[2] * 3266489917u);
+
+                int Slot = (int)(Hash & (uint32_t)(NumSlots - 1));
+                while(Slots[Slot] >= 0 && !SameVertex(Vertices, Slots[Slot], Corner))
+                {
+                        Slot = (Slot + 1) & (NumSlots - 1);
+                }
+                if(Slots[Slot] < 0)
+                {
+                        /* Earlier than the corner, so moving it down overwrites nothing still needed. */
+                        Vertices->X[Count] = Vertices->X[Corner];
+                        Vertices->Y[Count] = Vertices->Y[Corner];
+                        Vertices->Z[Count] = Vertices->Z[Corner];
+                        Vertices->Colors[Count] = Vertices->Colors[Corner];
+                        if(Vertices->W != NULL)
+                        {
+                                Vertices->W[Count] = Vertices->W[Corner];
+                                Vertices->U[Count] = Vertices->U[Corner];
+                                Vertices->V[Count] = Vertices->V[Corner];
+                        }
+                        Slots[Slot] = Count++;
+                }
+                Result[Corner] = (uint32_t)Slots[Slot];
+        }
+        free(Slots);
+
+        GsRasterOptimizeIndices(GS_RASTER_INDEX_32, Result, NumTriangles, Count);
+        *NumVertices = Count;
+        return(Result);
+}
+
+/*
+ * The immediate pipeline split into its two stages, GsRasterGenerateScanlines
+ * and GsRasterRasterize, then each engine's whole GsRasterDraw.
+ */
+void
+BenchScene(options *Options, scene_type *Type, int Width, int Height)
+{
+        random_series Series = { 0x2545F491 };
+        scene Scene;
+        Type->Generate(&Scene, &Series, Width, Height);
+
+        int Capacity = GsRasterCapacityRequired(Scene.Triangles, Scene.NumTriangles, Height);
+        int *Pixels = (int *)malloc(sizeof(int) * Width * Height);
+        int NumRuns = Options->NumWarmup + Options->NumFrames;
+
+        stage_timings Stages[4] =
+        {
+                { "generate", NULL, 0 },
+                { "rasterize", NULL, 0 },
+                { "draw scanline", NULL, 0 },
+                { "draw halfspace", NULL, 0 },
+        };
+        for(int i=0; i<4; i++)
+        {
+                Stages[i].Times = (double *)malloc(sizeof(double) * Options->NumFrames);
+        }
+
+        gs_raster_scanline *Scanlines;
+        GsRasterInitScanlines(&Scanlines, Height, Capacity, NULL);
+        for(int Run=0; Run<NumRuns; Run++)
+        {
+                bool Timed = (Run >= Options->NumWarmup);
+                StatsAttach(&Stages[0], Timed);
+                double Start = Seconds();
+                if(!GsRasterGenerateScanlines(Scene.Triangles, Scene.NumTriangles, Scanlines, Height))
+                {
+                        fprintf(stderr, "Couldn't allocate scanline scratch memory\n");
+                        exit(EXIT_FAILURE);
+                }
+                double Generated = Seconds();
+                StatsAttach(&Stages[1], Timed);
+                GsRasterRasterize(Pixels, Width, Height, Scanlines, Scene.Triangles, Scene.Colors, Scene.NumTriangles);
+                double Rasterized = Seconds();
+
+                if(Timed)
+                {
+                        Stages[0].Times[Stages[0].NumTimes++] = Generated - Start;
+                        Stages[1].Times[Stages[1].NumTimes++] = Rasterized - Generated;
+                }
+        }
+        free(Scanlines);
+
+        gs_raster_texture *Texture = NULL;
+        gs_raster_texcoords *Texcoords = NULL;
+        if(Options->Texture)
+        {
+                Texture = BenchTexture(&Series);
+                Texcoords = BenchTexcoords(&Scene, Height);
+        }
+
+        gs_raster_vertices Vertices = {0};
+        gs_raster_matrix Transform = BenchTransform(Width, Height);
+        uint32_t *Indices = NULL;
+        int NumVertices = Scene.NumTriangles * 3;
+        if(Options->Vertices)
+        {
+                Vertices = BenchVertices(&Scene, Texcoords);
+        }
+        if(Options->Indexed)
+        {
+                Indices = BenchIndices(&Vertices, Scene.NumTriangles, &NumVertices);
+        }
+
+        for(int Engine=0; Engine<2; Engine++)
+        {
+                stage_timings *Stage = &Stages[2 + Engine];
+
+                gs_raster_config Config = {0};
+                Config.Engine = (Engine == 0) ? GS_RASTER_ENGINE_SCANLINE : GS_RASTER_ENGINE_HALFSPACE;
+                Config.Width = Width;
+                Config.Height = Height;
+                Config.Capacity = Capacity;
+                Config.MaxTriangles = Scene.NumTriangles;
+                Config.NumThreads = Options->NumThreads;
+                Config.Blend = Options->Blend;
+                Config.Antialias = Options->Antialias;
+                Config.Framebuffer = Options->Framebuffer;
+                Config.Format = Options->Format;
+
+                gs_raster_context Context;
+                if(!GsRasterInit(&Context, &Config))
+                {
+                        fprintf(stderr, "Couldn't allocate a context for %dx%d\n", Width, Height);
+                        exit(EXIT_FAILURE);
+                }
+                for(int Run=0; Run<NumRuns; Run++)
+                {
+                        StatsAttach(Stage, Run >= Options->NumWarmup);
+                        double Start = Seconds();
+                        if(Indices != NULL)
+                        {
+                                GsRasterDrawIndexed(&Context, Pixels, &Transform, &Vertices, Texture, GS_RASTER_INDEX_32, Indices, Scene.NumTriangles);
+                        }
+                        else if(Options->Vertices)
+                        {
+                                GsRasterDrawVertices(&Context, Pixels, &Transform, &Vertices, Texture, Scene.NumTriangles);
+                        }
+                        else if(Texture != NULL)
+                        {
+                                GsRasterDrawTextured(&Context, Pixels, Scene.Triangles, Texcoords, Texture, NULL, Scene.NumTriangles);
+                        }
+                        else
+                        {
+                                GsRasterDraw(&Context, Pixels, Scene.Triangles, Scene.Colors, NULL, Scene.NumTriangles);
+                        }
+                        double End = Seconds();
+
+                        if(Run >= Options->NumWarmup)
+                        {
+                                Stage->Times[Stage->NumTimes++] = End - Start;
+                        }
+                }
+                GsRasterFree(&Context);
+        }
+        StatsAttach(&Stages[0], false);
+        GsRasterTextureFree(Texture);
+        free(Texcoords);
+        BenchVerticesFree(&Vertices);
+        free(Indices);
+
+        printf("%s %dx%d: %d triangles, capacity %d", Type->Name, Width, Height, Scene.NumTriangles, Capacity);
+        if(Options->Indexed)
+        {
+                printf(", %d vertices", NumVertices);
+        }
+        printf("\n");
+        for(int i=0; i<4; i++)
+        {
+                ReportStage(&Stages[i], Scene.NumTriangles, Width, Height);
+                free(Stages[i].Times);
+        }
+        fflush(stdout);
+
+        free(Pixels);
+        SceneFree(&Scene);
+}
+
+/******************************************************************************
+ * Verification
+ ******************************************************************************/
+
+enum verify_draw
+{
+        VERIFY_DRAW_COLORS, /* GsRasterDraw */
+        VERIFY_DRAW_SHADED, /* GsRasterDrawShaded */
+        VERIFY_DRAW_TEXTURED, /* GsRasterDrawTextured */
+        VERIFY_DRAW_VERTICES, /* GsRasterDrawVertices, Gouraud shaded */
+        NUM_VERIFY_DRAWS,
+};
+typedef enum verify_draw verify_draw;
+
+/* One way of drawing a scene, whose pixels must not depend on threads or SIMD level. */
+struct verify_mode
+{
+        gs_raster_engine Engine;
+        gs_raster_blend Blend;
+        gs_raster_antialias Antialias;
+        gs_raster_framebuffer Framebuffer;
+        gs_raster_depth_format DepthFormat;
+        verify_draw Draw;
+};
+typedef struct verify_mode verify_mode;
+
+/* A scene along with everything the modes draw it with. */
+struct verify_scene
+{
+        scene Scene;
+        int Width;
+        int Height;
+        int Capacity;
+        gs_raster_material *Materials; /* Random vertex colors, with the scene's alphas. */
+        gs_raster_depth *Depths;
+        gs_raster_texture *Texture;
+        gs_raster_texcoords *Texcoords;
+        gs_raster_vertices Vertices; /* With the same vertex colors, and the depths in Z reaching past the near plane. */
+        gs_raster_matrix Transform;
+};
+typedef struct verify_scene verify_scene;
+
+char *
+SimdName(gs_raster_simd Simd)
+{
+        char *Result = (Simd == GS_RASTER_SIMD_AVX2) ? "avx2" : (Simd == GS_RASTER_SIMD_SSE2) ? "sse2" : "scalar";
+        return(Result);
+}
+
+void
+VerifyModeName(verify_mode *Mode, char *Buffer, size_t Size)
+{
+        char *Draws[NUM_VERIFY_DRAWS] = { "colors", "shaded", "textured", "vertices" };
+        snprintf(Buffer, Size, "%s%s%s%s%s %s",
+                 (Mode->Engine == GS_RASTER_ENGINE_SCANLINE) ? "scanline" : "halfspace",
+                 (Mode->Blend != GS_RASTER_BLEND_NONE) ? " blend" : "",
+                 (Mode->Antialias != GS_RASTER_ANTIALIAS_NONE) ? " antialias" : "",
+                 (Mode->Framebuffer != GS_RASTER_FRAMEBUFFER_NONE) ? " tiled" : "",
+                 (Mode->DepthFormat != GS_RASTER_DEPTH_NONE) ? " depth" : "",
+                 Draws[Mode->Draw]);
+}
+
+/* Draws the scene once into Pixels, cleared first, with a context of its own. */
+void
+VerifyRender(options *Options, verify_scene *Verify, verify_mode *Mode, int NumThreads, gs_raster_simd Simd, int Capacity, int *Pixels)
+{
+        GsRasterSelectSimd(Simd);
+
+        gs_raster_config Config = {0};
+        Config.Engine = Mode->Engine;
+        Config.Width = Verify->Width;
+        Config.Height = Verify->Height;
+        Config.Capacity = Capacity;
+        Config.MaxTriangles = Verify->Scene.NumTriangles;
+        Config.NumThreads = NumThreads;
+        Config.DepthFormat = Mode->DepthFormat;
+        Config.Blend = Mode->Blend;
+        Config.Antialias = Mode->Antialias;
+        Config.Framebuffer = Mode->Framebuffer;
+        Config.Format = Options->Format;
+
+        gs_raster_context Context;
+        if(!GsRasterInit(&Context, &Config))
+        {
+                fprintf(stderr, "Couldn't allocate a context for %dx%d\n", Verify->Width, Verify->Height);
+                exit(EXIT_FAILURE);
+        }
+
+        memset(Pixels, 0, sizeof(int) * Verify->Width * Verify->Height);
+        scene *Scene = &Verify->Scene;
+        gs_raster_depth *Depths = (Mode->DepthFormat != GS_RASTER_DEPTH_NONE) ? Verify->Depths : NULL;
+        switch(Mode->Draw)
+        {
+                case VERIFY_DRAW_COLORS:
+                {
+                        GsRasterDraw(&Context, Pixels, Scene->Triangles, Scene->Colors, Depths, Scene->NumTriangles);
+                } break;
+                case VERIFY_DRAW_SHADED:
+                {
+                        GsRasterDrawShaded(&Context, Pixels, Scene->Triangles, Verify->Materials, Depths, Scene->NumTriangles);
+                } break;
+                case VERIFY_DRAW_TEXTURED:
+                {
+                        GsRasterDrawTextured(&Context, Pixels, Scene->Triangles, Verify->Texcoords, Verify->Texture, Depths, Scene->NumTriangles);
+                } break;
+                case VERIFY_DRAW_VERTICES:
+                {
+                        GsRasterDrawVertices(&Context, Pixels, &Verify->Transform, &Verify->Vertices, NULL, Scene->NumTriangles);
+                } break;
+                case NUM_VERIFY_DRAWS: break;
+        }
+        GsRasterFree(&Context);
+}
+
+/*
+ * Draws the scene in every mode with one thread and scalar kernels, then
+ * again with NumThreads threads and with the widest kernels the CPU has, and
+ * once more with room for far more intersections than the scene's capacity,
+ * which the scanline engine must not need.  Reports every mode whose pixels
+ * differ, and returns the number of those.
+ */
+int
+VerifyScene(options *Options, scene_type *Type, int Width, int Height, int NumThreads)
+{
+        random_series Series = { 0x2545F491 };
+        verify_scene Verify;
+        Type->Generate(&Verify.Scene, &Series, Width, Height);
+        scene *Scene = &Verify.Scene;
+        Verify.Width = Width;
+        Verify.Height = Height;
+        Verify.Capacity = GsRasterCapacityRequired(Scene->Triangles, Scene->NumTriangles, Height);
+        Verify.Texture = BenchTexture(&Series);
+        Verify.Texcoords = BenchTexcoords(Scene, Height);
+        Verify.Vertices = BenchVertices(Scene, NULL);
+        Verify.Transform = BenchTransform(Width, Height);
+        int NumAllocated = (Scene->NumTriangles > 0) ? Scene->NumTriangles : 1;
+        Verify.Materials = (gs_raster_material *)malloc(sizeof(gs_raster_material) * NumAllocated);
+        Verify.Depths = (gs_raster_depth *)malloc(sizeof(gs_raster_depth) * NumAllocated);
+        for(int i=0; i<Scene->NumTriangles; i++)
+        {
+                for(int Vertex=0; Vertex<3; Vertex++)
+                {
+                        int Index = (i * 3) + Vertex;
+                        gs_raster_color Color = (RandomNext(&Series) & 0xFFFFFF00) | (Scene->Colors[i] & 0xFF);
+                        Verify.Materials[i].VertexColors[Vertex] = Color;
+                        Verify.Vertices.Colors[Index] = Color;
+
+                        float Z = RandomUnilateral(&Series);
+                        Verify.Depths[i].Z[Vertex] = Z;
+                        Verify.Vertices.Z[Index] = (2.25f * Z) - 1.25f;
+                }
+        }
+
+        gs_raster_simd Widest = GsRasterSelectSimd(GS_RASTER_SIMD_AVX2);
+        struct { int NumThreads; gs_raster_simd Simd; int Capacity; } Runs[] =
+        {
+                { NumThreads, GS_RASTER_SIMD_SCALAR, Verify.Capacity },
+                { 1, Widest, Verify.Capacity },
+                { NumThreads, Widest, Verify.Capacity },
+                { NumThreads, Widest, 16 * Verify.Capacity },
+        };
+        size_t FrameSize = sizeof(int) * Width * Height;
+        int BytesPerPixel = (Options->Format == GS_RASTER_FORMAT_RGBA8888) ? 4 : (Options->Format == GS_RASTER_FORMAT_RGB565) ? 2 : 1;
+        int *Expected = (int *)malloc(FrameSize);
+        int *Pixels = (int *)malloc(FrameSize);
+
+        /* The low bits of the mode index pick engine, blend, antialias or tiled, and depth; the rest pick the draw. */
+        int NumModes = 16 * NUM_VERIFY_DRAWS;
+        int NumDiffering = 0;
+        for(int ModeIndex=0; ModeIndex<NumModes; ModeIndex++)
+        {
+                bool Halfspace = (ModeIndex & 1);
+                bool Variant = (ModeIndex & 4);
+
+                /* Antialiasing only applies to the scanline engine, the tiled framebuffer only to the half-space one. */
+                verify_mode Mode;
+                Mode.Engine = Halfspace ? GS_RASTER_ENGINE_HALFSPACE : GS_RASTER_ENGINE_SCANLINE;
+                Mode.Blend = (ModeIndex & 2) ? GS_RASTER_BLEND_ALPHA : GS_RASTER_BLEND_NONE;
+                Mode.Antialias = (!Halfspace && Variant) ? GS_RASTER_ANTIALIAS_EDGES : GS_RASTER_ANTIALIAS_NONE;
+                Mode.Framebuffer = (Halfspace && Variant) ? GS_RASTER_FRAMEBUFFER_TILED : GS_RASTER_FRAMEBUFFER_NONE;
+                Mode.DepthFormat = (ModeIndex & 8) ? GS_RASTER_DEPTH_32 : GS_RASTER_DEPTH_NONE;
+                Mode.Draw = (verify_draw)(ModeIndex / 16);
+
+                VerifyRender(Options, &Verify, &Mode, 1, GS_RASTER_SIMD_SCALAR, Verify.Capacity, Expected);
+                for(int RunIndex=0; RunIndex<(int)(sizeof(Runs) / sizeof(Runs[0])); RunIndex++)
+                {
+                        VerifyRender(Options, &Verify, &Mode, Runs[RunIndex].NumThreads, Runs[RunIndex].Simd, Runs[RunIndex].Capacity, Pixels);
+                        if(memcmp(Expected, Pixels, FrameSize) == 0) continue;
+
+                        size_t Byte = 0;
+                        while(((char *)Expected)[Byte] == ((char *)Pixels)[Byte]) Byte++;
+                        int Pixel = (int)(Byte / BytesPerPixel);
+
+                        char Name[128];
+                        VerifyModeName(&Mode, Name, sizeof(Name));
+                        printf("  %s: %s with %d threads and capacity %d differs from scalar with 1 and %d, first at (%d, %d)\n",
+                               Name, SimdName(Runs[RunIndex].Simd), Runs[RunIndex].NumThreads, Runs[RunIndex].Capacity,
+                               Verify.Capacity, Pixel % Width, Pixel / Width);
+                        NumDiffering++;
+                        break;
+                }
+        }
+
+        printf("%s %dx%d: %d modes, 1 and %d threads, scalar and %s: %s\n", Type->Name, Width, Height, NumModes,
+               NumThreads, SimdName(Widest), (NumDiffering == 0) ? "identical" : "DIFFERENT");
+        fflush(stdout);
+
+        free(Pixels);
+        free(Expected);
+        free(Verify.Depths);
+        free(Verify.Materials);
+        BenchVerticesFree(&Verify.Vertices);
+        free(Verify.Texcoords);
+        GsRasterTextureFree(Verify.Texture);
+        SceneFree(Scene);
+        return(NumDiffering);
+}
+
+void
+Usage()
+{
+        printf("Usage: bench [--scene name] [--size WxH] [--frames n] [--warmup n] [--threads n] [--blend] [--antialias] [--tiled] [--format f] [--texture] [--vertices] [--indexed] [--verify]\n");
+        printf("  Renders synthetic scenes into memory and reports per-stage frame times.\n");
+        printf("  --scene:   one of tiny, huge, guard, slivers, overlap, clustered, mesh.  Default: all.\n");
+        printf("  --size:    resolution, e.g. 1280x720.  Default: 320x240, 1280x720 and 1920x1080.\n");
+        printf("  --frames:  timed frames per stage.  Default: 20.\n");
+        printf("  --warmup:  untimed frames before those.  Default: 3.\n");
+        printf("  --threads: threads for GsRasterDraw; 0 for one per CPU.  Default: 0.\n");
+        printf("  --blend:   alpha blend in GsRasterDraw; the scenes' colors have random alphas.\n");
+        printf("  --antialias: antialias edges in GsRasterDraw.\n");
+        printf("  --tiled:   draw halfspace into a tiled framebuffer and copy it out.\n");
+        printf("  --format:  rgba8888, rgb565 or index8, for GsRasterDraw's pixels.  Default: rgba8888.\n");
+        printf("  --texture: draw with GsRasterDrawTextured and a 256x256 texture in perspective.\n");
+        printf("  --vertices: draw with GsRasterDrawVertices, transforming each vertex from pixels.\n");
+        printf("  --indexed: draw with GsRasterDrawIndexed, after welding shared vertices and reordering.\n");
+        printf("  --verify:  instead of timing, check that every engine, blend, antialias, tiled, depth and draw\n");
+        printf("             combination draws the same pixels with 1 thread and scalar kernels as with --threads\n");
+        printf("             threads (7 unless more than 1) and the widest kernels.  Fails on any difference.\n");
+        printf("             Default size: 320x240.\n");
+        printf("  Specify '-h' or '--help' for this help text.\n");
+        exit(EXIT_SUCCESS);
+}
+
+int
+main(int ArgCount, char **Args)
+{
+        options Options = { NULL, 0, 0, 20, 3, 0, GS_RASTER_BLEND_NONE, GS_RASTER_ANTIALIAS_NONE, GS_RASTER_FRAMEBUFFER_NONE, GS_RASTER_FORMAT_RGBA8888, false, false, false, false };
+
+        for(int i=1; i<ArgCount; i++)
+        {
+                bool HasValue = (i + 1 < ArgCount);
+                if(strcmp(Args[i], "--scene") == 0 && HasValue)
+                {
+                        Options.SceneName = Args[++i];
+                }
+                else if(strcmp(Args[i], "--size") == 0 && HasValue)
+                {
+                        if(sscanf(Args[++i], "%dx%d", &Options.Width, &Options.Height) != 2 ||
+                           Options.Width <= 0 || Options.Height <= 0)
+                        {
+                                Usage();
+                        }
+                }
+                else if(strcmp(Args[i], "--frames") == 0 && HasValue)
+                {
+                        Options.NumFrames = (int)strtol(Args[++i], NULL, 10);
+                        if(Options.NumFrames <= 0) Usage();
+                }
+                else if(strcmp(Args[i], "--warmup") == 0 && HasValue)
+                {
+                        Options.NumWarmup = (int)strtol(Args[++i], NULL, 10);
+                        if(Options.NumWarmup < 0) Usage();
+                }
+                else if(strcmp(Args[i], "--threads") == 0 && HasValue)
+                {
+                        Options.NumThreads = (int)strtol(Args[++i], NULL, 10);
+                }
+                else if(strcmp(Args[i], "--blend") == 0)
+                {
+                        Options.Blend = GS_RASTER_BLEND_ALPHA;
+                }
+                else if(strcmp(Args[i], "--antialias") == 0)
+                {
+                        Options.Antialias = GS_RASTER_ANTIALIAS_EDGES;
+                }
+                else if(strcmp(Args[i], "--tiled") == 0)
+                {
+                        Options.Framebuffer = GS_RASTER_FRAMEBUFFER_TILED;
+                }
+                else if(strcmp(Args[i], "--format") == 0 && HasValue)
+                {
+                        char *Format = Args[++i];
+                        if(strcmp(Format, "rgba8888") == 0) Options.Format = GS_RASTER_FORMAT_RGBA8888;
+                        else if(strcmp(Format, "rgb565") == 0) Options.Format = GS_RASTER_FORMAT_RGB565;
+                        else if(strcmp(Format, "index8") == 0) Options.Format = GS_RASTER_FORMAT_INDEX8;
+                        else Usage();
+                }
+                else if(strcmp(Args[i], "--texture") == 0)
+                {
+                        Options.Texture = true;
+                }
+                else if(strcmp(Args[i], "--vertices") == 0)
+                {
+                        Options.Vertices = true;
+                }
+                else if(strcmp(Args[i], "--indexed") == 0)
+                {
+                        Options.Vertices = true;
+                        Options.Indexed = true;
+                }
+                else if(strcmp(Args[i], "--verify") == 0)
+                {
+                        Options.Verify = true;
+                }
+                else
+                {
+                        Usage();
+                }
+        }
+
+        bool Found = false;
+        int NumDiffering = 0;
+        for(int TypeIndex=0; TypeIndex<NUM_SCENE_TYPES; TypeIndex++)
+        {
+                scene_type *Type = &SceneTypes[TypeIndex];
+                if(Options.SceneName != NULL && strcmp(Options.SceneName, Type->Name) != 0) continue;
+                Found = true;
+
+                if(Options.Verify)
+                {
+                        int NumThreads = (Options.NumThreads > 1) ? Options.NumThreads : 7;
+                        int Width = (Options.Width > 0) ? Options.Width : Resolutions[0].Width;
+                        int Height = (Options.Width > 0) ? Options.Height : Resolutions[0].Height;
+                        NumDiffering += VerifyScene(&Options, Type, Width, Height, NumThreads);
+                        continue;
+                }
+
+                if(Options.Width > 0)
+                {
+                        BenchScene(&Options, Type, Options.Width, Options.Height);
+                        continue;
+                }
+
+                for(int ResolutionIndex=0; ResolutionIndex<NUM_RESOLUTIONS; ResolutionIndex++)
+                {
+                        resolution *Resolution = &Resolutions[ResolutionIndex];
+                        BenchScene(&Options, Type, Resolution->Width, Resolution->Height);
+                }
+        }
+        if(!Found) Usage();
+
+        return((NumDiffering == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
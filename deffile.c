@@ -0,0 +1,441 @@
+#define _POSIX_C_SOURCE 200809L /* fileno, fstat, mprotect */
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+
+#include "deffile.h"
+
+#include <stdlib.h> /* malloc, free */
+#include <string.h> /* memchr, memmove, memset */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h> /* sysconf */
+
+typedef int bool;
+#define false 0
+#define true !false
+
+/* "0,0 0,0 0,0 0\n" is the shortest line that holds a triangle. */
+#define GS_DEFFILE_MIN_LINE 14
+
+/*
+ * Triangles' worth of memory committed ahead of each chunk; more than one
+ * chunk's lines can hold, so lines never need to check.
+ */
+#define GS_DEFFILE_COMMIT_TRIANGLES (64 * 1024)
+#if GS_DEFFILE_COMMIT_TRIANGLES < ((GS_DEFFILE_CHUNK_SIZE + GS_DEFFILE_MAX_LINE) / GS_DEFFILE_MIN_LINE) + 1
+#error "GS_DEFFILE_COMMIT_TRIANGLES must cover a whole chunk"
+#endif
+
+/******************************************************************************
+ * Arrays
+ ******************************************************************************/
+
+size_t
+PageAlign(size_t Size)
+{
+        size_t Page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t Result = (Size + Page - 1) / Page * Page;
+        return(Result);
+}
+
+/* Reserves address space only; nothing is usable until committed. */
+bool
+ArrayReserve(gs_deffile_array *Array, size_t Size)
+{
+        Array->Base = NULL;
+        Array->Committed = 0;
+        Array->Reserved = PageAlign((Size > 0) ? Size : 1);
+
+        void *Memory = mmap(NULL, Array->Reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(Memory == MAP_FAILED)
+        {
+                Array->Reserved = 0;
+                return(false);
+        }
+
+        Array->Base = (char *)Memory;
+        return(true);
+}
+
+/* Makes the first Size bytes usable, keeping what is already there. */
+bool
+ArrayCommit(gs_deffile_array *Array, size_t Size)
+{
+        if(Size <= Array->Committed) return(true);
+
+        size_t Committed = PageAlign(Size);
+        if(Committed > Array->Reserved) Committed = Array->Reserved;
+        if(mprotect(Array->Base + Array->Committed, Committed - Array->Committed, PROT_READ | PROT_WRITE) != 0)
+        {
+                return(false);
+        }
+
+        Array->Committed = Committed;
+        return(true);
+}
+
+void
+ArrayRelease(gs_deffile_array *Array)
+{
+        if(Array->Base != NULL)
+        {
+                munmap(Array->Base, Array->Reserved);
+        }
+        memset(Array, 0, sizeof(*Array));
+}
+
+/******************************************************************************
+ * Numbers
+ ******************************************************************************/
+
+bool
+IsDigit(char C)
+{
+        bool Result = (C >= '0' && C <= '9');
+        return(Result);
+}
+
+int
+HexDigitValue(char C)
+{
+        if(C >= '0' && C <= '9') return(C - '0');
+        if(C >= 'a' && C <= 'f') return(C - 'a' + 10);
+        if(C >= 'A' && C <= 'F') return(C - 'A' + 10);
+        return(-1);
+}
+
+double
+PowerOfTen(int Exponent)
+{
+        /* Exact in a double up to 10^22. */
+        static double Exact[] =
+        {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+        };
+
+        double Result = 1.0;
+        for(; Exponent > 22; Exponent -= 22)
+        {
+                Result *= 1e22;
+        }
+        Result *= Exact[Exponent];
+        return(Result);
+}
+
+/*
+ * Parses [+-]digits[.digits][(e|E)[+-]digits] at At, with at least one
+ * digit in the mantissa, always with '.' as the decimal point.  Returns the
+ * first character after the number, or NULL if there is none.
+ */
+char *
+ParseFloat(char *At, float *Value)
+{
+        bool Negative = (*At == '-');
+        if(*At == '-' || *At == '+') At++;
+
+        /* Digits past the 19th cannot change a float. */
+        uint64_t Mantissa = 0;
+        int NumSignificant = 0;
+        int Exponent = 0;
+        int NumDigits = 0;
+        for(; IsDigit(*At); At++, NumDigits++)
+        {
+                if(NumSignificant < 19)
+                {
+                        Mantissa = (Mantissa * 10) + (uint64_t)(*At - '0');
+                        if(Mantissa > 0) NumSignificant++;
+                }
+                else
+                {
+                        Exponent++;
+                }
+        }
+        if(*At == '.')
+        {
+                for(At++; IsDigit(*At); At++, NumDigits++)
+                {
+                        if(NumSignificant < 19)
+                        {
+                                Mantissa = (Mantissa * 10) + (uint64_t)(*At - '0');
+                                if(Mantissa > 0) NumSignificant++;
+                                Exponent--;
+                        }
+                }
+        }
+        if(NumDigits == 0) return(NULL);
+
+        if((*At == 'e' || *At == 'E') &&
+           (IsDigit(At[1]) || ((At[1] == '-' || At[1] == '+') && IsDigit(At[2]))))
+        {
+                At++;
+                bool NegativeExponent = (*At == '-');
+                if(*At == '-' || *At == '+') At++;
+
+                int Written = 0;
+                for(; IsDigit(*At); At++)
+                {
+                        if(Written < 1000) Written = (Written * 10) + (*At - '0');
+                }
+                Exponent += NegativeExponent ? -Written : Written;
+        }
+
+        double Result = (double)Mantissa;
+        if(Mantissa != 0)
+        {
+                if(Exponent > 400) Exponent = 400;
+                if(Exponent < -400) Exponent = -400;
+                Result = (Exponent < 0) ? (Result / PowerOfTen(-Exponent)) : (Result * PowerOfTen(Exponent));
+        }
+        *Value = (float)(Negative ? -Result : Result);
+        return(At);
+}
+
+/* Parses up to eight hex digits, optionally preceded by 0x, as sscanf's %x would. */
+char *
+ParseHex(char *At, uint32_t *Value)
+{
+        if(At[0] == '0' && (At[1] == 'x' || At[1] == 'X') && HexDigitValue(At[2]) >= 0)
+        {
+                At += 2;
+        }
+
+        uint32_t Result = 0;
+        int NumDigits = 0;
+        for(int Digit = HexDigitValue(*At); Digit >= 0; Digit = HexDigitValue(*++At))
+        {
+                if(++NumDigits > 8) return(NULL);
+                Result = (Result << 4) | (uint32_t)Digit;
+        }
+        if(NumDigits == 0) return(NULL);
+
+        *Value = Result;
+        return(At);
+}
+
+/******************************************************************************
+ * Lines
+ ******************************************************************************/
+
+char *
+SkipBlanks(char *At)
+{
+        while(*At == ' ' || *At == '\t') At++;
+        return(At);
+}
+
+bool
+IsEndOfLine(char C)
+{
+        bool Result = (C == '\n' || C == '\r' || C == '\0');
+        return(Result);
+}
+
+/* x,y or x,y,z; Z is left alone without one. */
+char *
+ParsePoint(char *At, gs_raster_point2d *Point, float *Z, bool *HasZ)
+{
+        At = ParseFloat(At, &Point->X);
+        if(At == NULL || *At != ',') return(NULL);
+        At = ParseFloat(At + 1, &Point->Y);
+        if(At == NULL) return(NULL);
+
+        *HasZ = (*At == ',');
+        if(*HasZ)
+        {
+                At = ParseFloat(At + 1, Z);
+        }
+        return(At);
+}
+
+bool
+ParserFail(gs_deffile_parser *Parser, char *Error, int Line)
+{
+        Parser->Error = Error;
+        Parser->ErrorLine = Line;
+        return(false);
+}
+
+/* Appends the triangle on the line at At, which ends at '\n' or '\0'; blank lines add nothing. */
+bool
+ParseLine(gs_deffile_parser *Parser, char *At)
+{
+        At = SkipBlanks(At);
+        if(IsEndOfLine(*At)) return(true);
+
+        int Index = Parser->NumTriangles;
+        if(Index >= Parser->MaxTriangles)
+        {
+                return(ParserFail(Parser, "too many triangles", Parser->Line));
+        }
+
+        gs_raster_triangle *Triangle = &Parser->Triangles[Index];
+        gs_raster_material *Material = &Parser->Materials[Index];
+        gs_raster_depth *Depth = &Parser->Depths[Index];
+        Depth->Z[0] = Depth->Z[1] = Depth->Z[2] = 0.0f;
+
+        for(int Vertex = 0; Vertex < 3; Vertex++)
+        {
+                bool HasZ;
+                At = ParsePoint(At, &Triangle->Point[Vertex], &Depth->Z[Vertex], &HasZ);
+                if(At == NULL || (*At != ' ' && *At != '\t'))
+                {
+                        return(ParserFail(Parser, "expected three points x,y or x,y,z", Parser->Line));
+                }
+                if(HasZ) Parser->HasDepth = true;
+                At = SkipBlanks(At);
+        }
+
+        int NumColors = 0;
+        while(NumColors < 3 && !IsEndOfLine(*At))
+        {
+                At = ParseHex(At, &Material->VertexColors[NumColors]);
+                if(At == NULL)
+                {
+                        return(ParserFail(Parser, "expected a hexadecimal color", Parser->Line));
+                }
+                NumColors++;
+                At = SkipBlanks(At);
+        }
+        if(NumColors == 0)
+        {
+                return(ParserFail(Parser, "expected a hexadecimal color", Parser->Line));
+        }
+        if(*At == '\r') At++;
+        if(*At != '\n' && *At != '\0')
+        {
+                return(ParserFail(Parser, "unexpected text after the colors", Parser->Line));
+        }
+
+        if(NumColors < 3)
+        {
+                Material->VertexColors[1] = Material->VertexColors[0];
+                Material->VertexColors[2] = Material->VertexColors[0];
+        }
+
+        Parser->NumTriangles++;
+        return(true);
+}
+
+/******************************************************************************
+ * Parser
+ ******************************************************************************/
+
+int
+GsDefFileOpen(gs_deffile_parser *Parser, char *FileName)
+{
+        memset(Parser, 0, sizeof(*Parser));
+
+        Parser->File = fopen(FileName, "rb");
+        if(Parser->File == NULL)
+        {
+                return(ParserFail(Parser, "couldn't open definitions file", 0));
+        }
+
+        /* A regular file's size bounds its line count; anything else gets the default. */
+        Parser->MaxTriangles = GS_DEFFILE_MAX_TRIANGLES;
+        struct stat Status;
+        if(fstat(fileno(Parser->File), &Status) == 0 && S_ISREG(Status.st_mode))
+        {
+                uint64_t Bound = ((uint64_t)Status.st_size / GS_DEFFILE_MIN_LINE) + 1;
+                Parser->MaxTriangles = (Bound < INT32_MAX) ? (int)Bound : INT32_MAX;
+        }
+
+        size_t MaxTriangles = (size_t)Parser->MaxTriangles;
+        Parser->Chunk = (char *)malloc(GS_DEFFILE_CHUNK_SIZE + GS_DEFFILE_MAX_LINE + 1);
+        if(Parser->Chunk == NULL ||
+           !ArrayReserve(&Parser->TriangleArray, sizeof(gs_raster_triangle) * MaxTriangles) ||
+           !ArrayReserve(&Parser->MaterialArray, sizeof(gs_raster_material) * MaxTriangles) ||
+           !ArrayReserve(&Parser->DepthArray, sizeof(gs_raster_depth) * MaxTriangles))
+        {
+                GsDefFileClose(Parser);
+                return(ParserFail(Parser, "couldn't reserve memory for the triangles", 0));
+        }
+
+        Parser->Triangles = (gs_raster_triangle *)Parser->TriangleArray.Base;
+        Parser->Materials = (gs_raster_material *)Parser->MaterialArray.Base;
+        Parser->Depths = (gs_raster_depth *)Parser->DepthArray.Base;
+        return(true);
+}
+
+/* Commits room for every triangle the next chunk could add. */
+bool
+ParserCommitChunk(gs_deffile_parser *Parser)
+{
+        size_t Count = (size_t)Parser->NumTriangles + GS_DEFFILE_COMMIT_TRIANGLES;
+        bool Result = (ArrayCommit(&Parser->TriangleArray, sizeof(gs_raster_triangle) * Count) &&
+                       ArrayCommit(&Parser->MaterialArray, sizeof(gs_raster_material) * Count) &&
+                       ArrayCommit(&Parser->DepthArray, sizeof(gs_raster_depth) * Count));
+        return(Result);
+}
+
+int
+GsDefFileParseChunk(gs_deffile_parser *Parser)
+{
+        if(Parser->Error != NULL || Parser->Finished) return(false);
+
+        size_t Read = fread(Parser->Chunk + Parser->Carried, 1, GS_DEFFILE_CHUNK_SIZE, Parser->File);
+        if(ferror(Parser->File))
+        {
+                return(ParserFail(Parser, "couldn't read definitions file", 0));
+        }
+        bool AtEnd = (Read < GS_DEFFILE_CHUNK_SIZE);
+        if(AtEnd && Read == 0 && Parser->Carried == 0)
+        {
+                Parser->Finished = true;
+                return(false);
+        }
+
+        /* The terminator ends a last line without a newline. */
+        char *At = Parser->Chunk;
+        char *End = Parser->Chunk + Parser->Carried + Read;
+        *End = '\0';
+
+        if(!ParserCommitChunk(Parser))
+        {
+                return(ParserFail(Parser, "out of memory", 0));
+        }
+
+        for(;;)
+        {
+                char *Newline = (char *)memchr(At, '\n', End - At);
+                if(Newline == NULL)
+                {
+                        if(!AtEnd || At == End) break;
+                        Newline = End;
+                }
+
+                Parser->Line++;
+                if(!ParseLine(Parser, At)) return(false);
+                At = (Newline < End) ? (Newline + 1) : End;
+        }
+
+        Parser->Carried = End - At;
+        if(Parser->Carried > GS_DEFFILE_MAX_LINE)
+        {
+                return(ParserFail(Parser, "line is too long", Parser->Line + 1));
+        }
+        memmove(Parser->Chunk, At, Parser->Carried);
+
+        Parser->Finished = AtEnd;
+        return(true);
+}
+
+void
+GsDefFileClose(gs_deffile_parser *Parser)
+{
+        if(Parser->File != NULL)
+        {
+                fclose(Parser->File);
+        }
+        free(Parser->Chunk);
+        ArrayRelease(&Parser->TriangleArray);
+        ArrayRelease(&Parser->MaterialArray);
+        ArrayRelease(&Parser->DepthArray);
+
+        Parser->File = NULL;
+        Parser->Chunk = NULL;
+        Parser->Triangles = NULL;
+        Parser->Materials = NULL;
+        Parser->Depths = NULL;
+        Parser->NumTriangles = 0;
+}
@@ -0,0 +1,112 @@
+#if !defined(GS_DEFFILE)
+#define GS_DEFFILE
+
+#include "raster.h"
+
+#include <stdio.h> /* FILE */
+
+/*
+ * A streaming reader for .def triangle definitions files; see
+ * triangles.def.example.  Each line is
+ *
+ *         x,y x,y x,y color [color color]
+ *
+ * where points may also be written x,y,z to give a depth, and colors are
+ * hexadecimal with an optional 0x.  Blank lines are skipped.
+ *
+ * The file is read GS_DEFFILE_CHUNK_SIZE bytes at a time and parsed by hand,
+ * without sscanf or the C locale, into arrays that grow in place: their
+ * address space is reserved up front and committed as they fill, so they
+ * never move, and triangles already parsed stay put while later chunks are
+ * read.  Callers can therefore set up each chunk's triangles as soon as
+ * GsDefFileParseChunk returns it.
+ *
+ * Triangles are stored as written; call GsRasterReorderTriangle on them,
+ * rotating their materials and depths to match, before rasterizing.
+ */
+
+#define GS_DEFFILE_CHUNK_SIZE (64 * 1024)
+#define GS_DEFFILE_MAX_LINE 1024
+#define GS_DEFFILE_MAX_TRIANGLES (1 << 24)
+
+/* Address space reserved for one of the parser's arrays; see GsDefFileOpen. */
+struct gs_deffile_array
+{
+        char *Base;
+        size_t Reserved;
+        size_t Committed;
+};
+typedef struct gs_deffile_array gs_deffile_array;
+
+/*
+ * NumTriangles, Triangles, Materials and Depths grow with every chunk.
+ * Depths holds z = 0 for points written without one; HasDepth is set once
+ * any point in the file has one.
+ * Error is NULL until parsing fails; ErrorLine is then the 1-based line at
+ * fault, or 0 for errors not tied to one.
+ */
+struct gs_deffile_parser
+{
+        int NumTriangles;
+        gs_raster_triangle *Triangles;
+        gs_raster_material *Materials;
+        gs_raster_depth *Depths;
+        int HasDepth;
+
+        char *Error;
+        int ErrorLine;
+
+        FILE *File;
+        char *Chunk; /* GS_DEFFILE_CHUNK_SIZE + GS_DEFFILE_MAX_LINE bytes, plus a terminator. */
+        size_t Carried; /* Bytes of an unfinished line kept from the previous chunk. */
+        int Line;
+        int MaxTriangles;
+        int Finished;
+        gs_deffile_array TriangleArray;
+        gs_deffile_array MaterialArray;
+        gs_deffile_array DepthArray;
+};
+typedef struct gs_deffile_parser gs_deffile_parser;
+
+/*
+ * Opens FileName for parsing.  For regular files, room is reserved for as
+ * many triangles as the file could possibly hold; for pipes and the like,
+ * for GS_DEFFILE_MAX_TRIANGLES.  Returns 0, with Parser->Error set, if the
+ * file cannot be opened or the memory cannot be reserved.
+ */
+int
+GsDefFileOpen(
+        gs_deffile_parser *Parser,
+        char *FileName);
+
+/*
+ * Reads and parses the next chunk, appending its complete lines' triangles.
+ * Returns nonzero when a chunk was parsed, and 0 once the whole file has
+ * been, or on error; check Parser->Error to tell which.
+ *
+ * Example usage:
+ *         gs_deffile_parser Parser;
+ *         if(!GsDefFileOpen(&Parser, "triangles.def")) Fail(Parser.Error);
+ *
+ *         int NumReady = 0;
+ *         while(GsDefFileParseChunk(&Parser))
+ *         {
+ *                 for(; NumReady < Parser.NumTriangles; NumReady++)
+ *                 {
+ *                         GsRasterReorderTriangle(&Parser.Triangles[NumReady]);
+ *                 }
+ *         }
+ *         if(Parser.Error != NULL) Fail(Parser.Error);
+ */
+int
+GsDefFileParseChunk(
+        gs_deffile_parser *Parser);
+
+/*
+ * Closes the file and releases the parser's arrays.
+ */
+void
+GsDefFileClose(
+        gs_deffile_parser *Parser);
+
+#endif /* GS_DEFFILE */
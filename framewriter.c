@@ -0,0 +1,221 @@
+#include "framewriter.h"
+
+#include <stdint.h> /* uint32_t */
+#include <stdio.h>
+#include <stdlib.h> /* malloc, free */
+#include <string.h> /* memset */
+
+typedef int bool;
+#define false 0
+#define true !false
+
+/******************************************************************************
+ * Conversion
+ ******************************************************************************/
+
+/* Unpacks RGBA8888 pixels into bytes, dropping alpha for PPM. */
+size_t
+FrameConvert(gs_framewriter *Writer, int *Pixels)
+{
+        size_t NumPixels = (size_t)Writer->Width * Writer->Height;
+        unsigned char *Out = Writer->Bytes;
+
+        if(Writer->Format == GS_FRAMEWRITER_PPM)
+        {
+                for(size_t i=0; i<NumPixels; i++)
+                {
+                        uint32_t Pixel = (uint32_t)Pixels[i];
+                        *Out++ = (unsigned char)(Pixel >> 24);
+                        *Out++ = (unsigned char)(Pixel >> 16);
+                        *Out++ = (unsigned char)(Pixel >> 8);
+                }
+        }
+        else
+        {
+                for(size_t i=0; i<NumPixels; i++)
+                {
+                        uint32_t Pixel = (uint32_t)Pixels[i];
+                        *Out++ = (unsigned char)(Pixel >> 24);
+                        *Out++ = (unsigned char)(Pixel >> 16);
+                        *Out++ = (unsigned char)(Pixel >> 8);
+                        *Out++ = (unsigned char)Pixel;
+                }
+        }
+
+        size_t Result = Out - Writer->Bytes;
+        return(Result);
+}
+
+/* Returns NULL on success, or what went wrong. */
+char *
+FrameWrite(gs_framewriter *Writer, gs_framewriter_buffer *Buffer)
+{
+        size_t Size = FrameConvert(Writer, Buffer->Pixels);
+
+        FILE *File = fopen(Buffer->FileName, "wb");
+        if(!File) return("couldn't open frame file");
+
+        bool Written = true;
+        if(Writer->Format == GS_FRAMEWRITER_PPM)
+        {
+                Written = (fprintf(File, "P6\n%d %d\n255\n", Writer->Width, Writer->Height) > 0);
+        }
+        Written = Written && (fwrite(Writer->Bytes, 1, Size, File) == Size);
+        if(fclose(File) != 0) Written = false;
+
+        return(Written ? NULL : "couldn't write frame file");
+}
+
+/******************************************************************************
+ * Writer Thread
+ ******************************************************************************/
+
+/*
+ * Writes buffers in the order they were queued until the writer closes with
+ * nothing left queued.  After a failure, buffers are still handed back, just
+ * not written, so the renderer never waits on a writer that has given up.
+ */
+void *
+FrameWriterThread(void *Parameter)
+{
+        gs_framewriter *Writer = (gs_framewriter *)Parameter;
+
+        pthread_mutex_lock(&Writer->Mutex);
+        for(;;)
+        {
+                gs_framewriter_buffer *Buffer = &Writer->Buffers[Writer->NextWrite];
+                while(!Buffer->Queued && !Writer->Closing)
+                {
+                        pthread_cond_wait(&Writer->Queued, &Writer->Mutex);
+                }
+                if(!Buffer->Queued) break;
+                bool Failed = (Writer->Error != NULL);
+                pthread_mutex_unlock(&Writer->Mutex);
+
+                /* The renderer leaves a queued buffer alone, so it is read without the lock. */
+                char *Error = Failed ? NULL : FrameWrite(Writer, Buffer);
+
+                pthread_mutex_lock(&Writer->Mutex);
+                if(Error != NULL)
+                {
+                        Writer->Error = Error;
+                        Writer->ErrorFrame = Buffer->Frame;
+                }
+                else if(!Failed)
+                {
+                        Writer->NumWritten++;
+                }
+                Buffer->Queued = false;
+                Writer->NextWrite = (Writer->NextWrite + 1) % Writer->NumBuffers;
+                pthread_cond_signal(&Writer->Written);
+        }
+        pthread_mutex_unlock(&Writer->Mutex);
+
+        return(NULL);
+}
+
+/******************************************************************************
+ * Writer
+ ******************************************************************************/
+
+void
+FrameWriterFreeBuffers(gs_framewriter *Writer)
+{
+        for(int i=0; i<GS_FRAMEWRITER_MAX_BUFFERS; i++)
+        {
+                free(Writer->Buffers[i].Pixels);
+                Writer->Buffers[i].Pixels = NULL;
+        }
+        free(Writer->Bytes);
+        Writer->Bytes = NULL;
+}
+
+int
+GsFrameWriterOpen(gs_framewriter *Writer, int Width, int Height, gs_framewriter_format Format, int NumBuffers)
+{
+        memset(Writer, 0, sizeof(*Writer));
+        Writer->Width = Width;
+        Writer->Height = Height;
+        Writer->Format = Format;
+
+        if(NumBuffers < 2) NumBuffers = 2;
+        if(NumBuffers > GS_FRAMEWRITER_MAX_BUFFERS) NumBuffers = GS_FRAMEWRITER_MAX_BUFFERS;
+        Writer->NumBuffers = NumBuffers;
+
+        size_t NumPixels = (size_t)Width * Height;
+        bool Allocated = true;
+        for(int i=0; i<NumBuffers; i++)
+        {
+                Writer->Buffers[i].Pixels = (int *)malloc(sizeof(int) * NumPixels);
+                Allocated = Allocated && (Writer->Buffers[i].Pixels != NULL);
+        }
+        Writer->Bytes = (unsigned char *)malloc(4 * NumPixels);
+        Allocated = Allocated && (Writer->Bytes != NULL);
+        if(!Allocated)
+        {
+                FrameWriterFreeBuffers(Writer);
+                Writer->Error = "couldn't allocate frame buffers";
+                return(false);
+        }
+
+        pthread_mutex_init(&Writer->Mutex, NULL);
+        pthread_cond_init(&Writer->Queued, NULL);
+        pthread_cond_init(&Writer->Written, NULL);
+        if(pthread_create(&Writer->Thread, NULL, FrameWriterThread, Writer) != 0)
+        {
+                pthread_cond_destroy(&Writer->Written);
+                pthread_cond_destroy(&Writer->Queued);
+                pthread_mutex_destroy(&Writer->Mutex);
+                FrameWriterFreeBuffers(Writer);
+                Writer->Error = "couldn't start frame writer thread";
+                return(false);
+        }
+
+        return(true);
+}
+
+int *
+GsFrameWriterAcquire(gs_framewriter *Writer)
+{
+        pthread_mutex_lock(&Writer->Mutex);
+        gs_framewriter_buffer *Buffer = &Writer->Buffers[Writer->NextAcquire];
+        while(Buffer->Queued && Writer->Error == NULL)
+        {
+                pthread_cond_wait(&Writer->Written, &Writer->Mutex);
+        }
+        int *Result = (Writer->Error == NULL) ? Buffer->Pixels : NULL;
+        pthread_mutex_unlock(&Writer->Mutex);
+
+        return(Result);
+}
+
+void
+GsFrameWriterSubmit(gs_framewriter *Writer, char *FileName)
+{
+        gs_framewriter_buffer *Buffer = &Writer->Buffers[Writer->NextAcquire];
+        snprintf(Buffer->FileName, sizeof(Buffer->FileName), "%s", FileName);
+
+        pthread_mutex_lock(&Writer->Mutex);
+        Buffer->Frame = Writer->NumSubmitted++;
+        Buffer->Queued = true;
+        Writer->NextAcquire = (Writer->NextAcquire + 1) % Writer->NumBuffers;
+        pthread_cond_signal(&Writer->Queued);
+        pthread_mutex_unlock(&Writer->Mutex);
+}
+
+int
+GsFrameWriterClose(gs_framewriter *Writer)
+{
+        pthread_mutex_lock(&Writer->Mutex);
+        Writer->Closing = true;
+        pthread_cond_signal(&Writer->Queued);
+        pthread_mutex_unlock(&Writer->Mutex);
+
+        pthread_join(Writer->Thread, NULL);
+        pthread_cond_destroy(&Writer->Written);
+        pthread_cond_destroy(&Writer->Queued);
+        pthread_mutex_destroy(&Writer->Mutex);
+        FrameWriterFreeBuffers(Writer);
+
+        return(Writer->Error == NULL);
+}
@@ -0,0 +1,117 @@
+#if !defined(GS_FRAMEWRITER)
+#define GS_FRAMEWRITER
+
+#include <pthread.h>
+
+/*
+ * Writes rendered frames to disk on a thread of its own, so the renderer can
+ * get on with the next frame while the last one is written out.
+ *
+ * Frames pass through a ring of pixel buffers owned by the writer: the
+ * renderer acquires the next buffer, draws into it and submits it with a file
+ * name, and the writer thread converts and writes it, then hands the buffer
+ * back.  The renderer only waits when every buffer is still queued, that is,
+ * when the disk cannot keep up.
+ *
+ * Pixels are laid out as the rasterizer writes them for SDL's
+ * SDL_PIXELFORMAT_RGBA8888: one int per pixel, red in the top byte.
+ */
+
+#define GS_FRAMEWRITER_MAX_BUFFERS 8
+#define GS_FRAMEWRITER_MAX_PATH 1024
+
+enum gs_framewriter_format
+{
+        GS_FRAMEWRITER_PPM, /* Binary PPM (P6): 8-bit RGB with a small text header. */
+        GS_FRAMEWRITER_RGBA, /* Raw 8-bit R, G, B, A bytes, no header. */
+};
+typedef enum gs_framewriter_format gs_framewriter_format;
+
+struct gs_framewriter_buffer
+{
+        int *Pixels;
+        char FileName[GS_FRAMEWRITER_MAX_PATH];
+        int Queued;
+        int Frame;
+};
+typedef struct gs_framewriter_buffer gs_framewriter_buffer;
+
+/*
+ * NumWritten counts frames written so far.  Error is NULL until a write
+ * fails; ErrorFrame is then the failing frame's number, counting submitted
+ * frames from 0.  The writer stops writing after the first failure.
+ */
+struct gs_framewriter
+{
+        int NumWritten;
+        char *Error;
+        int ErrorFrame;
+
+        int Width;
+        int Height;
+        gs_framewriter_format Format;
+        int NumBuffers;
+        gs_framewriter_buffer Buffers[GS_FRAMEWRITER_MAX_BUFFERS];
+        unsigned char *Bytes; /* A frame converted for writing; the writer thread's own. */
+        int NextAcquire;
+        int NextWrite;
+        int NumSubmitted;
+
+        pthread_t Thread;
+        pthread_mutex_t Mutex;
+        pthread_cond_t Queued; /* Signalled when a buffer is submitted or the writer is closing. */
+        pthread_cond_t Written; /* Signalled when the writer thread hands a buffer back. */
+        int Closing;
+};
+typedef struct gs_framewriter gs_framewriter;
+
+/*
+ * Allocates NumBuffers Width x Height buffers, clamped to
+ * [2, GS_FRAMEWRITER_MAX_BUFFERS], and starts the writer thread.  Returns 0,
+ * with Writer->Error set, if either fails.
+ */
+int
+GsFrameWriterOpen(
+        gs_framewriter *Writer,
+        int Width,
+        int Height,
+        gs_framewriter_format Format,
+        int NumBuffers);
+
+/*
+ * Returns the next buffer to draw into, waiting for the writer thread if
+ * every buffer is queued.  Returns NULL once a write has failed.
+ */
+int *
+GsFrameWriterAcquire(
+        gs_framewriter *Writer);
+
+/*
+ * Queues the buffer returned by the last GsFrameWriterAcquire to be written
+ * to FileName, and returns at once.
+ *
+ * Example usage:
+ *         for(int Frame=0; Frame<NumFrames; Frame++)
+ *         {
+ *                 int *Pixels = GsFrameWriterAcquire(&Writer);
+ *                 if(Pixels == NULL) break;
+ *
+ *                 GsRasterDraw(&Context, Pixels, Triangles, Colors, NULL, NumTriangles);
+ *                 GsFrameWriterSubmit(&Writer, FileNames[Frame]);
+ *         }
+ *         if(!GsFrameWriterClose(&Writer)) Fail(Writer.Error, Writer.ErrorFrame);
+ */
+void
+GsFrameWriterSubmit(
+        gs_framewriter *Writer,
+        char *FileName);
+
+/*
+ * Waits for every queued frame to be written, stops the writer thread and
+ * frees the buffers.  Returns 0 if any write failed.
+ */
+int
+GsFrameWriterClose(
+        gs_framewriter *Writer);
+
+#endif /* GS_FRAMEWRITER */
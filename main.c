@@ -1,9 +1,14 @@
 #include "SDL.h"
+#include "deffile.h"
+#include "framewriter.h"
 #include "raster.h"
+#include "scenefile.h"
 
-#include <alloca.h>
+#include <math.h> /* fminf, fmaxf */
 #include <stdio.h>
-#include <stdlib.h> /* EXIT_SUCCESS, EXIT_FAILURE */
+#include <stdlib.h> /* EXIT_SUCCESS, EXIT_FAILURE, strtol */
+#include <string.h> /* memcpy */
+#include <time.h> /* timespec_get */
 
 typedef int bool;
 #define false 0
@@ -36,162 +41,415 @@ StringLength(char *String)
 }
 
 /******************************************************************************
- * Streams
+ * Main section for client code to raster library.
  ******************************************************************************/
 
-struct buffer
+enum DISPLAY_SIZE
 {
-        char *Start;
-        char *Cursor;
-        size_t Capacity;
-        size_t Length;
+        DISPLAY_WIDTH = 1024,
+        DISPLAY_HEIGHT = 768,
 };
-typedef struct buffer buffer;
 
 void
-CopyBuffer(buffer *Source, buffer *Dest)
+AbortWithMessage(const char *msg)
 {
-        Dest->Start = Source->Start;
-        Dest->Cursor = Source->Cursor;
-        Dest->Length = Source->Length;
-        Dest->Capacity = Source->Capacity;
+        fprintf(stderr, "%s\n", msg);
+        exit(EXIT_FAILURE);
 }
 
-buffer *
-BufferSet(buffer *Buffer, char *Cursor, size_t Length, size_t Capacity)
+/*
+ * GsRasterReorderTriangle rotates the vertices; rotate the vertex colors and
+ * depths to match.
+ */
+void
+ReorderVertexAttributes(gs_raster_triangle *Original, gs_raster_triangle *Reordered, gs_raster_material *Material, gs_raster_depth *Depth)
 {
-        Buffer->Start = Cursor;
-        Buffer->Cursor = Cursor;
-        Buffer->Length = Length;
-        Buffer->Capacity = Capacity;
-        return(Buffer);
+        gs_raster_material Unordered = *Material;
+        gs_raster_depth UnorderedDepth = *Depth;
+        int Rotation = 0;
+        for(int i=0; i<3; i++)
+        {
+                if(Original->Point[i].X == Reordered->A.X && Original->Point[i].Y == Reordered->A.Y)
+                {
+                        Rotation = i;
+                        break;
+                }
+        }
+
+        for(int i=0; i<3; i++)
+        {
+                Material->VertexColors[i] = Unordered.VertexColors[(i + Rotation) % 3];
+                Depth->Z[i] = UnorderedDepth.Z[(i + Rotation) % 3];
+        }
 }
 
-bool
-CopyFileIntoBuffer(char *FileName, buffer *Mem)
+/*
+ * Parses a definitions file (see deffile.h), reordering each chunk's
+ * triangles for the rasterizer as soon as the chunk is parsed.  The arrays
+ * belong to Parser.  *Depths is set to NULL when no triangle has a depth.
+ */
+void
+CreateRasterDatastructuresFromFile(char *Filename, gs_deffile_parser *Parser, gs_raster_triangle **Triangles, gs_raster_material **Materials, gs_raster_depth **Depths, int *Count)
 {
-        FILE *File = fopen(FileName, "r");
-        if(File)
+        if(!GsDefFileOpen(Parser, Filename))
         {
-                fseek(File, 0, SEEK_END);
-                size_t FileSize = ftell(File);
-                if(FileSize + 1 > Mem->Capacity)
+                AbortWithMessage(Parser->Error);
+        }
+
+        int NumReady = 0;
+        while(GsDefFileParseChunk(Parser))
+        {
+                for(; NumReady < Parser->NumTriangles; NumReady++)
                 {
-                        return(false);
+                        gs_raster_triangle *Triangle = &Parser->Triangles[NumReady];
+                        gs_raster_triangle Original = *Triangle;
+                        GsRasterReorderTriangle(Triangle);
+                        ReorderVertexAttributes(&Original, Triangle, &Parser->Materials[NumReady], &Parser->Depths[NumReady]);
                 }
+        }
 
-                fseek(File, 0, SEEK_SET);
-                fread(Mem->Cursor, 1, FileSize, File);
-                Mem->Cursor[FileSize] = 0;
-                Mem->Length = FileSize;
-
-                fclose(File);
+        if(Parser->Error != NULL)
+        {
+                fprintf(stderr, "%s:%d: %s\n", Filename, Parser->ErrorLine, Parser->Error);
+                exit(EXIT_FAILURE);
         }
 
-        return(true);
+        *Triangles = Parser->Triangles;
+        *Materials = Parser->Materials;
+        *Depths = Parser->HasDepth ? Parser->Depths : NULL;
+        *Count = Parser->NumTriangles;
 }
 
-size_t  /* Returns size of file in bytes plus one for trailing '\0'. */
-FileSize(char *FileName)
+/*
+ * A scene file or a parsed definitions file, whichever the file turned out
+ * to be, ready for the rasterizer.
+ */
+struct loaded_scene
 {
-        FILE *File = fopen(FileName, "r");
-        if(File)
+        gs_scenefile SceneFile;
+        gs_deffile_parser DefFile;
+
+        gs_raster_triangle *Triangles;
+        gs_raster_material *Materials;
+        gs_raster_depth *Depths;
+        int NumTriangles;
+};
+typedef struct loaded_scene loaded_scene;
+
+void
+LoadScene(char *Filename, loaded_scene *Scene)
+{
+        *Scene = (loaded_scene){0};
+
+        /* Scene files are mapped and used in place; anything else is parsed as definitions. */
+        if(GsSceneFileDetect(Filename))
         {
-                fseek(File, 0, SEEK_END);
-                size_t FileSize = ftell(File);
-                fclose(File);
-                return(FileSize + 1); /* +1 for trailing null byte. */
+                char *Error;
+                if(!GsSceneFileOpen(Filename, &Scene->SceneFile, &Error))
+                {
+                        fprintf(stderr, "%s: %s\n", Filename, Error);
+                        exit(EXIT_FAILURE);
+                }
+                Scene->Triangles = Scene->SceneFile.Triangles;
+                Scene->Materials = Scene->SceneFile.Materials;
+                Scene->Depths = Scene->SceneFile.Depths;
+                Scene->NumTriangles = Scene->SceneFile.NumTriangles;
+        }
+        else
+        {
+                CreateRasterDatastructuresFromFile(Filename, &Scene->DefFile, &Scene->Triangles, &Scene->Materials, &Scene->Depths, &Scene->NumTriangles);
         }
+}
 
-        return(0);
+void
+UnloadScene(loaded_scene *Scene)
+{
+        GsSceneFileClose(&Scene->SceneFile);
+        GsDefFileClose(&Scene->DefFile);
 }
 
+/*
+ * The scanline capacity Scene needs on a display Height rows tall, from
+ * GsRasterCapacityRequired.  Unlike bench's scenes, ours move: two more leave
+ * room to move a triangle onto the busiest row.
+ */
+int
+SceneCapacity(loaded_scene *Scene, int Height)
+{
+        int Result = GsRasterCapacityRequired(Scene->Triangles, Scene->NumTriangles, Height);
+        if(Result == 0) AbortWithMessage("Couldn't count scanline intersections");
+        return(Result + 2);
+}
+
+/*
+ * Adds every triangle of Loaded to Scene, filling in their handles.  The
+ * capacity comes from SceneCapacity, so a triangle that does not fit means
+ * the scene is broken; give up rather than draw without it.
+ */
 void
-BufferNextLine(buffer *Buffer)
+SceneAddAll(gs_raster_scene *Scene, loaded_scene *Loaded, gs_raster_handle *Handles)
 {
-        while((Buffer->Cursor - Buffer->Start) < Buffer->Length)
+        if(Scene == NULL) AbortWithMessage("Couldn't allocate the scene");
+        for(int i=0; i<Loaded->NumTriangles; i++)
         {
-                if(*(Buffer->Cursor) == '\n')
+                gs_raster_depth *Depth = (Loaded->Depths != NULL) ? &Loaded->Depths[i] : NULL;
+                Handles[i] = GsRasterSceneAdd(Scene, &Loaded->Triangles[i], &Loaded->Materials[i], Depth);
+                if(Handles[i] == 0)
                 {
-                        ++Buffer->Cursor;
-                        break;
+                        fprintf(stderr, "Couldn't add triangle %d to the scene: a row it crosses is full\n", i);
+                        exit(EXIT_FAILURE);
                 }
-                ++Buffer->Cursor;
         }
 }
 
-bool
-IsEndOfBuffer(buffer *Buffer)
+void
+TranslateTriangle(gs_raster_triangle *Triangle, float Dx, float Dy)
 {
-        bool Result = (Buffer->Cursor - Buffer->Start) >= Buffer->Length;
-        return(Result);
+        for(int i=0; i<3; i++)
+        {
+                Triangle->Point[i].X += Dx;
+                Triangle->Point[i].Y += Dy;
+        }
 }
 
 /******************************************************************************
- * Main section for client code to raster library.
+ * Batch Rendering
  ******************************************************************************/
 
-enum DISPLAY_SIZE
+/*
+ * Frames are rendered headless and handed to a gs_framewriter, whose thread
+ * writes each one out while the next is rendered.
+ */
+struct batch_options
 {
-        DISPLAY_WIDTH = 1024,
-        DISPLAY_HEIGHT = 768,
+        gs_raster_engine Engine;
+        gs_raster_blend Blend;
+        gs_raster_antialias Antialias;
+        gs_raster_framebuffer Framebuffer;
+        char **Filenames;
+        int NumFilenames;
+        char *Output; /* Frame file names: a printf pattern with one %d for the frame number. */
+        gs_framewriter_format Format;
+        int NumFrames; /* 0 renders one frame per file; otherwise animates the only file. */
+        float Dx; /* Movement of the last triangle per animated frame. */
+        float Dy;
 };
+typedef struct batch_options batch_options;
+
+/* Whether Pattern has exactly one %d, optionally zero-padded as in %04d, and otherwise only %%. */
+bool
+IsFramePattern(char *Pattern)
+{
+        int NumConversions = 0;
+        for(char *P = Pattern; *P != '\0'; P++)
+        {
+                if(*P != '%') continue;
+                P++;
+                if(*P == '%') continue;
+
+                while(*P >= '0' && *P <= '9') P++;
+                if(*P != 'd') return(false);
+                NumConversions++;
+        }
+        return(NumConversions == 1);
+}
+
+double
+SecondsSince(struct timespec *Start)
+{
+        struct timespec Now;
+        timespec_get(&Now, TIME_UTC);
+        double Result = (double)(Now.tv_sec - Start->tv_sec) + ((double)(Now.tv_nsec - Start->tv_nsec) * 1e-9);
+        return(Result);
+}
 
+/*
+ * Sets the context up for Scene, reusing it when it already has room for the
+ * scene's triangles and intersections, and the right depth buffer.
+ */
 void
-AbortWithMessage(const char *msg)
+BatchPrepareContext(gs_raster_context *Context, gs_raster_config *Config, bool *Initialized, loaded_scene *Scene)
 {
-        fprintf(stderr, "%s\n", msg);
-        exit(EXIT_FAILURE);
+        gs_raster_depth_format DepthFormat = (Scene->Depths != NULL) ? GS_RASTER_DEPTH_32 : GS_RASTER_DEPTH_NONE;
+        int Capacity = SceneCapacity(Scene, Config->Height);
+        if(*Initialized && Scene->NumTriangles <= Config->MaxTriangles && Capacity <= Config->Capacity &&
+           DepthFormat == Config->DepthFormat)
+        {
+                return;
+        }
+
+        if(*Initialized) GsRasterFree(Context);
+        Config->Capacity = Capacity;
+        Config->MaxTriangles = Scene->NumTriangles;
+        Config->DepthFormat = DepthFormat;
+        if(!GsRasterInit(Context, Config)) AbortWithMessage("Couldn't allocate the raster context");
+        *Initialized = true;
 }
 
 void
-CreateRasterDatastructuresFromFile(char *Filename, gs_raster_triangle **Triangles, gs_raster_color **Colors, int *Count)
+BatchSubmit(batch_options *Options, gs_framewriter *Writer, int Frame)
 {
-        size_t AllocSize = FileSize(Filename);
-        buffer FileContents;
+        char FileName[GS_FRAMEWRITER_MAX_PATH];
+        snprintf(FileName, sizeof(FileName), Options->Output, Frame);
+        GsFrameWriterSubmit(Writer, FileName);
+}
 
-        /* Allocate space on the stack. */
-        BufferSet(&FileContents, (char *)alloca(AllocSize), 0, AllocSize);
-        if(!CopyFileIntoBuffer(Filename, &FileContents))
+/* One frame per file, each drawn from scratch. */
+void
+BatchRenderFiles(batch_options *Options, gs_framewriter *Writer, gs_raster_context *Context, gs_raster_config *Config, bool *Initialized)
+{
+        for(int Frame=0; Frame<Options->NumFilenames; Frame++)
         {
-                AbortWithMessage("Couldn't copy entire file to buffer");
+                /* Loading overlaps with the writer thread still busy on the previous frame. */
+                loaded_scene Scene;
+                LoadScene(Options->Filenames[Frame], &Scene);
+                BatchPrepareContext(Context, Config, Initialized, &Scene);
+
+                int *Pixels = GsFrameWriterAcquire(Writer);
+                if(Pixels != NULL)
+                {
+                        GsRasterDrawShaded(Context, Pixels, Scene.Triangles, Scene.Materials, Scene.Depths, Scene.NumTriangles);
+                        BatchSubmit(Options, Writer, Frame);
+                }
+                UnloadScene(&Scene);
+
+                if(Pixels == NULL) break;
         }
+}
+
+/*
+ * Options->NumFrames frames of the one file, moving its last triangle by
+ * (Dx, Dy) between frames as the arrow keys do interactively.  With the
+ * scanline engine the triangles are kept in a scene, so each frame redraws
+ * only the rows the move touched.
+ */
+void
+BatchRenderAnimation(batch_options *Options, gs_framewriter *Writer, gs_raster_context *Context, gs_raster_config *Config, bool *Initialized)
+{
+        loaded_scene Scene;
+        LoadScene(Options->Filenames[0], &Scene);
+        BatchPrepareContext(Context, Config, Initialized, &Scene);
+
+        int Selected = Scene.NumTriangles - 1;
+        size_t FrameSize = sizeof(int) * Config->Width * Config->Height;
 
-        /* Determine how many triangles we need to create. */
-        int NumTriangles = 0;
-        buffer Reader;
-        CopyBuffer(&FileContents, &Reader);
-        for(int i=0; i<FileContents.Length; i++)
+        gs_raster_scene *Retained = NULL;
+        gs_raster_handle *Handles = NULL;
+        int *Canvas = NULL;
+        if(Options->Engine == GS_RASTER_ENGINE_SCANLINE)
         {
-                if(*(Reader.Cursor) == '\n') NumTriangles++;
-                Reader.Cursor++;
+                Retained = GsRasterSceneCreate(Context, Scene.NumTriangles);
+                Handles = (gs_raster_handle *)malloc(sizeof(gs_raster_handle) * (Scene.NumTriangles > 0 ? Scene.NumTriangles : 1));
+                if(Handles == NULL) AbortWithMessage("Couldn't allocate the scene's handles");
+                SceneAddAll(Retained, &Scene, Handles);
+
+                /* The scene patches the previous frame, but the writer's buffers take turns; keep one of our own. */
+                Canvas = (int *)malloc(FrameSize);
+                if(Canvas == NULL) AbortWithMessage("Couldn't allocate the canvas");
         }
-        *Count = NumTriangles;
 
-        *Triangles = (gs_raster_triangle *)malloc(sizeof(gs_raster_triangle) * NumTriangles);
-        *Colors = (gs_raster_color *)malloc(sizeof(gs_raster_color) * NumTriangles);
+        for(int Frame=0; Frame<Options->NumFrames; Frame++)
+        {
+                if(Frame > 0 && Selected >= 0)
+                {
+                        TranslateTriangle(&Scene.Triangles[Selected], Options->Dx, Options->Dy);
+                        if(Retained != NULL)
+                        {
+                                gs_raster_depth *Depth = (Scene.Depths != NULL) ? &Scene.Depths[Selected] : NULL;
+                                GsRasterSceneUpdate(Retained, Handles[Selected], &Scene.Triangles[Selected], &Scene.Materials[Selected], Depth);
+                        }
+                }
 
-        for(int i=0; i<NumTriangles; i++)
+                int *Pixels = GsFrameWriterAcquire(Writer);
+                if(Pixels == NULL) break;
+
+                if(Retained != NULL)
+                {
+                        GsRasterSceneRasterize(Retained, Canvas);
+                        memcpy(Pixels, Canvas, FrameSize);
+                }
+                else
+                {
+                        GsRasterDrawShaded(Context, Pixels, Scene.Triangles, Scene.Materials, Scene.Depths, Scene.NumTriangles);
+                }
+                BatchSubmit(Options, Writer, Frame);
+        }
+
+        free(Canvas);
+        free(Handles);
+        UnloadScene(&Scene);
+}
+
+int
+RunBatch(batch_options *Options)
+{
+        gs_framewriter Writer;
+        if(!GsFrameWriterOpen(&Writer, DISPLAY_WIDTH, DISPLAY_HEIGHT, Options->Format, 3))
+        {
+                AbortWithMessage(Writer.Error);
+        }
+
+        gs_raster_config Config = {0};
+        Config.Engine = Options->Engine;
+        Config.Blend = Options->Blend;
+        Config.Antialias = Options->Antialias;
+        Config.Framebuffer = Options->Framebuffer;
+        Config.Width = DISPLAY_WIDTH;
+        Config.Height = DISPLAY_HEIGHT;
+        gs_raster_context Context;
+        bool Initialized = false;
+
+        struct timespec Start;
+        timespec_get(&Start, TIME_UTC);
+
+        if(Options->NumFrames > 0)
+        {
+                BatchRenderAnimation(Options, &Writer, &Context, &Config, &Initialized);
+        }
+        else
         {
-                gs_raster_triangle *Triangle = &(*Triangles)[i];
+                BatchRenderFiles(Options, &Writer, &Context, &Config, &Initialized);
+        }
 
-                sscanf(FileContents.Cursor, "%f,%f %f,%f %f,%f %x",
-                       &(Triangle->X1), &(Triangle->Y1),
-                       &(Triangle->X2), &(Triangle->Y2),
-                       &(Triangle->X3), &(Triangle->Y3),
-                       &(*Colors)[i]);
+        /* The context goes first: the writer may still be busy, and need not hold it up. */
+        if(Initialized) GsRasterFree(&Context);
 
-                GsRasterReorderTriangle(Triangle);
-                BufferNextLine(&FileContents);
+        if(!GsFrameWriterClose(&Writer))
+        {
+                char FileName[GS_FRAMEWRITER_MAX_PATH];
+                snprintf(FileName, sizeof(FileName), Options->Output, Writer.ErrorFrame);
+                fprintf(stderr, "%s: %s\n", FileName, Writer.Error);
+                return(EXIT_FAILURE);
         }
+
+        printf("%d frames in %.2f s\n", Writer.NumWritten, SecondsSince(&Start));
+        return(EXIT_SUCCESS);
 }
 
+/******************************************************************************
+ * Command Line
+ ******************************************************************************/
+
 void
 Usage()
 {
-        printf("Usage: program definitions_file\n");
+        printf("Usage: program [--halfspace] [--tiled] [--blend] [--antialias] definitions_file|scene_file\n");
+        printf("       program --convert definitions_file scene_file\n");
+        printf("       program --batch [--halfspace] [--tiled] [--blend] [--antialias] [--format ppm|rgba] [--output pattern] file...\n");
+        printf("       program --batch [--halfspace] [--tiled] [--blend] [--antialias] [--format ppm|rgba] [--output pattern] --frames n [--move dx,dy] file\n");
         printf("  definitions_file: file in current directory defining triangle coordinates.\n");
         printf("                    See: triangles.def.example\n");
+        printf("  scene_file:       binary scene written by --convert; loads without parsing.\n");
+        printf("  --halfspace:      rasterize with the half-space engine instead of scanlines.\n");
+        printf("  --tiled:          have the half-space engine draw into 64x64 blocks, then copy them out.\n");
+        printf("  --blend:          blend triangles by their alpha, the last byte of each color; ff is opaque.\n");
+        printf("  --antialias:      smooth triangle edges.  The half-space engine ignores this.\n");
+        printf("  --convert:        write definitions_file out as scene_file and exit.\n");
+        printf("  --batch:          render without a window, one frame per file, and write the frames out.\n");
+        printf("  --format:         frame files as binary PPM or raw RGBA bytes.  Default: ppm.\n");
+        printf("  --output:         frame file names, with one %%d for the frame number.  Default: frame%%04d.ppm\n");
+        printf("  --frames:         render n frames of the one file, moving its last triangle between frames.\n");
+        printf("  --move:           how far the last triangle moves per frame.  Default: 1,0.\n");
         printf("  Specify '-h' or '--help' for this help text.\n");
         exit(EXIT_SUCCESS);
 }
@@ -199,26 +457,130 @@ Usage()
 int
 main(int ArgCount, char **Args)
 {
-        for(int i=0; i<ArgCount; i++)
+        gs_raster_engine Engine = GS_RASTER_ENGINE_SCANLINE;
+        gs_raster_blend Blend = GS_RASTER_BLEND_NONE;
+        gs_raster_antialias Antialias = GS_RASTER_ANTIALIAS_NONE;
+        gs_raster_framebuffer Framebuffer = GS_RASTER_FRAMEBUFFER_NONE;
+        char *ConvertFilename = NULL;
+        bool Batch = false;
+        bool BatchOnly = false; /* Seen an option that needs --batch. */
+
+        batch_options Options = {0};
+        Options.Filenames = (char **)malloc(sizeof(char *) * ArgCount);
+        Options.Format = GS_FRAMEWRITER_PPM;
+        Options.Dx = 1.0f;
+
+        for(int i=1; i<ArgCount; i++)
         {
+                bool HasValue = (i + 1 < ArgCount);
                 if(StringEqual(Args[i], "-h", StringLength("-h")) ||
                    StringEqual(Args[i], "--help", StringLength("--help")))
                 {
                         Usage();
                 }
+                else if(StringEqual(Args[i], "--halfspace", StringLength("--halfspace")))
+                {
+                        Engine = GS_RASTER_ENGINE_HALFSPACE;
+                }
+                else if(StringEqual(Args[i], "--tiled", StringLength("--tiled")))
+                {
+                        Framebuffer = GS_RASTER_FRAMEBUFFER_TILED;
+                }
+                else if(StringEqual(Args[i], "--blend", StringLength("--blend")))
+                {
+                        Blend = GS_RASTER_BLEND_ALPHA;
+                }
+                else if(StringEqual(Args[i], "--antialias", StringLength("--antialias")))
+                {
+                        Antialias = GS_RASTER_ANTIALIAS_EDGES;
+                }
+                else if(StringEqual(Args[i], "--convert", StringLength("--convert")) && i + 2 < ArgCount)
+                {
+                        Options.Filenames[Options.NumFilenames++] = Args[++i];
+                        ConvertFilename = Args[++i];
+                }
+                else if(StringEqual(Args[i], "--batch", StringLength("--batch")))
+                {
+                        Batch = true;
+                }
+                else if(StringEqual(Args[i], "--format", StringLength("--format")) && HasValue)
+                {
+                        char *Format = Args[++i];
+                        if(StringEqual(Format, "ppm", StringLength("ppm"))) Options.Format = GS_FRAMEWRITER_PPM;
+                        else if(StringEqual(Format, "rgba", StringLength("rgba"))) Options.Format = GS_FRAMEWRITER_RGBA;
+                        else Usage();
+                        BatchOnly = true;
+                }
+                else if(StringEqual(Args[i], "--output", StringLength("--output")) && HasValue)
+                {
+                        Options.Output = Args[++i];
+                        if(!IsFramePattern(Options.Output)) Usage();
+                        BatchOnly = true;
+                }
+                else if(StringEqual(Args[i], "--frames", StringLength("--frames")) && HasValue)
+                {
+                        Options.NumFrames = (int)strtol(Args[++i], NULL, 10);
+                        if(Options.NumFrames <= 0) Usage();
+                        BatchOnly = true;
+                }
+                else if(StringEqual(Args[i], "--move", StringLength("--move")) && HasValue)
+                {
+                        if(sscanf(Args[++i], "%f,%f", &Options.Dx, &Options.Dy) != 2) Usage();
+                        BatchOnly = true;
+                }
+                else
+                {
+                        Options.Filenames[Options.NumFilenames++] = Args[i];
+                }
         }
-        if(ArgCount != 2) Usage();
+
+        if(Options.NumFilenames == 0) Usage();
+        if(!Batch && (BatchOnly || Options.NumFilenames != 1)) Usage();
+        if(Batch && (ConvertFilename != NULL || (Options.NumFrames > 0 && Options.NumFilenames != 1))) Usage();
+
+        char *Filename = Options.Filenames[0];
+        loaded_scene Loaded;
+
+        if(ConvertFilename != NULL)
+        {
+                LoadScene(Filename, &Loaded);
+                if(!GsSceneFileWrite(ConvertFilename, Loaded.Triangles, Loaded.Materials, Loaded.Depths, Loaded.NumTriangles))
+                {
+                        AbortWithMessage("Couldn't write scene file");
+                }
+                UnloadScene(&Loaded);
+                free(Options.Filenames);
+                return(0);
+        }
+
+        if(Batch)
+        {
+                Options.Engine = Engine;
+                Options.Blend = Blend;
+                Options.Antialias = Antialias;
+                Options.Framebuffer = Framebuffer;
+                if(Options.Output == NULL)
+                {
+                        Options.Output = (Options.Format == GS_FRAMEWRITER_PPM) ? "frame%04d.ppm" : "frame%04d.rgba";
+                }
+                int Result = RunBatch(&Options);
+                free(Options.Filenames);
+                return(Result);
+        }
+        free(Options.Filenames);
+
+        LoadScene(Filename, &Loaded);
+        gs_raster_triangle *Triangles = Loaded.Triangles;
+        gs_raster_material *Materials = Loaded.Materials;
+        gs_raster_depth *Depths = Loaded.Depths;
+        int NumTriangles = Loaded.NumTriangles;
 
         SDL_Window *Window;
         SDL_Renderer *Renderer;
         SDL_Texture *Texture;
-        int DisplayBufferPitch;
         int *DisplayBuffer;
 
-        gs_raster_scanline *Scanlines;
-        gs_raster_triangle *Triangles;
-        gs_raster_color *Colors;
-        int NumTriangles;
+        gs_raster_context Context;
 
         DisplayBuffer = (int*)malloc(DISPLAY_WIDTH * DISPLAY_HEIGHT * 4);
 
@@ -236,20 +598,43 @@ main(int ArgCount, char **Args)
         Texture = SDL_CreateTexture(Renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, DISPLAY_WIDTH, DISPLAY_HEIGHT);
         if(Texture == NULL) AbortWithMessage(SDL_GetError());
 
-        CreateRasterDatastructuresFromFile(Args[1], &Triangles, &Colors, &NumTriangles);
-        GsRasterInitScanlines(&Scanlines, DISPLAY_HEIGHT, DISPLAY_WIDTH, NULL);
-        GsRasterGenerateScanlines(Triangles, NumTriangles, Scanlines, DISPLAY_HEIGHT);
-
-        SDL_LockTexture(Texture, NULL, (void**)&DisplayBuffer, &DisplayBufferPitch);
+        gs_raster_config Config = {0};
+        Config.Engine = Engine;
+        Config.Blend = Blend;
+        Config.Antialias = Antialias;
+        Config.Framebuffer = Framebuffer;
+        Config.Width = DISPLAY_WIDTH;
+        Config.Height = DISPLAY_HEIGHT;
+        Config.Capacity = SceneCapacity(&Loaded, DISPLAY_HEIGHT);
+        Config.MaxTriangles = NumTriangles;
+        Config.DepthFormat = (Depths != NULL) ? GS_RASTER_DEPTH_32 : GS_RASTER_DEPTH_NONE;
+        if(!GsRasterInit(&Context, &Config)) AbortWithMessage("Couldn't allocate the raster context");
+
+        /*
+         * The scanline engine keeps the triangles in a scene, so moving one
+         * only redraws and uploads the pixels it touched.  The half-space
+         * engine redraws the whole frame instead.
+         */
+        gs_raster_scene *Scene = NULL;
+        gs_raster_handle *Handles = NULL;
+        if(Engine == GS_RASTER_ENGINE_SCANLINE)
         {
-                GsRasterRasterize(DisplayBuffer, DISPLAY_WIDTH, DISPLAY_HEIGHT, Scanlines, Triangles, Colors, NumTriangles);
+                Scene = GsRasterSceneCreate(&Context, NumTriangles);
+                Handles = (gs_raster_handle *)malloc(sizeof(gs_raster_handle) * (NumTriangles > 0 ? NumTriangles : 1));
+                if(Handles == NULL) AbortWithMessage("Couldn't allocate the scene's handles");
+                SceneAddAll(Scene, &Loaded, Handles);
         }
-        SDL_UnlockTexture(Texture);
+
+        /* The arrow keys move the last triangle in the file. */
+        int Selected = NumTriangles - 1;
+        bool Redraw = true;
 
         bool Running = true;
         while(Running)
         {
                 SDL_Event Event;
+                float Dx = 0.0f;
+                float Dy = 0.0f;
 
                 while(SDL_PollEvent(&Event))
                 {
@@ -272,15 +657,60 @@ main(int ArgCount, char **Args)
                                                         Running = false;
                                                 }
                                         }
+
+                                        if(Event.type == SDL_KEYDOWN)
+                                        {
+                                                if(KeyCode == SDLK_LEFT) Dx -= 1.0f;
+                                                if(KeyCode == SDLK_RIGHT) Dx += 1.0f;
+                                                if(KeyCode == SDLK_UP) Dy -= 1.0f;
+                                                if(KeyCode == SDLK_DOWN) Dy += 1.0f;
+                                        }
                                 } break;
                         }
                 }
 
+                if((Dx != 0.0f || Dy != 0.0f) && Selected >= 0)
+                {
+                        gs_raster_triangle *Triangle = &Triangles[Selected];
+                        TranslateTriangle(Triangle, Dx, Dy);
+
+                        if(Scene != NULL)
+                        {
+                                gs_raster_depth *Depth = (Depths != NULL) ? &Depths[Selected] : NULL;
+                                GsRasterSceneUpdate(Scene, Handles[Selected], Triangle, &Materials[Selected], Depth);
+                        }
+                        Redraw = true;
+                }
+
+                gs_raster_rect Dirty = {0, 0, 0, 0};
+                if(Scene != NULL)
+                {
+                        Dirty = GsRasterSceneRasterize(Scene, DisplayBuffer);
+                }
+                else if(Redraw)
+                {
+                        GsRasterDrawShaded(&Context, DisplayBuffer, Triangles, Materials, Depths, NumTriangles);
+                        Dirty.Width = DISPLAY_WIDTH;
+                        Dirty.Height = DISPLAY_HEIGHT;
+                }
+                Redraw = false;
+
+                if(Dirty.Width > 0 && Dirty.Height > 0)
+                {
+                        SDL_Rect Rect = { Dirty.X, Dirty.Y, Dirty.Width, Dirty.Height };
+                        int *Source = DisplayBuffer + (Dirty.Y * DISPLAY_WIDTH) + Dirty.X;
+                        SDL_UpdateTexture(Texture, &Rect, Source, DISPLAY_WIDTH * 4);
+                }
+
                 SDL_RenderClear(Renderer);
                 SDL_RenderCopy(Renderer, Texture, 0, 0);
                 SDL_RenderPresent(Renderer);
         }
 
+        GsRasterFree(&Context);
+        UnloadScene(&Loaded);
+        free(Handles);
+
         SDL_DestroyTexture(Texture);
         SDL_DestroyRenderer(Renderer);
         SDL_DestroyWindow(Window);
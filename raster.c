@@ -1,7 +1,21 @@
+#define _POSIX_C_SOURCE 200809L /* sysconf */
+
 #include "raster.h"
-#include <stdlib.h> /* NULL, qsort */
+#include <stdlib.h> /* NULL, malloc, calloc, free */
 #include <alloca.h>
-#include <math.h> /* sqrt */
+#include <limits.h> /* INT_MAX */
+#include <math.h> /* sqrt, ceil */
+#include <string.h> /* memcpy */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h> /* sysconf */
+#ifdef GS_RASTER_STATS
+#include <time.h> /* clock_gettime */
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GS_RASTER_X86 1
+#include <immintrin.h>
+#endif
 
 typedef int bool;
 #define false 0
@@ -11,6 +25,9 @@ typedef int bool;
 #define local_persist static
 #define global_variable static
 
+/* Compiles a single function for a wider instruction set than the build's baseline. */
+#define GS_RASTER_TARGET(Isa) __attribute__((target(Isa)))
+
 #ifdef GS_RASTER_DEBUG
 #define Assert(Expression) if(!(Expression)) {*(int *)0 = 0;}
 #else
@@ -77,15 +94,16 @@ typedef struct gs_raster_triangle_edges gs_raster_triangle_edges;
 
 struct gs_raster_triangle_intersection
 {
-        unsigned int X;
-        gs_raster_triangle *Triangle;
+        int X; /* First pixel column whose center is at or right of the edge; never negative. */
+        int Triangle; /* Index into the triangle list. */
 };
 typedef struct gs_raster_triangle_intersection gs_raster_triangle_intersection;
 
-int
+size_t
 GsRasterSizeRequiredForScanlines(int NumScanlines, int Capacity)
 {
-        int Result = (sizeof(gs_raster_scanline) + Capacity) * NumScanlines;
+        size_t Result = (sizeof(gs_raster_scanline) +
+                         (sizeof(gs_raster_triangle_intersection) * Capacity)) * NumScanlines;
         return(Result);
 }
 
@@ -96,522 +114,6391 @@ GsRasterInitScanlines(gs_raster_scanline **Scanlines, int NumScanlines, int Capa
 {
         if(Memory == NULL)
         {
-                int Size = GsRasterSizeRequiredForScanlines(NumScanlines, Capacity);
+                size_t Size = GsRasterSizeRequiredForScanlines(NumScanlines, Capacity);
                 Memory = malloc(Size);
         }
         *Scanlines = (gs_raster_scanline *)Memory;
+        if(Memory == NULL) return;
+
+        /* The intersection lists follow the scanline records, Capacity apiece. */
+        gs_raster_triangle_intersection *Intersections = (gs_raster_triangle_intersection *)(*Scanlines + NumScanlines);
 
         for(int Index = 0; Index < NumScanlines; Index++)
         {
                 gs_raster_scanline *CurrentScanline = &(*Scanlines)[Index];
                 CurrentScanline->Capacity = Capacity;
                 CurrentScanline->NumIntersections = 0;
-
-                int SizeOfScanlines = sizeof(gs_raster_scanline) * NumScanlines;
-                char *Intersections = (char *)Memory + SizeOfScanlines;
-                int Offset = Capacity * Index;
-
-                CurrentScanline->Intersections = (gs_raster_triangle_intersection *)(Intersections + Offset);
+                CurrentScanline->Intersections = Intersections + (Capacity * Index);
         }
 }
 
+/* A triangle on the stack as EmitSpanDepth sees it over one span. */
+struct gs_raster_layer
+{
+        float MinZ;
+        float MidZ; /* Average depth over the span. */
+        int Triangle;
+        bool Translucent;
+};
+typedef struct gs_raster_layer gs_raster_layer;
+
 struct gs_raster_triangle_stack
 {
-        gs_raster_triangle **Stack;
+        int *Stack; /* Triangle indices. */
         int Capacity;
         int Head;
+        gs_raster_layer *Layers; /* Twice Capacity, for depth resolving; NULL unless a worker's. */
 };
 typedef struct gs_raster_triangle_stack gs_raster_triangle_stack;
 
 //------------------------------------------------------------------------------
-// Material Operations
+// Arena Operations
 //------------------------------------------------------------------------------
 
-gs_raster_color
-ColorForTriangle(gs_raster_triangle *Triangles, gs_raster_color *Colors, int Count, gs_raster_triangle *Triangle)
+/*
+ * A stack allocator over a chain of heap blocks.  Pushing bumps an offset and
+ * popping back to a mark is O(1).  A push that does not fit moves on to the
+ * next block of the chain, allocating one only when none is left; blocks are
+ * kept until the arena is destroyed, so once the chain is as long as a
+ * frame needs, frames stop allocating.
+ */
+struct gs_raster_arena_block
 {
-        for(int Index = 0; Index < Count; Index++)
-        {
-                if(&Triangles[Index] == Triangle)
-                {
-                        return(Colors[Index]);
-                }
-        }
-
-        /* TODO(AARON): Default to fuchsia or some obviously "wrong" color? */
-        return(0x00000000); /* Default to the color black. */
-}
-
-//------------------------------------------------------------------------------
-// Triangle Stack Operations
-//------------------------------------------------------------------------------
+        struct gs_raster_arena_block *Next;
+        size_t Size; /* Usable bytes, which follow the header. */
+};
+typedef struct gs_raster_arena_block gs_raster_arena_block;
 
-void
-TriangleStackInit(gs_raster_triangle_stack **Stack, int Capacity, void *Memory)
+struct gs_raster_arena
 {
-        Assert(Memory != NULL);
-        *Stack = (gs_raster_triangle_stack *)Memory;
-
-        gs_raster_triangle_stack *StackPointer = *Stack;
-        void *MemoryOffset = (char *)Memory + sizeof(gs_raster_triangle_stack);
-        StackPointer->Stack = (gs_raster_triangle **)MemoryOffset;
-        StackPointer->Head = 0;
-        StackPointer->Capacity = Capacity;
-}
+        gs_raster_arena_block *First;
+        gs_raster_arena_block *Block; /* Receives the next push. */
+        size_t Used; /* Bytes of Block in use, including alignment padding. */
+        int NumBlocks;
+};
+typedef struct gs_raster_arena gs_raster_arena;
 
-bool
-TriangleStackIsEmpty(gs_raster_triangle_stack *Stack)
+struct gs_raster_arena_mark
 {
-        return(Stack->Head == 0);
-}
+        gs_raster_arena_block *Block;
+        size_t Used;
+};
+typedef struct gs_raster_arena_mark gs_raster_arena_mark;
 
-unsigned int
-TriangleStackSize(gs_raster_triangle_stack *Stack)
-{
-        return(Stack->Head);
-}
+/* Default alignment of arena pushes; enough for any scalar or SSE type. */
+#define GS_RASTER_ARENA_ALIGNMENT 16
 
-bool
-TriangleStackPush(gs_raster_triangle_stack *Stack, gs_raster_triangle *Object)
-{
-        Assert(Stack->Head < (Stack->Capacity + 1));
-        ++Stack->Head;
-        Stack->Stack[Stack->Head] = Object;
-        return(true);
-}
+/* Bytes to reserve for Count elements of Type pushed with the default alignment. */
+#define ArenaSizeForArray(Count, Type) (sizeof(Type) * (size_t)(Count) + GS_RASTER_ARENA_ALIGNMENT)
+#define ArenaPushArray(Arena, Count, Type) ((Type *)ArenaPush((Arena), sizeof(Type) * (size_t)(Count), GS_RASTER_ARENA_ALIGNMENT))
+#define ArenaPushStruct(Arena, Type) ArenaPushArray(Arena, 1, Type)
 
-gs_raster_triangle *
-TriangleStackPop(gs_raster_triangle_stack *Stack)
+gs_raster_arena_block *
+ArenaBlockCreate(size_t Size)
 {
-        Assert(Stack->Head > 0);
-        gs_raster_triangle *Result = Stack->Stack[Stack->Head];
-        --Stack->Head;
-
-        return(Result);
+        /* The header is 16 bytes, so block data keeps malloc's alignment. */
+        gs_raster_arena_block *Block = (gs_raster_arena_block *)malloc(sizeof(gs_raster_arena_block) + Size);
+        if(Block == NULL) return(NULL);
+        Block->Next = NULL;
+        Block->Size = Size;
+        return(Block);
 }
 
-gs_raster_triangle *
-TriangleStackTop(gs_raster_triangle_stack *Stack)
+char *
+ArenaBlockBase(gs_raster_arena_block *Block)
 {
-        return(Stack->Stack[Stack->Head]);
+        char *Result = (char *)(Block + 1);
+        return(Result);
 }
 
-bool
-TriangleStackFind(gs_raster_triangle_stack *Stack, gs_raster_triangle *Object)
+/*
+ * Alignment must be a power of two.  Returns NULL, leaving the arena as it
+ * was, when the push needs a new block and the heap has none to give.
+ */
+void *
+ArenaPush(gs_raster_arena *Arena, size_t Size, size_t Alignment)
 {
-        for(int i=0; i<=Stack->Head; ++i)
+        for(;;)
         {
-                if(Stack->Stack[i] == Object)
+                uintptr_t Base = (uintptr_t)ArenaBlockBase(Arena->Block);
+                uintptr_t Address = (Base + Arena->Used + (Alignment - 1)) & ~(uintptr_t)(Alignment - 1);
+                size_t Offset = (size_t)(Address - Base);
+                if(Offset + Size <= Arena->Block->Size)
                 {
-                        return(true);
+                        Arena->Used = Offset + Size;
+                        return((void *)Address);
                 }
-        }
 
-        return(false);
-}
-
-bool
-TriangleStackRemove(gs_raster_triangle_stack *Stack, gs_raster_triangle *Object)
-{
-        int index = -1;
-        for(int i=0; i <= Stack->Head; ++i)
-        {
-                if(Stack->Stack[i] == Object)
+                gs_raster_arena_block *Next = Arena->Block->Next;
+                if(Next == NULL || Next->Size < Size + Alignment)
                 {
-                        index = i;
-                        break;
-                }
-        }
+                        /*
+                         * Spill into a new block at least as large as this
+                         * one.  Nothing past this block is in use, so a next
+                         * block too small for the push is replaced, which
+                         * keeps the chain from growing frame after frame.
+                         */
+                        size_t BlockSize = Size + Alignment;
+                        if(BlockSize < Arena->Block->Size) BlockSize = Arena->Block->Size;
 
-        if(index < 0)
-        {
-                return(false);
-        }
+                        gs_raster_arena_block *Spill = ArenaBlockCreate(BlockSize);
+                        if(Spill == NULL) return(NULL);
+                        if(Next != NULL)
+                        {
+                                Spill->Next = Next->Next;
+                                free(Next);
+                        }
+                        else
+                        {
+                                Arena->NumBlocks++;
+                        }
+                        Arena->Block->Next = Spill;
+                }
 
-        for(int i=index; i < Stack->Head; ++i)
-        {
-                Stack->Stack[i] = Stack->Stack[i+1];
+                Arena->Block = Arena->Block->Next;
+                Arena->Used = 0;
         }
-        --Stack->Head;
-
-        return(true);
 }
 
-//------------------------------------------------------------------------------
-// Ray, Point and other similar operations
-//------------------------------------------------------------------------------
-
-float
-VectorLength(vector2d V)
+/*
+ * Size is the usable size of the first block; the arena keeps its own header
+ * there too.  Returns NULL if the block cannot be allocated.
+ */
+gs_raster_arena *
+ArenaCreate(size_t Size)
 {
-        float Result = sqrt((V.X * V.X) + (V.Y * V.Y));
+        Size += ArenaSizeForArray(1, gs_raster_arena);
+        gs_raster_arena_block *Block = ArenaBlockCreate(Size);
+        if(Block == NULL) return(NULL);
+
+        gs_raster_arena Bootstrap = { Block, Block, 0, 1 };
+        gs_raster_arena *Result = ArenaPushStruct(&Bootstrap, gs_raster_arena);
+        *Result = Bootstrap;
         return(Result);
 }
 
-vector2d
-VectorNormalize(vector2d V)
+void
+ArenaDestroy(gs_raster_arena *Arena)
 {
-        float Factor = 1.0 / VectorLength(V);
-        vector2d Result;
-        Result.X = V.X * Factor;
-        Result.Y = V.Y * Factor;
-        return(Result);
+        gs_raster_arena_block *Block = Arena->First;
+        while(Block != NULL)
+        {
+                gs_raster_arena_block *Next = Block->Next;
+                free(Block); /* The arena itself lives in the first block. */
+                Block = Next;
+        }
 }
 
-float
-VectorDotProduct(vector2d A, vector2d B)
+gs_raster_arena_mark
+ArenaMark(gs_raster_arena *Arena)
 {
-        float Result = (A.X * B.X) + (A.Y * B.Y);
+        gs_raster_arena_mark Result = { Arena->Block, Arena->Used };
         return(Result);
 }
 
-gs_raster_point2d
-Apply(gs_raster_point2d Point, float T)
+/* Releases everything pushed since the mark was taken. */
+void
+ArenaPop(gs_raster_arena *Arena, gs_raster_arena_mark Mark)
 {
-        gs_raster_point2d Result;
-        Result.X = Point.X * T;
-        Result.Y = Point.Y * T;
-        return(Result);
+        Arena->Block = Mark.Block;
+        Arena->Used = Mark.Used;
 }
 
-vector2d
-VectorProjection(vector2d Source, vector2d Destination)
-{
-        float DestLength = VectorLength(Destination);
-        float DotProduct = VectorDotProduct(Source, Destination);
-        float Scalar = DotProduct / (DestLength * DestLength);
-        vector2d Result = Apply(Destination, Scalar);
+//------------------------------------------------------------------------------
+// Stats Operations
+//------------------------------------------------------------------------------
 
-        return(Result);
-}
+/*
+ * With GS_RASTER_STATS, every thread counts into its own gs_raster_stats,
+ * reached through StatsThread: a pool thread's lives in its worker, and the
+ * calling thread's is opened by StatsBegin at the top of each public call.
+ * WorkersRun folds the pool threads' counters into the caller's once they
+ * finish, and StatsEnd folds those into the attached struct, so the hot
+ * paths never share a counter.
+ * Without GS_RASTER_STATS every macro here expands to nothing.
+ */
+#ifdef GS_RASTER_STATS
 
-gs_raster_point2d
-Add(gs_raster_point2d First, gs_raster_point2d Second)
-{
-        gs_raster_point2d Result;
-        Result.X = First.X + Second.X;
-        Result.Y = First.Y + Second.Y;
-        return(Result);
-}
+global_variable gs_raster_stats *StatsTarget;
+global_variable _Thread_local gs_raster_stats *StatsThread;
 
-gs_raster_point2d
-Evaluate(ray2d Ray, float T)
-{
-        vector2d Applied = Apply(Ray.Dir, T);
-        gs_raster_point2d Result = Add(Ray.Pos, Applied);
-        return(Result);
-}
+#define StatsBegin() gs_raster_stats StatsCall = {0}; StatsThread = &StatsCall
+#define StatsEnd() StatsPublish(&StatsCall)
+#define StatsCount(Field, Value) (StatsThread->Field += (Value))
+#define StatsPeak(Field, Value) if((Value) > StatsThread->Field) StatsThread->Field = (Value)
+#define StatsTimerBegin(Timer) uint64_t Timer = StatsClock()
+#define StatsTimerEnd(Timer, Stage) (StatsThread->Cycles[Stage] += StatsClock() - (Timer))
+#define StatsRow(Row, Count, Capacity) StatsRowGenerated(Row, Count, Capacity)
+#define StatsPixels(Triangle, Count) StatsPixelsWritten(Triangle, Count)
 
-gs_raster_point2d
-Subtract(gs_raster_point2d Minuend, gs_raster_point2d Subtrahend)
+void
+GsRasterSetStats(gs_raster_stats *Stats)
 {
-        gs_raster_point2d Result;
-        Result.X = Minuend.X - Subtrahend.X;
-        Result.Y = Minuend.Y - Subtrahend.Y;
-        return(Result);
+        StatsTarget = Stats;
 }
 
-line_segment
-FromPoints(gs_raster_point2d Start, gs_raster_point2d End)
+uint64_t
+StatsClock()
 {
-        line_segment Result;
-        Result.Start = Start;
-        Result.End = End;
+#if GS_RASTER_X86
+        uint64_t Result = __rdtsc();
+#else
+        struct timespec Now;
+        clock_gettime(CLOCK_MONOTONIC, &Now);
+        uint64_t Result = ((uint64_t)Now.tv_sec * 1000000000) + (uint64_t)Now.tv_nsec;
+#endif
         return(Result);
 }
 
-ray2d
-FromLineSegment(line_segment Segment)
+/* The last bucket also takes every count too large for the one before. */
+int
+StatsBucket(int Count)
 {
-        ray2d Result;
-        Result.Pos = Segment.Start;
-        Result.Dir = Subtract(Segment.End, Segment.Start);
+        int Result = 0;
+        while(Count > 0 && Result < GS_RASTER_STATS_BUCKETS - 1)
+        {
+                Count >>= 1;
+                Result++;
+        }
         return(Result);
 }
 
-line_segment
-FromEdge(edge Edge)
+void
+StatsRowGenerated(int Row, int Count, int Capacity)
 {
-        line_segment Result = FromPoints(Edge.Start, Edge.End);
-        return(Result);
-}
+        gs_raster_stats *Stats = StatsThread;
+        Stats->Rows++;
+        Stats->Intersections += Count;
+        Stats->Histogram[StatsBucket(Count)]++;
+        if(Count > Stats->PeakIntersections) Stats->PeakIntersections = Count;
+        if(Capacity > Stats->Capacity) Stats->Capacity = Capacity;
 
+        /* Each row is generated by one thread, so the slots are not shared. */
+        gs_raster_stats *Target = StatsTarget;
+        if(Target != NULL && Target->RowIntersections != NULL && Row < Target->NumRows)
+        {
+                Target->RowIntersections[Row] = Count;
+        }
+}
 
+/* Triangle is -1 for the background. */
 void
-GsRasterReorderTriangle(gs_raster_triangle *Unordered)
+StatsPixelsWritten(int Triangle, int Count)
 {
-        // Counter-clockwise.
-        // Bottom-left starting.
-
-        gs_raster_triangle Temp;
+        if(Count <= 0) return;
+        StatsThread->PixelsWritten += Count;
 
-        if(Unordered->A.Y > Unordered->B.Y && Unordered->A.Y > Unordered->C.Y)
+        /* One triangle's bands or blocks may be drawn by several threads at once. */
+        gs_raster_stats *Target = StatsTarget;
+        if(Triangle >= 0 && Target != NULL && Target->TrianglePixels != NULL && Triangle < Target->NumTriangles)
         {
-                ;
+                __atomic_fetch_add(&Target->TrianglePixels[Triangle], (uint32_t)Count, __ATOMIC_RELAXED);
         }
-        else if(Unordered->B.Y > Unordered->A.Y && Unordered->B.Y > Unordered->C.Y)
+}
+
+/* Adds Source's counters to Target's; the optional arrays are left alone. */
+void
+StatsMerge(gs_raster_stats *Target, gs_raster_stats *Source)
+{
+        for(int Stage = 0; Stage < GS_RASTER_STAGE_COUNT; Stage++)
         {
-                Temp.A = Unordered->B;
-                Temp.B = Unordered->C;
-                Temp.C = Unordered->A;
-                Unordered->A = Temp.A;
-                Unordered->B = Temp.B;
-                Unordered->C = Temp.C;
+                Target->Cycles[Stage] += Source->Cycles[Stage];
         }
-        else
+        for(int Bucket = 0; Bucket < GS_RASTER_STATS_BUCKETS; Bucket++)
         {
-                Temp.A = Unordered->C;
-                Temp.B = Unordered->A;
-                Temp.C = Unordered->B;
-                Unordered->A = Temp.A;
-                Unordered->B = Temp.B;
-                Unordered->C = Temp.C;
+                Target->Histogram[Bucket] += Source->Histogram[Bucket];
         }
-}
-
-gs_raster_triangle_edges
-FromTriangle(gs_raster_triangle Triangle)
-{
-        gs_raster_triangle_edges Result;
 
-        Result.Edges[0].Start = Triangle.Point[0];
-        Result.Edges[0].End = Triangle.Point[1];
+        Target->Rows += Source->Rows;
+        Target->Intersections += Source->Intersections;
+        if(Source->PeakIntersections > Target->PeakIntersections) Target->PeakIntersections = Source->PeakIntersections;
+        if(Source->Capacity > Target->Capacity) Target->Capacity = Source->Capacity;
+        Target->Overflows += Source->Overflows;
 
-        Result.Edges[1].Start = Triangle.Point[1];
-        Result.Edges[1].End = Triangle.Point[2];
+        Target->StackPushes += Source->StackPushes;
+        Target->StackPops += Source->StackPops;
+        if(Source->PeakStackDepth > Target->PeakStackDepth) Target->PeakStackDepth = Source->PeakStackDepth;
 
-        Result.Edges[2].Start = Triangle.Point[2];
-        Result.Edges[2].End = Triangle.Point[0];
+        Target->PixelsWritten += Source->PixelsWritten;
+        Target->PixelsDrawn += Source->PixelsDrawn;
+        Target->PixelsAntialiased += Source->PixelsAntialiased;
 
-        return(Result);
+        Target->TrianglesCulled += Source->TrianglesCulled;
+        Target->TrianglesClipped += Source->TrianglesClipped;
+        Target->VerticesTransformed += Source->VerticesTransformed;
 }
 
-ray2d
-PositiveXVectorAtHeight(int Height)
+void
+StatsPublish(gs_raster_stats *Call)
 {
-        ray2d Result;
-        Result.X = 0;
-        Result.Y = (float)Height;
-        Result.Dx = 1;
-        Result.Dy = 0;
-        return(Result);
+        if(StatsTarget != NULL)
+        {
+                StatsMerge(StatsTarget, Call);
+        }
+        StatsThread = NULL;
 }
 
-/* This assumes a horizontal +X Vector. */
-bool
-HasIntersection(ray2d Ray, line_segment Line)
-{
-        vector2d LineDir = Subtract(Line.End, Line.Start);
-        LineDir = VectorNormalize(LineDir);
+#else
 
-        float DeltaY = Ray.Y - Line.StartY;
-        float Factor = DeltaY / LineDir.Y;
-        vector2d Delta = Apply(LineDir, Factor);
-        vector2d Point = Add(Line.Start, Delta);
+#define StatsBegin()
+#define StatsEnd()
+#define StatsCount(Field, Value)
+#define StatsPeak(Field, Value)
+#define StatsTimerBegin(Timer)
+#define StatsTimerEnd(Timer, Stage)
+#define StatsRow(Row, Count, Capacity)
+#define StatsPixels(Triangle, Count)
 
-        float LesserX, LesserY, GreaterX, GreaterY;
-        if(Line.StartX < Line.EndX)
-        {
-                LesserX = Line.StartX;
-                GreaterX = Line.EndX;
-        }
-        else
-        {
-                LesserX = Line.EndX;
-                GreaterX = Line.StartX;
-        }
+#endif /* GS_RASTER_STATS */
 
-        if(Line.StartY < Line.EndY)
-        {
-                LesserY = Line.StartY;
-                GreaterY = Line.EndY;
-        }
-        else
-        {
-                LesserY = Line.EndY;
-                GreaterY = Line.StartY;
-        }
+//------------------------------------------------------------------------------
+// Subpixel Operations
+//------------------------------------------------------------------------------
 
-        bool Result = ((Point.X >= LesserX) &&
-                       (Point.X <= GreaterX) &&
-                       (Point.Y >= LesserY) &&
-                       (Point.Y <= GreaterY));
+/*
+ * Vertices are snapped to a grid of 1 / GS_RASTER_SUBPIXEL_ONE pixels, and
+ * from there every coverage decision is made exactly, in integers.  A pixel
+ * is covered when its center lies inside the triangle, or on a top edge
+ * (horizontal, with the inside below) or a left edge (inside to its right).
+ * Triangles sharing an edge therefore cover each pixel along it exactly once.
+ * Override GS_RASTER_SUBPIXEL_BITS at build time for a finer or coarser
+ * grid; finer grids shrink the usable coordinate range.
+ */
+#ifndef GS_RASTER_SUBPIXEL_BITS
+#define GS_RASTER_SUBPIXEL_BITS 4
+#endif
+#if GS_RASTER_SUBPIXEL_BITS < 1 || GS_RASTER_SUBPIXEL_BITS > 8
+#error "GS_RASTER_SUBPIXEL_BITS must be between 1 and 8"
+#endif
+#define GS_RASTER_SUBPIXEL_ONE (1 << GS_RASTER_SUBPIXEL_BITS)
+#define GS_RASTER_SUBPIXEL_HALF (GS_RASTER_SUBPIXEL_ONE / 2)
 
-        return(Result);
-}
+/*
+ * Snapped coordinates are clamped to +/- this many subpixels, which keeps an
+ * edge function's per-pixel step at most 2^26; see HalfSpaceRasterizeTilePixels.
+ * That is +/- 131072 pixels with the default 4 bits.
+ */
+#define GS_RASTER_SUBPIXEL_LIMIT (1 << (25 - GS_RASTER_SUBPIXEL_BITS))
 
-float
-Intersect(ray2d Ray, line_segment Line)
-{
-        vector2d LineDir = Subtract(Line.End, Line.Start);
-        LineDir = VectorNormalize(LineDir);
+/*
+ * The same limit in pixels.  Draws clip triangles reaching past it to it,
+ * so only those few are ever cut up; everything within is drawn as given.
+ */
+#define GS_RASTER_GUARD_BAND ((float)(GS_RASTER_SUBPIXEL_LIMIT / GS_RASTER_SUBPIXEL_ONE))
 
-        float DeltaY = Ray.Y - Line.StartY;
-        float Factor = DeltaY / LineDir.Y;
-        vector2d Delta = Apply(LineDir, Factor);
-        vector2d Point = Add(Line.Start, Delta);
+struct gs_raster_fixed_point
+{
+        int32_t X;
+        int32_t Y;
+};
+typedef struct gs_raster_fixed_point gs_raster_fixed_point;
 
-        float LesserX, LesserY, GreaterX, GreaterY;
-        if(Line.StartX < Line.EndX)
+/* A gs_raster_triangle in subpixels, laid out so both convert as flat arrays of coordinates. */
+struct gs_raster_fixed_triangle
+{
+        gs_raster_fixed_point Point[3];
+};
+typedef struct gs_raster_fixed_triangle gs_raster_fixed_triangle;
+
+_Static_assert(sizeof(gs_raster_fixed_triangle) == sizeof(gs_raster_triangle),
+               "fixed and float triangles must convert coordinate for coordinate");
+
+/* Rounds Count pixel coordinates to the nearest subpixel, ties to even, clamped to the limit. */
+void
+SnapCoordinatesScalar(float *Coordinates, int32_t *Fixed, int Count)
+{
+        float Limit = (float)GS_RASTER_SUBPIXEL_LIMIT;
+
+        for(int Index = 0; Index < Count; Index++)
+        {
+                float Value = Coordinates[Index] * (float)GS_RASTER_SUBPIXEL_ONE;
+                if(!(Value >= -Limit)) Value = -Limit; /* Also catches NaN. */
+                if(Value > Limit) Value = Limit;
+                Fixed[Index] = (int32_t)rintf(Value);
+        }
+}
+
+/* True when a coordinate of the triangle lies beyond the guard band, or is not a number. */
+bool
+TriangleOutsideGuardBand(gs_raster_triangle *Triangle)
+{
+        float *Coordinates = (float *)Triangle;
+        bool Result = false;
+        for(int Index = 0; Index < 6; Index++)
+        {
+                if(!(fabsf(Coordinates[Index]) <= GS_RASTER_GUARD_BAND)) Result = true;
+        }
+        return(Result);
+}
+
+/*
+ * The triangle exactly as the rasterizer covers it, back in pixels.  A
+ * triangle beyond the guard band is returned as it is, since only the
+ * pieces it is clipped into are covered, and they lie on its plane.
+ */
+gs_raster_triangle
+SnappedTriangle(gs_raster_triangle *Triangle)
+{
+        if(TriangleOutsideGuardBand(Triangle)) return(*Triangle);
+
+        gs_raster_fixed_triangle Fixed;
+        SnapCoordinatesScalar((float *)Triangle, (int32_t *)&Fixed, 6);
+
+        gs_raster_triangle Result;
+        for(int Index = 0; Index < 3; Index++)
+        {
+                Result.Point[Index].X = (float)Fixed.Point[Index].X / (float)GS_RASTER_SUBPIXEL_ONE;
+                Result.Point[Index].Y = (float)Fixed.Point[Index].Y / (float)GS_RASTER_SUBPIXEL_ONE;
+        }
+        return(Result);
+}
+
+/*
+ * True for snapped triangles that cannot draw a pixel of a Width x Height
+ * grid: those without area and those lying wholly more than a pixel off the
+ * grid, a margin that keeps every pixel an antialiased edge passes through.
+ * With GS_RASTER_CULL_BACK, triangles wound clockwise on screen are culled
+ * too; Y points down, so their doubled area is positive.
+ */
+bool
+TriangleCulled(gs_raster_fixed_triangle *Triangle, int Width, int Height, gs_raster_cull Cull)
+{
+        gs_raster_fixed_point *Point = Triangle->Point;
+        int64_t Area = ((((int64_t)Point[1].X - Point[0].X) * ((int64_t)Point[2].Y - Point[0].Y)) -
+                        (((int64_t)Point[2].X - Point[0].X) * ((int64_t)Point[1].Y - Point[0].Y)));
+        if(Area == 0) return(true);
+        if(Cull == GS_RASTER_CULL_BACK && Area > 0) return(true);
+
+        int32_t MinX = Point[0].X, MaxX = Point[0].X;
+        int32_t MinY = Point[0].Y, MaxY = Point[0].Y;
+        for(int Index = 1; Index < 3; Index++)
+        {
+                if(Point[Index].X < MinX) MinX = Point[Index].X;
+                if(Point[Index].X > MaxX) MaxX = Point[Index].X;
+                if(Point[Index].Y < MinY) MinY = Point[Index].Y;
+                if(Point[Index].Y > MaxY) MaxY = Point[Index].Y;
+        }
+
+        bool Result = (MaxX < -GS_RASTER_SUBPIXEL_ONE || MaxY < -GS_RASTER_SUBPIXEL_ONE ||
+                       MinX > (int64_t)(Width + 1) * GS_RASTER_SUBPIXEL_ONE ||
+                       MinY > (int64_t)(Height + 1) * GS_RASTER_SUBPIXEL_ONE);
+        return(Result);
+}
+
+/* The most points a triangle can have once clipped to the guard band: one more per side. */
+#define GS_RASTER_CLIP_POINTS 7
+
+/*
+ * Clips the triangle to the guard band, one side after another, into the
+ * convex polygon Points, and returns its number of points; 0 when nothing
+ * is left, or a coordinate is not finite.  Each point keeps the winding of
+ * the triangle, and lies within the band.
+ */
+int
+ClipToGuardBand(gs_raster_triangle *Triangle, gs_raster_point2d Points[GS_RASTER_CLIP_POINTS])
+{
+        float Band = GS_RASTER_GUARD_BAND;
+        int NumPoints = 3;
+        for(int Index = 0; Index < 3; Index++)
+        {
+                Points[Index] = Triangle->Point[Index];
+                if(!isfinite(Points[Index].X) || !isfinite(Points[Index].Y)) return(0);
+        }
+
+        /* Sides are X >= -Band, X <= Band, Y >= -Band and Y <= Band. */
+        for(int Side = 0; Side < 4 && NumPoints > 0; Side++)
+        {
+                float Sign = (Side & 1) ? -1.0f : 1.0f;
+                gs_raster_point2d Input[GS_RASTER_CLIP_POINTS];
+                float Inside[GS_RASTER_CLIP_POINTS]; /* Distance from the side, negative when outside. */
+                int NumInput = NumPoints;
+                for(int Index = 0; Index < NumInput; Index++)
+                {
+                        Input[Index] = Points[Index];
+                        float Coordinate = (Side < 2) ? Input[Index].X : Input[Index].Y;
+                        Inside[Index] = Band + (Sign * Coordinate);
+                }
+
+                NumPoints = 0;
+                for(int Index = 0; Index < NumInput; Index++)
+                {
+                        int Previous = (Index + NumInput - 1) % NumInput;
+                        if((Inside[Previous] >= 0.0f) != (Inside[Index] >= 0.0f))
+                        {
+                                float T = Inside[Previous] / (Inside[Previous] - Inside[Index]);
+                                gs_raster_point2d *Point = &Points[NumPoints++];
+                                Point->X = Input[Previous].X + (T * (Input[Index].X - Input[Previous].X));
+                                Point->Y = Input[Previous].Y + (T * (Input[Index].Y - Input[Previous].Y));
+                                if(Side < 2) Point->X = -Sign * Band;
+                                else Point->Y = -Sign * Band;
+                        }
+                        if(Inside[Index] >= 0.0f)
+                        {
+                                Points[NumPoints++] = Input[Index];
+                        }
+                }
+        }
+
+        /* Interpolating along the later sides can round a point just past the earlier ones. */
+        for(int Index = 0; Index < NumPoints; Index++)
+        {
+                Points[Index].X = fminf(fmaxf(Points[Index].X, -Band), Band);
+                Points[Index].Y = fminf(fmaxf(Points[Index].Y, -Band), Band);
+        }
+        return(NumPoints);
+}
+
+/* Floor and ceiling of Numerator / Denominator for positive denominators. */
+int64_t
+FloorDivide(int64_t Numerator, int64_t Denominator)
+{
+        int64_t Result = Numerator / Denominator;
+        if((Numerator % Denominator) != 0 && Numerator < 0) Result--;
+        return(Result);
+}
+
+int64_t
+CeilDivide(int64_t Numerator, int64_t Denominator)
+{
+        int64_t Result = -FloorDivide(-Numerator, Denominator);
+        return(Result);
+}
+
+/*
+ * The first pixel row or column whose center is at or past the subpixel
+ * coordinate, ceil(Coordinate / GS_RASTER_SUBPIXEL_ONE - 1/2).
+ */
+int
+FirstPixelAtOrAfter(int32_t Coordinate)
+{
+        int Result = (int)CeilDivide((int64_t)Coordinate - GS_RASTER_SUBPIXEL_HALF, GS_RASTER_SUBPIXEL_ONE);
+        return(Result);
+}
+
+//------------------------------------------------------------------------------
+// Material Operations
+//------------------------------------------------------------------------------
+
+/* Color channels are interpolated in 8.16 fixed point. */
+#define GS_RASTER_GRADIENT_SHIFT 16
+
+/*
+ * Per-triangle color planes: channel C at the center of pixel (X, Y) is
+ * Base[C] + DcDx[C] * X + DcDy[C] * Y.  Planes are built from the snapped
+ * vertices, so colors follow the edges the pixels were covered by.
+ */
+struct gs_raster_gradient
+{
+        float Base[4];
+        float DcDx[4];
+        float DcDy[4];
+        bool IsFlat;
+        gs_raster_color Color; /* Used directly when IsFlat. */
+
+        /* See gs_raster_blend; always true without blending. */
+        bool IsOpaque;
+        bool IsPremultiplied; /* The planes already interpolate premultiplied colors. */
+        gs_raster_color Premultiplied; /* Color times its alpha, for blending when IsFlat. */
+
+        /*
+         * Textured triangles take their colors from Texture instead, with
+         * planes for U / W, V / W and 1 / W, U and V in texels of the top
+         * level.  See TextureSpan.
+         */
+        gs_raster_texture *Texture; /* NULL when untextured. */
+        float TexBase[3];
+        float TexDx[3];
+        float TexDy[3];
+};
+typedef struct gs_raster_gradient gs_raster_gradient;
+
+float
+ColorChannel(gs_raster_color Color, int Channel)
+{
+        float Result = (float)((Color >> (Channel * 8)) & 0xFF);
+        return(Result);
+}
+
+/* X * A / 255, rounded to nearest, for 8-bit X and A. */
+uint32_t
+MultiplyChannel(uint32_t X, uint32_t A)
+{
+        uint32_t T = (X * A) + 128;
+        uint32_t Result = (T + (T >> 8)) >> 8;
+        return(Result);
+}
+
+/* Scales the color channels by alpha, the lowest channel, which is kept. */
+gs_raster_color
+PremultiplyColor(gs_raster_color Color)
+{
+        uint32_t Alpha = Color & 0xFF;
+        gs_raster_color Result = (Alpha |
+                                  (MultiplyChannel((Color >> 8) & 0xFF, Alpha) << 8) |
+                                  (MultiplyChannel((Color >> 16) & 0xFF, Alpha) << 16) |
+                                  (MultiplyChannel((Color >> 24) & 0xFF, Alpha) << 24));
+        return(Result);
+}
+
+/*
+ * Source over Dest, for a premultiplied Source: each channel is Source plus
+ * Dest scaled by Source's transparency, saturating at 255.
+ */
+gs_raster_color
+BlendColor(gs_raster_color Dest, gs_raster_color Source)
+{
+        uint32_t Inverse = 255 - (Source & 0xFF);
+        gs_raster_color Result = 0;
+        for(int Shift = 0; Shift < 32; Shift += 8)
+        {
+                uint32_t Channel = ((Source >> Shift) & 0xFF) + MultiplyChannel((Dest >> Shift) & 0xFF, Inverse);
+                if(Channel > 255) Channel = 255;
+                Result |= Channel << Shift;
+        }
+        return(Result);
+}
+
+void
+GradientSetBlend(gs_raster_gradient *Gradient, gs_raster_material *Material, gs_raster_blend Blend)
+{
+        Gradient->IsOpaque = true;
+        Gradient->IsPremultiplied = (Blend == GS_RASTER_BLEND_PREMULTIPLIED);
+        Gradient->Premultiplied = Gradient->Color;
+        if(Blend == GS_RASTER_BLEND_NONE) return;
+
+        for(int Vertex = 0; Vertex < 3; Vertex++)
+        {
+                if((Material->VertexColors[Vertex] & 0xFF) != 0xFF) Gradient->IsOpaque = false;
+        }
+        if(!Gradient->IsPremultiplied)
+        {
+                Gradient->Premultiplied = PremultiplyColor(Gradient->Color);
+        }
+}
+
+/* A flat gradient, so flat colors can be blended like materials. */
+gs_raster_gradient
+GradientForColor(gs_raster_color Color, gs_raster_blend Blend)
+{
+        gs_raster_material Material = {{ Color, Color, Color }};
+        gs_raster_gradient Result = {{ 0 }};
+        Result.Color = Color;
+        Result.IsFlat = true;
+        GradientSetBlend(&Result, &Material, Blend);
+        return(Result);
+}
+
+/*
+ * Fits the plane through the values V0, V1 and V2 at the triangle's vertices,
+ * so the value at the center of pixel (X, Y) is Base + Dx * X + Dy * Y.  Area
+ * is twice the triangle's signed area, and must not be zero.
+ */
+void
+TrianglePlane(gs_raster_triangle *Triangle, float Area, float V0, float V1, float V2, float *Base, float *Dx, float *Dy)
+{
+        float X1 = Triangle->X2 - Triangle->X1;
+        float Y1 = Triangle->Y2 - Triangle->Y1;
+        float X2 = Triangle->X3 - Triangle->X1;
+        float Y2 = Triangle->Y3 - Triangle->Y1;
+        float C1 = V1 - V0;
+        float C2 = V2 - V0;
+
+        *Dx = ((C1 * Y2) - (C2 * Y1)) / Area;
+        *Dy = ((C2 * X1) - (C1 * X2)) / Area;
+        *Base = (V0 -
+                 (*Dx * (Triangle->X1 - 0.5f)) -
+                 (*Dy * (Triangle->Y1 - 0.5f)));
+}
+
+gs_raster_gradient
+GradientForMaterial(gs_raster_triangle *Unsnapped, gs_raster_material *Material, gs_raster_blend Blend)
+{
+        gs_raster_triangle Snapped = SnappedTriangle(Unsnapped);
+        gs_raster_triangle *Triangle = &Snapped;
+
+        gs_raster_gradient Result = {{ 0 }};
+        Result.Color = Material->VertexColors[0];
+        Result.IsFlat = (Material->VertexColors[0] == Material->VertexColors[1] &&
+                         Material->VertexColors[0] == Material->VertexColors[2]);
+
+        float X1 = Triangle->X2 - Triangle->X1;
+        float Y1 = Triangle->Y2 - Triangle->Y1;
+        float X2 = Triangle->X3 - Triangle->X1;
+        float Y2 = Triangle->Y3 - Triangle->Y1;
+        float Area = (X1 * Y2) - (X2 * Y1);
+        if(Area == 0.0f)
+        {
+                Result.IsFlat = true;
+        }
+        GradientSetBlend(&Result, Material, Blend);
+        if(Result.IsFlat)
+        {
+                return(Result);
+        }
+
+        for(int Channel = 0; Channel < 4; Channel++)
+        {
+                TrianglePlane(Triangle, Area,
+                              ColorChannel(Material->VertexColors[0], Channel),
+                              ColorChannel(Material->VertexColors[1], Channel),
+                              ColorChannel(Material->VertexColors[2], Channel),
+                              &Result.Base[Channel], &Result.DcDx[Channel], &Result.DcDy[Channel]);
+        }
+
+        return(Result);
+}
+
+/* Whether the triangle is drawn without blending; Gradients is NULL for flat colors. */
+bool
+TriangleIsOpaque(gs_raster_gradient *Gradients, int Triangle)
+{
+        bool Result = (Gradients == NULL || Gradients[Triangle].IsOpaque);
+        return(Result);
+}
+
+//------------------------------------------------------------------------------
+// Texture Operations
+//------------------------------------------------------------------------------
+
+/* Enough levels for a GS_RASTER_MAX_TEXTURE_SIZE texture down to 1x1. */
+#define GS_RASTER_MAX_TEXTURE_LEVELS 16
+
+/*
+ * Texel (X, Y) of a level is at TexelIndex(Level, X, Y): the low MortonBits
+ * bits of X and Y interleaved, X in the even bits, and the remaining bits of
+ * the longer side above them.  Square levels are one Z-order curve; longer
+ * ones are a row or column of them.
+ */
+struct gs_raster_texture_level
+{
+        int Width;
+        int Height;
+        int MortonBits; /* log2 of the shorter side. */
+        gs_raster_color *Texels;
+};
+typedef struct gs_raster_texture_level gs_raster_texture_level;
+
+struct gs_raster_texture
+{
+        int NumLevels;
+        bool IsOpaque; /* Every texel's alpha is 255. */
+        gs_raster_texture_level Levels[GS_RASTER_MAX_TEXTURE_LEVELS];
+};
+
+/* Each byte with its bits moved to the even bits of 16. */
+global_variable const uint16_t SpreadByte[256] =
+{
+        0x0000, 0x0001, 0x0004, 0x0005, 0x0010, 0x0011, 0x0014, 0x0015,
+        0x0040, 0x0041, 0x0044, 0x0045, 0x0050, 0x0051, 0x0054, 0x0055,
+        0x0100, 0x0101, 0x0104, 0x0105, 0x0110, 0x0111, 0x0114, 0x0115,
+        0x0140, 0x0141, 0x0144, 0x0145, 0x0150, 0x0151, 0x0154, 0x0155,
+        0x0400, 0x0401, 0x0404, 0x0405, 0x0410, 0x0411, 0x0414, 0x0415,
+        0x0440, 0x0441, 0x0444, 0x0445, 0x0450, 0x0451, 0x0454, 0x0455,
+        0x0500, 0x0501, 0x0504, 0x0505, 0x0510, 0x0511, 0x0514, 0x0515,
+        0x0540, 0x0541, 0x0544, 0x0545, 0x0550, 0x0551, 0x0554, 0x0555,
+        0x1000, 0x1001, 0x1004, 0x1005, 0x1010, 0x1011, 0x1014, 0x1015,
+        0x1040, 0x1041, 0x1044, 0x1045, 0x1050, 0x1051, 0x1054, 0x1055,
+        0x1100, 0x1101, 0x1104, 0x1105, 0x1110, 0x1111, 0x1114, 0x1115,
+        0x1140, 0x1141, 0x1144, 0x1145, 0x1150, 0x1151, 0x1154, 0x1155,
+        0x1400, 0x1401, 0x1404, 0x1405, 0x1410, 0x1411, 0x1414, 0x1415,
+        0x1440, 0x1441, 0x1444, 0x1445, 0x1450, 0x1451, 0x1454, 0x1455,
+        0x1500, 0x1501, 0x1504, 0x1505, 0x1510, 0x1511, 0x1514, 0x1515,
+        0x1540, 0x1541, 0x1544, 0x1545, 0x1550, 0x1551, 0x1554, 0x1555,
+        0x4000, 0x4001, 0x4004, 0x4005, 0x4010, 0x4011, 0x4014, 0x4015,
+        0x4040, 0x4041, 0x4044, 0x4045, 0x4050, 0x4051, 0x4054, 0x4055,
+        0x4100, 0x4101, 0x4104, 0x4105, 0x4110, 0x4111, 0x4114, 0x4115,
+        0x4140, 0x4141, 0x4144, 0x4145, 0x4150, 0x4151, 0x4154, 0x4155,
+        0x4400, 0x4401, 0x4404, 0x4405, 0x4410, 0x4411, 0x4414, 0x4415,
+        0x4440, 0x4441, 0x4444, 0x4445, 0x4450, 0x4451, 0x4454, 0x4455,
+        0x4500, 0x4501, 0x4504, 0x4505, 0x4510, 0x4511, 0x4514, 0x4515,
+        0x4540, 0x4541, 0x4544, 0x4545, 0x4550, 0x4551, 0x4554, 0x4555,
+        0x5000, 0x5001, 0x5004, 0x5005, 0x5010, 0x5011, 0x5014, 0x5015,
+        0x5040, 0x5041, 0x5044, 0x5045, 0x5050, 0x5051, 0x5054, 0x5055,
+        0x5100, 0x5101, 0x5104, 0x5105, 0x5110, 0x5111, 0x5114, 0x5115,
+        0x5140, 0x5141, 0x5144, 0x5145, 0x5150, 0x5151, 0x5154, 0x5155,
+        0x5400, 0x5401, 0x5404, 0x5405, 0x5410, 0x5411, 0x5414, 0x5415,
+        0x5440, 0x5441, 0x5444, 0x5445, 0x5450, 0x5451, 0x5454, 0x5455,
+        0x5500, 0x5501, 0x5504, 0x5505, 0x5510, 0x5511, 0x5514, 0x5515,
+        0x5540, 0x5541, 0x5544, 0x5545, 0x5550, 0x5551, 0x5554, 0x5555,
+};
+
+/* Moves the low 16 bits of Value into the even bits. */
+uint32_t
+SpreadBits(uint32_t Value)
+{
+        uint32_t Result = SpreadByte[Value & 0xFF] | ((uint32_t)SpreadByte[(Value >> 8) & 0xFF] << 16);
+        return(Result);
+}
+
+uint32_t
+TexelIndex(gs_raster_texture_level *Level, uint32_t X, uint32_t Y)
+{
+        uint32_t Mask = (1u << Level->MortonBits) - 1;
+        uint32_t Result = (SpreadBits(X & Mask) |
+                           (SpreadBits(Y & Mask) << 1) |
+                           (((X | Y) >> Level->MortonBits) << (2 * Level->MortonBits)));
+        return(Result);
+}
+
+int
+Log2OfPowerOfTwo(int Value)
+{
+        int Result = 0;
+        while((1 << Result) < Value) Result++;
+        return(Result);
+}
+
+/* Averages four colors channel by channel, rounding to nearest. */
+gs_raster_color
+AverageColors(gs_raster_color A, gs_raster_color B, gs_raster_color C, gs_raster_color D)
+{
+        gs_raster_color Result = 0;
+        for(int Shift = 0; Shift < 32; Shift += 8)
+        {
+                uint32_t Sum = (((A >> Shift) & 0xFF) + ((B >> Shift) & 0xFF) +
+                                ((C >> Shift) & 0xFF) + ((D >> Shift) & 0xFF) + 2);
+                Result |= (Sum >> 2) << Shift;
+        }
+        return(Result);
+}
+
+gs_raster_texture *
+GsRasterTextureCreate(gs_raster_color *Texels, int Width, int Height)
+{
+        if(Width < 1 || Width > GS_RASTER_MAX_TEXTURE_SIZE || (Width & (Width - 1)) != 0 ||
+           Height < 1 || Height > GS_RASTER_MAX_TEXTURE_SIZE || (Height & (Height - 1)) != 0)
+        {
+                return(NULL);
+        }
+
+        int NumLevels = 0;
+        size_t NumTexels = 0;
+        for(int W = Width, H = Height; ; W = (W > 1) ? W / 2 : 1, H = (H > 1) ? H / 2 : 1)
+        {
+                NumLevels++;
+                NumTexels += (size_t)W * H;
+                if(W == 1 && H == 1) break;
+        }
+
+        gs_raster_texture *Texture = (gs_raster_texture *)malloc(sizeof(gs_raster_texture) + (sizeof(gs_raster_color) * NumTexels));
+        if(Texture == NULL) return(NULL);
+
+        Texture->NumLevels = NumLevels;
+        Texture->IsOpaque = true;
+        gs_raster_color *Memory = (gs_raster_color *)(Texture + 1);
+        for(int Index = 0; Index < NumLevels; Index++)
+        {
+                gs_raster_texture_level *Level = &Texture->Levels[Index];
+                Level->Width = (Width >> Index) > 1 ? (Width >> Index) : 1;
+                Level->Height = (Height >> Index) > 1 ? (Height >> Index) : 1;
+                Level->MortonBits = Log2OfPowerOfTwo((Level->Width < Level->Height) ? Level->Width : Level->Height);
+                Level->Texels = Memory;
+                Memory += (size_t)Level->Width * Level->Height;
+        }
+
+        gs_raster_texture_level *Top = &Texture->Levels[0];
+        for(int Y = 0; Y < Height; Y++)
+        {
+                for(int X = 0; X < Width; X++)
+                {
+                        gs_raster_color Texel = Texels[((size_t)Y * Width) + X];
+                        if((Texel & 0xFF) != 0xFF) Texture->IsOpaque = false;
+                        Top->Texels[TexelIndex(Top, X, Y)] = Texel;
+                }
+        }
+
+        for(int Index = 1; Index < NumLevels; Index++)
+        {
+                gs_raster_texture_level *Above = &Texture->Levels[Index - 1];
+                gs_raster_texture_level *Level = &Texture->Levels[Index];
+                for(int Y = 0; Y < Level->Height; Y++)
+                {
+                        /* A side already 1 texel long is averaged with itself. */
+                        int Y0 = Y * 2;
+                        int Y1 = (Y0 + 1 < Above->Height) ? Y0 + 1 : Y0;
+                        for(int X = 0; X < Level->Width; X++)
+                        {
+                                int X0 = X * 2;
+                                int X1 = (X0 + 1 < Above->Width) ? X0 + 1 : X0;
+                                Level->Texels[TexelIndex(Level, X, Y)] = AverageColors(Above->Texels[TexelIndex(Above, X0, Y0)],
+                                                                                       Above->Texels[TexelIndex(Above, X1, Y0)],
+                                                                                       Above->Texels[TexelIndex(Above, X0, Y1)],
+                                                                                       Above->Texels[TexelIndex(Above, X1, Y1)]);
+                        }
+                }
+        }
+
+        return(Texture);
+}
+
+void
+GsRasterTextureFree(gs_raster_texture *Texture)
+{
+        free(Texture);
+}
+
+/* The smallest texture coordinate W taken; see gs_raster_texcoords. */
+#define GS_RASTER_MIN_TEXCOORD_W 1e-6f
+
+/*
+ * A gradient that maps Texture across the triangle.  Blending follows the
+ * texels' alphas, as GradientSetBlend follows the vertex colors'.
+ */
+gs_raster_gradient
+GradientForTexcoords(gs_raster_triangle *Unsnapped, gs_raster_texcoords *Texcoords, gs_raster_texture *Texture, gs_raster_blend Blend)
+{
+        gs_raster_triangle Snapped = SnappedTriangle(Unsnapped);
+        gs_raster_triangle *Triangle = &Snapped;
+
+        gs_raster_gradient Result = {{ 0 }};
+        Result.Texture = Texture;
+        Result.IsOpaque = (Blend == GS_RASTER_BLEND_NONE || Texture->IsOpaque);
+        Result.IsPremultiplied = (Blend == GS_RASTER_BLEND_PREMULTIPLIED);
+        Result.TexBase[2] = 1.0f;
+
+        float X1 = Triangle->X2 - Triangle->X1;
+        float Y1 = Triangle->Y2 - Triangle->Y1;
+        float X2 = Triangle->X3 - Triangle->X1;
+        float Y2 = Triangle->Y3 - Triangle->Y1;
+        float Area = (X1 * Y2) - (X2 * Y1);
+        if(Area == 0.0f)
+        {
+                return(Result);
+        }
+
+        float Width = (float)Texture->Levels[0].Width;
+        float Height = (float)Texture->Levels[0].Height;
+        float U[3];
+        float V[3];
+        float Q[3];
+        for(int Vertex = 0; Vertex < 3; Vertex++)
+        {
+                /* Raising W keeps 1 / W, and the planes built from it, finite; NaN fails the test too. */
+                float W = Texcoords->W[Vertex];
+                if(!(W >= GS_RASTER_MIN_TEXCOORD_W)) W = GS_RASTER_MIN_TEXCOORD_W;
+                Q[Vertex] = 1.0f / W;
+                U[Vertex] = Texcoords->U[Vertex] * Width * Q[Vertex];
+                V[Vertex] = Texcoords->V[Vertex] * Height * Q[Vertex];
+        }
+        TrianglePlane(Triangle, Area, U[0], U[1], U[2], &Result.TexBase[0], &Result.TexDx[0], &Result.TexDy[0]);
+        TrianglePlane(Triangle, Area, V[0], V[1], V[2], &Result.TexBase[1], &Result.TexDx[1], &Result.TexDy[1]);
+        TrianglePlane(Triangle, Area, Q[0], Q[1], Q[2], &Result.TexBase[2], &Result.TexDx[2], &Result.TexDy[2]);
+
+        return(Result);
+}
+
+//------------------------------------------------------------------------------
+// Depth Buffer Operations
+//------------------------------------------------------------------------------
+
+/*
+ * The half-space engine tests triangles against blocks, then tiles, then
+ * pixels; the depth buffer keeps its coarse bounds at the same two levels.
+ */
+/* Pixels per side of the finest tile tested before falling back to pixels. */
+#define GS_RASTER_TILE_SIZE 8
+/* Pixels per side of the coarse blocks tested first; a multiple of the tile size. */
+#define GS_RASTER_BLOCK_SIZE 64
+
+/*
+ * Depth at the center of pixel (X, Y) is (Base + DzDy * Y) + DzDx * X,
+ * clamped to [MinZ, MaxZ], in buffer units.  Every step of that expression
+ * rounds monotonically, so over any rectangle it is bounded by its corner
+ * values.
+ */
+struct gs_raster_depth_plane
+{
+        float Base;
+        float DzDx;
+        float DzDy;
+        float MinZ;
+        float MaxZ;
+};
+typedef struct gs_raster_depth_plane gs_raster_depth_plane;
+
+struct gs_raster_depth_buffer
+{
+        gs_raster_depth_format Format;
+        int Width;
+        int Height;
+        void *Values; /* uint16_t or float per pixel, by Format; smaller is nearer. */
+        float Far; /* Cleared value, in buffer units. */
+
+        /*
+         * Conservative bounds on the stored depths of each tile and block:
+         * every stored value lies in [Min, Max].  Only the half-space engine
+         * maintains them.
+         */
+        int TilesX;
+        float *TileMin;
+        float *TileMax;
+        int BlocksX;
+        float *BlockMin;
+        float *BlockMax;
+
+        gs_raster_depth_plane *Planes; /* Of the draw in progress; one per triangle. */
+};
+typedef struct gs_raster_depth_buffer gs_raster_depth_buffer;
+
+size_t
+DepthBufferSizeRequired(gs_raster_depth_format Format, int Width, int Height)
+{
+        int NumTiles = ((Width + GS_RASTER_TILE_SIZE - 1) / GS_RASTER_TILE_SIZE) * ((Height + GS_RASTER_TILE_SIZE - 1) / GS_RASTER_TILE_SIZE);
+        int NumBlocks = ((Width + GS_RASTER_BLOCK_SIZE - 1) / GS_RASTER_BLOCK_SIZE) * ((Height + GS_RASTER_BLOCK_SIZE - 1) / GS_RASTER_BLOCK_SIZE);
+        size_t Result = (ArenaSizeForArray(1, gs_raster_depth_buffer) +
+                         ((Format == GS_RASTER_DEPTH_16) ? ArenaSizeForArray(Width * Height, uint16_t) : ArenaSizeForArray(Width * Height, float)) +
+                         (2 * ArenaSizeForArray(NumTiles, float)) +
+                         (2 * ArenaSizeForArray(NumBlocks, float)));
+        return(Result);
+}
+
+/* Lives as long as the arena; see DepthBufferSizeRequired. */
+gs_raster_depth_buffer *
+DepthBufferCreate(gs_raster_arena *Arena, gs_raster_depth_format Format, int Width, int Height)
+{
+        gs_raster_depth_buffer *Buffer = ArenaPushStruct(Arena, gs_raster_depth_buffer);
+        Buffer->Format = Format;
+        Buffer->Width = Width;
+        Buffer->Height = Height;
+        Buffer->Far = (Format == GS_RASTER_DEPTH_16) ? 65535.0f : 1.0f;
+
+        if(Format == GS_RASTER_DEPTH_16)
+        {
+                Buffer->Values = ArenaPushArray(Arena, Width * Height, uint16_t);
+        }
+        else
+        {
+                Buffer->Values = ArenaPushArray(Arena, Width * Height, float);
+        }
+
+        Buffer->TilesX = (Width + GS_RASTER_TILE_SIZE - 1) / GS_RASTER_TILE_SIZE;
+        int TilesY = (Height + GS_RASTER_TILE_SIZE - 1) / GS_RASTER_TILE_SIZE;
+        Buffer->TileMin = ArenaPushArray(Arena, Buffer->TilesX * TilesY, float);
+        Buffer->TileMax = ArenaPushArray(Arena, Buffer->TilesX * TilesY, float);
+
+        Buffer->BlocksX = (Width + GS_RASTER_BLOCK_SIZE - 1) / GS_RASTER_BLOCK_SIZE;
+        int BlocksY = (Height + GS_RASTER_BLOCK_SIZE - 1) / GS_RASTER_BLOCK_SIZE;
+        Buffer->BlockMin = ArenaPushArray(Arena, Buffer->BlocksX * BlocksY, float);
+        Buffer->BlockMax = ArenaPushArray(Arena, Buffer->BlocksX * BlocksY, float);
+
+        Buffer->Planes = NULL;
+        return(Buffer);
+}
+
+/* Snaps a depth in buffer units to the value the buffer would store. */
+float
+DepthQuantize(gs_raster_depth_buffer *Buffer, float Z)
+{
+        float Result = (Buffer->Format == GS_RASTER_DEPTH_16) ? floorf(Z) : Z;
+        return(Result);
+}
+
+/* Built from the snapped vertices, as with GradientForMaterial. */
+gs_raster_depth_plane
+DepthPlaneForTriangle(gs_raster_depth_buffer *Buffer, gs_raster_triangle *Unsnapped, gs_raster_depth *Depth)
+{
+        gs_raster_triangle Snapped = SnappedTriangle(Unsnapped);
+        gs_raster_triangle *Triangle = &Snapped;
+
+        float Z[3];
+        for(int Index = 0; Index < 3; Index++)
+        {
+                float Value = Depth->Z[Index];
+                if(Value < 0.0f) Value = 0.0f;
+                if(Value > 1.0f) Value = 1.0f;
+                Z[Index] = Value * Buffer->Far;
+        }
+
+        gs_raster_depth_plane Result;
+        Result.MinZ = fminf(Z[0], fminf(Z[1], Z[2]));
+        Result.MaxZ = fmaxf(Z[0], fmaxf(Z[1], Z[2]));
+
+        float X1 = Triangle->X2 - Triangle->X1;
+        float Y1 = Triangle->Y2 - Triangle->Y1;
+        float X2 = Triangle->X3 - Triangle->X1;
+        float Y2 = Triangle->Y3 - Triangle->Y1;
+        float Area = (X1 * Y2) - (X2 * Y1);
+        if(Area == 0.0f)
+        {
+                /* Degenerate triangles draw nothing; any plane will do. */
+                Result.DzDx = 0.0f;
+                Result.DzDy = 0.0f;
+                Result.Base = Result.MinZ;
+                return(Result);
+        }
+
+        float Z1 = Z[1] - Z[0];
+        float Z2 = Z[2] - Z[0];
+        Result.DzDx = ((Z1 * Y2) - (Z2 * Y1)) / Area;
+        Result.DzDy = ((Z2 * X1) - (Z1 * X2)) / Area;
+        Result.Base = Z[0] - (Result.DzDx * (Triangle->X1 - 0.5f)) - (Result.DzDy * (Triangle->Y1 - 0.5f));
+
+        return(Result);
+}
+
+/* RowBase is Plane->Base + Plane->DzDy * Y for the pixel's row. */
+float
+DepthAt(gs_raster_depth_plane *Plane, float RowBase, int X)
+{
+        float Result = RowBase + (Plane->DzDx * (float)X);
+        if(Result < Plane->MinZ) Result = Plane->MinZ;
+        if(Result > Plane->MaxZ) Result = Plane->MaxZ;
+        return(Result);
+}
+
+/* Stored-value bounds of the plane over the inclusive rectangle; see gs_raster_depth_plane. */
+void
+DepthRangeOverRect(gs_raster_depth_buffer *Buffer, gs_raster_depth_plane *Plane, int X0, int Y0, int X1, int Y1, float *MinZ, float *MaxZ)
+{
+        float Top = Plane->Base + (Plane->DzDy * (float)Y0);
+        float Bottom = Plane->Base + (Plane->DzDy * (float)Y1);
+        float Corners[4] = { DepthAt(Plane, Top, X0), DepthAt(Plane, Top, X1),
+                             DepthAt(Plane, Bottom, X0), DepthAt(Plane, Bottom, X1) };
+
+        float Min = Corners[0];
+        float Max = Corners[0];
+        for(int Index = 1; Index < 4; Index++)
+        {
+                if(Corners[Index] < Min) Min = Corners[Index];
+                if(Corners[Index] > Max) Max = Corners[Index];
+        }
+
+        *MinZ = DepthQuantize(Buffer, Min);
+        *MaxZ = DepthQuantize(Buffer, Max);
+}
+
+/* Resets the stored depths of [X0, X1) x [Y0, Y1) to far. */
+void
+DepthBufferClearValues(gs_raster_depth_buffer *Buffer, int X0, int Y0, int X1, int Y1)
+{
+        for(int Row = Y0; Row < Y1; Row++)
+        {
+                if(Buffer->Format == GS_RASTER_DEPTH_16)
+                {
+                        uint16_t *Values = (uint16_t *)Buffer->Values + (Row * Buffer->Width);
+                        for(int X = X0; X < X1; X++) Values[X] = 0xFFFF;
+                }
+                else
+                {
+                        float *Values = (float *)Buffer->Values + (Row * Buffer->Width);
+                        for(int X = X0; X < X1; X++) Values[X] = 1.0f;
+                }
+        }
+}
+
+//------------------------------------------------------------------------------
+// Triangle Stack Operations
+//------------------------------------------------------------------------------
+
+void
+TriangleStackInit(gs_raster_triangle_stack **Stack, int Capacity, void *Memory)
+{
+        Assert(Memory != NULL);
+        *Stack = (gs_raster_triangle_stack *)Memory;
+
+        gs_raster_triangle_stack *StackPointer = *Stack;
+        void *MemoryOffset = (char *)Memory + sizeof(gs_raster_triangle_stack);
+        StackPointer->Stack = (int *)MemoryOffset;
+        StackPointer->Head = 0;
+        StackPointer->Capacity = Capacity;
+        StackPointer->Layers = NULL;
+}
+
+bool
+TriangleStackIsEmpty(gs_raster_triangle_stack *Stack)
+{
+        return(Stack->Head == 0);
+}
+
+unsigned int
+TriangleStackSize(gs_raster_triangle_stack *Stack)
+{
+        return(Stack->Head);
+}
+
+bool
+TriangleStackPush(gs_raster_triangle_stack *Stack, int Object)
+{
+        Assert(Stack->Head < Stack->Capacity);
+        ++Stack->Head;
+        Stack->Stack[Stack->Head] = Object;
+        return(true);
+}
+
+int
+TriangleStackPop(gs_raster_triangle_stack *Stack)
+{
+        Assert(Stack->Head > 0);
+        int Result = Stack->Stack[Stack->Head];
+        --Stack->Head;
+
+        return(Result);
+}
+
+/* Returns -1 when the stack is empty. */
+int
+TriangleStackTop(gs_raster_triangle_stack *Stack)
+{
+        if(Stack->Head == 0)
+        {
+                return(-1);
+        }
+
+        return(Stack->Stack[Stack->Head]);
+}
+
+bool
+TriangleStackRemove(gs_raster_triangle_stack *Stack, int Object)
+{
+        int index = -1;
+        for(int i=1; i <= Stack->Head; ++i)
+        {
+                if(Stack->Stack[i] == Object)
+                {
+                        index = i;
+                        break;
+                }
+        }
+
+        if(index < 0)
+        {
+                return(false);
+        }
+
+        for(int i=index; i < Stack->Head; ++i)
+        {
+                Stack->Stack[i] = Stack->Stack[i+1];
+        }
+        --Stack->Head;
+
+        return(true);
+}
+
+//------------------------------------------------------------------------------
+// Ray, Point and other similar operations
+//------------------------------------------------------------------------------
+
+float
+VectorLength(vector2d V)
+{
+        float Result = sqrt((V.X * V.X) + (V.Y * V.Y));
+        return(Result);
+}
+
+vector2d
+VectorNormalize(vector2d V)
+{
+        float Factor = 1.0 / VectorLength(V);
+        vector2d Result;
+        Result.X = V.X * Factor;
+        Result.Y = V.Y * Factor;
+        return(Result);
+}
+
+float
+VectorDotProduct(vector2d A, vector2d B)
+{
+        float Result = (A.X * B.X) + (A.Y * B.Y);
+        return(Result);
+}
+
+gs_raster_point2d
+Apply(gs_raster_point2d Point, float T)
+{
+        gs_raster_point2d Result;
+        Result.X = Point.X * T;
+        Result.Y = Point.Y * T;
+        return(Result);
+}
+
+vector2d
+VectorProjection(vector2d Source, vector2d Destination)
+{
+        float DestLength = VectorLength(Destination);
+        float DotProduct = VectorDotProduct(Source, Destination);
+        float Scalar = DotProduct / (DestLength * DestLength);
+        vector2d Result = Apply(Destination, Scalar);
+
+        return(Result);
+}
+
+gs_raster_point2d
+Add(gs_raster_point2d First, gs_raster_point2d Second)
+{
+        gs_raster_point2d Result;
+        Result.X = First.X + Second.X;
+        Result.Y = First.Y + Second.Y;
+        return(Result);
+}
+
+gs_raster_point2d
+Evaluate(ray2d Ray, float T)
+{
+        vector2d Applied = Apply(Ray.Dir, T);
+        gs_raster_point2d Result = Add(Ray.Pos, Applied);
+        return(Result);
+}
+
+gs_raster_point2d
+Subtract(gs_raster_point2d Minuend, gs_raster_point2d Subtrahend)
+{
+        gs_raster_point2d Result;
+        Result.X = Minuend.X - Subtrahend.X;
+        Result.Y = Minuend.Y - Subtrahend.Y;
+        return(Result);
+}
+
+line_segment
+FromPoints(gs_raster_point2d Start, gs_raster_point2d End)
+{
+        line_segment Result;
+        Result.Start = Start;
+        Result.End = End;
+        return(Result);
+}
+
+ray2d
+FromLineSegment(line_segment Segment)
+{
+        ray2d Result;
+        Result.Pos = Segment.Start;
+        Result.Dir = Subtract(Segment.End, Segment.Start);
+        return(Result);
+}
+
+line_segment
+FromEdge(edge Edge)
+{
+        line_segment Result = FromPoints(Edge.Start, Edge.End);
+        return(Result);
+}
+
+
+void
+GsRasterReorderTriangle(gs_raster_triangle *Unordered)
+{
+        // Counter-clockwise.
+        // Bottom-left starting.
+
+        gs_raster_triangle Temp;
+
+        if(Unordered->A.Y > Unordered->B.Y && Unordered->A.Y > Unordered->C.Y)
+        {
+                ;
+        }
+        else if(Unordered->B.Y > Unordered->A.Y && Unordered->B.Y > Unordered->C.Y)
+        {
+                Temp.A = Unordered->B;
+                Temp.B = Unordered->C;
+                Temp.C = Unordered->A;
+                Unordered->A = Temp.A;
+                Unordered->B = Temp.B;
+                Unordered->C = Temp.C;
+        }
+        else
+        {
+                Temp.A = Unordered->C;
+                Temp.B = Unordered->A;
+                Temp.C = Unordered->B;
+                Unordered->A = Temp.A;
+                Unordered->B = Temp.B;
+                Unordered->C = Temp.C;
+        }
+}
+
+gs_raster_triangle_edges
+FromTriangle(gs_raster_triangle Triangle)
+{
+        gs_raster_triangle_edges Result;
+
+        Result.Edges[0].Start = Triangle.Point[0];
+        Result.Edges[0].End = Triangle.Point[1];
+
+        Result.Edges[1].Start = Triangle.Point[1];
+        Result.Edges[1].End = Triangle.Point[2];
+
+        Result.Edges[2].Start = Triangle.Point[2];
+        Result.Edges[2].End = Triangle.Point[0];
+
+        return(Result);
+}
+
+//------------------------------------------------------------------------------
+// Edge Table Operations
+//------------------------------------------------------------------------------
+
+/*
+ * An edge stepped one scanline at a time in exact integer arithmetic.  On
+ * row Y the edge crosses the row's pixel centers at the first covered column
+ * ceil(N(Y) / Denominator), where the numerator N grows by a constant per
+ * row.  The numerator is carried as a quotient and remainder, so stepping a
+ * row costs two adds and a compare and never leaves 32-bit registers.
+ */
+struct gs_raster_edge
+{
+        int YStart; /* First scanline whose pixel centers the edge covers. */
+        int YEnd; /* First scanline no longer covered by this edge. */
+        int32_t Quotient; /* N(YStart) is Quotient * Denominator + Remainder ... */
+        int32_t Remainder; /* ... with Remainder in [0, Denominator). */
+        int32_t Denominator; /* Positive. */
+        int32_t StepQuotient; /* N(Y + 1) - N(Y) is StepQuotient * Denominator + StepRemainder. */
+        int32_t StepRemainder; /* In [0, Denominator). */
+        int Triangle; /* Index into the triangle list. */
+        struct gs_raster_edge *Next; /* Next edge starting on the same scanline. */
+};
+typedef struct gs_raster_edge gs_raster_edge;
+
+struct gs_raster_edge_table
+{
+        gs_raster_edge *Edges;
+        int NumEdges;
+        gs_raster_edge **Buckets; /* One list of starting edges per scanline. */
+        int NumBuckets;
+};
+typedef struct gs_raster_edge_table gs_raster_edge_table;
+
+/*
+ * The fan of pieces DrawClip cuts a triangle's polygon into, consecutive in
+ * the draw: the index of the first and how many there are.  The scanline
+ * engine draws the fan as one shape, under the index of its first piece,
+ * from the polygon's boundary edges alone; see EdgesForShape.
+ */
+struct gs_raster_shape
+{
+        int First;
+        int Count;
+};
+typedef struct gs_raster_shape gs_raster_shape;
+
+struct gs_raster_active_edge
+{
+        int32_t Quotient; /* N(Y) at the current scanline, as in gs_raster_edge. */
+        int32_t Remainder;
+        gs_raster_edge *Edge;
+};
+typedef struct gs_raster_active_edge gs_raster_active_edge;
+
+/* The intersection's column at the current scanline; see gs_raster_triangle_intersection. */
+int
+ActiveEdgeColumn(gs_raster_active_edge *Edge)
+{
+        int Result = Edge->Quotient + (Edge->Remainder > 0);
+        return(Result);
+}
+
+/*
+ * Edges crossing the current scanline, sorted by column.  Each thread owns one, so
+ * the edge table itself stays read-only while scanlines are generated.
+ */
+struct gs_raster_active_list
+{
+        gs_raster_active_edge *Edges;
+        int Count;
+        int Capacity; /* Matches the scanline capacity; one intersection per edge. */
+};
+typedef struct gs_raster_active_list gs_raster_active_list;
+
+int
+EdgeTableSizeRequired(int NumTriangles, int NumScanlines)
+{
+        int MaxEdges = NumTriangles * 3;
+        int Result = (sizeof(gs_raster_edge) * MaxEdges +
+                      sizeof(gs_raster_edge *) * NumScanlines);
+        return(Result);
+}
+
+void
+EdgeTableInit(gs_raster_edge_table *Table, int NumTriangles, int NumScanlines, void *Memory)
+{
+        Assert(Memory != NULL);
+        int MaxEdges = NumTriangles * 3;
+
+        Table->Edges = (gs_raster_edge *)Memory;
+        Table->NumEdges = 0;
+        Table->Buckets = (gs_raster_edge **)(Table->Edges + MaxEdges);
+        Table->NumBuckets = NumScanlines;
+
+        for(int Index = 0; Index < NumScanlines; Index++)
+        {
+                Table->Buckets[Index] = NULL;
+        }
+}
+
+/*
+ * Computes the scanline range and stepping terms of the edge between two
+ * snapped vertices.  Edges cover the rows whose pixel centers lie in
+ * [Top.Y, Bottom.Y), so shared vertices produce exactly one intersection per
+ * triangle, horizontal edges produce none, and a center exactly on a
+ * horizontal edge belongs to the triangle below it.  Likewise the column
+ * rounds up from the crossing, so a center exactly on an edge belongs to
+ * the triangle on its right.  YStart >= YEnd marks an edge that covers no
+ * scanlines of the destination.
+ */
+void
+EdgeSetup(gs_raster_edge *Result, gs_raster_fixed_point Start, gs_raster_fixed_point End, int Triangle, int NumScanlines)
+{
+        gs_raster_fixed_point Top = Start;
+        gs_raster_fixed_point Bottom = End;
+        if(Top.Y > Bottom.Y)
+        {
+                Top = End;
+                Bottom = Start;
+        }
+
+        Result->Triangle = Triangle;
+        Result->YStart = FirstPixelAtOrAfter(Top.Y);
+        Result->YEnd = FirstPixelAtOrAfter(Bottom.Y);
+        if(Result->YStart < 0) Result->YStart = 0;
+        if(Result->YEnd > NumScanlines) Result->YEnd = NumScanlines;
+        if(Result->YStart >= Result->YEnd)
+        {
+                Result->Denominator = 1;
+                return;
+        }
+
+        /*
+         * The crossing on the row through subpixel Y is
+         * Top.X + (Y - Top.Y) * Dx / Dy, and its column rounds up from there
+         * less half a pixel.  Over the common denominator Dy * ONE:
+         * N(Row) = (Row * ONE + HALF - Top.Y) * Dx + (Top.X - HALF) * Dy.
+         */
+        int64_t Dx = (int64_t)Bottom.X - Top.X;
+        int64_t Dy = (int64_t)Bottom.Y - Top.Y;
+        int64_t Step = Dx * GS_RASTER_SUBPIXEL_ONE;
+        int64_t CenterY = ((int64_t)Result->YStart * GS_RASTER_SUBPIXEL_ONE) + GS_RASTER_SUBPIXEL_HALF;
+
+        int64_t Numerator = ((CenterY - Top.Y) * Dx) + (((int64_t)Top.X - GS_RASTER_SUBPIXEL_HALF) * Dy);
+        Result->Denominator = (int32_t)(Dy * GS_RASTER_SUBPIXEL_ONE);
+        Result->Quotient = (int32_t)FloorDivide(Numerator, Result->Denominator);
+        Result->Remainder = (int32_t)(Numerator - ((int64_t)Result->Quotient * Result->Denominator));
+        Result->StepQuotient = (int32_t)FloorDivide(Step, Result->Denominator);
+        Result->StepRemainder = (int32_t)(Step - ((int64_t)Result->StepQuotient * Result->Denominator));
+}
+
+/* Fills the three edge table records of the triangle with the given index. */
+void
+EdgesForTriangle(gs_raster_edge Edges[3], gs_raster_fixed_triangle *Triangle, int Index, int NumScanlines)
+{
+        for(int EdgeIndex = 0; EdgeIndex < 3; EdgeIndex++)
+        {
+                EdgeSetup(&Edges[EdgeIndex], Triangle->Point[EdgeIndex], Triangle->Point[(EdgeIndex + 1) % 3], Index, NumScanlines);
+        }
+}
+
+/*
+ * Whether edge EdgeIndex of the piece at Index lies inside its fan: piece
+ * I is (P0, P[I + 1], P[I + 2]), so its first edge is shared with the piece
+ * before and its last with the piece after.
+ */
+bool
+EdgeInsideShape(gs_raster_shape *Shape, int Index, int EdgeIndex)
+{
+        bool Result = ((EdgeIndex == 0 && Index > Shape->First) ||
+                       (EdgeIndex == 2 && Index < Shape->First + Shape->Count - 1));
+        return(Result);
+}
+
+/*
+ * Makes the edges of the piece at Index part of its shape: the edges inside
+ * the fan cover no scanlines, and the rest belong to the shape's first
+ * piece, so each row crossing the shape still has just two intersections.
+ */
+void
+EdgesForShape(gs_raster_edge Edges[3], gs_raster_shape *Shape, int Index)
+{
+        for(int EdgeIndex = 0; EdgeIndex < 3; EdgeIndex++)
+        {
+                Edges[EdgeIndex].Triangle = Shape->First;
+                if(EdgeInsideShape(Shape, Index, EdgeIndex)) Edges[EdgeIndex].YEnd = Edges[EdgeIndex].YStart;
+        }
+}
+
+/* Links each edge that covers any scanline into the bucket of its first scanline. */
+void
+EdgeTableBucket(gs_raster_edge_table *Table)
+{
+        for(int Index = 0; Index < Table->NumEdges; Index++)
+        {
+                gs_raster_edge *Edge = &Table->Edges[Index];
+                if(Edge->YStart >= Edge->YEnd) continue;
+
+                Edge->Next = Table->Buckets[Edge->YStart];
+                Table->Buckets[Edge->YStart] = Edge;
+        }
+}
+
+/* Positions the active edge on the given row of its edge; past the first row this costs a division. */
+void
+ActiveEdgeSeek(gs_raster_active_edge *Active, gs_raster_edge *Edge, int Row)
+{
+        Active->Edge = Edge;
+        Active->Quotient = Edge->Quotient;
+        Active->Remainder = Edge->Remainder;
+        if(Row == Edge->YStart) return;
+
+        int64_t Rows = Row - Edge->YStart;
+        int64_t Remainder = Edge->Remainder + (Rows * Edge->StepRemainder);
+        int64_t Carry = FloorDivide(Remainder, Edge->Denominator);
+        Active->Quotient += (int32_t)((Rows * Edge->StepQuotient) + Carry);
+        Active->Remainder = (int32_t)(Remainder - (Carry * Edge->Denominator));
+}
+
+/* Orders by column, breaking ties by position in the edge table. */
+bool
+ActiveEdgeLess(gs_raster_active_edge *Left, gs_raster_active_edge *Right)
+{
+        int LeftX = ActiveEdgeColumn(Left);
+        int RightX = ActiveEdgeColumn(Right);
+        bool Result = ((LeftX < RightX) ||
+                       (LeftX == RightX && Left->Edge < Right->Edge));
+        return(Result);
+}
+
+/*
+ * Seeds the active list with the edges that started above Row and still cover
+ * it, positioned on the row before.  Only the edges of the given triangles
+ * are considered; they must include every triangle crossing Row.
+ */
+void
+EdgeTableEnter(gs_raster_edge_table *Table, gs_raster_active_list *Active, int Row, int *Triangles, int NumTriangles)
+{
+        Active->Count = 0;
+
+        for(int Index = 0; Index < NumTriangles; Index++)
+        {
+                gs_raster_edge *Edges = &Table->Edges[Triangles[Index] * 3];
+                for(int EdgeIndex = 0; EdgeIndex < 3; EdgeIndex++)
+                {
+                        gs_raster_edge *Edge = &Edges[EdgeIndex];
+                        if(Edge->YStart < Row && Edge->YEnd > Row)
+                        {
+                                /* A full list drops the edge, as EdgeTableAdvance does. */
+                                if(Active->Count >= Active->Capacity)
+                                {
+                                        StatsCount(Overflows, 1);
+                                        continue;
+                                }
+                                ActiveEdgeSeek(&Active->Edges[Active->Count++], Edge, Row - 1);
+                        }
+                }
+        }
+}
+
+/*
+ * Moves the active edge list from the previous scanline onto the given one:
+ * retires edges that have ended, steps the rest, pulls in edges starting here
+ * and restores column ordering.  Stepping is exact, so a row's intersections do
+ * not depend on which row the list was seeded at.  Edges only swap order
+ * where they cross, so insertion sort stays close to linear.
+ */
+void
+EdgeTableAdvance(gs_raster_edge_table *Table, gs_raster_active_list *Active, int Row)
+{
+        int Count = 0;
+        for(int Index = 0; Index < Active->Count; Index++)
+        {
+                gs_raster_active_edge Edge = Active->Edges[Index];
+                if(Edge.Edge->YEnd <= Row) continue;
+
+                /* Branch-free; the carry is as unpredictable as the edge's slope. */
+                Edge.Remainder += Edge.Edge->StepRemainder;
+                int32_t Carry = (Edge.Remainder >= Edge.Edge->Denominator);
+                Edge.Quotient += Edge.Edge->StepQuotient + Carry;
+                Edge.Remainder -= Edge.Edge->Denominator & -Carry;
+                Active->Edges[Count++] = Edge;
+        }
+
+        for(gs_raster_edge *Edge = Table->Buckets[Row]; Edge != NULL; Edge = Edge->Next)
+        {
+                /*
+                 * Edges beyond the capacity are dropped.  The rows they cross
+                 * then draw wrongly, but nothing is written out of bounds.
+                 */
+                if(Count >= Active->Capacity)
+                {
+                        StatsCount(Overflows, 1);
+                        continue;
+                }
+                ActiveEdgeSeek(&Active->Edges[Count++], Edge, Row);
+        }
+        Active->Count = Count;
+
+        for(int Index = 1; Index < Count; Index++)
+        {
+                gs_raster_active_edge Edge = Active->Edges[Index];
+                int Insert = Index;
+                while(Insert > 0 && ActiveEdgeLess(&Edge, &Active->Edges[Insert - 1]))
+                {
+                        Active->Edges[Insert] = Active->Edges[Insert - 1];
+                        Insert--;
+                }
+                Active->Edges[Insert] = Edge;
+        }
+}
+
+//------------------------------------------------------------------------------
+// SIMD Kernels
+//------------------------------------------------------------------------------
+
+/*
+ * The innermost loops come in scalar, SSE2 and AVX2 variants.  All variants
+ * perform the same operations in the same order, so they produce
+ * bit-identical output.  The widest set the CPU supports is chosen once from
+ * CPUID, and callers go through the Kernels table.
+ *
+ * The rest of the file is built for plain SSE, so AVX2 variants clear the
+ * upper halves of the registers before handing their tails on or returning;
+ * GCC does not always do so for functions given a target attribute, and
+ * every SSE instruction after that pays for the transition.
+ */
+struct gs_raster_kernels
+{
+        gs_raster_simd Level;
+
+        /* Writes Count copies of Color. */
+        void (*FillSpan)(int *Pixels, int Count, gs_raster_color Color);
+
+        /* Writes Count pixels whose 8.16 fixed-point channels start at Value and step by Delta. */
+        void (*ShadeSpan)(int *Pixels, int Count, int32_t Value[4], int32_t Delta[4]);
+
+        /*
+         * Bit I is set when E[K] + A[K] * I >= 0 for all three edges.
+         * Count <= 32, and no E[K] + A[K] * I may overflow.
+         */
+        uint32_t (*CoverageMask)(int32_t E[3], int32_t A[3], int Count);
+
+        /* Snaps Count coordinates to the subpixel grid; see SnapCoordinatesScalar. */
+        void (*SnapCoordinates)(float *Coordinates, int32_t *Fixed, int Count);
+
+        /* Blends Count copies of the premultiplied Color over the pixels; see BlendColor. */
+        void (*BlendFillSpan)(int *Pixels, int Count, gs_raster_color Color);
+
+        /* Blends Count premultiplied Source pixels over the pixels; see BlendColor. */
+        void (*BlendSpan)(int *Pixels, int *Source, int Count);
+
+        /* Premultiplies Count pixels in place; see PremultiplyColor. */
+        void (*PremultiplySpan)(int *Pixels, int Count);
+
+        /* Copies Count Source pixels, with streaming stores where it can; the copy is not read back. */
+        void (*CopySpan)(int *Pixels, int *Source, int Count);
+
+        /* As CopySpan, packing each pixel as GS_RASTER_FORMAT_RGB565 or GS_RASTER_FORMAT_INDEX8. */
+        void (*PackSpanRgb565)(uint16_t *Pixels, int *Source, int Count);
+        void (*PackSpanIndex8)(uint8_t *Pixels, int *Source, int Count);
+
+        /* Transforms Count vertices from First on into Screen; see TransformVerticesScalar. */
+        void (*TransformVertices)(float Matrix[4][4], gs_raster_vertices *Vertices, int First, int Count, gs_raster_vertices *Screen);
+};
+typedef struct gs_raster_kernels gs_raster_kernels;
+
+/*
+ * Spans at least this many pixels wide bypass the cache with streaming
+ * stores.  Threads drawing a band that is packed into another format as soon
+ * as it is done raise their own threshold, since the band is read back.
+ */
+#define GS_RASTER_STREAMING_SPAN 256
+
+/*
+ * Shorter spans are shaded by ShadeSpanScalar: setting up the vector
+ * channels costs more than a vector's worth of scalar pixels, and dense
+ * geometry is mostly short spans.
+ */
+#define GS_RASTER_SSE2_MIN_SHADE 4
+#define GS_RASTER_AVX2_MIN_SHADE 8
+global_variable _Thread_local int StreamingSpan = GS_RASTER_STREAMING_SPAN;
+
+void
+FillSpanScalar(int *Pixels, int Count, gs_raster_color Color)
+{
+        while(Count > 0)
+        {
+                *Pixels++ = Color;
+                Count--;
+        }
+}
+
+gs_raster_color
+PackChannels(int32_t Value[4])
+{
+        gs_raster_color Result = ((((uint32_t)Value[0] >> GS_RASTER_GRADIENT_SHIFT)) |
+                                  (((uint32_t)Value[1] >> GS_RASTER_GRADIENT_SHIFT) << 8) |
+                                  (((uint32_t)Value[2] >> GS_RASTER_GRADIENT_SHIFT) << 16) |
+                                  (((uint32_t)Value[3] >> GS_RASTER_GRADIENT_SHIFT) << 24));
+        return(Result);
+}
+
+void
+ShadeSpanScalar(int *Pixels, int Count, int32_t Value[4], int32_t Delta[4])
+{
+        int32_t Current[4] = { Value[0], Value[1], Value[2], Value[3] };
+
+        for(int Index = 0; Index < Count; Index++)
+        {
+                Pixels[Index] = PackChannels(Current);
+
+                Current[0] += Delta[0];
+                Current[1] += Delta[1];
+                Current[2] += Delta[2];
+                Current[3] += Delta[3];
+        }
+}
+
+uint32_t
+CoverageMaskScalar(int32_t E[3], int32_t A[3], int Count)
+{
+        uint32_t Result = 0;
+
+        for(int Index = 0; Index < Count; Index++)
+        {
+                if((E[0] + (A[0] * Index)) >= 0 &&
+                   (E[1] + (A[1] * Index)) >= 0 &&
+                   (E[2] + (A[2] * Index)) >= 0)
+                {
+                        Result |= (1u << Index);
+                }
+        }
+
+        return(Result);
+}
+
+void
+BlendFillSpanScalar(int *Pixels, int Count, gs_raster_color Color)
+{
+        for(int Index = 0; Index < Count; Index++)
+        {
+                Pixels[Index] = BlendColor(Pixels[Index], Color);
+        }
+}
+
+void
+BlendSpanScalar(int *Pixels, int *Source, int Count)
+{
+        for(int Index = 0; Index < Count; Index++)
+        {
+                Pixels[Index] = BlendColor(Pixels[Index], Source[Index]);
+        }
+}
+
+void
+PremultiplySpanScalar(int *Pixels, int Count)
+{
+        for(int Index = 0; Index < Count; Index++)
+        {
+                Pixels[Index] = PremultiplyColor(Pixels[Index]);
+        }
+}
+
+void
+CopySpanScalar(int *Pixels, int *Source, int Count)
+{
+        for(int Index = 0; Index < Count; Index++)
+        {
+                Pixels[Index] = Source[Index];
+        }
+}
+
+uint16_t
+PackRgb565(gs_raster_color Color)
+{
+        uint16_t Result = (uint16_t)(((Color >> 16) & 0xF800) | ((Color >> 13) & 0x07E0) | ((Color >> 11) & 0x001F));
+        return(Result);
+}
+
+uint8_t
+PackIndex8(gs_raster_color Color)
+{
+        uint8_t Result = (uint8_t)(Color >> 24);
+        return(Result);
+}
+
+/* One packing kernel per destination format, each with its pack inlined. */
+#define GS_RASTER_PACK_SPAN_SCALAR(Name, Type, Pack) \
+void \
+Name(Type *Pixels, int *Source, int Count) \
+{ \
+        for(int Index = 0; Index < Count; Index++) \
+        { \
+                Pixels[Index] = Pack((gs_raster_color)Source[Index]); \
+        } \
+}
+
+GS_RASTER_PACK_SPAN_SCALAR(PackSpanRgb565Scalar, uint16_t, PackRgb565)
+GS_RASTER_PACK_SPAN_SCALAR(PackSpanIndex8Scalar, uint8_t, PackIndex8)
+
+/*
+ * Multiplies vertices First to First + Count - 1 by Matrix, then divides the
+ * results' X, Y and Z by their W.  Screen's X, Y, Z and W arrays receive
+ * them from index 0, W holding the clip-space W.  Rows are summed left to
+ * right, and every division is exact, in every variant.
+ */
+void
+TransformVerticesScalar(float Matrix[4][4], gs_raster_vertices *Vertices, int First, int Count, gs_raster_vertices *Screen)
+{
+        for(int Index = 0; Index < Count; Index++)
+        {
+                float X = Vertices->X[First + Index];
+                float Y = Vertices->Y[First + Index];
+                float Z = Vertices->Z[First + Index];
+                float W = (Vertices->W != NULL) ? Vertices->W[First + Index] : 1.0f;
+
+                float Clip[4];
+                for(int Row = 0; Row < 4; Row++)
+                {
+                        Clip[Row] = (((Matrix[Row][0] * X) + (Matrix[Row][1] * Y)) + (Matrix[Row][2] * Z)) + (Matrix[Row][3] * W);
+                }
+                Screen->X[Index] = Clip[0] / Clip[3];
+                Screen->Y[Index] = Clip[1] / Clip[3];
+                Screen->Z[Index] = Clip[2] / Clip[3];
+                Screen->W[Index] = Clip[3];
+        }
+}
+
+#if GS_RASTER_X86
+
+GS_RASTER_TARGET("sse2")
+void
+FillSpanSse2(int *Pixels, int Count, gs_raster_color Color)
+{
+        /* Scalar head until the destination is 16-byte aligned. */
+        while(Count > 0 && ((uintptr_t)Pixels & 15) != 0)
+        {
+                *Pixels++ = Color;
+                Count--;
+        }
+
+        __m128i Wide = _mm_set1_epi32((int)Color);
+        if(Count >= StreamingSpan)
+        {
+                for(; Count >= 16; Count -= 16, Pixels += 16)
+                {
+                        _mm_stream_si128((__m128i *)Pixels + 0, Wide);
+                        _mm_stream_si128((__m128i *)Pixels + 1, Wide);
+                        _mm_stream_si128((__m128i *)Pixels + 2, Wide);
+                        _mm_stream_si128((__m128i *)Pixels + 3, Wide);
+                }
+        }
+        for(; Count >= 4; Count -= 4, Pixels += 4)
+        {
+                _mm_store_si128((__m128i *)Pixels, Wide);
+        }
+
+        FillSpanScalar(Pixels, Count, Color);
+}
+
+GS_RASTER_TARGET("sse2")
+void
+ShadeSpanSse2(int *Pixels, int Count, int32_t Value[4], int32_t Delta[4])
+{
+        if(Count < GS_RASTER_SSE2_MIN_SHADE)
+        {
+                ShadeSpanScalar(Pixels, Count, Value, Delta);
+                return;
+        }
+
+        /* Pixels 0 to 3 with channels across the lanes, transposed into one register per channel. */
+        __m128i Channels = _mm_loadu_si128((__m128i *)Value);
+        __m128i Deltas = _mm_loadu_si128((__m128i *)Delta);
+        __m128i Pixel1 = _mm_add_epi32(Channels, Deltas);
+        __m128i Pixel2 = _mm_add_epi32(Pixel1, Deltas);
+        __m128i Pixel3 = _mm_add_epi32(Pixel2, Deltas);
+        __m128i Low01 = _mm_unpacklo_epi32(Channels, Pixel1);
+        __m128i Low23 = _mm_unpacklo_epi32(Pixel2, Pixel3);
+        __m128i High01 = _mm_unpackhi_epi32(Channels, Pixel1);
+        __m128i High23 = _mm_unpackhi_epi32(Pixel2, Pixel3);
+        __m128i R = _mm_unpacklo_epi64(Low01, Low23);
+        __m128i G = _mm_unpackhi_epi64(Low01, Low23);
+        __m128i B = _mm_unpacklo_epi64(High01, High23);
+        __m128i A = _mm_unpackhi_epi64(High01, High23);
+        __m128i Steps = _mm_slli_epi32(Deltas, 2);
+        __m128i StepR = _mm_shuffle_epi32(Steps, 0x00);
+        __m128i StepG = _mm_shuffle_epi32(Steps, 0x55);
+        __m128i StepB = _mm_shuffle_epi32(Steps, 0xAA);
+        __m128i StepA = _mm_shuffle_epi32(Steps, 0xFF);
+
+        int Index = 0;
+        for(; Index + 4 <= Count; Index += 4)
+        {
+                __m128i Color = _mm_or_si128(
+                        _mm_or_si128(_mm_srli_epi32(R, GS_RASTER_GRADIENT_SHIFT),
+                                     _mm_slli_epi32(_mm_srli_epi32(G, GS_RASTER_GRADIENT_SHIFT), 8)),
+                        _mm_or_si128(_mm_slli_epi32(_mm_srli_epi32(B, GS_RASTER_GRADIENT_SHIFT), 16),
+                                     _mm_slli_epi32(_mm_srli_epi32(A, GS_RASTER_GRADIENT_SHIFT), 24)));
+                _mm_storeu_si128((__m128i *)(Pixels + Index), Color);
+
+                R = _mm_add_epi32(R, StepR);
+                G = _mm_add_epi32(G, StepG);
+                B = _mm_add_epi32(B, StepB);
+                A = _mm_add_epi32(A, StepA);
+        }
+
+        int32_t Tail[4];
+        for(int Channel = 0; Channel < 4; Channel++)
+        {
+                Tail[Channel] = Value[Channel] + (Index * Delta[Channel]);
+        }
+        ShadeSpanScalar(Pixels + Index, Count - Index, Tail, Delta);
+}
+
+GS_RASTER_TARGET("sse2")
+uint32_t
+CoverageMaskSse2(int32_t E[3], int32_t A[3], int Count)
+{
+        __m128i Negative = _mm_set1_epi32(-1);
+        __m128i Edge[3];
+        __m128i Step[3];
+        for(int Index = 0; Index < 3; Index++)
+        {
+                Edge[Index] = _mm_setr_epi32(E[Index], E[Index] + A[Index], E[Index] + (2 * A[Index]), E[Index] + (3 * A[Index]));
+                Step[Index] = _mm_set1_epi32(4 * A[Index]);
+        }
+
+        uint32_t Result = 0;
+        for(int Base = 0; Base < Count; Base += 4)
+        {
+                __m128i Inside = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi32(Edge[0], Negative),
+                                                             _mm_cmpgt_epi32(Edge[1], Negative)),
+                                               _mm_cmpgt_epi32(Edge[2], Negative));
+                Result |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(Inside)) << Base;
+
+                for(int Index = 0; Index < 3; Index++)
+                {
+                        Edge[Index] = _mm_add_epi32(Edge[Index], Step[Index]);
+                }
+        }
+
+        if(Count < 32) Result &= (1u << Count) - 1;
+        return(Result);
+}
+
+/* Four coordinates per instruction; cvtps2dq rounds to nearest even like rintf. */
+GS_RASTER_TARGET("sse2")
+void
+SnapCoordinatesSse2(float *Coordinates, int32_t *Fixed, int Count)
+{
+        __m128 Scale = _mm_set1_ps((float)GS_RASTER_SUBPIXEL_ONE);
+        __m128 Low = _mm_set1_ps(-(float)GS_RASTER_SUBPIXEL_LIMIT);
+        __m128 High = _mm_set1_ps((float)GS_RASTER_SUBPIXEL_LIMIT);
+
+        int Index = 0;
+        for(; Index + 4 <= Count; Index += 4)
+        {
+                __m128 Value = _mm_mul_ps(_mm_loadu_ps(Coordinates + Index), Scale);
+                /* maxps returns its second operand for NaN, matching the scalar clamp. */
+                Value = _mm_min_ps(_mm_max_ps(Value, Low), High);
+                _mm_storeu_si128((__m128i *)(Fixed + Index), _mm_cvtps_epi32(Value));
+        }
+
+        SnapCoordinatesScalar(Coordinates + Index, Fixed + Index, Count - Index);
+}
+
+/* Four vertices per instruction, each matrix entry broadcast. */
+GS_RASTER_TARGET("sse2")
+void
+TransformVerticesSse2(float Matrix[4][4], gs_raster_vertices *Vertices, int First, int Count, gs_raster_vertices *Screen)
+{
+        int Index = 0;
+        for(; Index + 4 <= Count; Index += 4)
+        {
+                __m128 X = _mm_loadu_ps(Vertices->X + First + Index);
+                __m128 Y = _mm_loadu_ps(Vertices->Y + First + Index);
+                __m128 Z = _mm_loadu_ps(Vertices->Z + First + Index);
+                __m128 W = (Vertices->W != NULL) ? _mm_loadu_ps(Vertices->W + First + Index) : _mm_set1_ps(1.0f);
+
+                __m128 Clip[4];
+                for(int Row = 0; Row < 4; Row++)
+                {
+                        Clip[Row] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(Matrix[Row][0]), X),
+                                                                     _mm_mul_ps(_mm_set1_ps(Matrix[Row][1]), Y)),
+                                                          _mm_mul_ps(_mm_set1_ps(Matrix[Row][2]), Z)),
+                                               _mm_mul_ps(_mm_set1_ps(Matrix[Row][3]), W));
+                }
+                _mm_storeu_ps(Screen->X + Index, _mm_div_ps(Clip[0], Clip[3]));
+                _mm_storeu_ps(Screen->Y + Index, _mm_div_ps(Clip[1], Clip[3]));
+                _mm_storeu_ps(Screen->Z + Index, _mm_div_ps(Clip[2], Clip[3]));
+                _mm_storeu_ps(Screen->W + Index, Clip[3]);
+        }
+
+        gs_raster_vertices Rest = { Screen->X + Index, Screen->Y + Index, Screen->Z + Index, Screen->W + Index };
+        TransformVerticesScalar(Matrix, Vertices, First + Index, Count - Index, &Rest);
+}
+
+GS_RASTER_TARGET("sse2")
+void
+FenceSse2()
+{
+        _mm_sfence();
+}
+
+/*
+ * The blend kernels widen pixels to 16 bits per channel, two pixels per
+ * register half, and multiply with the same rounding as MultiplyChannel.
+ */
+GS_RASTER_TARGET("sse2")
+__m128i
+MultiplyChannelsSse2(__m128i X, __m128i A)
+{
+        __m128i T = _mm_add_epi16(_mm_mullo_epi16(X, A), _mm_set1_epi16(128));
+        __m128i Result = _mm_srli_epi16(_mm_add_epi16(T, _mm_srli_epi16(T, 8)), 8);
+        return(Result);
+}
+
+/* Each widened pixel's alpha in all four of its channels. */
+GS_RASTER_TARGET("sse2")
+__m128i
+BroadcastAlphaSse2(__m128i Wide)
+{
+        __m128i Result = _mm_shufflehi_epi16(_mm_shufflelo_epi16(Wide, 0x00), 0x00);
+        return(Result);
+}
+
+GS_RASTER_TARGET("sse2")
+__m128i
+BlendPixelsSse2(__m128i Dest, __m128i Source, __m128i InverseLow, __m128i InverseHigh)
+{
+        __m128i Zero = _mm_setzero_si128();
+        __m128i Low = MultiplyChannelsSse2(_mm_unpacklo_epi8(Dest, Zero), InverseLow);
+        __m128i High = MultiplyChannelsSse2(_mm_unpackhi_epi8(Dest, Zero), InverseHigh);
+        __m128i Result = _mm_adds_epu8(Source, _mm_packus_epi16(Low, High));
+        return(Result);
+}
+
+GS_RASTER_TARGET("sse2")
+void
+BlendFillSpanSse2(int *Pixels, int Count, gs_raster_color Color)
+{
+        __m128i Source = _mm_set1_epi32((int)Color);
+        __m128i Inverse = _mm_set1_epi16((short)(255 - (Color & 0xFF)));
+
+        int Index = 0;
+        for(; Index + 4 <= Count; Index += 4)
+        {
+                __m128i Dest = _mm_loadu_si128((__m128i *)(Pixels + Index));
+                _mm_storeu_si128((__m128i *)(Pixels + Index), BlendPixelsSse2(Dest, Source, Inverse, Inverse));
+        }
+
+        BlendFillSpanScalar(Pixels + Index, Count - Index, Color);
+}
+
+GS_RASTER_TARGET("sse2")
+void
+BlendSpanSse2(int *Pixels, int *Source, int Count)
+{
+        __m128i Zero = _mm_setzero_si128();
+        __m128i Max = _mm_set1_epi16(255);
+
+        int Index = 0;
+        for(; Index + 4 <= Count; Index += 4)
+        {
+                __m128i Dest = _mm_loadu_si128((__m128i *)(Pixels + Index));
+                __m128i Color = _mm_loadu_si128((__m128i *)(Source + Index));
+                __m128i InverseLow = _mm_sub_epi16(Max, BroadcastAlphaSse2(_mm_unpacklo_epi8(Color, Zero)));
+                __m128i InverseHigh = _mm_sub_epi16(Max, BroadcastAlphaSse2(_mm_unpackhi_epi8(Color, Zero)));
+                _mm_storeu_si128((__m128i *)(Pixels + Index), BlendPixelsSse2(Dest, Color, InverseLow, InverseHigh));
+        }
+
+        BlendSpanScalar(Pixels + Index, Source + Index, Count - Index);
+}
+
+GS_RASTER_TARGET("sse2")
+void
+PremultiplySpanSse2(int *Pixels, int Count)
+{
+        __m128i Zero = _mm_setzero_si128();
+        /* Alpha is scaled by 255, which keeps it as it is. */
+        __m128i AlphaLanes = _mm_setr_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        __m128i AlphaScale = _mm_and_si128(AlphaLanes, _mm_set1_epi16(255));
+
+        int Index = 0;
+        for(; Index + 4 <= Count; Index += 4)
+        {
+                __m128i Color = _mm_loadu_si128((__m128i *)(Pixels + Index));
+                __m128i Low = _mm_unpacklo_epi8(Color, Zero);
+                __m128i High = _mm_unpackhi_epi8(Color, Zero);
+                __m128i ScaleLow = _mm_or_si128(_mm_andnot_si128(AlphaLanes, BroadcastAlphaSse2(Low)), AlphaScale);
+                __m128i ScaleHigh = _mm_or_si128(_mm_andnot_si128(AlphaLanes, BroadcastAlphaSse2(High)), AlphaScale);
+                __m128i Result = _mm_packus_epi16(MultiplyChannelsSse2(Low, ScaleLow), MultiplyChannelsSse2(High, ScaleHigh));
+                _mm_storeu_si128((__m128i *)(Pixels + Index), Result);
+        }
+
+        PremultiplySpanScalar(Pixels + Index, Count - Index);
+}
+
+GS_RASTER_TARGET("sse2")
+void
+CopySpanSse2(int *Pixels, int *Source, int Count)
+{
+        /* Scalar head until the destination is 16-byte aligned. */
+        while(Count > 0 && ((uintptr_t)Pixels & 15) != 0)
+        {
+                *Pixels++ = *Source++;
+                Count--;
+        }
+
+        for(; Count >= 4; Count -= 4, Pixels += 4, Source += 4)
+        {
+                _mm_stream_si128((__m128i *)Pixels, _mm_loadu_si128((__m128i *)Source));
+        }
+
+        CopySpanScalar(Pixels, Source, Count);
+}
+
+/* Four RGB565 values, one in the low half of each lane, sign-extended so _mm_packs_epi32 keeps their bits. */
+GS_RASTER_TARGET("sse2")
+__m128i
+PackRgb565Sse2(__m128i Pixels)
+{
+        __m128i Red = _mm_and_si128(_mm_srli_epi32(Pixels, 16), _mm_set1_epi32(0xF800));
+        __m128i Green = _mm_and_si128(_mm_srli_epi32(Pixels, 13), _mm_set1_epi32(0x07E0));
+        __m128i Blue = _mm_and_si128(_mm_srli_epi32(Pixels, 11), _mm_set1_epi32(0x001F));
+        __m128i Result = _mm_or_si128(_mm_or_si128(Red, Green), Blue);
+        Result = _mm_srai_epi32(_mm_slli_epi32(Result, 16), 16);
+        return(Result);
+}
+
+GS_RASTER_TARGET("sse2")
+void
+PackSpanRgb565Sse2(uint16_t *Pixels, int *Source, int Count)
+{
+        while(Count > 0 && ((uintptr_t)Pixels & 15) != 0)
+        {
+                *Pixels++ = PackRgb565((gs_raster_color)*Source++);
+                Count--;
+        }
+
+        for(; Count >= 8; Count -= 8, Pixels += 8, Source += 8)
+        {
+                __m128i Low = PackRgb565Sse2(_mm_loadu_si128((__m128i *)Source + 0));
+                __m128i High = PackRgb565Sse2(_mm_loadu_si128((__m128i *)Source + 1));
+                _mm_stream_si128((__m128i *)Pixels, _mm_packs_epi32(Low, High));
+        }
+
+        PackSpanRgb565Scalar(Pixels, Source, Count);
+}
+
+GS_RASTER_TARGET("sse2")
+void
+PackSpanIndex8Sse2(uint8_t *Pixels, int *Source, int Count)
+{
+        while(Count > 0 && ((uintptr_t)Pixels & 15) != 0)
+        {
+                *Pixels++ = PackIndex8((gs_raster_color)*Source++);
+                Count--;
+        }
+
+        for(; Count >= 16; Count -= 16, Pixels += 16, Source += 16)
+        {
+                __m128i A = _mm_srli_epi32(_mm_loadu_si128((__m128i *)Source + 0), 24);
+                __m128i B = _mm_srli_epi32(_mm_loadu_si128((__m128i *)Source + 1), 24);
+                __m128i C = _mm_srli_epi32(_mm_loadu_si128((__m128i *)Source + 2), 24);
+                __m128i D = _mm_srli_epi32(_mm_loadu_si128((__m128i *)Source + 3), 24);
+                __m128i Result = _mm_packus_epi16(_mm_packs_epi32(A, B), _mm_packs_epi32(C, D));
+                _mm_stream_si128((__m128i *)Pixels, Result);
+        }
+
+        PackSpanIndex8Scalar(Pixels, Source, Count);
+}
+
+GS_RASTER_TARGET("avx2")
+void
+FillSpanAvx2(int *Pixels, int Count, gs_raster_color Color)
+{
+        /* Scalar head until the destination is 32-byte aligned. */
+        while(Count > 0 && ((uintptr_t)Pixels & 31) != 0)
+        {
+                *Pixels++ = Color;
+                Count--;
+        }
+
+        __m256i Wide = _mm256_set1_epi32((int)Color);
+        if(Count >= StreamingSpan)
+        {
+                for(; Count >= 32; Count -= 32, Pixels += 32)
+                {
+                        _mm256_stream_si256((__m256i *)Pixels + 0, Wide);
+                        _mm256_stream_si256((__m256i *)Pixels + 1, Wide);
+                        _mm256_stream_si256((__m256i *)Pixels + 2, Wide);
+                        _mm256_stream_si256((__m256i *)Pixels + 3, Wide);
+                }
+        }
+        for(; Count >= 8; Count -= 8, Pixels += 8)
+        {
+                _mm256_store_si256((__m256i *)Pixels, Wide);
+        }
+
+        FillSpanScalar(Pixels, Count, Color);
+}
+
+GS_RASTER_TARGET("avx2")
+void
+ShadeSpanAvx2(int *Pixels, int Count, int32_t Value[4], int32_t Delta[4])
+{
+        if(Count < GS_RASTER_AVX2_MIN_SHADE)
+        {
+                ShadeSpanScalar(Pixels, Count, Value, Delta);
+                return;
+        }
+
+        /* One register per channel. */
+        __m256i Lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i DeltaR = _mm256_set1_epi32(Delta[0]);
+        __m256i DeltaG = _mm256_set1_epi32(Delta[1]);
+        __m256i DeltaB = _mm256_set1_epi32(Delta[2]);
+        __m256i DeltaA = _mm256_set1_epi32(Delta[3]);
+        __m256i R = _mm256_add_epi32(_mm256_set1_epi32(Value[0]), _mm256_mullo_epi32(DeltaR, Lane));
+        __m256i G = _mm256_add_epi32(_mm256_set1_epi32(Value[1]), _mm256_mullo_epi32(DeltaG, Lane));
+        __m256i B = _mm256_add_epi32(_mm256_set1_epi32(Value[2]), _mm256_mullo_epi32(DeltaB, Lane));
+        __m256i A = _mm256_add_epi32(_mm256_set1_epi32(Value[3]), _mm256_mullo_epi32(DeltaA, Lane));
+        DeltaR = _mm256_slli_epi32(DeltaR, 3);
+        DeltaG = _mm256_slli_epi32(DeltaG, 3);
+        DeltaB = _mm256_slli_epi32(DeltaB, 3);
+        DeltaA = _mm256_slli_epi32(DeltaA, 3);
+
+        int Index = 0;
+        for(; Index + 8 <= Count; Index += 8)
+        {
+                __m256i Color = _mm256_or_si256(
+                        _mm256_or_si256(_mm256_srli_epi32(R, GS_RASTER_GRADIENT_SHIFT),
+                                        _mm256_slli_epi32(_mm256_srli_epi32(G, GS_RASTER_GRADIENT_SHIFT), 8)),
+                        _mm256_or_si256(_mm256_slli_epi32(_mm256_srli_epi32(B, GS_RASTER_GRADIENT_SHIFT), 16),
+                                        _mm256_slli_epi32(_mm256_srli_epi32(A, GS_RASTER_GRADIENT_SHIFT), 24)));
+                _mm256_storeu_si256((__m256i *)(Pixels + Index), Color);
+
+                R = _mm256_add_epi32(R, DeltaR);
+                G = _mm256_add_epi32(G, DeltaG);
+                B = _mm256_add_epi32(B, DeltaB);
+                A = _mm256_add_epi32(A, DeltaA);
+        }
+
+        int32_t Tail[4];
+        for(int Channel = 0; Channel < 4; Channel++)
+        {
+                Tail[Channel] = Value[Channel] + (Index * Delta[Channel]);
+        }
+        _mm256_zeroupper();
+        ShadeSpanSse2(Pixels + Index, Count - Index, Tail, Delta);
+}
+
+GS_RASTER_TARGET("avx2")
+uint32_t
+CoverageMaskAvx2(int32_t E[3], int32_t A[3], int Count)
+{
+        __m256i Negative = _mm256_set1_epi32(-1);
+        __m256i Lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i Edge[3];
+        __m256i Step[3];
+        for(int Index = 0; Index < 3; Index++)
+        {
+                __m256i Slope = _mm256_set1_epi32(A[Index]);
+                Edge[Index] = _mm256_add_epi32(_mm256_set1_epi32(E[Index]), _mm256_mullo_epi32(Slope, Lane));
+                Step[Index] = _mm256_slli_epi32(Slope, 3);
+        }
+
+        uint32_t Result = 0;
+        for(int Base = 0; Base < Count; Base += 8)
+        {
+                __m256i Inside = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(Edge[0], Negative),
+                                                                   _mm256_cmpgt_epi32(Edge[1], Negative)),
+                                                  _mm256_cmpgt_epi32(Edge[2], Negative));
+                Result |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(Inside)) << Base;
+
+                for(int Index = 0; Index < 3; Index++)
+                {
+                        Edge[Index] = _mm256_add_epi32(Edge[Index], Step[Index]);
+                }
+        }
+
+        if(Count < 32) Result &= (1u << Count) - 1;
+        return(Result);
+}
+
+GS_RASTER_TARGET("avx2")
+void
+SnapCoordinatesAvx2(float *Coordinates, int32_t *Fixed, int Count)
+{
+        __m256 Scale = _mm256_set1_ps((float)GS_RASTER_SUBPIXEL_ONE);
+        __m256 Low = _mm256_set1_ps(-(float)GS_RASTER_SUBPIXEL_LIMIT);
+        __m256 High = _mm256_set1_ps((float)GS_RASTER_SUBPIXEL_LIMIT);
+
+        int Index = 0;
+        for(; Index + 8 <= Count; Index += 8)
+        {
+                __m256 Value = _mm256_mul_ps(_mm256_loadu_ps(Coordinates + Index), Scale);
+                Value = _mm256_min_ps(_mm256_max_ps(Value, Low), High);
+                _mm256_storeu_si256((__m256i *)(Fixed + Index), _mm256_cvtps_epi32(Value));
+        }
+
+        _mm256_zeroupper();
+        SnapCoordinatesSse2(Coordinates + Index, Fixed + Index, Count - Index);
+}
+
+GS_RASTER_TARGET("avx2")
+void
+TransformVerticesAvx2(float Matrix[4][4], gs_raster_vertices *Vertices, int First, int Count, gs_raster_vertices *Screen)
+{
+        int Index = 0;
+        for(; Index + 8 <= Count; Index += 8)
+        {
+                __m256 X = _mm256_loadu_ps(Vertices->X + First + Index);
+                __m256 Y = _mm256_loadu_ps(Vertices->Y + First + Index);
+                __m256 Z = _mm256_loadu_ps(Vertices->Z + First + Index);
+                __m256 W = (Vertices->W != NULL) ? _mm256_loadu_ps(Vertices->W + First + Index) : _mm256_set1_ps(1.0f);
+
+                __m256 Clip[4];
+                for(int Row = 0; Row < 4; Row++)
+                {
+                        Clip[Row] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(Matrix[Row][0]), X),
+                                                                              _mm256_mul_ps(_mm256_set1_ps(Matrix[Row][1]), Y)),
+                                                                _mm256_mul_ps(_mm256_set1_ps(Matrix[Row][2]), Z)),
+                                                  _mm256_mul_ps(_mm256_set1_ps(Matrix[Row][3]), W));
+                }
+                _mm256_storeu_ps(Screen->X + Index, _mm256_div_ps(Clip[0], Clip[3]));
+                _mm256_storeu_ps(Screen->Y + Index, _mm256_div_ps(Clip[1], Clip[3]));
+                _mm256_storeu_ps(Screen->Z + Index, _mm256_div_ps(Clip[2], Clip[3]));
+                _mm256_storeu_ps(Screen->W + Index, Clip[3]);
+        }
+
+        gs_raster_vertices Rest = { Screen->X + Index, Screen->Y + Index, Screen->Z + Index, Screen->W + Index };
+        _mm256_zeroupper();
+        TransformVerticesSse2(Matrix, Vertices, First + Index, Count - Index, &Rest);
+}
+
+GS_RASTER_TARGET("avx2")
+__m256i
+MultiplyChannelsAvx2(__m256i X, __m256i A)
+{
+        __m256i T = _mm256_add_epi16(_mm256_mullo_epi16(X, A), _mm256_set1_epi16(128));
+        __m256i Result = _mm256_srli_epi16(_mm256_add_epi16(T, _mm256_srli_epi16(T, 8)), 8);
+        return(Result);
+}
+
+GS_RASTER_TARGET("avx2")
+__m256i
+BroadcastAlphaAvx2(__m256i Wide)
+{
+        __m256i Result = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(Wide, 0x00), 0x00);
+        return(Result);
+}
+
+/* Unpacking and packing both work within 128-bit lanes, so pixels come back in order. */
+GS_RASTER_TARGET("avx2")
+__m256i
+BlendPixelsAvx2(__m256i Dest, __m256i Source, __m256i InverseLow, __m256i InverseHigh)
+{
+        __m256i Zero = _mm256_setzero_si256();
+        __m256i Low = MultiplyChannelsAvx2(_mm256_unpacklo_epi8(Dest, Zero), InverseLow);
+        __m256i High = MultiplyChannelsAvx2(_mm256_unpackhi_epi8(Dest, Zero), InverseHigh);
+        __m256i Result = _mm256_adds_epu8(Source, _mm256_packus_epi16(Low, High));
+        return(Result);
+}
+
+GS_RASTER_TARGET("avx2")
+void
+BlendFillSpanAvx2(int *Pixels, int Count, gs_raster_color Color)
+{
+        __m256i Source = _mm256_set1_epi32((int)Color);
+        __m256i Inverse = _mm256_set1_epi16((short)(255 - (Color & 0xFF)));
+
+        int Index = 0;
+        for(; Index + 8 <= Count; Index += 8)
+        {
+                __m256i Dest = _mm256_loadu_si256((__m256i *)(Pixels + Index));
+                _mm256_storeu_si256((__m256i *)(Pixels + Index), BlendPixelsAvx2(Dest, Source, Inverse, Inverse));
+        }
+
+        _mm256_zeroupper();
+        BlendFillSpanSse2(Pixels + Index, Count - Index, Color);
+}
+
+GS_RASTER_TARGET("avx2")
+void
+BlendSpanAvx2(int *Pixels, int *Source, int Count)
+{
+        __m256i Zero = _mm256_setzero_si256();
+        __m256i Max = _mm256_set1_epi16(255);
+
+        int Index = 0;
+        for(; Index + 8 <= Count; Index += 8)
+        {
+                __m256i Dest = _mm256_loadu_si256((__m256i *)(Pixels + Index));
+                __m256i Color = _mm256_loadu_si256((__m256i *)(Source + Index));
+                __m256i InverseLow = _mm256_sub_epi16(Max, BroadcastAlphaAvx2(_mm256_unpacklo_epi8(Color, Zero)));
+                __m256i InverseHigh = _mm256_sub_epi16(Max, BroadcastAlphaAvx2(_mm256_unpackhi_epi8(Color, Zero)));
+                _mm256_storeu_si256((__m256i *)(Pixels + Index), BlendPixelsAvx2(Dest, Color, InverseLow, InverseHigh));
+        }
+
+        _mm256_zeroupper();
+        BlendSpanSse2(Pixels + Index, Source + Index, Count - Index);
+}
+
+GS_RASTER_TARGET("avx2")
+void
+PremultiplySpanAvx2(int *Pixels, int Count)
+{
+        __m256i Zero = _mm256_setzero_si256();
+        __m256i AlphaLanes = _mm256_setr_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+        __m256i AlphaScale = _mm256_and_si256(AlphaLanes, _mm256_set1_epi16(255));
+
+        int Index = 0;
+        for(; Index + 8 <= Count; Index += 8)
+        {
+                __m256i Color = _mm256_loadu_si256((__m256i *)(Pixels + Index));
+                __m256i Low = _mm256_unpacklo_epi8(Color, Zero);
+                __m256i High = _mm256_unpackhi_epi8(Color, Zero);
+                __m256i ScaleLow = _mm256_or_si256(_mm256_andnot_si256(AlphaLanes, BroadcastAlphaAvx2(Low)), AlphaScale);
+                __m256i ScaleHigh = _mm256_or_si256(_mm256_andnot_si256(AlphaLanes, BroadcastAlphaAvx2(High)), AlphaScale);
+                __m256i Result = _mm256_packus_epi16(MultiplyChannelsAvx2(Low, ScaleLow), MultiplyChannelsAvx2(High, ScaleHigh));
+                _mm256_storeu_si256((__m256i *)(Pixels + Index), Result);
+        }
+
+        _mm256_zeroupper();
+        PremultiplySpanSse2(Pixels + Index, Count - Index);
+}
+
+GS_RASTER_TARGET("avx2")
+void
+CopySpanAvx2(int *Pixels, int *Source, int Count)
+{
+        /* Scalar head until the destination is 32-byte aligned. */
+        while(Count > 0 && ((uintptr_t)Pixels & 31) != 0)
+        {
+                *Pixels++ = *Source++;
+                Count--;
+        }
+
+        for(; Count >= 8; Count -= 8, Pixels += 8, Source += 8)
+        {
+                _mm256_stream_si256((__m256i *)Pixels, _mm256_loadu_si256((__m256i *)Source));
+        }
+
+        CopySpanScalar(Pixels, Source, Count);
+}
+
+#endif /* GS_RASTER_X86 */
+
+global_variable gs_raster_kernels Kernels =
+{
+        GS_RASTER_SIMD_SCALAR,
+        FillSpanScalar,
+        ShadeSpanScalar,
+        CoverageMaskScalar,
+        SnapCoordinatesScalar,
+        BlendFillSpanScalar,
+        BlendSpanScalar,
+        PremultiplySpanScalar,
+        CopySpanScalar,
+        PackSpanRgb565Scalar,
+        PackSpanIndex8Scalar,
+        TransformVerticesScalar,
+};
+global_variable bool KernelsSelected = false;
+
+gs_raster_simd
+GsRasterSelectSimd(gs_raster_simd MaxLevel)
+{
+        gs_raster_kernels Result = { GS_RASTER_SIMD_SCALAR, FillSpanScalar, ShadeSpanScalar, CoverageMaskScalar, SnapCoordinatesScalar,
+                                     BlendFillSpanScalar, BlendSpanScalar, PremultiplySpanScalar, CopySpanScalar,
+                                     PackSpanRgb565Scalar, PackSpanIndex8Scalar, TransformVerticesScalar };
+
+#if GS_RASTER_X86
+        __builtin_cpu_init();
+        if(MaxLevel >= GS_RASTER_SIMD_SSE2 && __builtin_cpu_supports("sse2"))
+        {
+                gs_raster_kernels Sse2 = { GS_RASTER_SIMD_SSE2, FillSpanSse2, ShadeSpanSse2, CoverageMaskSse2, SnapCoordinatesSse2,
+                                           BlendFillSpanSse2, BlendSpanSse2, PremultiplySpanSse2, CopySpanSse2,
+                                           PackSpanRgb565Sse2, PackSpanIndex8Sse2, TransformVerticesSse2 };
+                Result = Sse2;
+        }
+        if(MaxLevel >= GS_RASTER_SIMD_AVX2 && __builtin_cpu_supports("avx2"))
+        {
+                gs_raster_kernels Avx2 = { GS_RASTER_SIMD_AVX2, FillSpanAvx2, ShadeSpanAvx2, CoverageMaskAvx2, SnapCoordinatesAvx2,
+                                           BlendFillSpanAvx2, BlendSpanAvx2, PremultiplySpanAvx2, CopySpanAvx2,
+                                           /* Packing is bound by the narrower stores, which SSE2 already streams. */
+                                           PackSpanRgb565Sse2, PackSpanIndex8Sse2, TransformVerticesAvx2 };
+                Result = Avx2;
+        }
+#endif
+
+        Kernels = Result;
+        KernelsSelected = true;
+        return(Result.Level);
+}
+
+/* Picks the widest kernels on first use unless the caller already chose. */
+void
+SelectDefaultKernels()
+{
+        if(!KernelsSelected)
+        {
+                GsRasterSelectSimd(GS_RASTER_SIMD_AVX2);
+        }
+}
+
+/* Orders streaming stores issued by FillSpan before the pixels are handed off. */
+void
+FillSpanFence()
+{
+#if GS_RASTER_X86
+        if(Kernels.Level >= GS_RASTER_SIMD_SSE2)
+        {
+                FenceSse2();
+        }
+#endif
+}
+
+/*
+ * Generates the intersections of scanlines [Y0, Y1) from a bucketed edge
+ * table.  Rows are independent, so separate ranges can be generated
+ * concurrently with separate active lists.  Triangles lists every triangle
+ * crossing row Y0; see EdgeTableEnter.
+ */
+void
+GenerateScanlineRows(gs_raster_edge_table *Table, gs_raster_active_list *Active, gs_raster_scanline *Scanlines, int Y0, int Y1, int *Triangles, int NumTriangles)
+{
+        EdgeTableEnter(Table, Active, Y0, Triangles, NumTriangles);
+
+        for(int Row = Y0; Row < Y1; Row++)
+        {
+                gs_raster_scanline *Scanline = Scanlines + Row;
+                Scanline->NumIntersections = 0;
+
+                EdgeTableAdvance(Table, Active, Row);
+
+                /* The row may hold fewer intersections than the active list. */
+                int Count = Active->Count;
+                if(Count > Scanline->Capacity)
+                {
+                        StatsCount(Overflows, Count - Scanline->Capacity);
+                        Count = Scanline->Capacity;
+                }
+
+                for(int Index = 0; Index < Count; Index++)
+                {
+                        gs_raster_triangle_intersection *Intersection = &Scanline->Intersections[Scanline->NumIntersections];
+                        Intersection->Triangle = Active->Edges[Index].Edge->Triangle;
+                        /* Clamping keeps the order; spans left of the destination become empty. */
+                        int X = ActiveEdgeColumn(&Active->Edges[Index]);
+                        Intersection->X = (X > 0) ? X : 0;
+                        Scanline->NumIntersections++;
+                }
+
+                StatsRow(Row, Scanline->NumIntersections, Scanline->Capacity);
+        }
+}
+
+/*
+ * Scanlines must be initialized to contain NumScanlines scanlines.
+ * Triangles must be an initialized array of gs_raster_triangles.
+ */
+int
+GsRasterGenerateScanlines(gs_raster_triangle *Triangles, int NumTriangles, gs_raster_scanline *Scanlines, int NumScanlines)
+{
+        if(NumScanlines <= 0) return(true);
+
+        /* All scratch memory comes from one block, so only one allocation can fail. */
+        int Capacity = Scanlines[0].Capacity;
+        size_t Size = EdgeTableSizeRequired(NumTriangles, NumScanlines) + GS_RASTER_ARENA_ALIGNMENT +
+                      ArenaSizeForArray(NumTriangles > 0 ? NumTriangles : 1, gs_raster_fixed_triangle) +
+                      ArenaSizeForArray(Capacity, gs_raster_active_edge);
+        gs_raster_arena *Arena = ArenaCreate(Size);
+        if(Arena == NULL) return(false);
+        StatsBegin();
+
+        gs_raster_edge_table Table;
+        void *TableMemory = ArenaPush(Arena, EdgeTableSizeRequired(NumTriangles, NumScanlines), GS_RASTER_ARENA_ALIGNMENT);
+        EdgeTableInit(&Table, NumTriangles, NumScanlines, TableMemory);
+
+        SelectDefaultKernels();
+        StatsTimerBegin(SetupStart);
+        gs_raster_fixed_triangle *Fixed = ArenaPushArray(Arena, NumTriangles > 0 ? NumTriangles : 1, gs_raster_fixed_triangle);
+        Kernels.SnapCoordinates((float *)Triangles, (int32_t *)Fixed, NumTriangles * 6);
+        for(int Index = 0; Index < NumTriangles; Index++)
+        {
+                /* No width is known here, so only the rows can cull. */
+                if(TriangleCulled(&Fixed[Index], GS_RASTER_SUBPIXEL_LIMIT, NumScanlines, GS_RASTER_CULL_NONE))
+                {
+                        gs_raster_fixed_triangle Culled = {{{ 0 }}};
+                        Fixed[Index] = Culled;
+                        StatsCount(TrianglesCulled, 1);
+                }
+                EdgesForTriangle(&Table.Edges[Index * 3], &Fixed[Index], Index, NumScanlines);
+        }
+        StatsTimerEnd(SetupStart, GS_RASTER_STAGE_SETUP);
+
+        StatsTimerBegin(BinStart);
+        Table.NumEdges = NumTriangles * 3;
+        EdgeTableBucket(&Table);
+        StatsTimerEnd(BinStart, GS_RASTER_STAGE_BIN);
+
+        gs_raster_active_list Active;
+        Active.Capacity = Capacity;
+        Active.Edges = ArenaPushArray(Arena, Capacity, gs_raster_active_edge);
+
+        /* No edge starts above row 0. */
+        StatsTimerBegin(GenerateStart);
+        GenerateScanlineRows(&Table, &Active, Scanlines, 0, NumScanlines, NULL, 0);
+        StatsTimerEnd(GenerateStart, GS_RASTER_STAGE_GENERATE);
+
+        ArenaDestroy(Arena);
+        StatsEnd();
+        return(true);
+}
+
+//------------------------------------------------------------------------------
+// Edge Antialiasing Operations
+//------------------------------------------------------------------------------
+
+/*
+ * An edge of a triangle where it crosses one pixel row: its line's x at the
+ * top and bottom of the row, and the columns the edge itself spans.
+ */
+struct gs_raster_row_edge
+{
+        float Top;
+        float Bottom;
+        float MinX;
+        float MaxX;
+};
+typedef struct gs_raster_row_edge gs_raster_row_edge;
+
+/*
+ * Finds the left or right edge of the triangle at the center of Row, or of
+ * the shape it is the first piece of when Shape is not NULL.  Returns false
+ * if no edge crosses the row's center.  The triangle is not snapped:
+ * coverage is measured against the edges as given, which the snapped ones
+ * used for the spans are within 1/32 of a pixel of.
+ */
+bool
+RowEdgeForTriangle(gs_raster_row_edge *Edge, gs_raster_triangle *Triangles, int Triangle, gs_raster_shape *Shape, int Row, bool Left)
+{
+        float Y = (float)Row + 0.5f;
+        bool Found = false;
+        float FoundX = 0.0f;
+
+        int NumPieces = (Shape != NULL) ? Shape->Count : 1;
+        for(int Piece = Triangle; Piece < Triangle + NumPieces; Piece++)
+        {
+                for(int Index = 0; Index < 3; Index++)
+                {
+                        if(Shape != NULL && EdgeInsideShape(Shape, Piece, Index)) continue;
+
+                        gs_raster_point2d *P = &Triangles[Piece].Point[Index];
+                        gs_raster_point2d *Q = &Triangles[Piece].Point[(Index + 1) % 3];
+                        float MinY = (P->Y < Q->Y) ? P->Y : Q->Y;
+                        float MaxY = (P->Y < Q->Y) ? Q->Y : P->Y;
+                        if(MinY == MaxY || Y < MinY || Y > MaxY) continue;
+
+                        float DxDy = (Q->X - P->X) / (Q->Y - P->Y);
+                        float X = P->X + ((Y - P->Y) * DxDy);
+                        if(Found && (Left ? (X >= FoundX) : (X <= FoundX))) continue;
+
+                        Found = true;
+                        FoundX = X;
+                        Edge->Top = X - (0.5f * DxDy);
+                        Edge->Bottom = X + (0.5f * DxDy);
+                        Edge->MinX = (P->X < Q->X) ? P->X : Q->X;
+                        Edge->MaxX = (P->X < Q->X) ? Q->X : P->X;
+                }
+        }
+
+        return(Found);
+}
+
+/* The integral of Clamp(U, 0, 1) from 0 to U. */
+float
+RampIntegral(float U)
+{
+        if(U <= 0.0f) return(0.0f);
+        if(U >= 1.0f) return(U - 0.5f);
+        return(0.5f * U * U);
+}
+
+/*
+ * The fraction of the area of pixel column X, within the row, right of the
+ * edge's line.  Across the row the pixel's covered width is
+ * Clamp(X + 1 - x(t), 0, 1) for the line's x(t), linear in t; its integral
+ * over t in [0, 1] has a closed form in RampIntegral.
+ */
+float
+CoverageRightOfEdge(gs_raster_row_edge *Edge, int X)
+{
+        float A = (float)(X + 1) - Edge->Top;
+        float B = Edge->Bottom - Edge->Top;
+        float Result;
+        if(fabsf(B) < 1e-6f)
+        {
+                Result = (A <= 0.0f) ? 0.0f : ((A >= 1.0f) ? 1.0f : A);
+        }
+        else
+        {
+                Result = (RampIntegral(A) - RampIntegral(A - B)) / B;
+        }
+        return(Result);
+}
+
+/* From mixed with To, To weighted by Weight / 256 in every channel. */
+gs_raster_color
+MixColor(gs_raster_color From, gs_raster_color To, uint32_t Weight)
+{
+        gs_raster_color Result = 0;
+        for(int Shift = 0; Shift < 32; Shift += 8)
+        {
+                uint32_t Channel = ((((From >> Shift) & 0xFF) * (256 - Weight)) +
+                                    (((To >> Shift) & 0xFF) * Weight) + 128) >> 8;
+                Result |= Channel << Shift;
+        }
+        return(Result);
+}
+
+/*
+ * Antialiases the boundary at column X between the spans [X0, X) and
+ * [X, X1), already drawn, along the left or right edge of the triangle at
+ * Triangle, or of its shape when Shapes is not NULL.  Each
+ * pixel the edge passes through within the row keeps its own color for the
+ * part of its area on its own side of the edge, and takes the color next to
+ * the boundary on the other side for the rest.  Pixels outside [X0, X1) or
+ * beyond the ends of the edge are left alone, and so is the whole boundary
+ * when the colors either side of it match.
+ */
+void
+AntialiasBoundary(int *RowPixels, int Row, int X, int X0, int X1, gs_raster_triangle *Triangles, gs_raster_shape *Shapes, int Triangle, bool LeftEdge)
+{
+        gs_raster_color Left = RowPixels[X - 1];
+        gs_raster_color Right = RowPixels[X];
+        if(Left == Right) return;
+
+        gs_raster_row_edge RowEdge;
+        gs_raster_row_edge *Edge = &RowEdge;
+        gs_raster_shape *Shape = (Shapes != NULL) ? &Shapes[Triangle] : NULL;
+        if(!RowEdgeForTriangle(Edge, Triangles, Triangle, Shape, Row, LeftEdge)) return;
+
+        float MinX = (Edge->Top < Edge->Bottom) ? Edge->Top : Edge->Bottom;
+        float MaxX = (Edge->Top < Edge->Bottom) ? Edge->Bottom : Edge->Top;
+        if(MinX < Edge->MinX) MinX = Edge->MinX;
+        if(MaxX > Edge->MaxX) MaxX = Edge->MaxX;
+
+        int Start = (int)floorf(MinX);
+        int End = (int)ceilf(MaxX);
+        if(End <= Start) End = Start + 1;
+        if(Start < X0) Start = X0;
+        if(End > X1) End = X1;
+
+        for(int Column = Start; Column < End; Column++)
+        {
+                float Coverage = CoverageRightOfEdge(Edge, Column);
+                uint32_t Weight = (uint32_t)((Coverage * 256.0f) + 0.5f);
+                if(Column < X)
+                {
+                        RowPixels[Column] = MixColor(RowPixels[Column], Right, Weight);
+                }
+                else
+                {
+                        RowPixels[Column] = MixColor(Left, RowPixels[Column], Weight);
+                }
+        }
+        StatsCount(PixelsAntialiased, (End > Start) ? End - Start : 0);
+}
+
+//------------------------------------------------------------------------------
+// Span Fill Operations
+//------------------------------------------------------------------------------
+
+/*
+ * Writes Count pixels starting at column X of row Y, interpolating the
+ * gradient's color planes.  Channel values are evaluated at both ends of the
+ * span and stepped with a fixed-point delta, so each pixel costs one add per
+ * channel.
+ */
+void
+ShadeSpanSetup(int Count, int X, int Y, gs_raster_gradient *Gradient, int32_t Value[4], int32_t Delta[4])
+{
+        for(int Channel = 0; Channel < 4; Channel++)
+        {
+                float Start = (Gradient->Base[Channel] +
+                               (Gradient->DcDx[Channel] * X) +
+                               (Gradient->DcDy[Channel] * Y));
+                float End = Start + (Gradient->DcDx[Channel] * (Count - 1));
+
+                /* Span ends can sit just outside the triangle; keep them in range. */
+                if(Start < 0.0f) Start = 0.0f;
+                if(Start > 255.0f) Start = 255.0f;
+                if(End < 0.0f) End = 0.0f;
+                if(End > 255.0f) End = 255.0f;
+
+                Value[Channel] = (int32_t)(Start * (1 << GS_RASTER_GRADIENT_SHIFT));
+                Delta[Channel] = 0;
+                if(Count > 1)
+                {
+                        Delta[Channel] = (int32_t)(((End - Start) * (1 << GS_RASTER_GRADIENT_SHIFT)) / (Count - 1));
+                }
+        }
+}
+
+void
+ShadeSpan(int *Pixels, int Count, int X, int Y, gs_raster_gradient *Gradient)
+{
+        if(Count <= 0) return;
+
+        int32_t Value[4];
+        int32_t Delta[4];
+        ShadeSpanSetup(Count, X, Y, Gradient, Value, Delta);
+
+        Kernels.ShadeSpan(Pixels, Count, Value, Delta);
+}
+
+/*
+ * Pixels between perspective divides along a textured span; a power of two.
+ * Steps fall on columns that are multiples of it, whatever span they are in.
+ */
+#define GS_RASTER_PERSPECTIVE_STEP 16
+
+/* 1 / W is kept above this, so texture coordinates beyond the horizon stay finite. */
+#define GS_RASTER_MIN_INVERSE_W 1e-6f
+
+/*
+ * A texel coordinate in 16.16 fixed point.  Only the low 16 integer bits are
+ * kept, which wraps the coordinate as the texture repeats, since no level is
+ * wider than that.
+ */
+uint32_t
+TexelFixed(float Texel)
+{
+        /* Also catches NaN, which has no integer to convert to. */
+        if(!(Texel > -1e9f)) Texel = -1e9f;
+        if(Texel > 1e9f) Texel = 1e9f;
+
+        uint32_t Result = (uint32_t)(int64_t)(Texel * 65536.0f);
+        return(Result);
+}
+
+/*
+ * The mip level for pixels whose sides span Scale texels of the top level,
+ * given Scale squared: the level where they span one, to the nearest level.
+ */
+int
+TextureLevel(gs_raster_texture *Texture, float ScaleSquared)
+{
+        int Result = 0;
+        if(ScaleSquared > 1.0f)
+        {
+                /*
+                 * log2(Scale) rounded is floor(log2(2 * Scale^2) / 2), and the
+                 * floor of the log is the float's exponent.  Infinity has the
+                 * largest exponent, which clamps to the last level.
+                 */
+                float Doubled = 2.0f * ScaleSquared;
+                uint32_t Bits;
+                memcpy(&Bits, &Doubled, sizeof(Bits));
+                Result = ((int)((Bits >> 23) & 0xFF) - 127) / 2;
+                if(Result > Texture->NumLevels - 1) Result = Texture->NumLevels - 1;
+        }
+        return(Result);
+}
+
+/*
+ * Writes Count texels starting at column X of row Y.  U and V are divided by
+ * W at every GS_RASTER_PERSPECTIVE_STEP column and stepped linearly between,
+ * in fixed point.  The mip level is chosen once per step from how far U and
+ * V move across a pixel and down a row there.  Steps sit on fixed columns,
+ * so a pixel's texel does not depend on where its span starts or ends.
+ */
+void
+TextureSpan(int *Pixels, int Count, int X, int Y, gs_raster_gradient *Gradient)
+{
+        gs_raster_texture *Texture = Gradient->Texture;
+        float *Dx = Gradient->TexDx;
+        float *Dy = Gradient->TexDy;
+        float RowU = Gradient->TexBase[0] + (Dy[0] * Y);
+        float RowV = Gradient->TexBase[1] + (Dy[1] * Y);
+        float RowQ = Gradient->TexBase[2] + (Dy[2] * Y);
+        int End = X + Count;
+
+        while(X < End)
+        {
+                int Step = X & ~(GS_RASTER_PERSPECTIVE_STEP - 1);
+                int StepEnd = Step + GS_RASTER_PERSPECTIVE_STEP;
+                int RunEnd = (StepEnd < End) ? StepEnd : End;
+
+                float Q0 = RowQ + (Dx[2] * Step);
+                float Q1 = RowQ + (Dx[2] * StepEnd);
+                if(Q0 < GS_RASTER_MIN_INVERSE_W) Q0 = GS_RASTER_MIN_INVERSE_W;
+                if(Q1 < GS_RASTER_MIN_INVERSE_W) Q1 = GS_RASTER_MIN_INVERSE_W;
+                float U0 = (RowU + (Dx[0] * Step)) / Q0;
+                float V0 = (RowV + (Dx[1] * Step)) / Q0;
+                float DuDx = (((RowU + (Dx[0] * StepEnd)) / Q1) - U0) * (1.0f / GS_RASTER_PERSPECTIVE_STEP);
+                float DvDx = (((RowV + (Dx[1] * StepEnd)) / Q1) - V0) * (1.0f / GS_RASTER_PERSPECTIVE_STEP);
+                float DuDy = (Dy[0] - (U0 * Dy[2])) / Q0;
+                float DvDy = (Dy[1] - (V0 * Dy[2])) / Q0;
+
+                float AcrossSquared = (DuDx * DuDx) + (DvDx * DvDx);
+                float DownSquared = (DuDy * DuDy) + (DvDy * DvDy);
+                int LevelIndex = TextureLevel(Texture, (AcrossSquared > DownSquared) ? AcrossSquared : DownSquared);
+                gs_raster_texture_level *Level = &Texture->Levels[LevelIndex];
+                int Shift = 16 + LevelIndex;
+                uint32_t MaskX = (uint32_t)Level->Width - 1;
+                uint32_t MaskY = (uint32_t)Level->Height - 1;
+
+                uint32_t StepU = TexelFixed(DuDx);
+                uint32_t StepV = TexelFixed(DvDx);
+                uint32_t U = TexelFixed(U0) + (StepU * (uint32_t)(X - Step));
+                uint32_t V = TexelFixed(V0) + (StepV * (uint32_t)(X - Step));
+                for(; X < RunEnd; X++)
+                {
+                        *Pixels++ = (int)Level->Texels[TexelIndex(Level, (U >> Shift) & MaskX, (V >> Shift) & MaskY)];
+                        U += StepU;
+                        V += StepV;
+                }
+        }
+}
+
+/* Pixels of a shaded span blended per pass; see BlendShadedRun. */
+#define GS_RASTER_BLEND_CHUNK 256
+
+/*
+ * Blends Count pixels of a translucent gradient, whose channels start at
+ * Value and step by Delta, over the pixels already there.  The colors are
+ * shaded into a buffer on the stack a chunk at a time, premultiplied unless
+ * the gradient already is, then blended.
+ */
+void
+BlendShadedRun(int *Pixels, int Count, int32_t Value[4], int32_t Delta[4], bool Premultiplied)
+{
+        int Source[GS_RASTER_BLEND_CHUNK];
+        int32_t Current[4] = { Value[0], Value[1], Value[2], Value[3] };
+
+        while(Count > 0)
+        {
+                int Chunk = (Count < GS_RASTER_BLEND_CHUNK) ? Count : GS_RASTER_BLEND_CHUNK;
+                Kernels.ShadeSpan(Source, Chunk, Current, Delta);
+                if(!Premultiplied)
+                {
+                        Kernels.PremultiplySpan(Source, Chunk);
+                }
+                Kernels.BlendSpan(Pixels, Source, Chunk);
+
+                for(int Channel = 0; Channel < 4; Channel++)
+                {
+                        Current[Channel] += Delta[Channel] * Chunk;
+                }
+                Pixels += Chunk;
+                Count -= Chunk;
+        }
+}
+
+/* As BlendShadedRun, for a textured gradient. */
+void
+BlendTextureRun(int *Pixels, int Count, int X, int Y, gs_raster_gradient *Gradient)
+{
+        int Source[GS_RASTER_BLEND_CHUNK];
+
+        while(Count > 0)
+        {
+                int Chunk = (Count < GS_RASTER_BLEND_CHUNK) ? Count : GS_RASTER_BLEND_CHUNK;
+                TextureSpan(Source, Chunk, X, Y, Gradient);
+                if(!Gradient->IsPremultiplied)
+                {
+                        Kernels.PremultiplySpan(Source, Chunk);
+                }
+                Kernels.BlendSpan(Pixels, Source, Chunk);
+
+                Pixels += Chunk;
+                X += Chunk;
+                Count -= Chunk;
+        }
+}
+
+/* Blends Count pixels starting at column X of row Y over the pixels already there. */
+void
+BlendSpan(int *Pixels, int Count, int X, int Y, gs_raster_gradient *Gradient)
+{
+        if(Count <= 0) return;
+
+        if(Gradient->Texture != NULL)
+        {
+                BlendTextureRun(Pixels, Count, X, Y, Gradient);
+                return;
+        }
+        if(Gradient->IsFlat)
+        {
+                Kernels.BlendFillSpan(Pixels, Count, Gradient->Premultiplied);
+                return;
+        }
+
+        int32_t Value[4];
+        int32_t Delta[4];
+        ShadeSpanSetup(Count, X, Y, Gradient, Value, Delta);
+
+        BlendShadedRun(Pixels, Count, Value, Delta, Gradient->IsPremultiplied);
+}
+
+/*
+ * Fills [X0, X1) of the given row for the triangle on top of the stack, or
+ * blends it over the row when it is translucent.
+ * Gradients is NULL for flat-colored rasterization.
+ */
+void
+EmitSpan(int *RowPixels, int Row, int X0, int X1, int Triangle, gs_raster_color *Colors, gs_raster_gradient *Gradients)
+{
+        StatsPixels(Triangle, X1 - X0);
+
+        if(Triangle < 0)
+        {
+                Kernels.FillSpan(RowPixels + X0, X1 - X0, 0x00000000); /* Background is black. */
+        }
+        else if(Gradients == NULL)
+        {
+                Kernels.FillSpan(RowPixels + X0, X1 - X0, Colors[Triangle]);
+        }
+        else if(!Gradients[Triangle].IsOpaque)
+        {
+                BlendSpan(RowPixels + X0, X1 - X0, X0, Row, &Gradients[Triangle]);
+        }
+        else if(Gradients[Triangle].Texture != NULL)
+        {
+                TextureSpan(RowPixels + X0, X1 - X0, X0, Row, &Gradients[Triangle]);
+        }
+        else if(Gradients[Triangle].IsFlat)
+        {
+                Kernels.FillSpan(RowPixels + X0, X1 - X0, Gradients[Triangle].Color);
+        }
+        else
+        {
+                ShadeSpan(RowPixels + X0, X1 - X0, X0, Row, &Gradients[Triangle]);
+        }
+}
+
+/*
+ * Fills [RunStart, RunEnd) of the span [X0, X1).  Shading is interpolated
+ * across the whole span, so a pixel's color does not depend on how the span
+ * was split into runs.  Texturing never depends on the span's ends.
+ */
+void
+EmitSpanRun(int *RowPixels, int Row, int X0, int X1, int RunStart, int RunEnd, int Triangle, gs_raster_color *Colors, gs_raster_gradient *Gradients)
+{
+        if(Gradients == NULL || Gradients[Triangle].IsFlat || Gradients[Triangle].Texture != NULL ||
+           (RunStart == X0 && RunEnd == X1))
+        {
+                EmitSpan(RowPixels, Row, RunStart, RunEnd, Triangle, Colors, Gradients);
+                return;
+        }
+
+        int32_t Value[4];
+        int32_t Delta[4];
+        ShadeSpanSetup(X1 - X0, X0, Row, &Gradients[Triangle], Value, Delta);
+        for(int Channel = 0; Channel < 4; Channel++)
+        {
+                Value[Channel] += Delta[Channel] * (RunStart - X0);
+        }
+
+        StatsPixels(Triangle, RunEnd - RunStart);
+        if(Gradients[Triangle].IsOpaque)
+        {
+                Kernels.ShadeSpan(RowPixels + RunStart, RunEnd - RunStart, Value, Delta);
+        }
+        else
+        {
+                BlendShadedRun(RowPixels + RunStart, RunEnd - RunStart, Value, Delta, Gradients[Triangle].IsPremultiplied);
+        }
+}
+
+/*
+ * Fills the pixels of [X0, X1) on Row where the triangle is nearer than the
+ * stored depth, and stores its depth there; translucent triangles are
+ * blended instead and leave the depth alone.  With Test false every pixel is
+ * written without reading the buffer; the caller must know they all pass.
+ */
+void
+DepthEmitSpan(gs_raster_depth_buffer *Buffer, int *RowPixels, int Row, int X0, int X1, int Triangle, bool Test, gs_raster_color *Colors, gs_raster_gradient *Gradients)
+{
+        gs_raster_depth_plane *Plane = &Buffer->Planes[Triangle];
+        float RowBase = Plane->Base + (Plane->DzDy * (float)Row);
+        bool Write = TriangleIsOpaque(Gradients, Triangle);
+        int RunStart = -1;
+
+        if(Buffer->Format == GS_RASTER_DEPTH_16)
+        {
+                uint16_t *Values = (uint16_t *)Buffer->Values + (Row * Buffer->Width);
+                for(int X = X0; X < X1; X++)
+                {
+                        uint16_t Z = (uint16_t)DepthAt(Plane, RowBase, X);
+                        if(!Test || Z < Values[X])
+                        {
+                                if(Write) Values[X] = Z;
+                                if(RunStart < 0) RunStart = X;
+                        }
+                        else if(RunStart >= 0)
+                        {
+                                EmitSpanRun(RowPixels, Row, X0, X1, RunStart, X, Triangle, Colors, Gradients);
+                                RunStart = -1;
+                        }
+                }
+        }
+        else
+        {
+                float *Values = (float *)Buffer->Values + (Row * Buffer->Width);
+                for(int X = X0; X < X1; X++)
+                {
+                        float Z = DepthAt(Plane, RowBase, X);
+                        if(!Test || Z < Values[X])
+                        {
+                                if(Write) Values[X] = Z;
+                                if(RunStart < 0) RunStart = X;
+                        }
+                        else if(RunStart >= 0)
+                        {
+                                EmitSpanRun(RowPixels, Row, X0, X1, RunStart, X, Triangle, Colors, Gradients);
+                                RunStart = -1;
+                        }
+                }
+        }
+
+        if(RunStart >= 0)
+        {
+                EmitSpanRun(RowPixels, Row, X0, X1, RunStart, X1, Triangle, Colors, Gradients);
+        }
+}
+
+/*
+ * Emits [X0, X1) for every triangle on the stack, without a depth buffer.
+ * The top triangle wins as usual; when it is translucent, the topmost opaque
+ * triangle under it, or the background, is drawn first and everything above
+ * that is blended over it bottom to top.  When all of those are flat the
+ * whole span blends to one color, which is worked out once and filled.
+ */
+void
+EmitSpanStack(int *RowPixels, int Row, int X0, int X1, gs_raster_triangle_stack *Stack, gs_raster_color *Colors, gs_raster_gradient *Gradients)
+{
+        int Top = TriangleStackTop(Stack);
+        if(Top < 0 || TriangleIsOpaque(Gradients, Top))
+        {
+                EmitSpan(RowPixels, Row, X0, X1, Top, Colors, Gradients);
+                return;
+        }
+
+        int Base = Stack->Head;
+        while(Base > 0 && !Gradients[Stack->Stack[Base]].IsOpaque)
+        {
+                Base--;
+        }
+
+        bool Flat = true;
+        for(int Index = (Base > 0) ? Base : 1; Index <= Stack->Head; Index++)
+        {
+                Flat = Flat && Gradients[Stack->Stack[Index]].IsFlat;
+        }
+
+        if(Flat)
+        {
+                StatsPixels(-1, (Base > 0) ? 0 : X1 - X0);
+                gs_raster_color Color = 0x00000000; /* Background is black. */
+                for(int Index = (Base > 0) ? Base : 1; Index <= Stack->Head; Index++)
+                {
+                        gs_raster_gradient *Gradient = &Gradients[Stack->Stack[Index]];
+                        StatsPixels(Stack->Stack[Index], X1 - X0);
+                        Color = (Index == Base) ? Gradient->Color : BlendColor(Color, Gradient->Premultiplied);
+                }
+                Kernels.FillSpan(RowPixels + X0, X1 - X0, Color);
+                return;
+        }
+
+        EmitSpan(RowPixels, Row, X0, X1, (Base > 0) ? Stack->Stack[Base] : -1, Colors, Gradients);
+        for(int Index = Base + 1; Index <= Stack->Head; Index++)
+        {
+                EmitSpan(RowPixels, Row, X0, X1, Stack->Stack[Index], Colors, Gradients);
+        }
+}
+
+/* Opaque layers first, by increasing index; then translucent ones, farthest first, ties by increasing index. */
+bool
+LayerBefore(gs_raster_layer *A, gs_raster_layer *B)
+{
+        if(A->Translucent != B->Translucent) return(!A->Translucent);
+        if(A->Translucent && A->MidZ != B->MidZ) return(A->MidZ > B->MidZ);
+        return(A->Triangle < B->Triangle);
+}
+
+/*
+ * Bottom-up merge sort by LayerBefore, with Scratch holding as many layers
+ * again.  Returns whichever of the two ends up holding the sorted layers.
+ */
+gs_raster_layer *
+LayersSort(gs_raster_layer *Layers, gs_raster_layer *Scratch, int Count)
+{
+        gs_raster_layer *From = Layers;
+        gs_raster_layer *To = Scratch;
+        for(int Run = 1; Run < Count; Run *= 2)
+        {
+                for(int Start = 0; Start < Count; Start += 2 * Run)
+                {
+                        int Middle = (Start + Run < Count) ? Start + Run : Count;
+                        int End = (Start + (2 * Run) < Count) ? Start + (2 * Run) : Count;
+                        int Left = Start;
+                        int Right = Middle;
+                        for(int Out = Start; Out < End; Out++)
+                        {
+                                bool TakeRight = (Left >= Middle || (Right < End && LayerBefore(&From[Right], &From[Left])));
+                                To[Out] = TakeRight ? From[Right++] : From[Left++];
+                        }
+                }
+
+                gs_raster_layer *Sorted = To;
+                To = From;
+                From = Sorted;
+        }
+        return(From);
+}
+
+/*
+ * Depth-resolves [X0, X1) of a row whose stored depths are still clear.
+ * Every triangle on the stack covers the whole span, so any triangle whose
+ * nearest depth on the span is behind the farthest depth of an opaque one
+ * is hidden and skipped without per-pixel work.  The visible opaque
+ * triangles are drawn in triangle order, so equal depths go to the earlier
+ * triangle as in the half-space engine.  The visible translucent ones are
+ * then blended farthest first, ordered by their average depth on the span.
+ * The visible triangles are sorted once into that order, in the stack's
+ * layers.
+ */
+void
+EmitSpanDepth(gs_raster_depth_buffer *Buffer, int *RowPixels, int Row, int X0, int X1, gs_raster_triangle_stack *Stack, gs_raster_color *Colors, gs_raster_gradient *Gradients)
+{
+        if(X1 <= X0) return;
+
+        gs_raster_layer *Layers = Stack->Layers;
+        float Occluder = Buffer->Far;
+        for(int Index = 1; Index <= Stack->Head; Index++)
+        {
+                gs_raster_layer *Layer = &Layers[Index - 1];
+                Layer->Triangle = Stack->Stack[Index];
+                Layer->Translucent = !TriangleIsOpaque(Gradients, Layer->Triangle);
+
+                float MinZ, MaxZ;
+                DepthRangeOverRect(Buffer, &Buffer->Planes[Layer->Triangle], X0, Row, X1 - 1, Row, &MinZ, &MaxZ);
+                Layer->MinZ = MinZ;
+                Layer->MidZ = (MinZ + MaxZ) * 0.5f;
+                if(!Layer->Translucent && MaxZ < Occluder) Occluder = MaxZ;
+        }
+
+        int NumVisible = 0;
+        int NumTranslucent = 0;
+        for(int Index = 0; Index < Stack->Head; Index++)
+        {
+                if(Layers[Index].MinZ <= Occluder)
+                {
+                        if(Layers[Index].Translucent) NumTranslucent++;
+                        Layers[NumVisible++] = Layers[Index];
+                }
+        }
+
+        if(NumVisible == 1 && NumTranslucent == 0 && Occluder < Buffer->Far)
+        {
+                /* Nothing else can win, and the triangle is nearer than the cleared depth. */
+                DepthEmitSpan(Buffer, RowPixels, Row, X0, X1, Layers[0].Triangle, false, Colors, Gradients);
+                return;
+        }
+
+        EmitSpan(RowPixels, Row, X0, X1, -1, Colors, Gradients);
+
+        Layers = LayersSort(Layers, Layers + Stack->Capacity, NumVisible);
+        for(int Index = 0; Index < NumVisible; Index++)
+        {
+                DepthEmitSpan(Buffer, RowPixels, Row, X0, X1, Layers[Index].Triangle, true, Colors, Gradients);
+        }
+}
+
+/*
+ * Each row is walked once over its sorted intersections: between consecutive
+ * intersection columns the top of the triangle stack is constant, so the row
+ * is emitted as [X0, X1) spans of a single triangle.  With a depth buffer
+ * each span is resolved among every triangle on the stack instead; see
+ * EmitSpanDepth.  Only rows [Y0, Y1) are written; the stack must hold as
+ * many triangles as a scanline has intersections.
+ * Triangles is NULL unless antialiasing.  Each boundary is then antialiased
+ * once the span after it is drawn, along the edge that changed the top of
+ * the stack, or failing that the first edge crossed there.  Shapes is NULL
+ * unless the triangles were clipped; see gs_raster_shape.
+ */
+void
+RasterizeScanlineRows(int *Pixels, int Width, gs_raster_scanline *Scanlines, int Y0, int Y1, gs_raster_triangle_stack *CurrentTriangle, gs_raster_color *Colors, gs_raster_gradient *Gradients, gs_raster_depth_buffer *Depth, gs_raster_triangle *Triangles, gs_raster_shape *Shapes)
+{
+        if(Depth != NULL)
+        {
+                DepthBufferClearValues(Depth, 0, Y0, Width, Y1);
+        }
+
+        for(int Row=Y0; Row<Y1; Row++)
+        {
+                gs_raster_scanline *Scanline = &Scanlines[Row];
+                int *RowPixels = Pixels + (Row * Width);
+                int SpanStart = 0;
+                int PendingX = -1; /* The last boundary, antialiased once the span after it is drawn. */
+                int PendingStart = 0;
+                int PendingTriangle = 0;
+                bool PendingLeft = false;
+
+                CurrentTriangle->Head = 0;
+                StatsCount(PixelsDrawn, Width);
+
+                int s = 0;
+                while(s < Scanline->NumIntersections)
+                {
+                        int X = Scanline->Intersections[s].X;
+                        if(X >= Width) break;
+
+                        if(Depth != NULL)
+                        {
+                                EmitSpanDepth(Depth, RowPixels, Row, SpanStart, X, CurrentTriangle, Colors, Gradients);
+                        }
+                        else
+                        {
+                                EmitSpanStack(RowPixels, Row, SpanStart, X, CurrentTriangle, Colors, Gradients);
+                        }
+
+                        if(PendingX >= 0)
+                        {
+                                AntialiasBoundary(RowPixels, Row, PendingX, PendingStart, X, Triangles, Shapes, PendingTriangle, PendingLeft);
+                                PendingX = -1;
+                        }
+
+                        int Top = TriangleStackTop(CurrentTriangle);
+                        int First = -1;
+                        bool FirstEntered = false;
+                        int Pushed = -1;
+                        bool RemovedTop = false;
+                        for(; s < Scanline->NumIntersections && Scanline->Intersections[s].X == X; ++s)
+                        {
+                                gs_raster_triangle_intersection *Intersection = &(Scanline->Intersections[s]);
+                                bool Entered = !TriangleStackRemove(CurrentTriangle, Intersection->Triangle);
+                                if(Entered)
+                                {
+                                        TriangleStackPush(CurrentTriangle, Intersection->Triangle);
+                                        StatsCount(StackPushes, 1);
+                                        StatsPeak(PeakStackDepth, CurrentTriangle->Head);
+                                        Pushed = Intersection->Triangle;
+                                }
+                                else
+                                {
+                                        StatsCount(StackPops, 1);
+                                        if(Intersection->Triangle == Top) RemovedTop = true;
+                                }
+
+                                if(First < 0)
+                                {
+                                        First = Intersection->Triangle;
+                                        FirstEntered = Entered;
+                                }
+                        }
+
+                        if(Triangles != NULL && X > 0)
+                        {
+                                PendingX = X;
+                                PendingStart = SpanStart;
+                                PendingTriangle = First;
+                                PendingLeft = FirstEntered;
+                                if(Pushed >= 0 && Pushed == TriangleStackTop(CurrentTriangle))
+                                {
+                                        PendingTriangle = Pushed;
+                                        PendingLeft = true;
+                                }
+                                else if(RemovedTop)
+                                {
+                                        PendingTriangle = Top;
+                                        PendingLeft = false;
+                                }
+                        }
+
+                        SpanStart = X;
+                }
+
+                if(Depth != NULL)
+                {
+                        EmitSpanDepth(Depth, RowPixels, Row, SpanStart, Width, CurrentTriangle, Colors, Gradients);
+                }
+                else
+                {
+                        EmitSpanStack(RowPixels, Row, SpanStart, Width, CurrentTriangle, Colors, Gradients);
+                }
+
+                if(PendingX >= 0)
+                {
+                        AntialiasBoundary(RowPixels, Row, PendingX, PendingStart, Width, Triangles, Shapes, PendingTriangle, PendingLeft);
+                }
+        }
+}
+
+int
+TriangleStackSizeRequired(int Capacity)
+{
+        /* Slot 0 is never used; see TriangleStackPush. */
+        int Result = sizeof(gs_raster_triangle_stack) + (sizeof(int) * (Capacity + 1));
+        return(Result);
+}
+
+void
+RasterizeScanlines(int *Pixels, int Width, int Height, gs_raster_scanline *Scanlines, gs_raster_color *Colors, gs_raster_gradient *Gradients)
+{
+        int Capacity = Scanlines[0].Capacity;
+        void *TriangleStackMemory = alloca(TriangleStackSizeRequired(Capacity));
+        gs_raster_triangle_stack *CurrentTriangle;
+        TriangleStackInit(&CurrentTriangle, Capacity, TriangleStackMemory);
+
+        RasterizeScanlineRows(Pixels, Width, Scanlines, 0, Height, CurrentTriangle, Colors, Gradients, NULL, NULL, NULL);
+
+        FillSpanFence();
+}
+
+/*
+ * Pixels is a Width * Height grid of pixels intended for display somewhere.
+ */
+void
+GsRasterRasterize(int *Pixels, int Width, int Height, gs_raster_scanline *Scanlines, gs_raster_triangle Triangles[], gs_raster_color Colors[], int NumTriangles)
+{
+        StatsBegin();
+        SelectDefaultKernels();
+
+        StatsTimerBegin(RasterizeStart);
+        RasterizeScanlines(Pixels, Width, Height, Scanlines, Colors, NULL);
+        StatsTimerEnd(RasterizeStart, GS_RASTER_STAGE_RASTERIZE);
+        StatsEnd();
+}
+
+void
+GradientsForMaterials(gs_raster_gradient *Gradients, gs_raster_triangle Triangles[], gs_raster_material Materials[], int NumTriangles, gs_raster_blend Blend)
+{
+        for(int Index = 0; Index < NumTriangles; Index++)
+        {
+                Gradients[Index] = GradientForMaterial(&Triangles[Index], &Materials[Index], Blend);
+        }
+}
+
+size_t
+GsRasterSizeRequiredForShading(int NumTriangles)
+{
+        size_t Result = sizeof(gs_raster_gradient) * (size_t)(NumTriangles > 0 ? NumTriangles : 1);
+        return(Result);
+}
+
+int
+GsRasterRasterizeShaded(int *Pixels, int Width, int Height, gs_raster_scanline *Scanlines, gs_raster_triangle Triangles[], gs_raster_material Materials[], int NumTriangles, void *Memory)
+{
+        gs_raster_gradient *Gradients = (gs_raster_gradient *)Memory;
+        if(Memory == NULL)
+        {
+                Gradients = (gs_raster_gradient *)malloc(GsRasterSizeRequiredForShading(NumTriangles));
+                if(Gradients == NULL) return(false);
+        }
+
+        StatsBegin();
+        StatsTimerBegin(SetupStart);
+        GradientsForMaterials(Gradients, Triangles, Materials, NumTriangles, GS_RASTER_BLEND_NONE);
+        StatsTimerEnd(SetupStart, GS_RASTER_STAGE_SETUP);
+
+        SelectDefaultKernels();
+        StatsTimerBegin(RasterizeStart);
+        RasterizeScanlines(Pixels, Width, Height, Scanlines, NULL, Gradients);
+        StatsTimerEnd(RasterizeStart, GS_RASTER_STAGE_RASTERIZE);
+
+        if(Memory == NULL) free(Gradients);
+        StatsEnd();
+        return(true);
+}
+
+//------------------------------------------------------------------------------
+// Half-Space Engine
+//------------------------------------------------------------------------------
+
+/*
+ * E(X, Y) = A * X + B * Y + C at the center of pixel (X, Y), in squared
+ * subpixels.  It is non-negative exactly where the pixel is covered: edges
+ * that are neither top nor left edges carry a bias of -1 in C, so centers
+ * lying on them fall outside.
+ */
+struct gs_raster_edge_function
+{
+        int64_t A;
+        int64_t B;
+        int64_t C;
+};
+typedef struct gs_raster_edge_function gs_raster_edge_function;
+
+struct gs_raster_halfspace_triangle
+{
+        bool Visible; /* False when the triangle covers no pixels. */
+        gs_raster_edge_function Edges[3];
+        int MinX, MinY; /* Inclusive pixel bounds, clipped to the destination. */
+        int MaxX, MaxY;
+};
+typedef struct gs_raster_halfspace_triangle gs_raster_halfspace_triangle;
+
+enum gs_raster_coverage
+{
+        COVERAGE_OUTSIDE,
+        COVERAGE_PARTIAL,
+        COVERAGE_INSIDE,
+};
+typedef enum gs_raster_coverage gs_raster_coverage;
+
+int64_t
+EdgeFunctionEvaluate(gs_raster_edge_function *Edge, int X, int Y)
+{
+        int64_t Result = (Edge->A * X) + (Edge->B * Y) + Edge->C;
+        return(Result);
+}
+
+/*
+ * Builds the edge functions and clipped bounds for the snapped triangle.
+ * Returns false, and clears Visible, for degenerate triangles and triangles
+ * covering no pixel centers of the destination, which produce no pixels.
+ */
+bool
+HalfSpaceSetup(gs_raster_halfspace_triangle *Setup, gs_raster_fixed_triangle *Triangle, int Width, int Height)
+{
+        Setup->Visible = false;
+
+        gs_raster_fixed_point *Point = Triangle->Point;
+        int64_t Area = ((((int64_t)Point[1].X - Point[0].X) * ((int64_t)Point[2].Y - Point[0].Y)) -
+                        (((int64_t)Point[2].X - Point[0].X) * ((int64_t)Point[1].Y - Point[0].Y)));
+        if(Area == 0) return(false);
+
+        /* Either winding is accepted; flip the edges so the inside is positive. */
+        int64_t Sign = (Area > 0) ? 1 : -1;
+
+        for(int Index = 0; Index < 3; Index++)
+        {
+                gs_raster_fixed_point Start = Point[Index];
+                gs_raster_fixed_point End = Point[(Index + 1) % 3];
+                gs_raster_edge_function *Edge = &Setup->Edges[Index];
+
+                /* Per subpixel; (A, B) points into the triangle. */
+                int64_t A = -((int64_t)End.Y - Start.Y) * Sign;
+                int64_t B = ((int64_t)End.X - Start.X) * Sign;
+
+                /* A left edge has the inside to its right; a top edge is horizontal with the inside below. */
+                bool TopLeft = (A > 0 || (A == 0 && B > 0));
+
+                Edge->A = A * GS_RASTER_SUBPIXEL_ONE;
+                Edge->B = B * GS_RASTER_SUBPIXEL_ONE;
+                Edge->C = ((A * (GS_RASTER_SUBPIXEL_HALF - (int64_t)Start.X)) +
+                           (B * (GS_RASTER_SUBPIXEL_HALF - (int64_t)Start.Y)) -
+                           (TopLeft ? 0 : 1));
+        }
+
+        int32_t MinX = Point[0].X, MaxX = Point[0].X;
+        int32_t MinY = Point[0].Y, MaxY = Point[0].Y;
+        for(int Index = 1; Index < 3; Index++)
+        {
+                if(Point[Index].X < MinX) MinX = Point[Index].X;
+                if(Point[Index].X > MaxX) MaxX = Point[Index].X;
+                if(Point[Index].Y < MinY) MinY = Point[Index].Y;
+                if(Point[Index].Y > MaxY) MaxY = Point[Index].Y;
+        }
+
+        /* The pixels whose centers lie within the bounding box. */
+        Setup->MinX = FirstPixelAtOrAfter(MinX);
+        Setup->MinY = FirstPixelAtOrAfter(MinY);
+        Setup->MaxX = FirstPixelAtOrAfter(MaxX + 1) - 1;
+        Setup->MaxY = FirstPixelAtOrAfter(MaxY + 1) - 1;
+        if(Setup->MinX < 0) Setup->MinX = 0;
+        if(Setup->MinY < 0) Setup->MinY = 0;
+        if(Setup->MaxX > Width - 1) Setup->MaxX = Width - 1;
+        if(Setup->MaxY > Height - 1) Setup->MaxY = Height - 1;
+
+        Setup->Visible = (Setup->MinX <= Setup->MaxX && Setup->MinY <= Setup->MaxY);
+        return(Setup->Visible);
+}
+
+/*
+ * Classifies the inclusive pixel rectangle against the triangle.  Each edge
+ * function is linear, so its extremes over the rectangle sit at the corners
+ * picked by the signs of A and B.
+ */
+gs_raster_coverage
+HalfSpaceTestRect(gs_raster_halfspace_triangle *Triangle, int X0, int Y0, int X1, int Y1)
+{
+        gs_raster_coverage Result = COVERAGE_INSIDE;
+
+        for(int Index = 0; Index < 3; Index++)
+        {
+                gs_raster_edge_function *Edge = &Triangle->Edges[Index];
+                int MaxCornerX = (Edge->A > 0) ? X1 : X0;
+                int MaxCornerY = (Edge->B > 0) ? Y1 : Y0;
+                int MinCornerX = (Edge->A > 0) ? X0 : X1;
+                int MinCornerY = (Edge->B > 0) ? Y0 : Y1;
+
+                if(EdgeFunctionEvaluate(Edge, MaxCornerX, MaxCornerY) < 0)
+                {
+                        return(COVERAGE_OUTSIDE);
+                }
+                if(EdgeFunctionEvaluate(Edge, MinCornerX, MinCornerY) < 0)
+                {
+                        Result = COVERAGE_PARTIAL;
+                }
+        }
+
+        return(Result);
+}
+
+/*
+ * Emits the covered pixels of a partially covered tile one row at a time.
+ * The triangle is convex, so the covered pixels of a row form one span.
+ * Coverage is tested in 32 bits: a row start further than 2^30 from the edge
+ * is clamped to 2^30, which keeps its sign for the tile's width because
+ * GS_RASTER_SUBPIXEL_LIMIT holds per-pixel steps to at most 2^26.
+ */
+void
+HalfSpaceRasterizeTilePixels(int *Pixels, int Stride, gs_raster_halfspace_triangle *Triangle, int X0, int Y0, int X1, int Y1, int Index, gs_raster_color *Colors, gs_raster_gradient *Gradients, gs_raster_depth_buffer *Depth, bool DepthTest)
+{
+        Assert(X1 - X0 < GS_RASTER_TILE_SIZE);
+        gs_raster_edge_function *Edges = Triangle->Edges;
+        int32_t A[3] = { (int32_t)Edges[0].A, (int32_t)Edges[1].A, (int32_t)Edges[2].A };
+        int64_t Clamp = (int64_t)1 << 30;
+        int64_t RowStart[3];
+        for(int Edge = 0; Edge < 3; Edge++)
+        {
+                RowStart[Edge] = EdgeFunctionEvaluate(&Edges[Edge], X0, Y0);
+        }
+
+        for(int Row = Y0; Row <= Y1; Row++)
+        {
+                int32_t E[3];
+                for(int Edge = 0; Edge < 3; Edge++)
+                {
+                        int64_t Value = RowStart[Edge];
+                        if(Value > Clamp) Value = Clamp;
+                        if(Value < -Clamp) Value = -Clamp;
+                        E[Edge] = (int32_t)Value;
+                        RowStart[Edge] += Edges[Edge].B;
+                }
+
+                uint32_t Mask = Kernels.CoverageMask(E, A, X1 - X0 + 1);
+                if(Mask == 0) continue;
+
+                int SpanStart = __builtin_ctz(Mask);
+                int SpanLength = __builtin_ctz(~(Mask >> SpanStart));
+                if(Depth != NULL)
+                {
+                        DepthEmitSpan(Depth, Pixels + (Row * Stride), Row, X0 + SpanStart, X0 + SpanStart + SpanLength, Index, DepthTest, Colors, Gradients);
+                }
+                else
+                {
+                        EmitSpan(Pixels + (Row * Stride), Row, X0 + SpanStart, X0 + SpanStart + SpanLength, Index, Colors, Gradients);
+                }
+        }
+}
+
+/*
+ * Lowers the bounds of the tiles overlapping the inclusive rectangle after a
+ * triangle with stored depths in [MinZ, MaxZ] was drawn over all of it.
+ * Every pixel now stores at most MaxZ, whether or not it passed, so tiles
+ * lying entirely inside the rectangle can lower their maximum too.
+ */
+void
+DepthBoundsCovered(gs_raster_depth_buffer *Buffer, int X0, int Y0, int X1, int Y1, float MinZ, float MaxZ)
+{
+        for(int TileY = Y0 / GS_RASTER_TILE_SIZE; TileY <= Y1 / GS_RASTER_TILE_SIZE; TileY++)
+        {
+                for(int TileX = X0 / GS_RASTER_TILE_SIZE; TileX <= X1 / GS_RASTER_TILE_SIZE; TileX++)
+                {
+                        int Tile = (TileY * Buffer->TilesX) + TileX;
+                        if(MinZ < Buffer->TileMin[Tile]) Buffer->TileMin[Tile] = MinZ;
+
+                        int TileX0 = TileX * GS_RASTER_TILE_SIZE;
+                        int TileY0 = TileY * GS_RASTER_TILE_SIZE;
+                        int TileX1 = (TileX0 + GS_RASTER_TILE_SIZE < Buffer->Width) ? (TileX0 + GS_RASTER_TILE_SIZE) : Buffer->Width;
+                        int TileY1 = (TileY0 + GS_RASTER_TILE_SIZE < Buffer->Height) ? (TileY0 + GS_RASTER_TILE_SIZE) : Buffer->Height;
+                        if(TileX0 >= X0 && TileY0 >= Y0 && TileX1 - 1 <= X1 && TileY1 - 1 <= Y1)
+                        {
+                                if(MaxZ < Buffer->TileMax[Tile]) Buffer->TileMax[Tile] = MaxZ;
+                        }
+                }
+        }
+}
+
+/* Block bounds are the hull of their tiles' bounds. */
+void
+DepthBoundsUpdateBlock(gs_raster_depth_buffer *Buffer, int X0, int Y0)
+{
+        float Min = Buffer->Far;
+        float Max = 0.0f;
+        int TileX1 = ((X0 + GS_RASTER_BLOCK_SIZE < Buffer->Width) ? (X0 + GS_RASTER_BLOCK_SIZE) : Buffer->Width) - 1;
+        int TileY1 = ((Y0 + GS_RASTER_BLOCK_SIZE < Buffer->Height) ? (Y0 + GS_RASTER_BLOCK_SIZE) : Buffer->Height) - 1;
+        for(int TileY = Y0 / GS_RASTER_TILE_SIZE; TileY <= TileY1 / GS_RASTER_TILE_SIZE; TileY++)
+        {
+                for(int TileX = X0 / GS_RASTER_TILE_SIZE; TileX <= TileX1 / GS_RASTER_TILE_SIZE; TileX++)
+                {
+                        int Tile = (TileY * Buffer->TilesX) + TileX;
+                        if(Buffer->TileMin[Tile] < Min) Min = Buffer->TileMin[Tile];
+                        if(Buffer->TileMax[Tile] > Max) Max = Buffer->TileMax[Tile];
+                }
+        }
+
+        int Block = ((Y0 / GS_RASTER_BLOCK_SIZE) * Buffer->BlocksX) + (X0 / GS_RASTER_BLOCK_SIZE);
+        Buffer->BlockMin[Block] = Min;
+        Buffer->BlockMax[Block] = Max;
+}
+
+/*
+ * Hierarchically rasterizes the Size x Size square at (X0, Y0): squares
+ * entirely outside the triangle are dropped, squares entirely inside are
+ * filled as spans without any per-pixel tests, and partially covered squares
+ * are split into tiles and then pixels.
+ * With a depth buffer, squares where the triangle is behind everything
+ * already stored are dropped too, and squares where it is in front of
+ * everything skip the per-pixel depth reads.  Translucent triangles store no
+ * depth, so they leave the bounds alone.
+ */
+void
+HalfSpaceRasterizeRect(int *Pixels, int Stride, gs_raster_halfspace_triangle *Triangle, int X0, int Y0, int Size, int Index, gs_raster_color *Colors, gs_raster_gradient *Gradients, gs_raster_depth_buffer *Depth)
+{
+        int RectX0 = (X0 > Triangle->MinX) ? X0 : Triangle->MinX;
+        int RectY0 = (Y0 > Triangle->MinY) ? Y0 : Triangle->MinY;
+        int RectX1 = (X0 + Size - 1 < Triangle->MaxX) ? (X0 + Size - 1) : Triangle->MaxX;
+        int RectY1 = (Y0 + Size - 1 < Triangle->MaxY) ? (Y0 + Size - 1) : Triangle->MaxY;
+        if(RectX0 > RectX1 || RectY0 > RectY1) return;
+
+        gs_raster_coverage Coverage = HalfSpaceTestRect(Triangle, RectX0, RectY0, RectX1, RectY1);
+        if(Coverage == COVERAGE_OUTSIDE) return;
+
+        float MinZ = 0.0f;
+        float MaxZ = 0.0f;
+        bool DepthTest = true;
+        if(Depth != NULL)
+        {
+                float BoundMin, BoundMax;
+                if(Size == GS_RASTER_BLOCK_SIZE)
+                {
+                        int Block = ((Y0 / GS_RASTER_BLOCK_SIZE) * Depth->BlocksX) + (X0 / GS_RASTER_BLOCK_SIZE);
+                        BoundMin = Depth->BlockMin[Block];
+                        BoundMax = Depth->BlockMax[Block];
+                }
+                else
+                {
+                        int Tile = ((Y0 / GS_RASTER_TILE_SIZE) * Depth->TilesX) + (X0 / GS_RASTER_TILE_SIZE);
+                        BoundMin = Depth->TileMin[Tile];
+                        BoundMax = Depth->TileMax[Tile];
+                }
+
+                DepthRangeOverRect(Depth, &Depth->Planes[Index], RectX0, RectY0, RectX1, RectY1, &MinZ, &MaxZ);
+                if(MinZ >= BoundMax) return;
+                DepthTest = (MaxZ >= BoundMin);
+        }
+
+        if(Coverage == COVERAGE_INSIDE)
+        {
+                for(int Row = RectY0; Row <= RectY1; Row++)
+                {
+                        if(Depth != NULL)
+                        {
+                                DepthEmitSpan(Depth, Pixels + (Row * Stride), Row, RectX0, RectX1 + 1, Index, DepthTest, Colors, Gradients);
+                        }
+                        else
+                        {
+                                EmitSpan(Pixels + (Row * Stride), Row, RectX0, RectX1 + 1, Index, Colors, Gradients);
+                        }
+                }
+
+                if(Depth != NULL && TriangleIsOpaque(Gradients, Index))
+                {
+                        DepthBoundsCovered(Depth, RectX0, RectY0, RectX1, RectY1, MinZ, MaxZ);
+                }
+        }
+        else if(Size > GS_RASTER_TILE_SIZE)
+        {
+                for(int Y = Y0; Y < Y0 + Size; Y += GS_RASTER_TILE_SIZE)
+                {
+                        for(int X = X0; X < X0 + Size; X += GS_RASTER_TILE_SIZE)
+                        {
+                                HalfSpaceRasterizeRect(Pixels, Stride, Triangle, X, Y, GS_RASTER_TILE_SIZE, Index, Colors, Gradients, Depth);
+                        }
+                }
+        }
+        else
+        {
+                HalfSpaceRasterizeTilePixels(Pixels, Stride, Triangle, RectX0, RectY0, RectX1, RectY1, Index, Colors, Gradients, Depth, DepthTest);
+
+                if(Depth != NULL && TriangleIsOpaque(Gradients, Index))
+                {
+                        int Tile = ((Y0 / GS_RASTER_TILE_SIZE) * Depth->TilesX) + (X0 / GS_RASTER_TILE_SIZE);
+                        if(MinZ < Depth->TileMin[Tile]) Depth->TileMin[Tile] = MinZ;
+                }
+        }
+
+        if(Depth != NULL && Size == GS_RASTER_BLOCK_SIZE)
+        {
+                DepthBoundsUpdateBlock(Depth, X0, Y0);
+        }
+}
+
+/*
+ * Draws one GS_RASTER_BLOCK_SIZE aligned block of the already set up
+ * triangles listed in Triangles, in order, so later triangles cover earlier
+ * ones where they overlap.  With a depth buffer, nearer triangles cover
+ * farther ones instead, and equal depths keep the earlier triangle; the
+ * translucent triangles are then blended in a second pass, in order, over
+ * whatever opaque surface is nearest.
+ * Pixel (X, Y) is Pixels[(Y * Stride) + X]; only the block's pixels are
+ * touched, so Pixels may address a tiled framebuffer's block alone.
+ * Gradients is NULL for flat-colored rasterization.
+ */
+void
+RasterizeHalfSpaceBlock(int *Pixels, int Stride, int Width, int Height, gs_raster_halfspace_triangle *Setups, int *Triangles, int NumTriangles, int X0, int Y0, gs_raster_color *Colors, gs_raster_gradient *Gradients, gs_raster_depth_buffer *Depth)
+{
+        Assert((X0 % GS_RASTER_BLOCK_SIZE) == 0 && (Y0 % GS_RASTER_BLOCK_SIZE) == 0);
+
+        int X1 = (X0 + GS_RASTER_BLOCK_SIZE < Width) ? (X0 + GS_RASTER_BLOCK_SIZE) : Width;
+        int Y1 = (Y0 + GS_RASTER_BLOCK_SIZE < Height) ? (Y0 + GS_RASTER_BLOCK_SIZE) : Height;
+        for(int Row = Y0; Row < Y1; Row++)
+        {
+                StatsCount(PixelsDrawn, X1 - X0);
+                StatsPixels(-1, X1 - X0);
+                Kernels.FillSpan(Pixels + (Row * Stride) + X0, X1 - X0, 0x00000000); /* Background is black. */
+        }
+
+        if(Depth != NULL)
+        {
+                DepthBufferClearValues(Depth, X0, Y0, X1, Y1);
+                for(int TileY = Y0 / GS_RASTER_TILE_SIZE; TileY <= (Y1 - 1) / GS_RASTER_TILE_SIZE; TileY++)
+                {
+                        for(int TileX = X0 / GS_RASTER_TILE_SIZE; TileX <= (X1 - 1) / GS_RASTER_TILE_SIZE; TileX++)
+                        {
+                                Depth->TileMin[(TileY * Depth->TilesX) + TileX] = Depth->Far;
+                                Depth->TileMax[(TileY * Depth->TilesX) + TileX] = Depth->Far;
+                        }
+                }
+                DepthBoundsUpdateBlock(Depth, X0, Y0);
+        }
+
+        bool Translucent = false;
+        for(int Index = 0; Index < NumTriangles; Index++)
+        {
+                int Triangle = Triangles[Index];
+                if(Depth != NULL && !TriangleIsOpaque(Gradients, Triangle))
+                {
+                        Translucent = true;
+                        continue;
+                }
+                HalfSpaceRasterizeRect(Pixels, Stride, &Setups[Triangle], X0, Y0, GS_RASTER_BLOCK_SIZE, Triangle, Colors, Gradients, Depth);
+        }
+
+        for(int Index = 0; Translucent && Index < NumTriangles; Index++)
+        {
+                int Triangle = Triangles[Index];
+                if(TriangleIsOpaque(Gradients, Triangle)) continue;
+                HalfSpaceRasterizeRect(Pixels, Stride, &Setups[Triangle], X0, Y0, GS_RASTER_BLOCK_SIZE, Triangle, Colors, Gradients, Depth);
+        }
+}
+
+//------------------------------------------------------------------------------
+// Tile Binning Operations
+//------------------------------------------------------------------------------
+
+/* Scanlines span the whole width, so the scanline engine bins by row band. */
+#define GS_RASTER_BAND_HEIGHT 16
+
+/* Inclusive pixel bounds of a triangle; empty when MinX > MaxX or MinY > MaxY. */
+struct gs_raster_bounds
+{
+        int MinX;
+        int MinY;
+        int MaxX;
+        int MaxY;
+};
+typedef struct gs_raster_bounds gs_raster_bounds;
+
+/*
+ * Screen tiles with the triangles overlapping each.  Bin Y * TilesX + X holds
+ * Triangles[Offsets[Bin], Offsets[Bin + 1]), in draw order.
+ */
+struct gs_raster_bins
+{
+        int TileWidth;
+        int TileHeight;
+        int TilesX;
+        int TilesY;
+        int *Offsets;
+        int *Triangles;
+};
+typedef struct gs_raster_bins gs_raster_bins;
+
+/* The rows covered by a triangle's edges, across the whole destination. */
+void
+BoundsFromEdges(gs_raster_bounds *Bounds, gs_raster_edge Edges[3], int Width)
+{
+        Bounds->MinX = 0;
+        Bounds->MaxX = Width - 1;
+        Bounds->MinY = 0x7FFFFFFF;
+        Bounds->MaxY = -1;
+
+        for(int Index = 0; Index < 3; Index++)
+        {
+                if(Edges[Index].YStart >= Edges[Index].YEnd) continue;
+                if(Edges[Index].YStart < Bounds->MinY) Bounds->MinY = Edges[Index].YStart;
+                if(Edges[Index].YEnd - 1 > Bounds->MaxY) Bounds->MaxY = Edges[Index].YEnd - 1;
+        }
+}
+
+void
+BoundsFromHalfSpace(gs_raster_bounds *Bounds, gs_raster_halfspace_triangle *Setup)
+{
+        /* HalfSpaceSetup leaves the box unset for triangles without area. */
+        if(!Setup->Visible)
+        {
+                Bounds->MinX = 0;
+                Bounds->MinY = 0;
+                Bounds->MaxX = -1;
+                Bounds->MaxY = -1;
+                return;
+        }
+
+        Bounds->MinX = Setup->MinX;
+        Bounds->MinY = Setup->MinY;
+        Bounds->MaxX = Setup->MaxX;
+        Bounds->MaxY = Setup->MaxY;
+}
+
+/*
+ * Bins each triangle into every tile its bounds overlap, with a counting
+ * sort so each bin keeps draw order.  Bounds must be clipped to the
+ * destination.  The bins live until the arena is popped.  Returns false if
+ * they cannot be allocated.
+ */
+bool
+BinsBuild(gs_raster_arena *Arena, gs_raster_bins *Bins, gs_raster_bounds *Bounds, int NumTriangles, int Width, int Height, int TileWidth, int TileHeight)
+{
+        Bins->TileWidth = TileWidth;
+        Bins->TileHeight = TileHeight;
+        Bins->TilesX = (Width + TileWidth - 1) / TileWidth;
+        Bins->TilesY = (Height + TileHeight - 1) / TileHeight;
+
+        int NumBins = Bins->TilesX * Bins->TilesY;
+        Bins->Offsets = ArenaPushArray(Arena, NumBins + 1, int);
+        if(Bins->Offsets == NULL) return(false);
+        for(int Bin = 0; Bin <= NumBins; Bin++)
+        {
+                Bins->Offsets[Bin] = 0;
+        }
+
+        int Total = 0;
+        for(int Index = 0; Index < NumTriangles; Index++)
+        {
+                gs_raster_bounds *Bound = &Bounds[Index];
+                if(Bound->MinX > Bound->MaxX || Bound->MinY > Bound->MaxY) continue;
+
+                for(int Y = Bound->MinY / TileHeight; Y <= Bound->MaxY / TileHeight; Y++)
+                {
+                        for(int X = Bound->MinX / TileWidth; X <= Bound->MaxX / TileWidth; X++)
+                        {
+                                Bins->Offsets[(Y * Bins->TilesX) + X]++;
+                                Total++;
+                        }
+                }
+        }
+
+        int Offset = 0;
+        for(int Bin = 0; Bin < NumBins; Bin++)
+        {
+                int Count = Bins->Offsets[Bin];
+                Bins->Offsets[Bin] = Offset;
+                Offset += Count;
+        }
+
+        /* Offsets[Bin] walks to the end of its bin, which is where the next bin starts. */
+        Bins->Triangles = ArenaPushArray(Arena, Total, int);
+        if(Bins->Triangles == NULL) return(false);
+        for(int Index = 0; Index < NumTriangles; Index++)
+        {
+                gs_raster_bounds *Bound = &Bounds[Index];
+                if(Bound->MinX > Bound->MaxX || Bound->MinY > Bound->MaxY) continue;
+
+                for(int Y = Bound->MinY / TileHeight; Y <= Bound->MaxY / TileHeight; Y++)
+                {
+                        for(int X = Bound->MinX / TileWidth; X <= Bound->MaxX / TileWidth; X++)
+                        {
+                                Bins->Triangles[Bins->Offsets[(Y * Bins->TilesX) + X]++] = Index;
+                        }
+                }
+        }
+
+        for(int Bin = NumBins; Bin > 0; Bin--)
+        {
+                Bins->Offsets[Bin] = Bins->Offsets[Bin - 1];
+        }
+        Bins->Offsets[0] = 0;
+        return(true);
+}
+
+//------------------------------------------------------------------------------
+// Worker Pool Operations
+//------------------------------------------------------------------------------
+
+/* Triangles set up per task. */
+#define GS_RASTER_SETUP_BATCH 1024
+#define GS_RASTER_CACHE_LINE 64
+
+/*
+ * Scratch memory owned by one thread; tasks never share it.  Queue holds the
+ * worker's pending task numbers [Begin, End) packed as End << 32 | Begin, so
+ * the owner and thieves can update it with a single compare-and-swap.
+ */
+struct gs_raster_worker
+{
+        _Alignas(GS_RASTER_CACHE_LINE) atomic_uint_least64_t Queue;
+        struct gs_raster_workers *Pool;
+        int Index;
+        gs_raster_triangle_stack *Stack;
+        gs_raster_active_list Active;
+        int *Band; /* Rows drawn before packing into another format; see StoreRows. */
+#ifdef GS_RASTER_STATS
+        gs_raster_stats Stats; /* Pool threads only; worker 0 counts into its caller's. */
+#endif
+};
+typedef struct gs_raster_worker gs_raster_worker;
+
+typedef void gs_raster_task(void *Data, int Task, gs_raster_worker *Worker);
+
+/*
+ * A persistent pool of threads.  WorkersRun deals task numbers [0, NumTasks)
+ * out to the workers in contiguous runs; a worker that runs dry steals the
+ * back half of another's run.  The calling thread takes part as worker 0 and
+ * returns once every task has finished.
+ */
+struct gs_raster_workers
+{
+        int NumWorkers; /* Including the calling thread. */
+        gs_raster_worker *Workers;
+        pthread_t *Threads;
+
+        pthread_mutex_t Mutex;
+        pthread_cond_t Start;
+        pthread_cond_t Finish;
+        int Generation; /* Bumped by every WorkersRun. */
+        int NumRunning;
+        bool Quit;
+
+        gs_raster_task *Task;
+        void *TaskData;
+};
+typedef struct gs_raster_workers gs_raster_workers;
+
+uint_least64_t
+PackTaskRange(uint32_t Begin, uint32_t End)
+{
+        uint_least64_t Result = ((uint_least64_t)End << 32) | Begin;
+        return(Result);
+}
+
+/* Takes the next task from the front of the worker's own queue. */
+bool
+WorkerPopTask(gs_raster_worker *Worker, int *Task)
+{
+        uint_least64_t Range = atomic_load(&Worker->Queue);
+        for(;;)
+        {
+                uint32_t Begin = (uint32_t)Range;
+                uint32_t End = (uint32_t)(Range >> 32);
+                if(Begin >= End) return(false);
+
+                if(atomic_compare_exchange_weak(&Worker->Queue, &Range, PackTaskRange(Begin + 1, End)))
+                {
+                        *Task = (int)Begin;
+                        return(true);
+                }
+        }
+}
+
+/* Takes the back half of the victim's queue; at least one task when any are left. */
+bool
+WorkerStealTasks(gs_raster_worker *Victim, uint32_t *StolenBegin, uint32_t *StolenEnd)
+{
+        uint_least64_t Range = atomic_load(&Victim->Queue);
+        for(;;)
+        {
+                uint32_t Begin = (uint32_t)Range;
+                uint32_t End = (uint32_t)(Range >> 32);
+                if(Begin >= End) return(false);
+
+                uint32_t Middle = Begin + ((End - Begin) / 2);
+                if(atomic_compare_exchange_weak(&Victim->Queue, &Range, PackTaskRange(Begin, Middle)))
+                {
+                        *StolenBegin = Middle;
+                        *StolenEnd = End;
+                        return(true);
+                }
+        }
+}
+
+/*
+ * Runs tasks until none are left anywhere.  Tasks only ever move between
+ * queues, and a thief owns what it stole, so every task runs exactly once
+ * even if a worker gives up while another is mid-steal.
+ */
+void
+WorkersRunTasks(gs_raster_workers *Pool, gs_raster_worker *Worker)
+{
+        for(;;)
+        {
+                int Task;
+                if(WorkerPopTask(Worker, &Task))
+                {
+                        Pool->Task(Pool->TaskData, Task, Worker);
+                        continue;
+                }
+
+                bool Stole = false;
+                for(int Offset = 1; Offset < Pool->NumWorkers && !Stole; Offset++)
+                {
+                        gs_raster_worker *Victim = &Pool->Workers[(Worker->Index + Offset) % Pool->NumWorkers];
+                        uint32_t Begin, End;
+                        if(WorkerStealTasks(Victim, &Begin, &End))
+                        {
+                                /* Nobody pushes onto an empty queue but its owner. */
+                                atomic_store(&Worker->Queue, PackTaskRange(Begin + 1, End));
+                                Pool->Task(Pool->TaskData, (int)Begin, Worker);
+                                Stole = true;
+                        }
+                }
+                if(!Stole) break;
+        }
+
+        FillSpanFence();
+}
+
+void *
+WorkerThread(void *Parameter)
+{
+        gs_raster_worker *Worker = (gs_raster_worker *)Parameter;
+        gs_raster_workers *Pool = Worker->Pool;
+        int Generation = 0;
+#ifdef GS_RASTER_STATS
+        StatsThread = &Worker->Stats;
+#endif
+
+        pthread_mutex_lock(&Pool->Mutex);
+        for(;;)
+        {
+                while(!Pool->Quit && Pool->Generation == Generation)
+                {
+                        pthread_cond_wait(&Pool->Start, &Pool->Mutex);
+                }
+                if(Pool->Quit) break;
+                Generation = Pool->Generation;
+                pthread_mutex_unlock(&Pool->Mutex);
+
+                WorkersRunTasks(Pool, Worker);
+
+                pthread_mutex_lock(&Pool->Mutex);
+                if(--Pool->NumRunning == 0)
+                {
+                        pthread_cond_signal(&Pool->Finish);
+                }
+        }
+        pthread_mutex_unlock(&Pool->Mutex);
+
+        return(NULL);
+}
+
+void
+WorkersRun(gs_raster_workers *Pool, gs_raster_task *Task, void *Data, int NumTasks)
+{
+        Pool->Task = Task;
+        Pool->TaskData = Data;
+
+        if(Pool->NumWorkers == 1 || NumTasks <= 1)
+        {
+                atomic_store(&Pool->Workers[0].Queue, PackTaskRange(0, NumTasks));
+                WorkersRunTasks(Pool, &Pool->Workers[0]);
+                return;
+        }
+
+        for(int Index = 0; Index < Pool->NumWorkers; Index++)
+        {
+                uint32_t Begin = (uint32_t)(((int64_t)NumTasks * Index) / Pool->NumWorkers);
+                uint32_t End = (uint32_t)(((int64_t)NumTasks * (Index + 1)) / Pool->NumWorkers);
+                atomic_store(&Pool->Workers[Index].Queue, PackTaskRange(Begin, End));
+        }
+
+        pthread_mutex_lock(&Pool->Mutex);
+        Pool->NumRunning = Pool->NumWorkers - 1;
+        Pool->Generation++;
+        pthread_cond_broadcast(&Pool->Start);
+        pthread_mutex_unlock(&Pool->Mutex);
+
+        WorkersRunTasks(Pool, &Pool->Workers[0]);
+
+        pthread_mutex_lock(&Pool->Mutex);
+        while(Pool->NumRunning > 0)
+        {
+                pthread_cond_wait(&Pool->Finish, &Pool->Mutex);
+        }
+        pthread_mutex_unlock(&Pool->Mutex);
+
+#ifdef GS_RASTER_STATS
+        for(int Index = 1; Index < Pool->NumWorkers; Index++)
+        {
+                StatsMerge(StatsThread, &Pool->Workers[Index].Stats);
+                Pool->Workers[Index].Stats = (gs_raster_stats){0};
+        }
+#endif
+}
+
+/* NumThreads <= 0 means one thread per online CPU. */
+int
+WorkersResolveCount(int NumThreads)
+{
+        if(NumThreads <= 0)
+        {
+                NumThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+                if(NumThreads <= 0) NumThreads = 1;
+        }
+        return(NumThreads);
+}
+
+size_t
+WorkersSizeRequired(int NumThreads, int Capacity, int BandPixels)
+{
+        NumThreads = WorkersResolveCount(NumThreads);
+        size_t PerWorker = ((TriangleStackSizeRequired(Capacity) + GS_RASTER_ARENA_ALIGNMENT) +
+                            ArenaSizeForArray(2 * Capacity, gs_raster_layer) +
+                            ArenaSizeForArray(Capacity, gs_raster_active_edge));
+        if(BandPixels > 0)
+        {
+                PerWorker += (sizeof(int) * (size_t)BandPixels) + GS_RASTER_CACHE_LINE;
+        }
+        size_t Result = (ArenaSizeForArray(1, gs_raster_workers) +
+                         (sizeof(gs_raster_worker) * NumThreads) + GS_RASTER_CACHE_LINE +
+                         ArenaSizeForArray(NumThreads, pthread_t) +
+                         (PerWorker * NumThreads));
+        return(Result);
+}
+
+/*
+ * The pool's memory, including each worker's scratch, comes from the arena;
+ * see WorkersSizeRequired.  Should the system refuse a thread, the pool runs
+ * with the threads it did start, down to the calling thread alone.
+ */
+gs_raster_workers *
+WorkersCreate(gs_raster_arena *Arena, int NumThreads, int Capacity, int BandPixels)
+{
+        NumThreads = WorkersResolveCount(NumThreads);
+
+        gs_raster_workers *Pool = ArenaPushStruct(Arena, gs_raster_workers);
+        Pool->NumWorkers = NumThreads;
+        /* Queues are touched by every thread; keep each on its own cache line. */
+        Pool->Workers = (gs_raster_worker *)ArenaPush(Arena, sizeof(gs_raster_worker) * NumThreads, GS_RASTER_CACHE_LINE);
+        Pool->Threads = ArenaPushArray(Arena, NumThreads, pthread_t);
+        Pool->Generation = 0;
+        Pool->NumRunning = 0;
+        Pool->Quit = false;
+        pthread_mutex_init(&Pool->Mutex, NULL);
+        pthread_cond_init(&Pool->Start, NULL);
+        pthread_cond_init(&Pool->Finish, NULL);
+
+        for(int Index = 0; Index < NumThreads; Index++)
+        {
+                gs_raster_worker *Worker = &Pool->Workers[Index];
+                atomic_init(&Worker->Queue, PackTaskRange(0, 0));
+                Worker->Pool = Pool;
+                Worker->Index = Index;
+                TriangleStackInit(&Worker->Stack, Capacity, ArenaPush(Arena, TriangleStackSizeRequired(Capacity), GS_RASTER_ARENA_ALIGNMENT));
+                Worker->Stack->Layers = ArenaPushArray(Arena, 2 * Capacity, gs_raster_layer);
+                Worker->Active.Capacity = Capacity;
+                Worker->Active.Count = 0;
+                Worker->Active.Edges = ArenaPushArray(Arena, Capacity, gs_raster_active_edge);
+                Worker->Band = NULL;
+                if(BandPixels > 0)
+                {
+                        Worker->Band = (int *)ArenaPush(Arena, sizeof(int) * (size_t)BandPixels, GS_RASTER_CACHE_LINE);
+                }
+#ifdef GS_RASTER_STATS
+                Worker->Stats = (gs_raster_stats){0};
+#endif
+
+                /* A thread that cannot be started leaves the pool at the ones that were. */
+                if(Index > 0 && pthread_create(&Pool->Threads[Index], NULL, WorkerThread, Worker) != 0)
+                {
+                        pthread_mutex_lock(&Pool->Mutex);
+                        Pool->NumWorkers = Index;
+                        pthread_mutex_unlock(&Pool->Mutex);
+                        break;
+                }
+        }
+
+        return(Pool);
+}
+
+/* Stops the threads; the pool's memory goes with its arena. */
+void
+WorkersDestroy(gs_raster_workers *Pool)
+{
+        pthread_mutex_lock(&Pool->Mutex);
+        Pool->Quit = true;
+        pthread_cond_broadcast(&Pool->Start);
+        pthread_mutex_unlock(&Pool->Mutex);
+
+        for(int Index = 0; Index < Pool->NumWorkers; Index++)
+        {
+                if(Index > 0)
+                {
+                        pthread_join(Pool->Threads[Index], NULL);
+                }
+        }
+
+        pthread_mutex_destroy(&Pool->Mutex);
+        pthread_cond_destroy(&Pool->Start);
+        pthread_cond_destroy(&Pool->Finish);
+}
+
+//------------------------------------------------------------------------------
+// Context Operations
+//------------------------------------------------------------------------------
+
+/* Bins per triangle assumed when sizing a draw's scratch memory. */
+#define GS_RASTER_BINS_PER_TRIANGLE 4
+
+/* Scratch memory for one draw of Config->MaxTriangles triangles; see Draw. */
+size_t
+DrawSizeRequired(gs_raster_config *Config)
+{
+        int MaxTriangles = (Config->MaxTriangles > 0) ? Config->MaxTriangles : 1;
+        size_t Result = (ArenaSizeForArray(MaxTriangles, gs_raster_bounds) +
+                         ArenaSizeForArray(MaxTriangles, gs_raster_gradient) +
+                         ArenaSizeForArray(MaxTriangles * GS_RASTER_BINS_PER_TRIANGLE, int));
+
+        if(Config->DepthFormat != GS_RASTER_DEPTH_NONE)
+        {
+                Result += ArenaSizeForArray(MaxTriangles, gs_raster_depth_plane);
+        }
+
+        switch(Config->Engine)
+        {
+                case GS_RASTER_ENGINE_SCANLINE:
+                {
+                        int NumBands = (Config->Height + GS_RASTER_BAND_HEIGHT - 1) / GS_RASTER_BAND_HEIGHT;
+                        Result += ArenaSizeForArray(1, gs_raster_edge_table) + EdgeTableSizeRequired(MaxTriangles, Config->Height) + GS_RASTER_ARENA_ALIGNMENT;
+                        Result += ArenaSizeForArray(NumBands + 1, int);
+                } break;
+
+                case GS_RASTER_ENGINE_HALFSPACE:
+                {
+                        int NumBlocks = (((Config->Width + GS_RASTER_BLOCK_SIZE - 1) / GS_RASTER_BLOCK_SIZE) *
+                                         ((Config->Height + GS_RASTER_BLOCK_SIZE - 1) / GS_RASTER_BLOCK_SIZE));
+                        Result += ArenaSizeForArray(MaxTriangles, gs_raster_halfspace_triangle);
+                        Result += ArenaSizeForArray(NumBlocks + 1, int);
+                } break;
+        }
+
+        return(Result);
+}
+
+/* Formats other than RGBA8888 are drawn into a tiled framebuffer and packed from there. */
+bool
+UsesTiledFramebuffer(gs_raster_config *Config)
+{
+        bool Result = (Config->Engine == GS_RASTER_ENGINE_HALFSPACE &&
+                       (Config->Framebuffer == GS_RASTER_FRAMEBUFFER_TILED || Config->Format != GS_RASTER_FORMAT_RGBA8888));
+        return(Result);
+}
+
+/* Pixels of each worker's band, for the scanline engine and scenes to pack from; 0 when none is needed. */
+int
+BandPixelsRequired(gs_raster_config *Config)
+{
+        int Result = 0;
+        if(Config->Format != GS_RASTER_FORMAT_RGBA8888)
+        {
+                Result = Config->Width * GS_RASTER_BAND_HEIGHT;
+        }
+        return(Result);
+}
+
+/*
+ * A tiled framebuffer holds whole blocks, even at the frame's right and
+ * bottom edges, in the order the half-space engine's bins number them.
+ */
+size_t
+FramebufferSizeRequired(int Width, int Height)
+{
+        size_t NumBlocks = ((size_t)((Width + GS_RASTER_BLOCK_SIZE - 1) / GS_RASTER_BLOCK_SIZE) *
+                            ((Height + GS_RASTER_BLOCK_SIZE - 1) / GS_RASTER_BLOCK_SIZE));
+        size_t Result = NumBlocks * GS_RASTER_BLOCK_SIZE * GS_RASTER_BLOCK_SIZE * sizeof(int);
+        return(Result);
+}
+
+size_t
+GsRasterSizeRequired(gs_raster_config *Config)
+{
+        size_t Result = (WorkersSizeRequired(Config->NumThreads, Config->Capacity, BandPixelsRequired(Config)) +
+                         DrawSizeRequired(Config));
+
+        if(Config->Engine == GS_RASTER_ENGINE_SCANLINE)
+        {
+                Result += GsRasterSizeRequiredForScanlines(Config->Height, Config->Capacity) + GS_RASTER_ARENA_ALIGNMENT;
+        }
+
+        if(Config->DepthFormat != GS_RASTER_DEPTH_NONE)
+        {
+                Result += DepthBufferSizeRequired(Config->DepthFormat, Config->Width, Config->Height);
+        }
+
+        if(UsesTiledFramebuffer(Config))
+        {
+                Result += FramebufferSizeRequired(Config->Width, Config->Height) + GS_RASTER_CACHE_LINE;
+        }
+
+        return(Result);
+}
+
+int
+GsRasterCapacityRequired(gs_raster_triangle Triangles[], int NumTriangles, int Height)
+{
+        /* Each triangle adds two at its first row and takes them away after its last. */
+        int *Counts = (int *)calloc((size_t)Height + 1, sizeof(int));
+        if(Counts == NULL) return(0);
+        for(int Index = 0; Index < NumTriangles; Index++)
+        {
+                gs_raster_triangle *Triangle = &Triangles[Index];
+                float MinY = fminf(Triangle->Y1, fminf(Triangle->Y2, Triangle->Y3));
+                float MaxY = fmaxf(Triangle->Y1, fmaxf(Triangle->Y2, Triangle->Y3));
+                int Row0 = (MinY < 0.0f) ? 0 : (MinY > (float)Height) ? Height : (int)MinY;
+                int Row1 = (MaxY + 1.0f > (float)Height) ? Height : (MaxY < 0.0f) ? 0 : (int)(MaxY + 1.0f);
+                if(Row0 >= Row1) continue;
+                Counts[Row0] += 2;
+                Counts[Row1] -= 2;
+        }
+
+        int Result = 2;
+        int Count = 0;
+        for(int Row = 0; Row < Height; Row++)
+        {
+                Count += Counts[Row];
+                if(Count > Result) Result = Count;
+        }
+        free(Counts);
+        return(Result);
+}
+
+int
+GsRasterInit(gs_raster_context *Context, gs_raster_config *Config)
+{
+        Context->Engine = Config->Engine;
+        Context->Blend = Config->Blend;
+        Context->Antialias = Config->Antialias;
+        Context->Format = Config->Format;
+        Context->Cull = Config->Cull;
+        Context->Width = Config->Width;
+        Context->Height = Config->Height;
+        Context->Scanlines = NULL;
+        Context->Blocks = NULL;
+        Context->Depth = NULL;
+        Context->Workers = NULL;
+        Context->Arena = ArenaCreate(GsRasterSizeRequired(Config));
+        if(Context->Arena == NULL) return(false);
+
+        /* Everything below fits in the arena's first block, so no push can fail. */
+        SelectDefaultKernels();
+
+        if(Config->Engine == GS_RASTER_ENGINE_SCANLINE)
+        {
+                void *Memory = ArenaPush(Context->Arena, GsRasterSizeRequiredForScanlines(Config->Height, Config->Capacity), GS_RASTER_ARENA_ALIGNMENT);
+                GsRasterInitScanlines(&Context->Scanlines, Config->Height, Config->Capacity, Memory);
+        }
+
+        if(Config->DepthFormat != GS_RASTER_DEPTH_NONE)
+        {
+                Context->Depth = DepthBufferCreate(Context->Arena, Config->DepthFormat, Config->Width, Config->Height);
+        }
+
+        if(UsesTiledFramebuffer(Config))
+        {
+                /* Line-aligned, so no cache line holds pixels of two blocks. */
+                Context->Blocks = (int *)ArenaPush(Context->Arena, FramebufferSizeRequired(Config->Width, Config->Height), GS_RASTER_CACHE_LINE);
+        }
+
+        Context->Workers = WorkersCreate(Context->Arena, Config->NumThreads, Config->Capacity, BandPixelsRequired(Config));
+        return(true);
+}
+
+void
+GsRasterFree(gs_raster_context *Context)
+{
+        WorkersDestroy(Context->Workers);
+        ArenaDestroy(Context->Arena);
+        Context->Workers = NULL;
+        Context->Scanlines = NULL;
+        Context->Depth = NULL;
+        Context->Arena = NULL;
+}
+
+/* The input of GsRasterDrawVertices and GsRasterDrawIndexed, transformed by the setup tasks. */
+struct gs_raster_vertex_stage
+{
+        float Matrix[4][4]; /* The caller's transform with the viewport mapping folded in. */
+        gs_raster_vertices *Vertices;
+        gs_raster_texture *Texture;
+        gs_raster_blend Blend;
+        gs_raster_index_format IndexFormat;
+        void *Indices; /* NULL when vertices 3 * I to 3 * I + 2 make triangle I. */
+};
+typedef struct gs_raster_vertex_stage gs_raster_vertex_stage;
+
+/* Everything a draw's tasks read; shared by all threads. */
+struct gs_raster_draw
+{
+        gs_raster_vertex_stage *Vertices; /* NULL unless drawing vertices; then Triangles is written by the setup tasks. */
+        gs_raster_triangle *Triangles;
+        int NumTriangles;
+        gs_raster_shape *Shapes; /* One per triangle once DrawClip has run, else NULL. */
+        gs_raster_color *Colors;
+        gs_raster_gradient *Gradients;
+        bool Antialias; /* GS_RASTER_ENGINE_SCANLINE */
+        void *Pixels;
+        gs_raster_format Format;
+        int *Blocks; /* GS_RASTER_ENGINE_HALFSPACE; NULL to draw straight into Pixels. */
+        int Width;
+        int Height;
+        gs_raster_cull Cull;
+
+        gs_raster_bounds *Bounds; /* Written by the setup tasks, one per triangle. */
+        atomic_int NumCulled; /* Counted by the setup tasks. */
+        atomic_int NumOutside; /* Triangles the setup tasks found beyond the guard band; see DrawClip. */
+        gs_raster_bins Bins;
+
+        gs_raster_depth *Depths;
+        gs_raster_depth_buffer *Depth; /* NULL without depth testing; planes written by the setup tasks. */
+
+        gs_raster_edge_table *Table; /* GS_RASTER_ENGINE_SCANLINE */
+        gs_raster_scanline *Scanlines;
+        gs_raster_halfspace_triangle *Setups; /* GS_RASTER_ENGINE_HALFSPACE */
+};
+typedef struct gs_raster_draw gs_raster_draw;
+
+/*
+ * The smallest clip-space W a vertex draw is drawn at; DrawClip cuts away
+ * what is nearer, so no point divided by W is at or behind the eye.
+ */
+#define GS_RASTER_NEAR_W 1e-5f
+
+/* Vertices transformed at once by SetupVertices; a multiple of 3 and of 8. */
+#define GS_RASTER_VERTEX_BATCH 192
+
+/* Lines of the direct-mapped cache GatherVertices keeps; a power of two above GS_RASTER_VERTEX_BATCH. */
+#define GS_RASTER_VERTEX_CACHE_BITS 8
+#define GS_RASTER_VERTEX_CACHE (1 << GS_RASTER_VERTEX_CACHE_BITS)
+
+/* The index at Corner of an index buffer. */
+uint32_t
+IndexAt(gs_raster_index_format IndexFormat, void *Indices, int Corner)
+{
+        uint32_t Result = ((IndexFormat == GS_RASTER_INDEX_16) ?
+                           (uint32_t)((uint16_t *)Indices)[Corner] :
+                           ((uint32_t *)Indices)[Corner]);
+        return(Result);
+}
+
+/*
+ * Copies the vertices of Count corners of an indexed draw, from First on,
+ * into Gathered, each distinct vertex once, and stores where each corner's
+ * went in Slots and which vertex it was in Sources.  A direct-mapped cache
+ * of the vertices gathered so far, hashed by index, finds the repeats; the
+ * rare vertex that collides with another is simply gathered twice.
+ * Returns the number of vertices gathered.
+ */
+int
+GatherVertices(gs_raster_vertex_stage *Stage, int First, int Count, int *Slots, uint32_t *Sources, gs_raster_vertices *Gathered)
+{
+        gs_raster_vertices *Vertices = Stage->Vertices;
+        int Cache[GS_RASTER_VERTEX_CACHE];
+        uint32_t Cached[GS_RASTER_VERTEX_BATCH]; /* The vertex in each slot. */
+        for(int Line = 0; Line < GS_RASTER_VERTEX_CACHE; Line++)
+        {
+                Cache[Line] = -1;
+        }
+
+        int Result = 0;
+        for(int Corner = 0; Corner < Count; Corner++)
+        {
+                uint32_t Index = IndexAt(Stage->IndexFormat, Stage->Indices, First + Corner);
+                uint32_t Line = (Index * 2654435761u) >> (32 - GS_RASTER_VERTEX_CACHE_BITS);
+                int Slot = Cache[Line];
+                if(Slot < 0 || Cached[Slot] != Index)
+                {
+                        Slot = Result++;
+                        Cache[Line] = Slot;
+                        Cached[Slot] = Index;
+                        Gathered->X[Slot] = Vertices->X[Index];
+                        Gathered->Y[Slot] = Vertices->Y[Index];
+                        Gathered->Z[Slot] = Vertices->Z[Index];
+                        if(Vertices->W != NULL) Gathered->W[Slot] = Vertices->W[Index];
+                }
+                Slots[Corner] = Slot;
+                Sources[Corner] = Index;
+        }
+        return(Result);
+}
+
+/* Adds a setup task's counts to the draw's. */
+void
+SetupCount(gs_raster_draw *Draw, int NumCulled, int NumOutside)
+{
+        if(NumCulled > 0) atomic_fetch_add(&Draw->NumCulled, NumCulled);
+        if(NumOutside > 0) atomic_fetch_add(&Draw->NumOutside, NumOutside);
+}
+
+/*
+ * Transforms the vertices of triangles [First, Last) of a vertex draw and
+ * snaps them into Fixed, then sets up the triangles' gradients, and their
+ * depth planes where the draw has them, and keeps them in screen space in
+ * Draw->Triangles.  A triangle wholly nearer than W = GS_RASTER_NEAR_W, or
+ * with a depth buffer wholly in front of depth 0, is culled along with the
+ * others TriangleCulled rejects; one partly so is left for DrawClip with
+ * its coordinates not a number, which puts it beyond the guard band.
+ */
+void
+SetupVertices(gs_raster_draw *Draw, int First, int Last, gs_raster_fixed_triangle *Fixed)
+{
+        gs_raster_vertex_stage *Stage = Draw->Vertices;
+        gs_raster_vertices *Vertices = Stage->Vertices;
+
+        float X[GS_RASTER_VERTEX_BATCH], Y[GS_RASTER_VERTEX_BATCH], Z[GS_RASTER_VERTEX_BATCH], W[GS_RASTER_VERTEX_BATCH];
+        int32_t FixedX[GS_RASTER_VERTEX_BATCH], FixedY[GS_RASTER_VERTEX_BATCH];
+        gs_raster_vertices Screen = { X, Y, Z, W };
+        int NumCulled = 0;
+        int NumOutside = 0;
+
+        /* Each corner's transformed vertex, and the vertex it came from. */
+        int Slots[GS_RASTER_VERTEX_BATCH];
+        uint32_t Sources[GS_RASTER_VERTEX_BATCH];
+        float GatheredX[GS_RASTER_VERTEX_BATCH], GatheredY[GS_RASTER_VERTEX_BATCH], GatheredZ[GS_RASTER_VERTEX_BATCH], GatheredW[GS_RASTER_VERTEX_BATCH];
+        gs_raster_vertices Gathered = { GatheredX, GatheredY, GatheredZ, (Vertices->W != NULL) ? GatheredW : NULL };
+
+        for(int Batch = First; Batch < Last; Batch += GS_RASTER_VERTEX_BATCH / 3)
+        {
+                int NumTriangles = Last - Batch;
+                if(NumTriangles > GS_RASTER_VERTEX_BATCH / 3) NumTriangles = GS_RASTER_VERTEX_BATCH / 3;
+
+                int NumCorners = NumTriangles * 3;
+                int NumTransformed = NumCorners;
+                if(Stage->Indices != NULL)
+                {
+                        NumTransformed = GatherVertices(Stage, Batch * 3, NumCorners, Slots, Sources, &Gathered);
+                        Kernels.TransformVertices(Stage->Matrix, &Gathered, 0, NumTransformed, &Screen);
+                }
+                else
+                {
+                        for(int Corner = 0; Corner < NumCorners; Corner++)
+                        {
+                                Slots[Corner] = Corner;
+                                Sources[Corner] = (uint32_t)((Batch * 3) + Corner);
+                        }
+                        Kernels.TransformVertices(Stage->Matrix, Vertices, Batch * 3, NumCorners, &Screen);
+                }
+                Kernels.SnapCoordinates(X, FixedX, NumTransformed);
+                Kernels.SnapCoordinates(Y, FixedY, NumTransformed);
+                StatsCount(VerticesTransformed, NumTransformed);
+
+                for(int Local = 0; Local < NumTriangles; Local++)
+                {
+                        int Index = Batch + Local;
+                        int *Slot = &Slots[Local * 3];
+                        uint32_t *Source = &Sources[Local * 3];
+                        /* Corners short of GS_RASTER_NEAR_W, NaN among them, then those past it but in front of depth 0. */
+                        int NumBehind = 0;
+                        int NumNearer = 0;
+                        for(int Point = 0; Point < 3; Point++)
+                        {
+                                if(!(W[Slot[Point]] >= GS_RASTER_NEAR_W)) NumBehind++;
+                                else if(Draw->Depth != NULL && !(Z[Slot[Point]] >= 0.0f)) NumNearer++;
+                        }
+                        bool Visible = (NumBehind == 0 && NumNearer == 0);
+
+                        gs_raster_triangle Triangle = {{{{ 0 }}}};
+                        gs_raster_fixed_triangle *Snapped = &Fixed[Index - First];
+                        for(int Point = 0; Point < 3; Point++)
+                        {
+                                Snapped->Point[Point].X = Visible ? FixedX[Slot[Point]] : 0;
+                                Snapped->Point[Point].Y = Visible ? FixedY[Slot[Point]] : 0;
+                                if(Visible)
+                                {
+                                        Triangle.Point[Point].X = X[Slot[Point]];
+                                        Triangle.Point[Point].Y = Y[Slot[Point]];
+                                }
+                        }
+
+                        if(!Visible && NumBehind < 3 && NumNearer < 3)
+                        {
+                                /* Part of it may be drawn; DrawClip clips it from its vertices. */
+                                for(int Point = 0; Point < 3; Point++)
+                                {
+                                        Triangle.Point[Point].X = NAN;
+                                        Triangle.Point[Point].Y = NAN;
+                                }
+                                Draw->Triangles[Index] = Triangle;
+                                NumOutside++;
+                                continue;
+                        }
+
+                        if(TriangleOutsideGuardBand(&Triangle))
+                        {
+                                NumOutside++;
+                        }
+                        else if(TriangleCulled(Snapped, Draw->Width, Draw->Height, Draw->Cull))
+                        {
+                                /* Nothing more is set up, so no pixel may be drawn. */
+                                gs_raster_fixed_triangle Culled = {{{ 0 }}};
+                                gs_raster_triangle Empty = {{{{ 0 }}}};
+                                *Snapped = Culled;
+                                Draw->Triangles[Index] = Empty;
+                                NumCulled++;
+                                continue;
+                        }
+
+                        if(Stage->Texture != NULL)
+                        {
+                                gs_raster_texcoords Texcoords;
+                                for(int Point = 0; Point < 3; Point++)
+                                {
+                                        Texcoords.U[Point] = Vertices->U[Source[Point]];
+                                        Texcoords.V[Point] = Vertices->V[Source[Point]];
+                                        Texcoords.W[Point] = W[Slot[Point]];
+                                }
+                                Draw->Gradients[Index] = GradientForTexcoords(&Triangle, &Texcoords, Stage->Texture, Stage->Blend);
+                        }
+                        else
+                        {
+                                gs_raster_material Material;
+                                for(int Point = 0; Point < 3; Point++)
+                                {
+                                        Material.VertexColors[Point] = Vertices->Colors[Source[Point]];
+                                }
+                                Draw->Gradients[Index] = GradientForMaterial(&Triangle, &Material, Stage->Blend);
+                        }
+
+                        if(Draw->Depth != NULL)
+                        {
+                                /* The stage's matrix already maps Z / W onto the buffer's 0 to 1. */
+                                gs_raster_depth Depth;
+                                for(int Point = 0; Point < 3; Point++)
+                                {
+                                        Depth.Z[Point] = Z[Slot[Point]];
+                                }
+                                Draw->Depth->Planes[Index] = DepthPlaneForTriangle(Draw->Depth, &Triangle, &Depth);
+                        }
+
+                        Draw->Triangles[Index] = Triangle;
+                }
+        }
+
+        SetupCount(Draw, NumCulled, NumOutside);
+}
+
+/*
+ * Snaps triangles [First, Last) into Fixed, culls those TriangleCulled
+ * rejects by clearing them, and sets up the depth planes of the rest, or
+ * hands vertex draws to SetupVertices.  Triangles beyond the guard band are
+ * only counted, and their planes set up for DrawClip.
+ */
+void
+SetupTriangles(gs_raster_draw *Draw, int First, int Last, gs_raster_fixed_triangle *Fixed)
+{
+        if(Draw->Vertices != NULL)
+        {
+                SetupVertices(Draw, First, Last, Fixed);
+                return;
+        }
+
+        Kernels.SnapCoordinates((float *)(Draw->Triangles + First), (int32_t *)Fixed, (Last - First) * 6);
+
+        int NumCulled = 0;
+        int NumOutside = 0;
+        for(int Index = First; Index < Last; Index++)
+        {
+                gs_raster_fixed_triangle *Snapped = &Fixed[Index - First];
+                /* The scanline engine needs every piece of a shape for its boundary; DrawClip culled the shape. */
+                bool Piece = (Draw->Table != NULL && Draw->Shapes != NULL && Draw->Shapes[Index].Count > 1);
+                if(TriangleOutsideGuardBand(&Draw->Triangles[Index]))
+                {
+                        NumOutside++;
+                }
+                else if(!Piece && TriangleCulled(Snapped, Draw->Width, Draw->Height, Draw->Cull))
+                {
+                        gs_raster_fixed_triangle Culled = {{{ 0 }}};
+                        *Snapped = Culled;
+                        NumCulled++;
+                        continue;
+                }
+
+                if(Draw->Depth != NULL)
+                {
+                        Draw->Depth->Planes[Index] = DepthPlaneForTriangle(Draw->Depth, &Draw->Triangles[Index], &Draw->Depths[Index]);
+                }
+        }
+
+        SetupCount(Draw, NumCulled, NumOutside);
+}
+
+void
+SetupEdgesTask(void *Data, int Task, gs_raster_worker *Worker)
+{
+        gs_raster_draw *Draw = (gs_raster_draw *)Data;
+        int First = Task * GS_RASTER_SETUP_BATCH;
+        int Last = First + GS_RASTER_SETUP_BATCH;
+        if(Last > Draw->NumTriangles) Last = Draw->NumTriangles;
+
+        StatsTimerBegin(SetupStart);
+        gs_raster_fixed_triangle Fixed[GS_RASTER_SETUP_BATCH];
+        SetupTriangles(Draw, First, Last, Fixed);
+
+        for(int Index = First; Index < Last; Index++)
+        {
+                gs_raster_edge *Edges = &Draw->Table->Edges[Index * 3];
+                EdgesForTriangle(Edges, &Fixed[Index - First], Index, Draw->Height);
+                if(Draw->Shapes != NULL) EdgesForShape(Edges, &Draw->Shapes[Index], Index);
+                BoundsFromEdges(&Draw->Bounds[Index], Edges, Draw->Width);
+        }
+        StatsTimerEnd(SetupStart, GS_RASTER_STAGE_SETUP);
+}
+
+/*
+ * Stores rows [Y0, Y1) of a frame drawn into scratch memory, columns
+ * [X0, X1), into Pixels, a Width-wide grid in Format.  Pixel (X, Y) of the
+ * scratch is Origin[(Y * Stride) + X].
+ */
+void
+StoreRows(void *Pixels, gs_raster_format Format, int Width, int *Origin, int Stride, int X0, int Y0, int X1, int Y1)
+{
+        for(int Row = Y0; Row < Y1; Row++)
+        {
+                int *Source = Origin + ((size_t)Row * Stride) + X0;
+                size_t Offset = ((size_t)Row * Width) + X0;
+                switch(Format)
+                {
+                        case GS_RASTER_FORMAT_RGBA8888: Kernels.CopySpan((int *)Pixels + Offset, Source, X1 - X0); break;
+                        case GS_RASTER_FORMAT_RGB565: Kernels.PackSpanRgb565((uint16_t *)Pixels + Offset, Source, X1 - X0); break;
+                        case GS_RASTER_FORMAT_INDEX8: Kernels.PackSpanIndex8((uint8_t *)Pixels + Offset, Source, X1 - X0); break;
+                }
+        }
+}
+
+/*
+ * Draws rows [Y0, Y1) with RasterizeScanlineRows, straight into Pixels when
+ * it holds RGBA8888, or else into the worker's band, packed once it is done.
+ */
+void
+RasterizeScanlineBand(void *Pixels, gs_raster_format Format, int Width, gs_raster_scanline *Scanlines, int Y0, int Y1, gs_raster_worker *Worker, gs_raster_color *Colors, gs_raster_gradient *Gradients, gs_raster_depth_buffer *Depth, gs_raster_triangle *Triangles, gs_raster_shape *Shapes)
+{
+        if(Format == GS_RASTER_FORMAT_RGBA8888)
+        {
+                RasterizeScanlineRows((int *)Pixels, Width, Scanlines, Y0, Y1, Worker->Stack, Colors, Gradients, Depth, Triangles, Shapes);
+                return;
+        }
+
+        /* Offset so the band's rows are indexed by frame row. */
+        int *Origin = Worker->Band - ((size_t)Y0 * Width);
+        StreamingSpan = INT_MAX;
+        RasterizeScanlineRows(Origin, Width, Scanlines, Y0, Y1, Worker->Stack, Colors, Gradients, Depth, Triangles, Shapes);
+        StreamingSpan = GS_RASTER_STREAMING_SPAN;
+        StoreRows(Pixels, Format, Width, Origin, Width, 0, Y0, Width, Y1);
+}
+
+void
+ScanlineBandTask(void *Data, int Task, gs_raster_worker *Worker)
+{
+        gs_raster_draw *Draw = (gs_raster_draw *)Data;
+        gs_raster_bins *Bins = &Draw->Bins;
+        int Y0 = Task * Bins->TileHeight;
+        int Y1 = Y0 + Bins->TileHeight;
+        if(Y1 > Draw->Height) Y1 = Draw->Height;
+
+        int *Triangles = Bins->Triangles + Bins->Offsets[Task];
+        int NumTriangles = Bins->Offsets[Task + 1] - Bins->Offsets[Task];
+
+        StatsTimerBegin(GenerateStart);
+        GenerateScanlineRows(Draw->Table, &Worker->Active, Draw->Scanlines, Y0, Y1, Triangles, NumTriangles);
+        StatsTimerEnd(GenerateStart, GS_RASTER_STAGE_GENERATE);
+
+        StatsTimerBegin(RasterizeStart);
+        RasterizeScanlineBand(Draw->Pixels, Draw->Format, Draw->Width, Draw->Scanlines, Y0, Y1, Worker, Draw->Colors, Draw->Gradients, Draw->Depth, Draw->Antialias ? Draw->Triangles : NULL, Draw->Shapes);
+        StatsTimerEnd(RasterizeStart, GS_RASTER_STAGE_RASTERIZE);
+}
+
+void
+HalfSpaceSetupTask(void *Data, int Task, gs_raster_worker *Worker)
+{
+        gs_raster_draw *Draw = (gs_raster_draw *)Data;
+        int First = Task * GS_RASTER_SETUP_BATCH;
+        int Last = First + GS_RASTER_SETUP_BATCH;
+        if(Last > Draw->NumTriangles) Last = Draw->NumTriangles;
+
+        StatsTimerBegin(SetupStart);
+        gs_raster_fixed_triangle Fixed[GS_RASTER_SETUP_BATCH];
+        SetupTriangles(Draw, First, Last, Fixed);
+
+        for(int Index = First; Index < Last; Index++)
+        {
+                HalfSpaceSetup(&Draw->Setups[Index], &Fixed[Index - First], Draw->Width, Draw->Height);
+                BoundsFromHalfSpace(&Draw->Bounds[Index], &Draw->Setups[Index]);
+        }
+        StatsTimerEnd(SetupStart, GS_RASTER_STAGE_SETUP);
+}
+
+void
+HalfSpaceTileTask(void *Data, int Task, gs_raster_worker *Worker)
+{
+        gs_raster_draw *Draw = (gs_raster_draw *)Data;
+        gs_raster_bins *Bins = &Draw->Bins;
+        int X0 = (Task % Bins->TilesX) * Bins->TileWidth;
+        int Y0 = (Task / Bins->TilesX) * Bins->TileHeight;
+
+        int *Triangles = Bins->Triangles + Bins->Offsets[Task];
+        int NumTriangles = Bins->Offsets[Task + 1] - Bins->Offsets[Task];
+
+        StatsTimerBegin(RasterizeStart);
+        if(Draw->Blocks == NULL)
+        {
+                RasterizeHalfSpaceBlock((int *)Draw->Pixels, Draw->Width, Draw->Width, Draw->Height, Draw->Setups, Triangles, NumTriangles, X0, Y0, Draw->Colors, Draw->Gradients, Draw->Depth);
+        }
+        else
+        {
+                /* Offset so the block's rows are indexed by frame coordinates; see RasterizeHalfSpaceBlock. */
+                int *Block = Draw->Blocks + ((size_t)Task * GS_RASTER_BLOCK_SIZE * GS_RASTER_BLOCK_SIZE);
+                int *Origin = Block - ((Y0 * GS_RASTER_BLOCK_SIZE) + X0);
+                RasterizeHalfSpaceBlock(Origin, GS_RASTER_BLOCK_SIZE, Draw->Width, Draw->Height, Draw->Setups, Triangles, NumTriangles, X0, Y0, Draw->Colors, Draw->Gradients, Draw->Depth);
+
+                int X1 = (X0 + GS_RASTER_BLOCK_SIZE < Draw->Width) ? (X0 + GS_RASTER_BLOCK_SIZE) : Draw->Width;
+                int Y1 = (Y0 + GS_RASTER_BLOCK_SIZE < Draw->Height) ? (Y0 + GS_RASTER_BLOCK_SIZE) : Draw->Height;
+                StoreRows(Draw->Pixels, Draw->Format, Draw->Width, Origin, GS_RASTER_BLOCK_SIZE, X0, Y0, X1, Y1);
+        }
+        StatsTimerEnd(RasterizeStart, GS_RASTER_STAGE_RASTERIZE);
+}
+
+/*
+ * Pushes a draw's per-triangle scratch memory and sets up its triangles on
+ * every thread.  Returns the number of triangles found beyond the guard
+ * band; if there are any, the draw must be clipped and set up again.
+ * Returns -1, setting nothing up, if the memory cannot be allocated.
+ */
+int
+DrawSetup(gs_raster_context *Context, gs_raster_draw *Draw)
+{
+        gs_raster_arena *Arena = Context->Arena;
+        int NumTriangles = Draw->NumTriangles;
+        Draw->Bounds = ArenaPushArray(Arena, NumTriangles, gs_raster_bounds);
+        atomic_init(&Draw->NumCulled, 0);
+        atomic_init(&Draw->NumOutside, 0);
+        Draw->Table = NULL;
+        Draw->Setups = NULL;
+        Draw->Depth = NULL;
+        if((Draw->Depths != NULL || Draw->Vertices != NULL) && Context->Depth != NULL)
+        {
+                Draw->Depth = Context->Depth;
+                Draw->Depth->Planes = ArenaPushArray(Arena, NumTriangles, gs_raster_depth_plane);
+        }
+
+        int NumSetupTasks = (NumTriangles + GS_RASTER_SETUP_BATCH - 1) / GS_RASTER_SETUP_BATCH;
+
+        switch(Context->Engine)
+        {
+                case GS_RASTER_ENGINE_SCANLINE:
+                {
+                        Draw->Table = ArenaPushStruct(Arena, gs_raster_edge_table);
+                        void *TableMemory = ArenaPush(Arena, EdgeTableSizeRequired(NumTriangles, Context->Height), GS_RASTER_ARENA_ALIGNMENT);
+                        if(Draw->Bounds == NULL || (Draw->Depth != NULL && Draw->Depth->Planes == NULL) ||
+                           Draw->Table == NULL || TableMemory == NULL)
+                        {
+                                return(-1);
+                        }
+                        EdgeTableInit(Draw->Table, NumTriangles, Context->Height, TableMemory);
+                        WorkersRun(Context->Workers, SetupEdgesTask, Draw, NumSetupTasks);
+                } break;
+
+                case GS_RASTER_ENGINE_HALFSPACE:
+                {
+                        Draw->Setups = ArenaPushArray(Arena, NumTriangles, gs_raster_halfspace_triangle);
+                        if(Draw->Bounds == NULL || (Draw->Depth != NULL && Draw->Depth->Planes == NULL) || Draw->Setups == NULL)
+                        {
+                                return(-1);
+                        }
+                        WorkersRun(Context->Workers, HalfSpaceSetupTask, Draw, NumSetupTasks);
+                } break;
+        }
+
+        int Result = atomic_load(&Draw->NumOutside);
+        return(Result);
+}
+
+/* Depth at a point of a triangle set up with the plane, back on the 0 to 1 scale of gs_raster_depth. */
+float
+DepthOnPlane(gs_raster_depth_buffer *Buffer, gs_raster_depth_plane *Plane, gs_raster_point2d Point)
+{
+        float Z = Plane->Base + (Plane->DzDx * (Point.X - 0.5f)) + (Plane->DzDy * (Point.Y - 0.5f));
+        Z = fminf(fmaxf(Z, Plane->MinZ), Plane->MaxZ);
+        float Result = Z / Buffer->Far;
+        return(Result);
+}
+
+/* A corner of a vertex draw's triangle in clip space, by the stage's matrix, with what it is shaded by. */
+struct gs_raster_clip_vertex
+{
+        float Clip[4];
+        float Values[4]; /* U and V with a texture, else the color's channels. */
+};
+typedef struct gs_raster_clip_vertex gs_raster_clip_vertex;
+
+/* The most points ClipVertices leaves of a triangle: one more per plane. */
+#define GS_RASTER_CLIP_VERTICES 9
+
+/* The corner at Corner of a vertex draw, transformed exactly as TransformVerticesScalar does. */
+gs_raster_clip_vertex
+ClipVertexAt(gs_raster_vertex_stage *Stage, int Corner)
+{
+        gs_raster_vertices *Vertices = Stage->Vertices;
+        float (*Matrix)[4] = Stage->Matrix;
+        uint32_t Index = (Stage->Indices != NULL) ? IndexAt(Stage->IndexFormat, Stage->Indices, Corner) : (uint32_t)Corner;
+        float X = Vertices->X[Index];
+        float Y = Vertices->Y[Index];
+        float Z = Vertices->Z[Index];
+        float W = (Vertices->W != NULL) ? Vertices->W[Index] : 1.0f;
+
+        gs_raster_clip_vertex Result;
+        for(int Row = 0; Row < 4; Row++)
+        {
+                Result.Clip[Row] = (((Matrix[Row][0] * X) + (Matrix[Row][1] * Y)) + (Matrix[Row][2] * Z)) + (Matrix[Row][3] * W);
+        }
+        if(Stage->Texture != NULL)
+        {
+                Result.Values[0] = Vertices->U[Index];
+                Result.Values[1] = Vertices->V[Index];
+                Result.Values[2] = 0.0f;
+                Result.Values[3] = 0.0f;
+        }
+        else
+        {
+                for(int Channel = 0; Channel < 4; Channel++)
+                {
+                        Result.Values[Channel] = ColorChannel(Vertices->Colors[Index], Channel);
+                }
+        }
+        return(Result);
+}
+
+/*
+ * Clips the triangle Corners make in clip space, before the divide, into
+ * the convex polygon Points, and returns its number of points; 0 when
+ * nothing is left, or a coordinate is not finite.  The planes are W =
+ * GS_RASTER_NEAR_W, depth 0 when Depth is set, and the guard band's four
+ * sides, so dividing every point by its W lands it within the band.  Values
+ * are interpolated along with the coordinates, so they stay correct in
+ * perspective.
+ */
+int
+ClipVertices(gs_raster_clip_vertex Corners[3], bool Depth, gs_raster_clip_vertex Points[GS_RASTER_CLIP_VERTICES])
+{
+        float Band = GS_RASTER_GUARD_BAND;
+        int NumPoints = 3;
+        for(int Index = 0; Index < 3; Index++)
+        {
+                Points[Index] = Corners[Index];
+                for(int Coordinate = 0; Coordinate < 4; Coordinate++)
+                {
+                        if(!isfinite(Points[Index].Clip[Coordinate])) return(0);
+                }
+        }
+
+        /* Planes are W >= GS_RASTER_NEAR_W, Z >= 0, then X and Y within Band * W either way. */
+        for(int Plane = 0; Plane < 6 && NumPoints > 0; Plane++)
+        {
+                if(Plane == 1 && !Depth) continue;
+
+                gs_raster_clip_vertex Input[GS_RASTER_CLIP_VERTICES];
+                float Inside[GS_RASTER_CLIP_VERTICES]; /* Distance from the plane, negative when outside. */
+                int NumInput = NumPoints;
+                for(int Index = 0; Index < NumInput; Index++)
+                {
+                        Input[Index] = Points[Index];
+                        float *Clip = Input[Index].Clip;
+                        switch(Plane)
+                        {
+                                case 0: Inside[Index] = Clip[3] - GS_RASTER_NEAR_W; break;
+                                case 1: Inside[Index] = Clip[2]; break;
+                                default:
+                                {
+                                        float Sign = (Plane & 1) ? -1.0f : 1.0f;
+                                        Inside[Index] = (Band * Clip[3]) + (Sign * Clip[(Plane - 2) / 2]);
+                                } break;
+                        }
+                }
+
+                NumPoints = 0;
+                for(int Index = 0; Index < NumInput; Index++)
+                {
+                        int Previous = (Index + NumInput - 1) % NumInput;
+                        if((Inside[Previous] >= 0.0f) != (Inside[Index] >= 0.0f))
+                        {
+                                float T = Inside[Previous] / (Inside[Previous] - Inside[Index]);
+                                gs_raster_clip_vertex *Point = &Points[NumPoints++];
+                                for(int Coordinate = 0; Coordinate < 4; Coordinate++)
+                                {
+                                        Point->Clip[Coordinate] = Input[Previous].Clip[Coordinate] + (T * (Input[Index].Clip[Coordinate] - Input[Previous].Clip[Coordinate]));
+                                        Point->Values[Coordinate] = Input[Previous].Values[Coordinate] + (T * (Input[Index].Values[Coordinate] - Input[Previous].Values[Coordinate]));
+                                }
+                                if(Plane == 0) Point->Clip[3] = GS_RASTER_NEAR_W;
+                                if(Plane == 1) Point->Clip[2] = 0.0f;
+                        }
+                        if(Inside[Index] >= 0.0f)
+                        {
+                                Points[NumPoints++] = Input[Index];
+                        }
+                }
+        }
+        return(NumPoints);
+}
+
+/*
+ * The gradient shared by the pieces of a vertex draw's triangle clipped into
+ * Points, fit to the largest piece of the fan, since the planes of every
+ * piece are those of the triangle.
+ */
+gs_raster_gradient
+GradientForClipped(gs_raster_vertex_stage *Stage, gs_raster_clip_vertex *Points, gs_raster_point2d *Screen, int NumPoints)
+{
+        int Largest = 2;
+        float LargestArea = -1.0f;
+        for(int Piece = 2; Piece < NumPoints; Piece++)
+        {
+                float Area = fabsf(((Screen[Piece - 1].X - Screen[0].X) * (Screen[Piece].Y - Screen[0].Y)) -
+                                   ((Screen[Piece].X - Screen[0].X) * (Screen[Piece - 1].Y - Screen[0].Y)));
+                if(Area > LargestArea)
+                {
+                        Largest = Piece;
+                        LargestArea = Area;
+                }
+        }
+
+        int Corners[3] = { 0, Largest - 1, Largest };
+        gs_raster_triangle Triangle;
+        for(int Point = 0; Point < 3; Point++) Triangle.Point[Point] = Screen[Corners[Point]];
+
+        gs_raster_gradient Result;
+        if(Stage->Texture != NULL)
         {
-                LesserX = Line.StartX;
-                GreaterX = Line.EndX;
+                gs_raster_texcoords Texcoords;
+                for(int Point = 0; Point < 3; Point++)
+                {
+                        Texcoords.U[Point] = Points[Corners[Point]].Values[0];
+                        Texcoords.V[Point] = Points[Corners[Point]].Values[1];
+                        Texcoords.W[Point] = Points[Corners[Point]].Clip[3];
+                }
+                Result = GradientForTexcoords(&Triangle, &Texcoords, Stage->Texture, Stage->Blend);
         }
         else
         {
-                LesserX = Line.EndX;
-                GreaterX = Line.StartX;
+                gs_raster_material Material;
+                for(int Point = 0; Point < 3; Point++)
+                {
+                        gs_raster_color Color = 0;
+                        for(int Channel = 0; Channel < 4; Channel++)
+                        {
+                                float Value = rintf(Points[Corners[Point]].Values[Channel]);
+                                Value = fminf(fmaxf(Value, 0.0f), 255.0f);
+                                Color |= (gs_raster_color)Value << (Channel * 8);
+                        }
+                        Material.VertexColors[Point] = Color;
+                }
+                Result = GradientForMaterial(&Triangle, &Material, Stage->Blend);
+        }
+        return(Result);
+}
+
+/* TriangleCulled for the convex polygon a triangle was clipped into, snapped as its pieces will be. */
+bool
+PolygonCulled(gs_raster_point2d *Points, int NumPoints, int Width, int Height, gs_raster_cull Cull)
+{
+        gs_raster_fixed_point Point[GS_RASTER_CLIP_VERTICES];
+        SnapCoordinatesScalar((float *)Points, (int32_t *)Point, NumPoints * 2);
+
+        int64_t Area = 0;
+        int32_t MinX = Point[0].X, MaxX = Point[0].X;
+        int32_t MinY = Point[0].Y, MaxY = Point[0].Y;
+        for(int Index = 0; Index < NumPoints; Index++)
+        {
+                gs_raster_fixed_point *Next = &Point[(Index + 1) % NumPoints];
+                Area += ((int64_t)Point[Index].X * Next->Y) - ((int64_t)Next->X * Point[Index].Y);
+                if(Point[Index].X < MinX) MinX = Point[Index].X;
+                if(Point[Index].X > MaxX) MaxX = Point[Index].X;
+                if(Point[Index].Y < MinY) MinY = Point[Index].Y;
+                if(Point[Index].Y > MaxY) MaxY = Point[Index].Y;
+        }
+        if(Area == 0) return(true);
+        if(Cull == GS_RASTER_CULL_BACK && Area > 0) return(true);
+
+        bool Result = (MaxX < -GS_RASTER_SUBPIXEL_ONE || MaxY < -GS_RASTER_SUBPIXEL_ONE ||
+                       MinX > (int64_t)(Width + 1) * GS_RASTER_SUBPIXEL_ONE ||
+                       MinY > (int64_t)(Height + 1) * GS_RASTER_SUBPIXEL_ONE);
+        return(Result);
+}
+
+/*
+ * Replaces the triangles of a draw DrawSetup found beyond the guard band
+ * with the fan of pieces ClipToGuardBand leaves of each, in its place so
+ * the draw order holds, and records each fan in Shapes.  A fan of more than
+ * one piece is culled as a whole, since the scanline engine draws it as
+ * one shape.  Pieces share the colors or gradients of their
+ * triangle, whose planes were fit to it unsnapped, and take their depths
+ * from its depth plane, so they are shaded and depth tested as it would be.
+ * A vertex draw's triangles the near plane cuts are clipped from their
+ * vertices by ClipVertices instead, before the divide, and their pieces
+ * share a gradient fit to one of them.
+ * Triangles setup found nothing to draw for are left out.  Returns false,
+ * changing nothing, if the memory for the pieces cannot be allocated.
+ */
+bool
+DrawClip(gs_raster_arena *Arena, gs_raster_draw *Draw, int NumOutside)
+{
+        gs_raster_vertex_stage *Stage = Draw->Vertices;
+        int MaxPoints = (Stage != NULL) ? GS_RASTER_CLIP_VERTICES : GS_RASTER_CLIP_POINTS;
+        int MaxTriangles = Draw->NumTriangles + (NumOutside * (MaxPoints - 3));
+        gs_raster_triangle *Triangles = ArenaPushArray(Arena, MaxTriangles, gs_raster_triangle);
+        gs_raster_color *Colors = (Draw->Colors != NULL) ? ArenaPushArray(Arena, MaxTriangles, gs_raster_color) : NULL;
+        gs_raster_gradient *Gradients = (Draw->Gradients != NULL) ? ArenaPushArray(Arena, MaxTriangles, gs_raster_gradient) : NULL;
+        gs_raster_depth *Depths = (Draw->Depth != NULL) ? ArenaPushArray(Arena, MaxTriangles, gs_raster_depth) : NULL;
+        gs_raster_shape *Shapes = ArenaPushArray(Arena, MaxTriangles, gs_raster_shape);
+        if(Triangles == NULL || Shapes == NULL || (Draw->Colors != NULL && Colors == NULL) ||
+           (Draw->Gradients != NULL && Gradients == NULL) || (Draw->Depth != NULL && Depths == NULL))
+        {
+                return(false);
+        }
+
+        int NumTriangles = 0;
+        for(int Index = 0; Index < Draw->NumTriangles; Index++)
+        {
+                gs_raster_triangle *Triangle = &Draw->Triangles[Index];
+                gs_raster_point2d Points[GS_RASTER_CLIP_VERTICES];
+                float PointZ[GS_RASTER_CLIP_VERTICES];
+                gs_raster_gradient Gradient = {{ 0 }};
+                int NumPoints = 0;
+                bool Clipped = TriangleOutsideGuardBand(Triangle);
+                bool FromVertices = (Stage != NULL && isnan(Triangle->X1)); /* Cut by the near plane; see SetupVertices. */
+                if(FromVertices)
+                {
+                        gs_raster_clip_vertex Corners[3];
+                        gs_raster_clip_vertex Vertices[GS_RASTER_CLIP_VERTICES];
+                        for(int Point = 0; Point < 3; Point++) Corners[Point] = ClipVertexAt(Stage, (Index * 3) + Point);
+                        NumPoints = ClipVertices(Corners, Draw->Depth != NULL, Vertices);
+
+                        /* Dividing can round a point just past the band. */
+                        float Band = GS_RASTER_GUARD_BAND;
+                        for(int Point = 0; Point < NumPoints; Point++)
+                        {
+                                float *Clip = Vertices[Point].Clip;
+                                Points[Point].X = fminf(fmaxf(Clip[0] / Clip[3], -Band), Band);
+                                Points[Point].Y = fminf(fmaxf(Clip[1] / Clip[3], -Band), Band);
+                                PointZ[Point] = Clip[2] / Clip[3];
+                        }
+                        if(NumPoints >= 3) Gradient = GradientForClipped(Stage, Vertices, Points, NumPoints);
+                }
+                else if(Clipped)
+                {
+                        NumPoints = ClipToGuardBand(Triangle, Points);
+                }
+                else if(Draw->Bounds[Index].MinY <= Draw->Bounds[Index].MaxY)
+                {
+                        NumPoints = 3;
+                        for(int Point = 0; Point < 3; Point++) Points[Point] = Triangle->Point[Point];
+                }
+
+                if(NumPoints > 3 && PolygonCulled(Points, NumPoints, Draw->Width, Draw->Height, Draw->Cull))
+                {
+                        NumPoints = 0;
+                }
+
+                int First = NumTriangles;
+                for(int Piece = 2; Piece < NumPoints; Piece++)
+                {
+                        gs_raster_triangle *Result = &Triangles[NumTriangles];
+                        Shapes[NumTriangles].First = First;
+                        Shapes[NumTriangles].Count = NumPoints - 2;
+                        Result->Point[0] = Points[0];
+                        Result->Point[1] = Points[Piece - 1];
+                        Result->Point[2] = Points[Piece];
+
+                        if(Colors != NULL) Colors[NumTriangles] = Draw->Colors[Index];
+                        if(Gradients != NULL) Gradients[NumTriangles] = FromVertices ? Gradient : Draw->Gradients[Index];
+                        if(Depths != NULL)
+                        {
+                                if(Draw->Depths != NULL && !Clipped)
+                                {
+                                        Depths[NumTriangles] = Draw->Depths[Index];
+                                }
+                                else if(FromVertices)
+                                {
+                                        int Corners[3] = { 0, Piece - 1, Piece };
+                                        for(int Point = 0; Point < 3; Point++) Depths[NumTriangles].Z[Point] = PointZ[Corners[Point]];
+                                }
+                                else
+                                {
+                                        for(int Point = 0; Point < 3; Point++)
+                                        {
+                                                Depths[NumTriangles].Z[Point] = DepthOnPlane(Draw->Depth, &Draw->Depth->Planes[Index], Result->Point[Point]);
+                                        }
+                                }
+                        }
+                        NumTriangles++;
+                }
+        }
+
+        Draw->Vertices = NULL;
+        Draw->Triangles = Triangles;
+        Draw->NumTriangles = NumTriangles;
+        Draw->Shapes = Shapes;
+        Draw->Colors = Colors;
+        Draw->Gradients = Gradients;
+        Draw->Depths = Depths;
+        return(true);
+}
+
+/*
+ * Gives the first piece of each shape the depth plane of its largest piece,
+ * the best fit to the polygon's plane, over the depth range of all its
+ * pieces, since the scanline engine draws the whole shape with it.
+ */
+void
+ShapesDepthPlanes(gs_raster_draw *Draw)
+{
+        gs_raster_depth_plane *Planes = Draw->Depth->Planes;
+        for(int First = 0; First < Draw->NumTriangles; First += Draw->Shapes[First].Count)
+        {
+                int Count = Draw->Shapes[First].Count;
+                if(Count == 1) continue;
+
+                int Largest = First;
+                float LargestArea = -1.0f;
+                float MinZ = Planes[First].MinZ;
+                float MaxZ = Planes[First].MaxZ;
+                for(int Piece = First; Piece < First + Count; Piece++)
+                {
+                        gs_raster_triangle *Triangle = &Draw->Triangles[Piece];
+                        float Area = fabsf(((Triangle->X2 - Triangle->X1) * (Triangle->Y3 - Triangle->Y1)) -
+                                           ((Triangle->X3 - Triangle->X1) * (Triangle->Y2 - Triangle->Y1)));
+                        if(Area > LargestArea)
+                        {
+                                Largest = Piece;
+                                LargestArea = Area;
+                        }
+                        MinZ = fminf(MinZ, Planes[Piece].MinZ);
+                        MaxZ = fmaxf(MaxZ, Planes[Piece].MaxZ);
+                }
+
+                gs_raster_depth_plane Plane = Planes[Largest];
+                Plane.MinZ = MinZ;
+                Plane.MaxZ = MaxZ;
+                Planes[First] = Plane;
+        }
+}
+
+/*
+ * Sets up all triangles, bins them into screen tiles, then rasterizes the
+ * tiles in parallel; idle threads steal tiles from busy ones, so clustered
+ * geometry still spreads across every thread.  Every tile is computed the
+ * same way whichever thread draws it, so the output does not depend on the
+ * number of threads.
+ * Triangles reaching beyond the guard band are rare enough that finding one
+ * sets the whole draw up a second time, clipped.
+ * Scratch memory comes from the context's arena; the caller pops it.
+ */
+void
+Draw(gs_raster_context *Context, void *Pixels, gs_raster_triangle Triangles[], int NumTriangles, gs_raster_color *Colors, gs_raster_gradient *Gradients, gs_raster_depth *Depths, gs_raster_vertex_stage *Vertices)
+{
+        gs_raster_arena *Arena = Context->Arena;
+        gs_raster_workers *Pool = Context->Workers;
+        gs_raster_draw Draw;
+        Draw.Vertices = Vertices;
+        Draw.Triangles = Triangles;
+        Draw.NumTriangles = NumTriangles;
+        Draw.Colors = Colors;
+        Draw.Gradients = Gradients;
+        Draw.Antialias = (Context->Antialias != GS_RASTER_ANTIALIAS_NONE);
+        Draw.Pixels = Pixels;
+        Draw.Format = Context->Format;
+        Draw.Blocks = Context->Blocks;
+        Draw.Width = Context->Width;
+        Draw.Height = Context->Height;
+        Draw.Cull = Context->Cull;
+        Draw.Scanlines = Context->Scanlines;
+        Draw.Depths = Depths;
+        Draw.Depth = NULL;
+        Draw.Shapes = NULL;
+        if(Vertices != NULL)
+        {
+                Draw.Triangles = ArenaPushArray(Arena, NumTriangles, gs_raster_triangle);
+                if(Draw.Triangles == NULL) return;
+        }
+
+        /* A draw whose scratch memory cannot be allocated draws nothing. */
+        int NumOutside = DrawSetup(Context, &Draw);
+        if(NumOutside > 0)
+        {
+                StatsCount(TrianglesClipped, NumOutside);
+                StatsTimerBegin(ClipStart);
+                bool Clipped = DrawClip(Arena, &Draw, NumOutside);
+                StatsTimerEnd(ClipStart, GS_RASTER_STAGE_SETUP);
+                NumOutside = Clipped ? DrawSetup(Context, &Draw) : -1;
+                if(NumOutside >= 0 && Context->Engine == GS_RASTER_ENGINE_SCANLINE && Draw.Depth != NULL)
+                {
+                        ShapesDepthPlanes(&Draw);
+                }
+        }
+
+        if(NumOutside >= 0)
+        {
+                StatsCount(TrianglesCulled, atomic_load(&Draw.NumCulled));
+
+                switch(Context->Engine)
+                {
+                        case GS_RASTER_ENGINE_SCANLINE:
+                        {
+                                StatsTimerBegin(BinStart);
+                                Draw.Table->NumEdges = Draw.NumTriangles * 3;
+                                EdgeTableBucket(Draw.Table);
+
+                                bool Binned = BinsBuild(Arena, &Draw.Bins, Draw.Bounds, Draw.NumTriangles, Context->Width, Context->Height, Context->Width, GS_RASTER_BAND_HEIGHT);
+                                StatsTimerEnd(BinStart, GS_RASTER_STAGE_BIN);
+                                if(Binned) WorkersRun(Pool, ScanlineBandTask, &Draw, Draw.Bins.TilesY);
+                        } break;
+
+                        case GS_RASTER_ENGINE_HALFSPACE:
+                        {
+                                /* Tiles are blocks; see RasterizeHalfSpaceBlock. */
+                                StatsTimerBegin(BinStart);
+                                bool Binned = BinsBuild(Arena, &Draw.Bins, Draw.Bounds, Draw.NumTriangles, Context->Width, Context->Height, GS_RASTER_BLOCK_SIZE, GS_RASTER_BLOCK_SIZE);
+                                StatsTimerEnd(BinStart, GS_RASTER_STAGE_BIN);
+                                if(Binned) WorkersRun(Pool, HalfSpaceTileTask, &Draw, Draw.Bins.TilesX * Draw.Bins.TilesY);
+                        } break;
+                }
+        }
+
+        if(Draw.Depth != NULL)
+        {
+                Draw.Depth->Planes = NULL;
         }
+}
+
+void
+GsRasterDraw(gs_raster_context *Context, void *Pixels, gs_raster_triangle Triangles[], gs_raster_color Colors[], gs_raster_depth Depths[], int NumTriangles)
+{
+        StatsBegin();
+        gs_raster_arena_mark Mark = ArenaMark(Context->Arena);
 
-        if(Line.StartY < Line.EndY)
+        if(Context->Blend != GS_RASTER_BLEND_NONE)
         {
-                LesserY = Line.StartY;
-                GreaterY = Line.EndY;
+                /* Blending works on gradients, so flat colors become flat gradients. */
+                StatsTimerBegin(SetupStart);
+                gs_raster_gradient *Gradients = ArenaPushArray(Context->Arena, NumTriangles, gs_raster_gradient);
+                for(int Index = 0; Gradients != NULL && Index < NumTriangles; Index++)
+                {
+                        Gradients[Index] = GradientForColor(Colors[Index], Context->Blend);
+                }
+                StatsTimerEnd(SetupStart, GS_RASTER_STAGE_SETUP);
+                if(Gradients != NULL) Draw(Context, Pixels, Triangles, NumTriangles, NULL, Gradients, Depths, NULL);
         }
         else
         {
-                LesserY = Line.EndY;
-                GreaterY = Line.StartY;
+                Draw(Context, Pixels, Triangles, NumTriangles, Colors, NULL, Depths, NULL);
+        }
+
+        ArenaPop(Context->Arena, Mark);
+        StatsEnd();
+}
+
+void
+GsRasterDrawShaded(gs_raster_context *Context, void *Pixels, gs_raster_triangle Triangles[], gs_raster_material Materials[], gs_raster_depth Depths[], int NumTriangles)
+{
+        StatsBegin();
+        gs_raster_arena_mark Mark = ArenaMark(Context->Arena);
+
+        StatsTimerBegin(SetupStart);
+        gs_raster_gradient *Gradients = ArenaPushArray(Context->Arena, NumTriangles, gs_raster_gradient);
+        if(Gradients != NULL)
+        {
+                GradientsForMaterials(Gradients, Triangles, Materials, NumTriangles, Context->Blend);
+        }
+        StatsTimerEnd(SetupStart, GS_RASTER_STAGE_SETUP);
+        if(Gradients != NULL) Draw(Context, Pixels, Triangles, NumTriangles, NULL, Gradients, Depths, NULL);
+
+        ArenaPop(Context->Arena, Mark);
+        StatsEnd();
+}
+
+void
+GsRasterDrawTextured(gs_raster_context *Context, void *Pixels, gs_raster_triangle Triangles[], gs_raster_texcoords Texcoords[], gs_raster_texture *Texture, gs_raster_depth Depths[], int NumTriangles)
+{
+        StatsBegin();
+        gs_raster_arena_mark Mark = ArenaMark(Context->Arena);
+
+        StatsTimerBegin(SetupStart);
+        gs_raster_gradient *Gradients = ArenaPushArray(Context->Arena, NumTriangles, gs_raster_gradient);
+        for(int Index = 0; Gradients != NULL && Index < NumTriangles; Index++)
+        {
+                Gradients[Index] = GradientForTexcoords(&Triangles[Index], &Texcoords[Index], Texture, Context->Blend);
+        }
+        StatsTimerEnd(SetupStart, GS_RASTER_STAGE_SETUP);
+        if(Gradients != NULL) Draw(Context, Pixels, Triangles, NumTriangles, NULL, Gradients, Depths, NULL);
+
+        ArenaPop(Context->Arena, Mark);
+        StatsEnd();
+}
+
+/* GsRasterDrawVertices and GsRasterDrawIndexed; Indices is NULL for the former. */
+void
+DrawMesh(gs_raster_context *Context, void *Pixels, gs_raster_matrix *Transform, gs_raster_vertices *Vertices, gs_raster_texture *Texture, gs_raster_index_format IndexFormat, void *Indices, int NumTriangles)
+{
+        StatsBegin();
+        gs_raster_arena_mark Mark = ArenaMark(Context->Arena);
+
+        /*
+         * Screen X is (X / W + 1) * Width / 2, Y is (1 - Y / W) * Height / 2
+         * and depth is (Z / W + 1) / 2; each is a row of the transform
+         * scaled, plus the W row, before the divide.
+         */
+        float Scale[3] = { 0.5f * (float)Context->Width, -0.5f * (float)Context->Height, 0.5f };
+        float Offset[3] = { 0.5f * (float)Context->Width, 0.5f * (float)Context->Height, 0.5f };
+        gs_raster_vertex_stage Stage;
+        for(int Column = 0; Column < 4; Column++)
+        {
+                for(int Row = 0; Row < 3; Row++)
+                {
+                        Stage.Matrix[Row][Column] = (Scale[Row] * Transform->M[Row][Column]) + (Offset[Row] * Transform->M[3][Column]);
+                }
+                Stage.Matrix[3][Column] = Transform->M[3][Column];
         }
+        Stage.Vertices = Vertices;
+        Stage.Texture = Texture;
+        Stage.Blend = Context->Blend;
+        Stage.IndexFormat = IndexFormat;
+        Stage.Indices = Indices;
 
-        bool Hit = ((Point.X >= LesserX) &&
-                    (Point.X <= GreaterX) &&
-                    (Point.Y >= LesserY) &&
-                    (Point.Y <= GreaterY));
-        Assert(Hit);
+        gs_raster_gradient *Gradients = ArenaPushArray(Context->Arena, NumTriangles, gs_raster_gradient);
+        if(Gradients != NULL) Draw(Context, Pixels, NULL, NumTriangles, NULL, Gradients, NULL, &Stage);
+
+        ArenaPop(Context->Arena, Mark);
+        StatsEnd();
+}
 
-        return(Point.X);
+void
+GsRasterDrawVertices(gs_raster_context *Context, void *Pixels, gs_raster_matrix *Transform, gs_raster_vertices *Vertices, gs_raster_texture *Texture, int NumTriangles)
+{
+        DrawMesh(Context, Pixels, Transform, Vertices, Texture, GS_RASTER_INDEX_32, NULL, NumTriangles);
 }
 
-int
-TriangleIntersectionSort(const void *Left, const void *Right)
+void
+GsRasterDrawIndexed(gs_raster_context *Context, void *Pixels, gs_raster_matrix *Transform, gs_raster_vertices *Vertices, gs_raster_texture *Texture, gs_raster_index_format IndexFormat, void *Indices, int NumTriangles)
 {
-        gs_raster_triangle_intersection First  = *((gs_raster_triangle_intersection *)Left);
-        gs_raster_triangle_intersection Second = *((gs_raster_triangle_intersection *)Right);
+        DrawMesh(Context, Pixels, Transform, Vertices, Texture, IndexFormat, Indices, NumTriangles);
+}
+
+//------------------------------------------------------------------------------
+// Mesh Operations
+//------------------------------------------------------------------------------
 
-        if(First.X > Second.X) return(1);
-        if(First.X < Second.X) return(-1);
+/* Size of the LRU cache GsRasterOptimizeIndices models. */
+#define GS_RASTER_OPTIMIZE_CACHE 32
 
-        return(0);
+/*
+ * Forsyth's score of a vertex: the last triangle's three vertices score the
+ * same, so no order among them is favored, the rest less the older they are,
+ * and vertices with few triangles left score more, so none are stranded.
+ * Position is -1 for a vertex outside the cache.
+ */
+float
+VertexCacheScore(int Position, int NumRemaining)
+{
+        if(NumRemaining == 0) return(-1.0f);
+
+        float Result = 0.0f;
+        if(Position >= 0 && Position < 3)
+        {
+                Result = 0.75f;
+        }
+        else if(Position >= 3)
+        {
+                float Age = 1.0f - ((float)(Position - 3) / (float)(GS_RASTER_OPTIMIZE_CACHE - 3));
+                Result = powf(Age, 1.5f);
+        }
+        Result += 2.0f / sqrtf((float)NumRemaining);
+        return(Result);
 }
 
 /*
- * Scanlines must be initialized to contain NumScanlines scanlines.
- * Triangles must be an initialized array of gs_raster_triangles.
+ * The scratch of GsRasterOptimizeIndices.  Each vertex's triangles are a run
+ * of VertexTriangles from Offsets[Vertex], those not yet added listed first.
  */
+struct gs_raster_mesh_order
+{
+        int *Offsets;
+        int *NumRemaining;
+        int *CachePositions;
+        float *Scores;
+        int *VertexTriangles;
+        float *TriangleScores;
+        bool *Added;
+        uint32_t *Order;
+};
+typedef struct gs_raster_mesh_order gs_raster_mesh_order;
+
+/* Writes the triangles of Indices into Mesh->Order in Forsyth's order. */
 void
-GsRasterGenerateScanlines(gs_raster_triangle *Triangles, int NumTriangles, gs_raster_scanline *Scanlines, int NumScanlines)
+OrderTriangles(gs_raster_mesh_order *Mesh, gs_raster_index_format IndexFormat, void *Indices, int NumTriangles, int NumVertices)
 {
-        for(int Row = 0; Row < NumScanlines; Row++)
+        int NumCorners = NumTriangles * 3;
+        int *Offsets = Mesh->Offsets;
+        int *NumRemaining = Mesh->NumRemaining;
+        int *CachePositions = Mesh->CachePositions;
+        float *Scores = Mesh->Scores;
+        int *VertexTriangles = Mesh->VertexTriangles;
+        float *TriangleScores = Mesh->TriangleScores;
+        bool *Added = Mesh->Added;
+        uint32_t *Order = Mesh->Order;
+
+        for(int Corner = 0; Corner < NumCorners; Corner++)
         {
-                gs_raster_scanline *Scanline = Scanlines + Row;
-                gs_raster_triangle_intersection *Intersections = Scanline->Intersections;
-                ray2d Ray = PositiveXVectorAtHeight(Row);
+                NumRemaining[IndexAt(IndexFormat, Indices, Corner)]++;
+        }
+        for(int Vertex = 0; Vertex < NumVertices; Vertex++)
+        {
+                Offsets[Vertex + 1] = Offsets[Vertex] + NumRemaining[Vertex];
+                NumRemaining[Vertex] = 0;
+                CachePositions[Vertex] = -1;
+        }
+        for(int Corner = 0; Corner < NumCorners; Corner++)
+        {
+                uint32_t Vertex = IndexAt(IndexFormat, Indices, Corner);
+                VertexTriangles[Offsets[Vertex] + NumRemaining[Vertex]++] = Corner / 3;
+        }
+        for(int Vertex = 0; Vertex < NumVertices; Vertex++)
+        {
+                Scores[Vertex] = VertexCacheScore(-1, NumRemaining[Vertex]);
+        }
+        for(int Triangle = 0; Triangle < NumTriangles; Triangle++)
+        {
+                TriangleScores[Triangle] = 0.0f;
+                for(int Point = 0; Point < 3; Point++)
+                {
+                        TriangleScores[Triangle] += Scores[IndexAt(IndexFormat, Indices, (Triangle * 3) + Point)];
+                }
+        }
+
+        /* Three more than the cache, for the vertices a triangle pushes out. */
+        uint32_t Cache[GS_RASTER_OPTIMIZE_CACHE + 3];
+        uint32_t NewCache[GS_RASTER_OPTIMIZE_CACHE + 3];
+        int CacheSize = 0;
+        int Next = 0; /* No triangle below this is left to add. */
+
+        int Best = 0;
+        for(int Triangle = 1; Triangle < NumTriangles; Triangle++)
+        {
+                if(TriangleScores[Triangle] > TriangleScores[Best]) Best = Triangle;
+        }
 
-                for(int Index = 0; Index < NumTriangles; Index++)
+        for(int NumAdded = 0; NumAdded < NumTriangles; NumAdded++)
+        {
+                if(Best < 0)
                 {
-                        gs_raster_triangle *Triangle = &Triangles[Index];
-                        gs_raster_triangle_edges Edges = FromTriangle(*Triangle);
-                        float TempIntersections[3];
-                        int Count = 0;
+                        /* Nothing left in the cache touches a triangle; start anew. */
+                        while(Added[Next]) Next++;
+                        Best = Next;
+                }
 
-                        /* First collect all actual intersections. */
-                        for(int EdgeIndex = 0; EdgeIndex < 3; EdgeIndex++)
+                /* The triangle's vertices go to the front of the cache, the rest follow in their order. */
+                uint32_t Points[3];
+                int NewSize = 0;
+                for(int Point = 0; Point < 3; Point++)
+                {
+                        Points[Point] = IndexAt(IndexFormat, Indices, (Best * 3) + Point);
+                        Order[(NumAdded * 3) + Point] = Points[Point];
+                        bool Cached = false; /* A degenerate triangle repeats a vertex. */
+                        for(int Position = 0; Position < NewSize; Position++)
                         {
-                                line_segment Edge = FromEdge(Edges.Edges[EdgeIndex]);
-                                if(!HasIntersection(Ray, Edge)) continue;
-
-                                TempIntersections[Count] = Intersect(Ray, Edge);
-                                Count++;
+                                if(NewCache[Position] == Points[Point]) Cached = true;
                         }
+                        if(!Cached) NewCache[NewSize++] = Points[Point];
 
-                        /* We may have duplicate intersections, so let's ignore those. */
-                        int Index = 0;
-                        if(Count == 3)
+                        /* Swap the triangle past the vertex's remaining ones. */
+                        int *Run = &VertexTriangles[Offsets[Points[Point]]];
+                        int Last = --NumRemaining[Points[Point]];
+                        for(int Slot = 0; Slot <= Last; Slot++)
                         {
-                                if((TempIntersections[0] == TempIntersections[1]) ||
-                                   (TempIntersections[0] == TempIntersections[2]))
+                                if(Run[Slot] == Best)
                                 {
-                                        Index++;
+                                        Run[Slot] = Run[Last];
+                                        Run[Last] = Best;
+                                        break;
                                 }
-                                else
+                        }
+                }
+                Added[Best] = true;
+
+                for(int Position = 0; Position < CacheSize; Position++)
+                {
+                        uint32_t Vertex = Cache[Position];
+                        if(Vertex != Points[0] && Vertex != Points[1] && Vertex != Points[2])
+                        {
+                                NewCache[NewSize++] = Vertex;
+                        }
+                }
+                for(int Position = 0; Position < NewSize; Position++)
+                {
+                        Cache[Position] = NewCache[Position];
+                }
+                CacheSize = NewSize;
+
+                /* Rescore the vertices whose position moved, and their triangles, then pick the best of those. */
+                for(int Position = 0; Position < CacheSize; Position++)
+                {
+                        uint32_t Vertex = Cache[Position];
+                        CachePositions[Vertex] = (Position < GS_RASTER_OPTIMIZE_CACHE) ? Position : -1;
+                        float Score = VertexCacheScore(CachePositions[Vertex], NumRemaining[Vertex]);
+                        float Change = Score - Scores[Vertex];
+                        Scores[Vertex] = Score;
+                        for(int Slot = 0; Slot < NumRemaining[Vertex]; Slot++)
+                        {
+                                TriangleScores[VertexTriangles[Offsets[Vertex] + Slot]] += Change;
+                        }
+                }
+                if(CacheSize > GS_RASTER_OPTIMIZE_CACHE) CacheSize = GS_RASTER_OPTIMIZE_CACHE;
+
+                Best = -1;
+                float BestScore = -1.0f;
+                for(int Position = 0; Position < CacheSize; Position++)
+                {
+                        uint32_t Vertex = Cache[Position];
+                        for(int Slot = 0; Slot < NumRemaining[Vertex]; Slot++)
+                        {
+                                int Triangle = VertexTriangles[Offsets[Vertex] + Slot];
+                                if(TriangleScores[Triangle] > BestScore)
                                 {
-                                        Count--;
+                                        Best = Triangle;
+                                        BestScore = TriangleScores[Triangle];
                                 }
                         }
+                }
+        }
+
+}
+
+void
+GsRasterOptimizeIndices(gs_raster_index_format IndexFormat, void *Indices, int NumTriangles, int NumVertices)
+{
+        if(NumTriangles <= 1 || NumVertices <= 0) return;
 
-                        /* Now copy the remaining unique intersections. */
-                        for(; Index < Count; Index++)
+        size_t NumCorners = (size_t)NumTriangles * 3;
+        gs_raster_mesh_order Mesh;
+        Mesh.Offsets = (int *)calloc((size_t)NumVertices + 1, sizeof(int));
+        Mesh.NumRemaining = (int *)calloc((size_t)NumVertices, sizeof(int));
+        Mesh.CachePositions = (int *)malloc(sizeof(int) * (size_t)NumVertices);
+        Mesh.Scores = (float *)malloc(sizeof(float) * (size_t)NumVertices);
+        Mesh.VertexTriangles = (int *)malloc(sizeof(int) * NumCorners);
+        Mesh.TriangleScores = (float *)malloc(sizeof(float) * (size_t)NumTriangles);
+        Mesh.Added = (bool *)calloc((size_t)NumTriangles, sizeof(bool));
+        Mesh.Order = (uint32_t *)malloc(sizeof(uint32_t) * NumCorners);
+
+        /* Without the memory, the order is left as it was. */
+        if(Mesh.Offsets != NULL && Mesh.NumRemaining != NULL && Mesh.CachePositions != NULL && Mesh.Scores != NULL &&
+           Mesh.VertexTriangles != NULL && Mesh.TriangleScores != NULL && Mesh.Added != NULL && Mesh.Order != NULL)
+        {
+                OrderTriangles(&Mesh, IndexFormat, Indices, NumTriangles, NumVertices);
+                for(size_t Corner = 0; Corner < NumCorners; Corner++)
+                {
+                        if(IndexFormat == GS_RASTER_INDEX_16)
+                        {
+                                ((uint16_t *)Indices)[Corner] = (uint16_t)Mesh.Order[Corner];
+                        }
+                        else
                         {
-                                gs_raster_triangle_intersection *Intersection = &Intersections[Scanline->NumIntersections];
-                                Intersection->Triangle = Triangle;
-                                Intersection->X = TempIntersections[Index];
-                                Scanline->NumIntersections++;
+                                ((uint32_t *)Indices)[Corner] = Mesh.Order[Corner];
                         }
                 }
+        }
+
+        free(Mesh.Offsets);
+        free(Mesh.NumRemaining);
+        free(Mesh.CachePositions);
+        free(Mesh.Scores);
+        free(Mesh.VertexTriangles);
+        free(Mesh.TriangleScores);
+        free(Mesh.Added);
+        free(Mesh.Order);
+}
+
+//------------------------------------------------------------------------------
+// Command Buffer Operations
+//------------------------------------------------------------------------------
+
+/*
+ * Batches are flattened as they are recorded: triangles moved to their
+ * origins and gradients set up with their batch's blending, so a draw is
+ * only ever one list.
+ */
+struct gs_raster_commands
+{
+        int MaxTriangles;
+        int NumTriangles;
+        int NumBatches;
+        bool HasDepths;
+        gs_raster_gradient *Gradients;
+        gs_raster_triangle *Triangles;
+        gs_raster_depth *Depths;
+};
+
+gs_raster_commands *
+GsRasterCommandsCreate(int MaxTriangles)
+{
+        if(MaxTriangles < 0) MaxTriangles = 0;
+
+        /* Gradients hold a pointer, so they go first after the header. */
+        size_t Size = (sizeof(gs_raster_commands) +
+                       (sizeof(gs_raster_gradient) * (size_t)MaxTriangles) +
+                       (sizeof(gs_raster_triangle) * (size_t)MaxTriangles) +
+                       (sizeof(gs_raster_depth) * (size_t)MaxTriangles));
+        gs_raster_commands *Commands = (gs_raster_commands *)malloc(Size);
+        if(Commands == NULL) return(NULL);
+
+        Commands->MaxTriangles = MaxTriangles;
+        Commands->Gradients = (gs_raster_gradient *)(Commands + 1);
+        Commands->Triangles = (gs_raster_triangle *)(Commands->Gradients + MaxTriangles);
+        Commands->Depths = (gs_raster_depth *)(Commands->Triangles + MaxTriangles);
+        GsRasterCommandsReset(Commands);
+        return(Commands);
+}
+
+void
+GsRasterCommandsFree(gs_raster_commands *Commands)
+{
+        free(Commands);
+}
+
+void
+GsRasterCommandsReset(gs_raster_commands *Commands)
+{
+        Commands->NumTriangles = 0;
+        Commands->NumBatches = 0;
+        Commands->HasDepths = false;
+}
+
+int
+GsRasterCommandsRecord(gs_raster_commands *Commands, gs_raster_batch *Batch)
+{
+        if(Batch->NumTriangles > Commands->MaxTriangles - Commands->NumTriangles) return(false);
+        if(Commands->NumBatches > 0 && Commands->HasDepths != (Batch->Depths != NULL)) return(false);
+
+        int First = Commands->NumTriangles;
+        for(int Index = 0; Index < Batch->NumTriangles; Index++)
+        {
+                gs_raster_triangle *Triangle = &Commands->Triangles[First + Index];
+                *Triangle = Batch->Triangles[Index];
+                for(int Vertex = 0; Vertex < 3; Vertex++)
+                {
+                        Triangle->Point[Vertex].X += Batch->Origin.X;
+                        Triangle->Point[Vertex].Y += Batch->Origin.Y;
+                }
+
+                gs_raster_gradient *Gradient = &Commands->Gradients[First + Index];
+                if(Batch->Texcoords != NULL)
+                {
+                        *Gradient = GradientForTexcoords(Triangle, &Batch->Texcoords[Index], Batch->Texture, Batch->Blend);
+                }
+                else if(Batch->Materials != NULL)
+                {
+                        *Gradient = GradientForMaterial(Triangle, &Batch->Materials[Index], Batch->Blend);
+                }
+                else
+                {
+                        *Gradient = GradientForColor(Batch->Colors[Index], Batch->Blend);
+                }
 
-                qsort(Scanline->Intersections,
-                      Scanline->NumIntersections,
-                      sizeof(gs_raster_triangle_intersection),
-                      TriangleIntersectionSort);
+                if(Batch->Depths != NULL)
+                {
+                        Commands->Depths[First + Index] = Batch->Depths[Index];
+                }
         }
+
+        Commands->HasDepths = (Batch->Depths != NULL);
+        Commands->NumTriangles += Batch->NumTriangles;
+        Commands->NumBatches++;
+        return(true);
 }
 
 void
-PutPixel(int *Pixels, int Width, int Height, int X, int Y, int NewPixel)
+GsRasterDrawCommands(gs_raster_context *Context, void *Pixels, gs_raster_commands *Commands)
 {
-        int Index = Y * Width + X;
-        Assert(Index < (Width * Height));
-        Pixels[Index] = NewPixel;
+        StatsBegin();
+        gs_raster_arena_mark Mark = ArenaMark(Context->Arena);
+
+        gs_raster_depth *Depths = Commands->HasDepths ? Commands->Depths : NULL;
+        Draw(Context, Pixels, Commands->Triangles, Commands->NumTriangles, NULL, Commands->Gradients, Depths, NULL);
+
+        ArenaPop(Context->Arena, Mark);
+        StatsEnd();
 }
 
+//------------------------------------------------------------------------------
+// Scene Operations
+//------------------------------------------------------------------------------
+
 /*
- * Pixels is a Width * Height grid of pixels intended for display somewhere.
- * scanline_intersectio
+ * Handles pack a slot's index plus one in the low bits and the slot's
+ * generation above, so a handle goes stale once its triangle is removed.
+ */
+#define GS_RASTER_HANDLE_INDEX_BITS 24
+#define GS_RASTER_HANDLE_INDEX_MASK ((1u << GS_RASTER_HANDLE_INDEX_BITS) - 1)
+
+/*
+ * Triangles kept across frames in slots, each slot's intersections kept in
+ * the scene's own scanlines.  Every row's intersections stay sorted by
+ * column, then by slot, so a row walks the same way however it was patched.
  */
+struct gs_raster_scene
+{
+        gs_raster_context *Context;
+        int Width;
+        int Height;
+        int MaxTriangles;
+        gs_raster_scanline *Scanlines;
+
+        /* One of each per slot. */
+        gs_raster_triangle *Triangles;
+        gs_raster_gradient *Gradients;
+        gs_raster_depth_plane *Planes; /* NULL without a depth buffer. */
+        gs_raster_bounds *Bounds; /* Pixels the slot's triangle covers. */
+        uint8_t *Generations;
+        bool *Live;
+
+        int *FreeSlots; /* Stack of unused slots. */
+        int NumFree;
+        int NumShaded; /* Live triangles with non-flat gradients. */
+
+        gs_raster_bounds Dirty; /* Pixels changed since the last GsRasterSceneRasterize. */
+};
+
+/* Everything a scene pass's tasks read. */
+struct gs_raster_scene_pass
+{
+        gs_raster_scene *Scene;
+        void *Pixels;
+        int Y0;
+        int Y1;
+};
+typedef struct gs_raster_scene_pass gs_raster_scene_pass;
+
 void
-GsRasterRasterize(int *Pixels, int Width, int Height, gs_raster_scanline *Scanlines, gs_raster_triangle Triangles[], gs_raster_color Colors[], int NumTriangles)
+BoundsUnion(gs_raster_bounds *Result, gs_raster_bounds *Bounds)
+{
+        if(Bounds->MinX > Bounds->MaxX || Bounds->MinY > Bounds->MaxY) return;
+
+        if(Bounds->MinX < Result->MinX) Result->MinX = Bounds->MinX;
+        if(Bounds->MinY < Result->MinY) Result->MinY = Bounds->MinY;
+        if(Bounds->MaxX > Result->MaxX) Result->MaxX = Bounds->MaxX;
+        if(Bounds->MaxY > Result->MaxY) Result->MaxY = Bounds->MaxY;
+}
+
+void
+BoundsClear(gs_raster_bounds *Bounds)
+{
+        Bounds->MinX = 0x7FFFFFFF;
+        Bounds->MinY = 0x7FFFFFFF;
+        Bounds->MaxX = -1;
+        Bounds->MaxY = -1;
+}
+
+/* Inserts an intersection, keeping the row sorted by column, then by triangle. */
+void
+ScanlineInsert(gs_raster_scanline *Scanline, int X, int Triangle)
 {
-        int TriangleStackAllocSize = 0;
+        Assert(Scanline->NumIntersections < Scanline->Capacity);
+
+        gs_raster_triangle_intersection *Intersections = Scanline->Intersections;
+        int Insert = Scanline->NumIntersections++;
+        while(Insert > 0 &&
+              (Intersections[Insert - 1].X > X ||
+               (Intersections[Insert - 1].X == X && Intersections[Insert - 1].Triangle > Triangle)))
         {
-                int PointerArraySize = sizeof(gs_raster_triangle *) * Width;
-                TriangleStackAllocSize = sizeof(gs_raster_triangle_stack) + PointerArraySize;
+                Intersections[Insert] = Intersections[Insert - 1];
+                Insert--;
         }
-        void *TriangleStackMemory = alloca(TriangleStackAllocSize);
-        gs_raster_triangle_stack *CurrentTriangle;
-        TriangleStackInit(&CurrentTriangle, Width, TriangleStackMemory);
 
-        for(int Row=0; Row<Height; Row++)
-        {
-                gs_raster_scanline *Scanline = &Scanlines[Row];
+        Intersections[Insert].X = X;
+        Intersections[Insert].Triangle = Triangle;
+}
 
-                for(int Col=0; Col<Width; Col++)
+/* Removes every intersection of the triangle from the row. */
+void
+ScanlineRemove(gs_raster_scanline *Scanline, int Triangle)
+{
+        int Count = 0;
+        for(int Index = 0; Index < Scanline->NumIntersections; Index++)
+        {
+                if(Scanline->Intersections[Index].Triangle != Triangle)
                 {
-                        for(int s=0; s<Scanline->NumIntersections; ++s)
-                        {
-                                gs_raster_triangle *Triangle;
-                                gs_raster_triangle_intersection *Intersection = &(Scanline->Intersections[s]);
-                                if(Intersection->X != Col) continue;
+                        Scanline->Intersections[Count++] = Scanline->Intersections[Index];
+                }
+        }
+        Scanline->NumIntersections = Count;
+}
 
-                                if(TriangleStackFind(CurrentTriangle, Intersection->Triangle))
-                                {
-                                        TriangleStackRemove(CurrentTriangle, Intersection->Triangle);
-                                }
-                                else
-                                {
-                                        TriangleStackPush(CurrentTriangle, Intersection->Triangle);
-                                }
-                        }
+/*
+ * Adds the triangle's intersections to the rows it covers and records the
+ * pixels it covers in the slot's bounds.  Every covered row gains exactly two
+ * intersections; if any row lacks room for them, nothing is changed and
+ * false is returned.
+ */
+bool
+SceneInsert(gs_raster_scene *Scene, int Slot, gs_raster_triangle *Triangle)
+{
+        gs_raster_fixed_triangle Fixed;
+        Kernels.SnapCoordinates((float *)Triangle, (int32_t *)&Fixed, 6);
 
-                        // TODO(AARON): This may be a NULL pointer.
-                        gs_raster_triangle *Triangle = TriangleStackTop(CurrentTriangle);
-                        gs_raster_color Color = 0x00000000;
-                        if(Triangle)
-                        {
-                                Color = ColorForTriangle(Triangles, Colors, NumTriangles, Triangle);
-                        }
+        gs_raster_edge Edges[3];
+        EdgesForTriangle(Edges, &Fixed, Slot, Scene->Height);
+
+        gs_raster_bounds *Bounds = &Scene->Bounds[Slot];
+        BoundsFromEdges(Bounds, Edges, Scene->Width);
+        for(int Row = Bounds->MinY; Row <= Bounds->MaxY; Row++)
+        {
+                gs_raster_scanline *Scanline = &Scene->Scanlines[Row];
+                if(Scanline->NumIntersections + 2 > Scanline->Capacity) return(false);
+        }
+
+        /* Covered pixels lie between a row's two intersections. */
+        Bounds->MinX = Scene->Width;
+        Bounds->MaxX = -1;
+        for(int EdgeIndex = 0; EdgeIndex < 3; EdgeIndex++)
+        {
+                gs_raster_edge *Edge = &Edges[EdgeIndex];
+                if(Edge->YStart >= Edge->YEnd) continue;
 
-                        PutPixel(Pixels, Width, Height, Col, Row, Color);
+                gs_raster_active_edge Active;
+                ActiveEdgeSeek(&Active, Edge, Edge->YStart);
+                for(int Row = Edge->YStart; Row < Edge->YEnd; Row++)
+                {
+                        int X = ActiveEdgeColumn(&Active);
+                        if(X < 0) X = 0;
+                        ScanlineInsert(&Scene->Scanlines[Row], X, Slot);
+                        if(X < Bounds->MinX) Bounds->MinX = X;
+                        if(X - 1 > Bounds->MaxX) Bounds->MaxX = X - 1;
+
+                        Active.Remainder += Edge->StepRemainder;
+                        int32_t Carry = (Active.Remainder >= Edge->Denominator);
+                        Active.Quotient += Edge->StepQuotient + Carry;
+                        Active.Remainder -= Edge->Denominator & -Carry;
                 }
         }
+        if(Bounds->MaxX > Scene->Width - 1) Bounds->MaxX = Scene->Width - 1;
+
+        return(true);
+}
+
+void
+SceneErase(gs_raster_scene *Scene, int Slot)
+{
+        gs_raster_bounds *Bounds = &Scene->Bounds[Slot];
+        for(int Row = Bounds->MinY; Row <= Bounds->MaxY; Row++)
+        {
+                ScanlineRemove(&Scene->Scanlines[Row], Slot);
+        }
+}
+
+/* Sets the slot's shading and depth; the triangle must already be inserted. */
+void
+SceneSetAttributes(gs_raster_scene *Scene, int Slot, gs_raster_triangle *Triangle, gs_raster_material *Material, gs_raster_depth *Depth)
+{
+        if(Scene->Live[Slot] && !Scene->Gradients[Slot].IsFlat) Scene->NumShaded--;
+
+        Scene->Triangles[Slot] = *Triangle;
+        Scene->Gradients[Slot] = GradientForMaterial(Triangle, Material, Scene->Context->Blend);
+        if(!Scene->Gradients[Slot].IsFlat) Scene->NumShaded++;
+
+        if(Scene->Planes != NULL)
+        {
+                gs_raster_depth Near = {{ 0.0f, 0.0f, 0.0f }};
+                Scene->Planes[Slot] = DepthPlaneForTriangle(Scene->Context->Depth, Triangle, (Depth != NULL) ? Depth : &Near);
+        }
+
+        Scene->Live[Slot] = true;
+        BoundsUnion(&Scene->Dirty, &Scene->Bounds[Slot]);
+}
+
+/* Returns the slot of a live triangle's handle, or -1 for a stale or invalid handle. */
+int
+SceneSlot(gs_raster_scene *Scene, gs_raster_handle Handle)
+{
+        int Slot = (int)(Handle & GS_RASTER_HANDLE_INDEX_MASK) - 1;
+        if(Slot < 0 || Slot >= Scene->MaxTriangles) return(-1);
+        if(!Scene->Live[Slot] || Scene->Generations[Slot] != (Handle >> GS_RASTER_HANDLE_INDEX_BITS)) return(-1);
+        return(Slot);
+}
+
+gs_raster_scene *
+GsRasterSceneCreate(gs_raster_context *Context, int MaxTriangles)
+{
+        Assert(MaxTriangles < (int)GS_RASTER_HANDLE_INDEX_MASK);
+        gs_raster_arena *Arena = Context->Arena;
+        int Capacity = Context->Workers->Workers[0].Active.Capacity;
+
+        gs_raster_arena_mark Mark = ArenaMark(Arena);
+        gs_raster_scene *Scene = ArenaPushStruct(Arena, gs_raster_scene);
+        void *Memory = ArenaPush(Arena, GsRasterSizeRequiredForScanlines(Context->Height, Capacity), GS_RASTER_ARENA_ALIGNMENT);
+        if(Scene == NULL || Memory == NULL)
+        {
+                ArenaPop(Arena, Mark);
+                return(NULL);
+        }
+        Scene->Context = Context;
+        Scene->Width = Context->Width;
+        Scene->Height = Context->Height;
+        Scene->MaxTriangles = MaxTriangles;
+        GsRasterInitScanlines(&Scene->Scanlines, Context->Height, Capacity, Memory);
+
+        Scene->Triangles = ArenaPushArray(Arena, MaxTriangles, gs_raster_triangle);
+        Scene->Gradients = ArenaPushArray(Arena, MaxTriangles, gs_raster_gradient);
+        Scene->Planes = NULL;
+        if(Context->Depth != NULL)
+        {
+                Scene->Planes = ArenaPushArray(Arena, MaxTriangles, gs_raster_depth_plane);
+        }
+        Scene->Bounds = ArenaPushArray(Arena, MaxTriangles, gs_raster_bounds);
+        Scene->Generations = ArenaPushArray(Arena, MaxTriangles, uint8_t);
+        Scene->Live = ArenaPushArray(Arena, MaxTriangles, bool);
+        Scene->FreeSlots = ArenaPushArray(Arena, MaxTriangles, int);
+        if(Scene->Triangles == NULL || Scene->Gradients == NULL || (Context->Depth != NULL && Scene->Planes == NULL) ||
+           Scene->Bounds == NULL || Scene->Generations == NULL || Scene->Live == NULL || Scene->FreeSlots == NULL)
+        {
+                ArenaPop(Arena, Mark);
+                return(NULL);
+        }
+
+        /* Slots are handed out lowest first. */
+        for(int Slot = 0; Slot < MaxTriangles; Slot++)
+        {
+                Scene->Generations[Slot] = 0;
+                Scene->Live[Slot] = false;
+                Scene->FreeSlots[Slot] = MaxTriangles - 1 - Slot;
+        }
+        Scene->NumFree = MaxTriangles;
+        Scene->NumShaded = 0;
+
+        /* The first pass draws the background everywhere. */
+        Scene->Dirty.MinX = 0;
+        Scene->Dirty.MinY = 0;
+        Scene->Dirty.MaxX = Scene->Width - 1;
+        Scene->Dirty.MaxY = Scene->Height - 1;
+
+        return(Scene);
+}
+
+gs_raster_handle
+GsRasterSceneAdd(gs_raster_scene *Scene, gs_raster_triangle *Triangle, gs_raster_material *Material, gs_raster_depth *Depth)
+{
+        if(Scene->NumFree == 0) return(0);
+
+        int Slot = Scene->FreeSlots[Scene->NumFree - 1];
+        if(!SceneInsert(Scene, Slot, Triangle)) return(0);
+
+        Scene->NumFree--;
+        SceneSetAttributes(Scene, Slot, Triangle, Material, Depth);
+
+        gs_raster_handle Result = (((gs_raster_handle)Scene->Generations[Slot] << GS_RASTER_HANDLE_INDEX_BITS) |
+                                   (gs_raster_handle)(Slot + 1));
+        return(Result);
+}
+
+int
+GsRasterSceneUpdate(gs_raster_scene *Scene, gs_raster_handle Handle, gs_raster_triangle *Triangle, gs_raster_material *Material, gs_raster_depth *Depth)
+{
+        int Slot = SceneSlot(Scene, Handle);
+        if(Slot < 0) return(false);
+
+        gs_raster_bounds Previous = Scene->Bounds[Slot];
+        SceneErase(Scene, Slot);
+        if(!SceneInsert(Scene, Slot, Triangle))
+        {
+                /* The old triangle's rows had room for it a moment ago. */
+                SceneInsert(Scene, Slot, &Scene->Triangles[Slot]);
+                return(false);
+        }
+
+        BoundsUnion(&Scene->Dirty, &Previous);
+        SceneSetAttributes(Scene, Slot, Triangle, Material, Depth);
+        return(true);
+}
+
+int
+GsRasterSceneRemove(gs_raster_scene *Scene, gs_raster_handle Handle)
+{
+        int Slot = SceneSlot(Scene, Handle);
+        if(Slot < 0) return(false);
+
+        SceneErase(Scene, Slot);
+        BoundsUnion(&Scene->Dirty, &Scene->Bounds[Slot]);
+        if(!Scene->Gradients[Slot].IsFlat) Scene->NumShaded--;
+
+        Scene->Live[Slot] = false;
+        Scene->Generations[Slot]++;
+        Scene->FreeSlots[Scene->NumFree++] = Slot;
+        return(true);
+}
+
+void
+SceneBandTask(void *Data, int Task, gs_raster_worker *Worker)
+{
+        gs_raster_scene_pass *Pass = (gs_raster_scene_pass *)Data;
+        gs_raster_scene *Scene = Pass->Scene;
+        int Y0 = Pass->Y0 + (Task * GS_RASTER_BAND_HEIGHT);
+        int Y1 = Y0 + GS_RASTER_BAND_HEIGHT;
+        if(Y1 > Pass->Y1) Y1 = Pass->Y1;
+
+        gs_raster_depth_buffer *Depth = (Scene->Planes != NULL) ? Scene->Context->Depth : NULL;
+        StatsTimerBegin(RasterizeStart);
+        gs_raster_triangle *Triangles = (Scene->Context->Antialias != GS_RASTER_ANTIALIAS_NONE) ? Scene->Triangles : NULL;
+        RasterizeScanlineBand(Pass->Pixels, Scene->Context->Format, Scene->Width, Scene->Scanlines, Y0, Y1, Worker, NULL, Scene->Gradients, Depth, Triangles, NULL);
+        StatsTimerEnd(RasterizeStart, GS_RASTER_STAGE_RASTERIZE);
+}
+
+/*
+ * Dirty rows are rewalked in full, which reproduces every pixel the changes
+ * did not cover.  Shaded spans are the exception: their interpolation is
+ * stepped from the span's ends, which move when the spans around them do, so
+ * while any triangle is shaded the whole width of the rows is reported.  So
+ * it is while antialiasing, which mixes pixels just outside a triangle's
+ * bounds too.
+ */
+gs_raster_rect
+GsRasterSceneRasterize(gs_raster_scene *Scene, void *Pixels)
+{
+        gs_raster_rect Result = { 0, 0, 0, 0 };
+        gs_raster_bounds Dirty = Scene->Dirty;
+        if(Dirty.MinX > Dirty.MaxX || Dirty.MinY > Dirty.MaxY) return(Result);
+
+        if(Scene->NumShaded > 0 || Scene->Context->Antialias != GS_RASTER_ANTIALIAS_NONE)
+        {
+                Dirty.MinX = 0;
+                Dirty.MaxX = Scene->Width - 1;
+        }
+
+        gs_raster_scene_pass Pass;
+        Pass.Scene = Scene;
+        Pass.Pixels = Pixels;
+        Pass.Y0 = Dirty.MinY;
+        Pass.Y1 = Dirty.MaxY + 1;
+        int NumBands = (Pass.Y1 - Pass.Y0 + GS_RASTER_BAND_HEIGHT - 1) / GS_RASTER_BAND_HEIGHT;
+
+        StatsBegin();
+        gs_raster_depth_buffer *Depth = Scene->Context->Depth;
+        if(Scene->Planes != NULL) Depth->Planes = Scene->Planes;
+        WorkersRun(Scene->Context->Workers, SceneBandTask, &Pass, NumBands);
+        if(Scene->Planes != NULL) Depth->Planes = NULL;
+        StatsEnd();
+
+        Result.X = Dirty.MinX;
+        Result.Y = Dirty.MinY;
+        Result.Width = Dirty.MaxX - Dirty.MinX + 1;
+        Result.Height = Dirty.MaxY - Dirty.MinY + 1;
+        BoundsClear(&Scene->Dirty);
+        return(Result);
 }
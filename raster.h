@@ -1,10 +1,58 @@
 #if !defined(GS_RASTER)
 #define GS_RASTER
 
+#include <stddef.h> /* size_t */
 #include <stdint.h>
 
 typedef uint32_t gs_raster_color;
 
+/*
+ * Per-vertex colors for a triangle.  VertexColors[i] belongs to
+ * gs_raster_triangle::Point[i] as it is passed to the rasterizer, so assign
+ * colors after calling GsRasterReorderTriangle.
+ * Each 8-bit channel is interpolated independently across the triangle.
+ */
+struct gs_raster_material
+{
+        gs_raster_color VertexColors[3];
+};
+typedef struct gs_raster_material gs_raster_material;
+
+/*
+ * Per-vertex depths for a triangle.  Z[i] belongs to gs_raster_triangle::Point[i]
+ * as it is passed to the rasterizer, as with gs_raster_material.
+ * Depth runs from 0 (near) to 1 (far); values outside are clamped.
+ */
+struct gs_raster_depth
+{
+        float Z[3];
+};
+typedef struct gs_raster_depth gs_raster_depth;
+
+/*
+ * Per-vertex texture coordinates for a triangle, ordered as with
+ * gs_raster_material.  U and V run from 0 to 1 across the texture and repeat
+ * outside that range.  W is the vertex's clip-space w, its distance along the
+ * view direction before the perspective divide; U / W, V / W and 1 / W are
+ * interpolated across the screen, so the mapping stays perspective-correct.
+ * Pass 1 for every W to map the texture affinely.  W must be positive, as it
+ * is for any vertex in front of the eye; smaller values, and NaN, are taken
+ * as 1e-6.
+ */
+struct gs_raster_texcoords
+{
+        float U[3];
+        float V[3];
+        float W[3];
+};
+typedef struct gs_raster_texcoords gs_raster_texcoords;
+
+/* The largest texture width or height GsRasterTextureCreate accepts. */
+#define GS_RASTER_MAX_TEXTURE_SIZE (1 << 15)
+
+struct gs_raster_texture;
+typedef struct gs_raster_texture gs_raster_texture;
+
 struct gs_raster_point2d
 {
         float X;
@@ -12,6 +60,59 @@ struct gs_raster_point2d
 };
 typedef struct gs_raster_point2d gs_raster_point2d;
 
+/*
+ * A 4x4 transform, M[Row][Column], applied to column vectors: clip-space X
+ * is M[0][0] * X + M[0][1] * Y + M[0][2] * Z + M[0][3] * W, and so on.
+ */
+struct gs_raster_matrix
+{
+        float M[4][4];
+};
+typedef struct gs_raster_matrix gs_raster_matrix;
+
+/*
+ * Vertices as a structure of arrays, one array per component, so they can be
+ * transformed several at a time; see GsRasterDrawVertices.
+ *
+ * W:
+ *         NULL when every vertex has W = 1, as for 3D positions.
+ *
+ * Colors:
+ *         Per-vertex colors, interpolated as in gs_raster_material.
+ *
+ * U, V:
+ *         Per-vertex texture coordinates, as in gs_raster_texcoords; only read
+ *         when drawing with a texture.
+ */
+struct gs_raster_vertices
+{
+        float *X;
+        float *Y;
+        float *Z;
+        float *W;
+        gs_raster_color *Colors;
+        float *U;
+        float *V;
+};
+typedef struct gs_raster_vertices gs_raster_vertices;
+
+/* How the indices of an indexed mesh are stored; see GsRasterDrawIndexed. */
+enum gs_raster_index_format
+{
+        /* A uint16_t per index, for meshes of up to 65536 vertices. */
+        GS_RASTER_INDEX_16,
+        /* A uint32_t per index. */
+        GS_RASTER_INDEX_32,
+};
+typedef enum gs_raster_index_format gs_raster_index_format;
+
+/*
+ * Vertices are in pixels, with pixel (X, Y) centered at (X + 0.5, Y + 0.5),
+ * and are snapped to the nearest 1/16 pixel before rasterizing.  A pixel is
+ * covered when its center is inside the triangle or on one of its top or left
+ * edges, so triangles sharing an edge never both cover, or both miss, a pixel
+ * along it.
+ */
 struct gs_raster_triangle
 {
         union
@@ -62,7 +163,7 @@ typedef struct gs_raster_scanline gs_raster_scanline;
  *         maximum number of intersections that can occur per row in the
  *         destination pixel grid.
  */
-int
+size_t
 GsRasterSizeRequiredForScanlines(
 	int NumScanlines, int Capacity);
 
@@ -82,7 +183,7 @@ GsRasterSizeRequiredForScanlines(
  *         Optional char buffer to use for scanline storage.
  *         If using this, determine size with GsRasterSizeRequiredForScanlines.
  *         Set to NULL to allow this function to allocate on the heap with
- *         malloc.
+ *         malloc; *Scanlines is then NULL if that fails.
  *
  * Example usage:
  *         int DisplayWidth = 1280;
@@ -99,8 +200,10 @@ GsRasterInitScanlines(
 
 /*
  * Calculates all triangle intersections for the given scanlines and triangles.
+ * Returns false, leaving the scanlines untouched, if its scratch memory cannot
+ * be allocated.
  */
-void
+int
 GsRasterGenerateScanlines(
         gs_raster_triangle *Triangles,
         int NumTriangles,
@@ -109,6 +212,8 @@ GsRasterGenerateScanlines(
 
 /*
  * Translate the given triangle list into pixels in the destination pixel grid.
+ * Colors are written as they are; blending is set up on a context, see
+ * gs_raster_config.
  */
 void
 GsRasterRasterize(
@@ -120,6 +225,37 @@ GsRasterRasterize(
         gs_raster_color Colors[],
         int NumTriangles);
 
+/*
+ * Returns the number of bytes GsRasterRasterizeShaded needs for the given
+ * number of triangles.
+ */
+size_t
+GsRasterSizeRequiredForShading(
+        int NumTriangles);
+
+/*
+ * Same as GsRasterRasterize, but shades each triangle by interpolating its
+ * material's vertex colors (Gouraud shading).  Triangles whose vertex colors
+ * are all equal take the same flat fill path as GsRasterRasterize.
+ *
+ * Memory:
+ *         Scratch space for the per-triangle color gradients, sized with
+ *         GsRasterSizeRequiredForShading.  If NULL, it is allocated and freed
+ *         on every call.
+ *
+ * Returns false, drawing nothing, if Memory is NULL and the allocation fails.
+ */
+int
+GsRasterRasterizeShaded(
+        int *Pixels,
+        int Width,
+        int Height,
+        gs_raster_scanline *Scanlines,
+        gs_raster_triangle Triangles[],
+        gs_raster_material Materials[],
+        int NumTriangles,
+        void *Memory);
+
 /*
  * Reorder the given triangle vertices to work with GsRaster rasterization.
  */
@@ -127,4 +263,740 @@ void
 GsRasterReorderTriangle(
         gs_raster_triangle *Unordered);
 
+enum gs_raster_simd
+{
+        GS_RASTER_SIMD_SCALAR,
+        GS_RASTER_SIMD_SSE2,
+        GS_RASTER_SIMD_AVX2,
+};
+typedef enum gs_raster_simd gs_raster_simd;
+
+/*
+ * Selects the widest SIMD kernels, up to MaxLevel, that the CPU supports
+ * according to CPUID, and returns the level actually chosen.  Every level
+ * produces the same pixels.  The library calls this with
+ * GS_RASTER_SIMD_AVX2 on first use; call it beforehand to force narrower
+ * kernels, e.g. when benchmarking.
+ */
+gs_raster_simd
+GsRasterSelectSimd(
+        gs_raster_simd MaxLevel);
+
+enum gs_raster_engine
+{
+        /* Edge table scanlines resolved with a triangle stack per row. */
+        GS_RASTER_ENGINE_SCANLINE,
+        /* Edge functions evaluated per triangle over 64x64 blocks and 8x8 tiles. */
+        GS_RASTER_ENGINE_HALFSPACE,
+};
+typedef enum gs_raster_engine gs_raster_engine;
+
+enum gs_raster_depth_format
+{
+        GS_RASTER_DEPTH_NONE,
+        /* Unsigned 16-bit depth; Z is scaled to [0, 65535] and truncated. */
+        GS_RASTER_DEPTH_16,
+        /* 32-bit float depth. */
+        GS_RASTER_DEPTH_32,
+};
+typedef enum gs_raster_depth_format gs_raster_depth_format;
+
+/*
+ * How a triangle's colors combine with what lies behind it.  When blending,
+ * the lowest byte of a color is its alpha, as in SDL_PIXELFORMAT_RGBA8888:
+ * 255 is opaque and 0 is fully transparent.  Pixels then hold premultiplied
+ * colors over the black, transparent background.
+ */
+enum gs_raster_blend
+{
+        /* Colors are written as they are, alpha and all. */
+        GS_RASTER_BLEND_NONE,
+        /* Colors carry straight alpha and are blended over what lies behind. */
+        GS_RASTER_BLEND_ALPHA,
+        /* As GS_RASTER_BLEND_ALPHA, with colors already multiplied by their alpha. */
+        GS_RASTER_BLEND_PREMULTIPLIED,
+};
+typedef enum gs_raster_blend gs_raster_blend;
+
+enum gs_raster_antialias
+{
+        /* Each pixel takes the color of the triangle covering its center. */
+        GS_RASTER_ANTIALIAS_NONE,
+        /* Pixels that edges pass through mix the colors on either side by area. */
+        GS_RASTER_ANTIALIAS_EDGES,
+};
+typedef enum gs_raster_antialias gs_raster_antialias;
+
+enum gs_raster_framebuffer
+{
+        /* Triangles are drawn straight into the caller's pixels. */
+        GS_RASTER_FRAMEBUFFER_NONE,
+        /* Triangles are drawn into the context's own blocks, then copied out. */
+        GS_RASTER_FRAMEBUFFER_TILED,
+};
+typedef enum gs_raster_framebuffer gs_raster_framebuffer;
+
+/* How pixels are stored in the grids the context draws into. */
+enum gs_raster_format
+{
+        /* An int per pixel holding its gs_raster_color. */
+        GS_RASTER_FORMAT_RGBA8888,
+        /* A uint16_t per pixel: the top 5 bits of red, 6 of green, 5 of blue. */
+        GS_RASTER_FORMAT_RGB565,
+        /* A uint8_t per pixel: the color's top byte, such as a palette index or mask value. */
+        GS_RASTER_FORMAT_INDEX8,
+};
+typedef enum gs_raster_format gs_raster_format;
+
+enum gs_raster_cull
+{
+        /* Triangles are drawn whichever way they are wound. */
+        GS_RASTER_CULL_NONE,
+        /* Triangles wound clockwise on screen are dropped during setup. */
+        GS_RASTER_CULL_BACK,
+};
+typedef enum gs_raster_cull gs_raster_cull;
+
+/*
+ * Everything a context needs to know up front; see GsRasterInit.
+ *
+ * Engine:
+ *         GS_RASTER_ENGINE_SCANLINE matches GsRasterGenerateScanlines followed
+ *         by GsRasterRasterize; where triangles overlap, the triangle whose
+ *         left edge was crossed last wins.
+ *         GS_RASTER_ENGINE_HALFSPACE draws triangles in order, so later
+ *         triangles win where they overlap.
+ *         With depth testing, both engines keep the nearest triangle; see
+ *         DepthFormat.
+ *
+ * Width, Height:
+ *         The size of the pixel grids drawn into.
+ *
+ * Capacity:
+ *         The maximum number of intersections per scanline; each triangle
+ *         crossing a row adds two, including triangles the draw clips into
+ *         several pieces, which are drawn as one shape.  Intersections
+ *         beyond it are dropped, and the rows they fall on draw wrongly; see
+ *         Overflows in gs_raster_stats.  Ignored by
+ *         GS_RASTER_ENGINE_HALFSPACE.
+ *
+ * MaxTriangles:
+ *         The largest draw expected.  Larger draws still work, but the first
+ *         one allocates more memory, which the context then keeps.
+ *
+ * NumThreads:
+ *         The number of threads drawing, including the caller's.  Each draw
+ *         is split into screen tiles (row bands for the scanline engine) that
+ *         idle threads steal from busy ones; the output is the same for any
+ *         thread count.  Pass 0 for one thread per online CPU, or 1 to draw
+ *         on the calling thread only.
+ *
+ * DepthFormat:
+ *         GS_RASTER_DEPTH_NONE, or the format of the context's depth buffer.
+ *         While a context has a depth buffer, draws that pass per-vertex
+ *         depths keep the nearest triangle at each pixel, whatever order the
+ *         triangles come in; equal depths keep the earlier triangle.  The
+ *         buffer is cleared to far at the start of every draw, along with the
+ *         pixels.
+ *         The half-space engine keeps conservative depth bounds for every 8x8
+ *         tile and 64x64 block, and skips blocks and tiles where a triangle is
+ *         hidden.  The scanline engine resolves each span among the triangles
+ *         crossing it and skips those hidden behind another along the whole
+ *         span.
+ *
+ * Blend:
+ *         GS_RASTER_BLEND_NONE, or how GsRasterDraw, GsRasterDrawShaded,
+ *         GsRasterDrawTextured and scenes blend triangles that are not
+ *         opaque.  Triangles whose vertex alphas, or texture's texel alphas,
+ *         are all 255 are drawn as without blending.  The others are
+ *         blended, back to front, over whatever they overlap: the scanline
+ *         engine composites every triangle on a span's stack from the
+ *         topmost opaque one up, and the half-space engine blends in draw
+ *         order.  With a depth buffer, translucent triangles are tested
+ *         against it but do not write it; they are blended over the nearest
+ *         opaque triangle, the scanline engine ordering them by their depth
+ *         at the middle of each span, the half-space engine by draw order.
+ *
+ * Antialias:
+ *         GS_RASTER_ANTIALIAS_EDGES smooths the edges of GsRasterDraw,
+ *         GsRasterDrawShaded, GsRasterDrawTextured and scenes.  Wherever the
+ *         color changes between two spans of a row, the pixels the edge
+ *         responsible passes through within the row are blended with the
+ *         color on its other side, by the exact area of each pixel on that
+ *         side.  Spans are still filled
+ *         as without antialiasing, so the extra cost grows with the length
+ *         of the edges rather than their area.  Edges that a depth test
+ *         makes visible in the middle of a span stay aliased.  Ignored by
+ *         GS_RASTER_ENGINE_HALFSPACE.
+ *
+ * Framebuffer:
+ *         GS_RASTER_FRAMEBUFFER_TILED has GS_RASTER_ENGINE_HALFSPACE draw into
+ *         a framebuffer of the context's own, kept as 64x64 pixel blocks of
+ *         16 KB each, every block's rows one after another.  A block then
+ *         spans four pages instead of a page per row, and since each block
+ *         is drawn by one thread, threads never write the same cache line.
+ *         Each finished block is copied into Pixels with streaming stores,
+ *         so Pixels is written once per draw however much the triangles
+ *         overlap or blend.  Ignored by GS_RASTER_ENGINE_SCANLINE, whose
+ *         bands already write whole rows, and by scenes.
+ *
+ * Format:
+ *         How the pixels passed to draws and scenes are stored.  Triangles
+ *         are always drawn, blended and antialiased at 8 bits per channel,
+ *         into memory of each thread's own: a band of rows for the scanline
+ *         engine and scenes, or a tiled framebuffer block for the half-space
+ *         engine, which implies GS_RASTER_FRAMEBUFFER_TILED.  Each finished
+ *         band or block is packed into Pixels while still in the cache, so
+ *         the frame costs 2 or 1 bytes of memory traffic per pixel instead
+ *         of 4, with no conversion pass afterwards.
+ *
+ * Cull:
+ *         GS_RASTER_CULL_BACK drops the back faces of draws: triangles wound
+ *         clockwise on screen, Y down, as opposed to the counter-clockwise
+ *         winding GsRasterReorderTriangle expects.  Whatever this is set to,
+ *         draws drop triangles without area and those lying wholly off the
+ *         grid before setting them up, and clip triangles reaching more than
+ *         131072 pixels from the origin, beyond which vertices can no longer
+ *         be snapped, to that guard band.  Ignored by scenes.
+ */
+struct gs_raster_config
+{
+        gs_raster_engine Engine;
+        int Width;
+        int Height;
+        int Capacity;
+        int MaxTriangles;
+        int NumThreads;
+        gs_raster_depth_format DepthFormat;
+        gs_raster_blend Blend;
+        gs_raster_antialias Antialias;
+        gs_raster_framebuffer Framebuffer;
+        gs_raster_format Format;
+        gs_raster_cull Cull;
+};
+typedef struct gs_raster_config gs_raster_config;
+
+struct gs_raster_arena;
+struct gs_raster_workers;
+struct gs_raster_depth_buffer;
+
+struct gs_raster_context
+{
+        gs_raster_engine Engine;
+        gs_raster_blend Blend;
+        gs_raster_antialias Antialias;
+        gs_raster_format Format;
+        gs_raster_cull Cull;
+        int Width;
+        int Height;
+        gs_raster_scanline *Scanlines; /* Only used by GS_RASTER_ENGINE_SCANLINE. */
+        int *Blocks; /* The tiled framebuffer; NULL without one. */
+        struct gs_raster_workers *Workers; /* Thread pool and per-thread scratch memory. */
+        struct gs_raster_depth_buffer *Depth; /* NULL without a depth format. */
+        struct gs_raster_arena *Arena; /* Holds all of the above, and every draw's scratch memory. */
+};
+typedef struct gs_raster_context gs_raster_context;
+
+/*
+ * Returns the number of bytes GsRasterInit allocates for the given config.
+ */
+size_t
+GsRasterSizeRequired(
+        gs_raster_config *Config);
+
+/*
+ * Returns the smallest Capacity that draws Triangles onto a grid Height rows
+ * tall without dropping intersections: two for each triangle crossing the
+ * busiest row, counted over each triangle's rows rounded outwards, so it errs
+ * high.  Triangles a draw clips need no more; see Capacity.  Returns 0 if
+ * memory runs out.
+ */
+int
+GsRasterCapacityRequired(
+        gs_raster_triangle Triangles[],
+        int NumTriangles,
+        int Height);
+
+/*
+ * Prepares a context for drawing as described by Config, and starts its
+ * worker threads.
+ *
+ * The context allocates one block of memory up front, holding its scanlines,
+ * per-thread stacks and depth buffer, plus room for a draw of
+ * Config->MaxTriangles triangles.  Each draw takes its scratch memory from
+ * there and gives it back before returning, so drawing makes no heap
+ * allocations once a context has seen its largest draw.  A draw whose scratch
+ * memory cannot be allocated draws nothing.
+ *
+ * Returns false if the context's memory cannot be allocated.  The context then
+ * holds nothing, and must be neither drawn with nor freed.
+ *
+ * Example usage:
+ *         gs_raster_config Config = {0};
+ *         Config.Engine = GS_RASTER_ENGINE_HALFSPACE;
+ *         Config.Width = 1280;
+ *         Config.Height = 720;
+ *         Config.Capacity = 1280;
+ *         Config.MaxTriangles = NumTriangles;
+ *
+ *         gs_raster_context Context;
+ *         if(!GsRasterInit(&Context, &Config)) return;
+ *         GsRasterDraw(&Context, Pixels, Triangles, Colors, NULL, NumTriangles);
+ */
+int
+GsRasterInit(
+        gs_raster_context *Context,
+        gs_raster_config *Config);
+
+/*
+ * Stops the worker threads and releases all memory held by the context.
+ */
+void
+GsRasterFree(
+        gs_raster_context *Context);
+
+/*
+ * Draws the triangle list into Pixels, a Context->Width * Context->Height
+ * pixel grid in the context's format, with the context's engine.
+ *
+ * Depths:
+ *         Per-vertex depths, one per triangle, tested against the context's
+ *         depth buffer.  Pass NULL, or draw with a context without a depth
+ *         buffer, to resolve overlaps as described for GsRasterInit.
+ */
+void
+GsRasterDraw(
+        gs_raster_context *Context,
+        void *Pixels,
+        gs_raster_triangle Triangles[],
+        gs_raster_color Colors[],
+        gs_raster_depth Depths[],
+        int NumTriangles);
+
+/*
+ * Same as GsRasterDraw, with Gouraud-shaded materials as in
+ * GsRasterRasterizeShaded.
+ */
+void
+GsRasterDrawShaded(
+        gs_raster_context *Context,
+        void *Pixels,
+        gs_raster_triangle Triangles[],
+        gs_raster_material Materials[],
+        gs_raster_depth Depths[],
+        int NumTriangles);
+
+/*
+ * Builds a texture from Width * Height texels in rows, top to bottom, along
+ * with its mip chain down to 1x1, each level averaging 2x2 texels of the one
+ * above.  Width and Height must be powers of two no larger than
+ * GS_RASTER_MAX_TEXTURE_SIZE.  The texels are copied, so the caller may free
+ * its own afterwards.
+ *
+ * Every level is stored in Morton (Z) order: texels are interleaved a bit of
+ * X, a bit of Y at a time, so texels near each other in either direction sit
+ * near each other in memory, and a span fetches few cache lines whichever
+ * way the texture runs across it.
+ *
+ * Returns NULL if the size is not supported or memory runs out.
+ */
+gs_raster_texture *
+GsRasterTextureCreate(
+        gs_raster_color *Texels,
+        int Width,
+        int Height);
+
+void
+GsRasterTextureFree(
+        gs_raster_texture *Texture);
+
+/*
+ * Same as GsRasterDraw, with every triangle mapped with Texture.
+ *
+ * Texture coordinates are divided through by W every 16 pixels along a span
+ * and interpolated linearly in between, which is indistinguishable from a
+ * divide per pixel unless W changes sharply across the triangle.  Each run of
+ * 16 pixels reads the mip level whose texels best match the size of its
+ * pixels, and each pixel takes the texel its center falls in.
+ *
+ * Texels are blended by their alpha as vertex colors are; see Blend for
+ * GsRasterInit.
+ */
+void
+GsRasterDrawTextured(
+        gs_raster_context *Context,
+        void *Pixels,
+        gs_raster_triangle Triangles[],
+        gs_raster_texcoords Texcoords[],
+        gs_raster_texture *Texture,
+        gs_raster_depth Depths[],
+        int NumTriangles);
+
+/*
+ * Same as GsRasterDrawShaded, or GsRasterDrawTextured when Texture is not
+ * NULL, for triangles given as vertices in 3D: vertices 3 * I to 3 * I + 2
+ * make triangle I.  Each vertex is transformed to clip space by Transform,
+ * divided by its clip-space W, and mapped onto the whole pixel grid with
+ * X = -1 at the left, X = 1 at the right, Y = 1 at the top and Y = -1 at the
+ * bottom.  Z / W runs from -1 (near) to 1 (far) and is tested against the
+ * context's depth buffer, if it has one.
+ *
+ * Vertices are transformed, several at a time, by the threads setting up the
+ * triangles, straight into the fixed-point coordinates the engines take.
+ *
+ * Triangles are clipped before the divide where W falls to nearly 0, at or
+ * behind the eye, and with a depth buffer where Z / W falls below -1, so a
+ * triangle crossing the near plane draws the part of it beyond.  A clipped
+ * triangle still adds two intersections to each row it crosses, as any
+ * other does, so Capacity for GS_RASTER_ENGINE_SCANLINE needs no room for
+ * the pieces clipping cuts it into.
+ */
+void
+GsRasterDrawVertices(
+        gs_raster_context *Context,
+        void *Pixels,
+        gs_raster_matrix *Transform,
+        gs_raster_vertices *Vertices,
+        gs_raster_texture *Texture,
+        int NumTriangles);
+
+/*
+ * Same as GsRasterDrawVertices for an indexed mesh: triangle I is made of
+ * the vertices at Indices[3 * I] to Indices[3 * I + 2], so a vertex shared
+ * by several triangles is stored once, however many refer to it.
+ *
+ * The threads setting triangles up do so 64 at a time, and keep the
+ * vertices they transform and snap for each run of 64 in a small cache, so
+ * a vertex shared by triangles of the same run is transformed only once.
+ * Order the indices with GsRasterOptimizeIndices to make the most of it.
+ */
+void
+GsRasterDrawIndexed(
+        gs_raster_context *Context,
+        void *Pixels,
+        gs_raster_matrix *Transform,
+        gs_raster_vertices *Vertices,
+        gs_raster_texture *Texture,
+        gs_raster_index_format IndexFormat,
+        void *Indices,
+        int NumTriangles);
+
+/*
+ * Reorders the triangles of an index buffer in place so that triangles
+ * sharing vertices come close together, using Tom Forsyth's linear-speed
+ * vertex cache optimization.  Triangles keep their vertices in order, so
+ * their winding is unchanged.  Every index must be below NumVertices.
+ *
+ * This allocates, and takes a while on large meshes; run it once when a
+ * mesh is loaded rather than every frame.
+ */
+void
+GsRasterOptimizeIndices(
+        gs_raster_index_format IndexFormat,
+        void *Indices,
+        int NumTriangles,
+        int NumVertices);
+
+/*
+ * A command buffer: batches of triangles recorded one after another, each with
+ * its own colors, placement and blending, then drawn together by
+ * GsRasterDrawCommands as a single draw.  All batches share one setup, one
+ * binning pass and one trip through the pixels, however many there are.
+ *
+ * Recording copies the triangles and sets up their colors, materials or
+ * texture coordinates on the caller's thread, and touches no context.  So one
+ * thread can record the next frame into one buffer while another draws the
+ * current frame from a second one.
+ */
+struct gs_raster_commands;
+typedef struct gs_raster_commands gs_raster_commands;
+
+/*
+ * One batch for GsRasterCommandsRecord.  Exactly one of Colors, Materials or
+ * Texcoords is set, one per triangle, and picks how the batch is filled as
+ * in GsRasterDraw, GsRasterDrawShaded or GsRasterDrawTextured.
+ *
+ * Texture:
+ *         The texture Texcoords map; it must outlive every draw of the batch.
+ *
+ * Depths:
+ *         Per-vertex depths, one per triangle, or NULL.  Either every batch in
+ *         a buffer has depths or none does.
+ *
+ * Origin:
+ *         Where the batch's (0, 0) falls in the pixel grid, the top-left
+ *         corner of its viewport; its triangles are moved by this much.
+ *         Triangles are not clipped to the viewport.
+ *
+ * Blend:
+ *         How the batch blends, in place of the context's Blend.
+ */
+struct gs_raster_batch
+{
+        gs_raster_triangle *Triangles;
+        int NumTriangles;
+        gs_raster_color *Colors;
+        gs_raster_material *Materials;
+        gs_raster_texcoords *Texcoords;
+        gs_raster_texture *Texture;
+        gs_raster_depth *Depths;
+        gs_raster_point2d Origin;
+        gs_raster_blend Blend;
+};
+typedef struct gs_raster_batch gs_raster_batch;
+
+/*
+ * Creates an empty command buffer for up to MaxTriangles triangles across all
+ * its batches.  Returns NULL if memory runs out.
+ */
+gs_raster_commands *
+GsRasterCommandsCreate(
+        int MaxTriangles);
+
+void
+GsRasterCommandsFree(
+        gs_raster_commands *Commands);
+
+/*
+ * Appends a batch after the batches recorded before it.  Where batches
+ * overlap, the context's engine picks which shows, as for the triangles of
+ * one draw; see Engine in gs_raster_config.  Only GS_RASTER_ENGINE_HALFSPACE
+ * draws a batch over the ones before it, so layer batches with it or with
+ * depths.  Returns 0, and records nothing, if the buffer has no room for the
+ * batch's triangles or the batch's depths disagree with the buffer's.
+ */
+int
+GsRasterCommandsRecord(
+        gs_raster_commands *Commands,
+        gs_raster_batch *Batch);
+
+/* Empties the buffer for recording the next frame. */
+void
+GsRasterCommandsReset(
+        gs_raster_commands *Commands);
+
+/*
+ * Draws every batch recorded since the buffer was last reset into Pixels, as
+ * GsRasterDraw would draw them all concatenated in recording order.  The
+ * buffer is left as it is, so drawing it again redraws the same frame.
+ */
+void
+GsRasterDrawCommands(
+        gs_raster_context *Context,
+        void *Pixels,
+        gs_raster_commands *Commands);
+
+/*
+ * A retained list of triangles, drawn with the scanline engine's row walker
+ * whatever the context's engine.  The scene keeps every row's intersections
+ * from one frame to the next: adding, updating or removing a triangle patches
+ * only the rows that triangle covers, and GsRasterSceneRasterize redraws only
+ * the rows patched since it last ran.
+ *
+ * Triangles are identified by handles.  Where triangles overlap without depth
+ * testing, the triangle whose left edge was crossed last wins, as with
+ * GsRasterRasterize; ties go to the triangle added to the lower slot, and
+ * slots are reused lowest first.  With a context depth buffer the nearest
+ * triangle wins as in GsRasterDraw.
+ */
+struct gs_raster_scene;
+typedef struct gs_raster_scene gs_raster_scene;
+
+/* Names a triangle in a scene.  0 is never a valid handle. */
+typedef uint32_t gs_raster_handle;
+
+/* Pixels [X, X + Width) x [Y, Y + Height); laid out like SDL_Rect. */
+struct gs_raster_rect
+{
+        int X;
+        int Y;
+        int Width;
+        int Height;
+};
+typedef struct gs_raster_rect gs_raster_rect;
+
+/*
+ * Creates an empty scene for up to MaxTriangles triangles, drawn into the
+ * context's pixel grid size.  Each scanline holds as many intersections as
+ * the context's Capacity.  The scene's memory comes from the context's
+ * arena and is released by GsRasterFree.  Returns NULL if that memory cannot
+ * be allocated.
+ */
+gs_raster_scene *
+GsRasterSceneCreate(
+        gs_raster_context *Context,
+        int MaxTriangles);
+
+/*
+ * Adds a triangle and returns its handle, or 0 if the scene is full or a
+ * scanline the triangle crosses has no room for its intersections.
+ *
+ * Depth:
+ *         Per-vertex depths, used when the context has a depth buffer.  NULL
+ *         places the triangle at depth 0.
+ */
+gs_raster_handle
+GsRasterSceneAdd(
+        gs_raster_scene *Scene,
+        gs_raster_triangle *Triangle,
+        gs_raster_material *Material,
+        gs_raster_depth *Depth);
+
+/*
+ * Replaces the triangle behind Handle, keeping its handle.  Returns 0, and
+ * keeps the old triangle, if Handle is stale or a scanline has no room for
+ * the new triangle.
+ */
+int
+GsRasterSceneUpdate(
+        gs_raster_scene *Scene,
+        gs_raster_handle Handle,
+        gs_raster_triangle *Triangle,
+        gs_raster_material *Material,
+        gs_raster_depth *Depth);
+
+/*
+ * Removes the triangle behind Handle, after which Handle is stale.  Returns
+ * 0 if it already was.
+ */
+int
+GsRasterSceneRemove(
+        gs_raster_scene *Scene,
+        gs_raster_handle Handle);
+
+/*
+ * Redraws the rows changed since the previous call into Pixels, which must
+ * hold the previous call's output, and returns the rectangle of pixels that
+ * may have changed; Width and Height are 0 when nothing did.  The first call
+ * draws the whole grid.
+ *
+ * Example usage:
+ *         gs_raster_rect Dirty = GsRasterSceneRasterize(Scene, Pixels);
+ *         if(Dirty.Width > 0)
+ *         {
+ *                 SDL_UpdateTexture(Texture, (SDL_Rect *)&Dirty,
+ *                                   Pixels + (Dirty.Y * Width) + Dirty.X,
+ *                                   Width * sizeof(int));
+ *         }
+ */
+gs_raster_rect
+GsRasterSceneRasterize(
+        gs_raster_scene *Scene,
+        void *Pixels);
+
+#if defined(GS_RASTER_STATS)
+/*
+ * Hot-path counters, compiled in only when raster.c and its callers are built
+ * with GS_RASTER_STATS defined; without it none of this exists and the
+ * rasterizer carries no counting code at all.
+ */
+
+enum gs_raster_stage
+{
+        GS_RASTER_STAGE_SETUP, /* Snapping, edge and half-space setup, gradients, depth planes. */
+        GS_RASTER_STAGE_BIN, /* Bucketing edges and binning triangles into bands or blocks. */
+        GS_RASTER_STAGE_GENERATE, /* Walking active edges into scanline intersections. */
+        GS_RASTER_STAGE_RASTERIZE, /* Filling spans and tiles. */
+        GS_RASTER_STAGE_COUNT,
+};
+typedef enum gs_raster_stage gs_raster_stage;
+
+/*
+ * Bucket 0 counts rows without intersections, bucket B rows with
+ * [2^(B-1), 2^B) of them; the last bucket also takes every larger count.
+ */
+#define GS_RASTER_STATS_BUCKETS 16
+
+/*
+ * Counters added to by every rasterizing call made while the struct is
+ * attached with GsRasterSetStats.  Zero it, attach it, make a frame's calls,
+ * then read it.
+ *
+ * Cycles:
+ *         Time spent in each stage, summed over every thread: TSC ticks on
+ *         x86, nanoseconds elsewhere.
+ *
+ * Rows, Intersections, Histogram, PeakIntersections:
+ *         Scanlines generated, the intersections they hold, how many rows
+ *         fell into each bucket of intersection counts, and the most on any
+ *         one row.  Compare PeakIntersections with Capacity, the largest
+ *         scanline capacity seen, to size gs_raster_config.Capacity.
+ *
+ * Overflows:
+ *         Intersections dropped because their scanline was already full.
+ *         Every build drops them, so the rows affected draw wrongly but
+ *         safely; only the count needs GS_RASTER_STATS.
+ *
+ * StackPushes, StackPops, PeakStackDepth:
+ *         Triangle stack traffic while walking scanlines, and the deepest
+ *         the stack got.
+ *
+ * PixelsWritten, PixelsDrawn:
+ *         Every pixel store, the background included, and the pixels of the
+ *         rows or blocks drawn.  Each of those is written at least once, so
+ *         PixelsWritten / PixelsDrawn is the overdraw.
+ *
+ * PixelsAntialiased:
+ *         Edge pixels mixed after their spans were written; see
+ *         gs_raster_config.Antialias.  Not counted in PixelsWritten.
+ *
+ * TrianglesCulled, TrianglesClipped:
+ *         Triangles dropped during setup, and triangles clipped to the guard
+ *         band; see gs_raster_config.Cull.
+ *
+ * VerticesTransformed:
+ *         Vertices transformed by GsRasterDrawVertices and
+ *         GsRasterDrawIndexed.  For an indexed draw, compare with three per
+ *         triangle to see how well the vertex cache did.
+ *
+ * RowIntersections, NumRows:
+ *         Optional; when set, the intersection count of every row generated
+ *         below NumRows is stored in RowIntersections[Row].
+ *
+ * TrianglePixels, NumTriangles:
+ *         Optional; when set, pixels written for each triangle below
+ *         NumTriangles are added to TrianglePixels[Triangle].  Triangles are
+ *         numbered by their index in the call, or for scenes by slot:
+ *         (Handle & 0xffffff) - 1.
+ */
+struct gs_raster_stats
+{
+        uint64_t Cycles[GS_RASTER_STAGE_COUNT];
+
+        uint64_t Rows;
+        uint64_t Intersections;
+        uint64_t Histogram[GS_RASTER_STATS_BUCKETS];
+        int PeakIntersections;
+        int Capacity;
+        uint64_t Overflows;
+
+        uint64_t StackPushes;
+        uint64_t StackPops;
+        int PeakStackDepth;
+
+        uint64_t PixelsWritten;
+        uint64_t PixelsDrawn;
+        uint64_t PixelsAntialiased;
+
+        uint64_t TrianglesCulled;
+        uint64_t TrianglesClipped;
+        uint64_t VerticesTransformed;
+
+        int *RowIntersections;
+        int NumRows;
+        uint32_t *TrianglePixels;
+        int NumTriangles;
+};
+typedef struct gs_raster_stats gs_raster_stats;
+
+/*
+ * Attaches Stats to every later call, on any thread, until replaced; NULL
+ * detaches it.  Calls add to the struct as they return, so do not read it
+ * while one is running, nor make calls on several threads at once.
+ */
+void
+GsRasterSetStats(
+        gs_raster_stats *Stats);
+#endif /* GS_RASTER_STATS */
+
 #endif /* GS_RASTER */
@@ -0,0 +1,221 @@
+#define _POSIX_C_SOURCE 200809L /* fstat, mmap */
+
+#include "scenefile.h"
+
+#include <fcntl.h> /* open */
+#include <stdio.h>
+#include <string.h> /* memcmp, memcpy */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h> /* close */
+
+typedef int bool;
+#define false 0
+#define true !false
+
+#define GS_SCENEFILE_BYTE_ORDER 0x01020304
+
+/* Colors gathered from materials per fwrite. */
+#define GS_SCENEFILE_COLOR_BATCH 1024
+
+uint64_t
+SceneFileAlign(uint64_t Offset)
+{
+        uint64_t Result = (Offset + GS_SCENEFILE_ALIGNMENT - 1) & ~(uint64_t)(GS_SCENEFILE_ALIGNMENT - 1);
+        return(Result);
+}
+
+/* Whether NumTriangles elements of ElementSize bytes at Offset lie aligned and inside the file. */
+bool
+SceneFileArrayFits(gs_scenefile_header *Header, uint64_t Offset, size_t ElementSize)
+{
+        if(Offset < Header->HeaderSize || (Offset % GS_SCENEFILE_ALIGNMENT) != 0) return(false);
+        if(Offset > Header->FileSize) return(false);
+
+        uint64_t Size = (uint64_t)Header->NumTriangles * ElementSize;
+        bool Result = (Size <= Header->FileSize - Offset);
+        return(Result);
+}
+
+char *
+SceneFileValidate(gs_scenefile_header *Header, size_t Size)
+{
+        if(memcmp(Header->Magic, GS_SCENEFILE_MAGIC, 4) != 0) return("not a scene file");
+        if(Header->ByteOrder != GS_SCENEFILE_BYTE_ORDER) return("scene file has the wrong byte order");
+        if(Header->Version != GS_SCENEFILE_VERSION) return("unsupported scene file version");
+        if(Header->HeaderSize < sizeof(gs_scenefile_header)) return("scene file header is too small");
+        if(Header->FileSize != Size) return("scene file is truncated");
+        if(Header->NumTriangles > INT32_MAX) return("scene file has too many triangles");
+
+        if(!SceneFileArrayFits(Header, Header->TrianglesOffset, sizeof(gs_raster_triangle)) ||
+           !SceneFileArrayFits(Header, Header->ColorsOffset, sizeof(gs_raster_color)) ||
+           !SceneFileArrayFits(Header, Header->MaterialsOffset, sizeof(gs_raster_material)))
+        {
+                return("scene file arrays lie outside the file");
+        }
+
+        if((Header->Flags & GS_SCENEFILE_HAS_DEPTHS) &&
+           !SceneFileArrayFits(Header, Header->DepthsOffset, sizeof(gs_raster_depth)))
+        {
+                return("scene file arrays lie outside the file");
+        }
+
+        return(NULL);
+}
+
+int
+GsSceneFileDetect(char *FileName)
+{
+        char Magic[4];
+        bool Result = false;
+
+        FILE *File = fopen(FileName, "rb");
+        if(File)
+        {
+                Result = (fread(Magic, 1, 4, File) == 4 && memcmp(Magic, GS_SCENEFILE_MAGIC, 4) == 0);
+                fclose(File);
+        }
+
+        return(Result);
+}
+
+int
+GsSceneFileOpen(char *FileName, gs_scenefile *Scene, char **Error)
+{
+        memset(Scene, 0, sizeof(*Scene));
+        char *Message = NULL;
+
+        int File = open(FileName, O_RDONLY);
+        if(File < 0)
+        {
+                Message = "couldn't open scene file";
+        }
+        else
+        {
+                struct stat Status;
+                if(fstat(File, &Status) != 0 || Status.st_size < (off_t)sizeof(gs_scenefile_header))
+                {
+                        Message = "scene file is truncated";
+                }
+                else
+                {
+                        /* Private pages: the caller may edit triangles in place without touching the file. */
+                        size_t Size = (size_t)Status.st_size;
+                        void *Memory = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE, File, 0);
+                        if(Memory == MAP_FAILED)
+                        {
+                                Message = "couldn't map scene file";
+                        }
+                        else
+                        {
+                                gs_scenefile_header *Header = (gs_scenefile_header *)Memory;
+                                Message = SceneFileValidate(Header, Size);
+                                if(Message != NULL)
+                                {
+                                        munmap(Memory, Size);
+                                }
+                                else
+                                {
+                                        char *Base = (char *)Memory;
+                                        Scene->Memory = Memory;
+                                        Scene->Size = Size;
+                                        Scene->NumTriangles = (int)Header->NumTriangles;
+                                        Scene->Triangles = (gs_raster_triangle *)(Base + Header->TrianglesOffset);
+                                        Scene->Colors = (gs_raster_color *)(Base + Header->ColorsOffset);
+                                        Scene->Materials = (gs_raster_material *)(Base + Header->MaterialsOffset);
+                                        if(Header->Flags & GS_SCENEFILE_HAS_DEPTHS)
+                                        {
+                                                Scene->Depths = (gs_raster_depth *)(Base + Header->DepthsOffset);
+                                        }
+                                }
+                        }
+                }
+                close(File);
+        }
+
+        if(Error != NULL) *Error = Message;
+        return(Message == NULL);
+}
+
+void
+GsSceneFileClose(gs_scenefile *Scene)
+{
+        if(Scene->Memory != NULL)
+        {
+                munmap(Scene->Memory, Scene->Size);
+        }
+        memset(Scene, 0, sizeof(*Scene));
+}
+
+/* Writes Size bytes of Data at Offset, zero-filling any gap from the current position. */
+bool
+SceneFileWriteAt(FILE *File, uint64_t *Position, uint64_t Offset, void *Data, size_t Size)
+{
+        static char Zeroes[GS_SCENEFILE_ALIGNMENT];
+        while(*Position < Offset)
+        {
+                size_t Gap = (size_t)(Offset - *Position);
+                if(Gap > sizeof(Zeroes)) Gap = sizeof(Zeroes);
+                if(fwrite(Zeroes, 1, Gap, File) != Gap) return(false);
+                *Position += Gap;
+        }
+
+        if(Size > 0 && fwrite(Data, 1, Size, File) != Size) return(false);
+        *Position += Size;
+        return(true);
+}
+
+int
+GsSceneFileWrite(char *FileName, gs_raster_triangle *Triangles, gs_raster_material *Materials, gs_raster_depth *Depths, int NumTriangles)
+{
+        if(NumTriangles < 0) return(false);
+        size_t Count = (size_t)NumTriangles;
+
+        gs_scenefile_header Header;
+        memset(&Header, 0, sizeof(Header));
+        memcpy(Header.Magic, GS_SCENEFILE_MAGIC, 4);
+        Header.ByteOrder = GS_SCENEFILE_BYTE_ORDER;
+        Header.Version = GS_SCENEFILE_VERSION;
+        Header.HeaderSize = sizeof(gs_scenefile_header);
+        Header.Flags = (Depths != NULL) ? GS_SCENEFILE_HAS_DEPTHS : 0;
+        Header.NumTriangles = (uint32_t)NumTriangles;
+
+        Header.TrianglesOffset = SceneFileAlign(sizeof(gs_scenefile_header));
+        Header.ColorsOffset = SceneFileAlign(Header.TrianglesOffset + (Count * sizeof(gs_raster_triangle)));
+        Header.MaterialsOffset = SceneFileAlign(Header.ColorsOffset + (Count * sizeof(gs_raster_color)));
+        Header.FileSize = Header.MaterialsOffset + (Count * sizeof(gs_raster_material));
+        if(Depths != NULL)
+        {
+                Header.DepthsOffset = SceneFileAlign(Header.FileSize);
+                Header.FileSize = Header.DepthsOffset + (Count * sizeof(gs_raster_depth));
+        }
+
+        FILE *File = fopen(FileName, "wb");
+        if(!File) return(false);
+
+        uint64_t Position = 0;
+        bool Written = (SceneFileWriteAt(File, &Position, 0, &Header, sizeof(Header)) &&
+                        SceneFileWriteAt(File, &Position, Header.TrianglesOffset, Triangles, Count * sizeof(gs_raster_triangle)));
+
+        gs_raster_color Colors[GS_SCENEFILE_COLOR_BATCH];
+        for(size_t First = 0; Written && First < Count; First += GS_SCENEFILE_COLOR_BATCH)
+        {
+                size_t Batch = (Count - First < GS_SCENEFILE_COLOR_BATCH) ? (Count - First) : GS_SCENEFILE_COLOR_BATCH;
+                for(size_t i=0; i<Batch; i++)
+                {
+                        Colors[i] = Materials[First + i].VertexColors[0];
+                }
+                uint64_t Offset = Header.ColorsOffset + (First * sizeof(gs_raster_color));
+                Written = SceneFileWriteAt(File, &Position, Offset, Colors, Batch * sizeof(gs_raster_color));
+        }
+
+        Written = (Written &&
+                   SceneFileWriteAt(File, &Position, Header.MaterialsOffset, Materials, Count * sizeof(gs_raster_material)));
+        if(Written && Depths != NULL)
+        {
+                Written = SceneFileWriteAt(File, &Position, Header.DepthsOffset, Depths, Count * sizeof(gs_raster_depth));
+        }
+
+        if(fclose(File) != 0) Written = false;
+        return(Written);
+}
@@ -0,0 +1,110 @@
+#if !defined(GS_SCENEFILE)
+#define GS_SCENEFILE
+
+#include "raster.h"
+
+/*
+ * A binary scene file: a fixed header followed by the triangle list and its
+ * attribute arrays, each laid out exactly as the raster API takes it and
+ * aligned to GS_SCENEFILE_ALIGNMENT.  Opening one maps the file into memory
+ * and points straight into it, so even very large scenes load in constant
+ * time and are never parsed or copied.
+ *
+ * Triangles are stored already passed through GsRasterReorderTriangle, with
+ * their materials and depths rotated to match.  Numbers are stored in the
+ * writer's byte order; a file from a machine of the other order is rejected.
+ */
+
+#define GS_SCENEFILE_MAGIC "GSRS"
+#define GS_SCENEFILE_VERSION 1
+#define GS_SCENEFILE_ALIGNMENT 64
+
+/* Set in gs_scenefile_header::Flags when the file has a depths array. */
+#define GS_SCENEFILE_HAS_DEPTHS 0x1
+
+/*
+ * Offsets are from the start of the file.  DepthsOffset is 0 without
+ * GS_SCENEFILE_HAS_DEPTHS.
+ */
+struct gs_scenefile_header
+{
+        char Magic[4];
+        uint32_t ByteOrder; /* 0x01020304 as written. */
+        uint32_t Version;
+        uint32_t HeaderSize;
+        uint32_t Flags;
+        uint32_t NumTriangles;
+        uint64_t TrianglesOffset; /* gs_raster_triangle[NumTriangles] */
+        uint64_t ColorsOffset; /* gs_raster_color[NumTriangles]: each material's first vertex color. */
+        uint64_t MaterialsOffset; /* gs_raster_material[NumTriangles] */
+        uint64_t DepthsOffset; /* gs_raster_depth[NumTriangles] */
+        uint64_t FileSize;
+};
+typedef struct gs_scenefile_header gs_scenefile_header;
+
+/*
+ * An open scene file.  The arrays point into the mapping, which is private
+ * and writable: changing a triangle copies only the page holding it, and
+ * never reaches the file.  Depths is NULL when the file has none.
+ */
+struct gs_scenefile
+{
+        void *Memory;
+        size_t Size;
+
+        int NumTriangles;
+        gs_raster_triangle *Triangles;
+        gs_raster_color *Colors;
+        gs_raster_material *Materials;
+        gs_raster_depth *Depths;
+};
+typedef struct gs_scenefile gs_scenefile;
+
+/*
+ * Returns nonzero if FileName starts with GS_SCENEFILE_MAGIC, so callers can
+ * tell scene files from other formats without relying on extensions.
+ */
+int
+GsSceneFileDetect(
+        char *FileName);
+
+/*
+ * Maps FileName and fills in Scene.  Returns 0, leaving Scene empty, if the
+ * file cannot be mapped or its header does not describe arrays that fit in
+ * it; Error, if not NULL, is then pointed at a description.
+ */
+int
+GsSceneFileOpen(
+        char *FileName,
+        gs_scenefile *Scene,
+        char **Error);
+
+/*
+ * Unmaps the file; the scene's arrays are invalid afterwards.
+ */
+void
+GsSceneFileClose(
+        gs_scenefile *Scene);
+
+/*
+ * Writes NumTriangles triangles with their materials, and optionally depths,
+ * as a scene file.  Triangles, materials and depths must already be
+ * reordered as described above.  Returns 0 if the file cannot be written.
+ *
+ * Example usage:
+ *         for(int i=0; i<NumTriangles; i++)
+ *         {
+ *                 GsRasterReorderTriangle(&Triangles[i]);
+ *                 (rotate Materials[i] and Depths[i] to match)
+ *         }
+ *         GsSceneFileWrite("triangles.scene", Triangles, Materials, NULL, NumTriangles);
+ */
+int
+GsSceneFileWrite(
+        char *FileName,
+        gs_raster_triangle *Triangles,
+        gs_raster_material *Materials,
+        gs_raster_depth *Depths,
+        int NumTriangles);
+
+#endif /* GS_SCENEFILE */